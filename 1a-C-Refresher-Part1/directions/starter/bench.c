@@ -0,0 +1,289 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+    #define BENCH_TSC 1
+#else
+    #define BENCH_TSC 0
+#endif
+
+#include "kernels.h"
+
+//Micro benchmarks for the stringfun kernels, built and run by make bench.
+//Every kernel runs at every level the CPU has, over inputs from 64 bytes
+//to 1 GB drawn from a few word length distributions.  Each run reports
+//GB/s and TSC cycles per byte (the TSC ticks at a fixed rate, so this is
+//reference cycles), the best of as many repeats as fit in BENCH_MIN_TIME.
+//
+//Before a level is timed its answer is checked against the scalar
+//reference on the same input, a mismatch is reported and makes the exit
+//code 1.  word_print has no per level versions, it is timed only, with
+//its output going to /dev/null.
+//
+//usage: bench [-s max_size] [-k kernel] [-t dist] [-d delims]
+#define BENCH_MIN_SIZE  64
+#define BENCH_MAX_SIZE  ((size_t)1 << 30)
+#define BENCH_STEP      16              //each size is this times the last
+#define BENCH_MIN_TIME  0.2             //seconds of repeats per result
+#define BENCH_BATCH     (1 << 20)       //bytes per timed batch, small inputs
+                                        //run many times between clock reads
+
+//word_print() from stringfun.c, built without its main()
+void word_print(char *);
+int  set_delims(const char *);
+
+typedef struct dist{
+    const char *name;
+    int         min_len;        //word length range
+    int         max_len;
+    bool        utf8;           //words of 2 to 4 byte characters
+} dist_t;
+
+static const dist_t dists[] = {
+    { "short",    1,   3, false },  //a word start every few bytes
+    { "english",  1,  12, false },
+    { "long",    20, 200, false },
+    { "utf8",     1,  12, true  },
+    { "oneword",  0,   0, false },  //no delimiters at all
+};
+
+static const char *kernel_names[] = { "count", "stats", "reverse", "utf8rev", "wordprint" };
+#define N_KERNELS   (int)(sizeof(kernel_names) / sizeof(kernel_names[0]))
+
+static uint64_t rng = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t next_rand(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+static double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t ticks(void) {
+#if BENCH_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+//len bytes of words from d, one or two spaces between them.  UTF-8 words
+//never end in a cut character, the last one is padded with ASCII instead.
+static void fill(char *buf, size_t len, const dist_t *d) {
+    static const char *chars[] = { "\xC3\xA9", "\xC3\xBC", "\xE4\xB8\xAD", "\xE2\x82\xAC",
+                                   "\xF0\x9F\x98\x80", "e\xCC\x81" };
+    size_t i = 0;
+
+    if (d->max_len == 0) {
+        memset(buf, 'x', len);
+        return;
+    }
+    while (i < len) {
+        int wlen = d->min_len + (int)(next_rand() % (d->max_len - d->min_len + 1));
+
+        for (int k = 0; k < wlen && i < len; k++) {
+            const char *c = d->utf8 && next_rand() % 2 == 0 ? chars[next_rand() % 6] : NULL;
+            size_t clen = c != NULL ? strlen(c) : 1;
+
+            if (c == NULL || i + clen > len)
+                buf[i++] = 'a' + next_rand() % 26;
+            else {
+                memcpy(buf + i, c, clen);
+                i += clen;
+            }
+        }
+        for (int k = next_rand() % 4 == 0 ? 2 : 1; k > 0 && i < len; k--)
+            buf[i++] = SPACE_CHAR;
+    }
+}
+
+//Run one kernel at the current level, work is a copy of buf to change
+static void run(int kernel, const char *buf, char *work, size_t len, kern_stats_t *st,
+                size_t *wc) {
+    switch (kernel) {
+    case 0:
+        *wc = kern_count_words(buf, len, false);
+        break;
+    case 1:
+        *st = (kern_stats_t){0};
+        kern_stats(buf, len, false, st);
+        break;
+    case 2:
+        kern_reverse(work, len);
+        break;
+    case 3:
+        kern_reverse_utf8(work, len);
+        break;
+    case 4:
+        word_print(work);
+        break;
+    }
+}
+
+//The level's answer against the reference, the scalar kernel.  The
+//reversals are run again at the scalar level on ref, a second copy of buf.
+static bool check(int kernel, int l, const char *buf, char *work, char *ref, size_t len) {
+    kern_stats_t st, ref_st = {0};
+    size_t wc = 0;
+
+    if (kernel == 4)
+        return true;
+    memcpy(work, buf, len);
+    kern_set_level(l);
+    run(kernel, buf, work, len, &st, &wc);
+    switch (kernel) {
+    case 0:
+        return wc == kern_count_words_scalar(buf, len, false);
+    case 1:
+        kern_stats_scalar(buf, len, false, &ref_st);
+        return st.lines == ref_st.lines && st.words == ref_st.words &&
+               st.longest == ref_st.longest && st.run == ref_st.run;
+    case 2:
+        memcpy(ref, buf, len);
+        kern_reverse_scalar(ref, len);
+        return memcmp(work, ref, len) == 0;
+    case 3:
+        memcpy(ref, buf, len);
+        kern_set_level(KERN_SCALAR);
+        kern_reverse_utf8(ref, len);
+        return memcmp(work, ref, len) == 0;
+    }
+    return true;
+}
+
+//a number of bytes, K, M or G after it multiplies by 1024 that many times
+static size_t parse_size(const char *arg) {
+    char *end;
+    size_t size = strtoull(arg, &end, 0);
+    const char *units = strchr("KMG", *end);
+
+    for (int i = units != NULL && *end != '\0' ? (int)(units - "KMG") + 1 : 0; i > 0; i--)
+        size *= 1024;
+    return size;
+}
+
+int main(int argc, char *argv[]) {
+    size_t max_size = BENCH_MAX_SIZE;
+    const char *only_kernel = NULL;
+    const char *only_dist = NULL;
+    int saved_stdout = dup(STDOUT_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY);
+    int top = kern_set_level(KERN_AVX2);
+    int bad = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:k:t:d:")) != -1) {
+        switch (opt) {
+        case 's':
+            max_size = parse_size(optarg);
+            break;
+        case 'k':
+            only_kernel = optarg;
+            break;
+        case 't':
+            only_dist = optarg;
+            break;
+        case 'd':
+            if (set_delims(optarg) != 0) {
+                fprintf(stderr, "bad delimiters %s\n", optarg);
+                return 1;
+            }
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-s max_size] [-k kernel] [-t dist] [-d delims]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (saved_stdout < 0 || null_fd < 0) {
+        perror("bench");
+        return 1;
+    }
+
+    printf("%-10s %-7s %-8s %11s %9s %8s  %s\n", "kernel", "level", "dist", "bytes", "GB/s",
+           "cyc/B", "check");
+    for (size_t len = BENCH_MIN_SIZE; len <= max_size; len *= BENCH_STEP) {
+        //+1 for the '\0' word_print() wants
+        char *buf = malloc(len + 1);
+        char *work = malloc(len + 1);
+        char *ref = malloc(len);
+
+        if (buf == NULL || work == NULL || ref == NULL) {
+            fprintf(stderr, "no memory for %zu bytes, stopping\n", len);
+            free(buf);
+            free(work);
+            free(ref);
+            break;
+        }
+        for (size_t d = 0; d < sizeof(dists) / sizeof(dists[0]); d++) {
+            if (only_dist != NULL && strcmp(only_dist, dists[d].name) != 0)
+                continue;
+            fill(buf, len, &dists[d]);
+            buf[len] = '\0';
+
+            for (int k = 0; k < N_KERNELS; k++) {
+                if (only_kernel != NULL && strcmp(only_kernel, kernel_names[k]) != 0)
+                    continue;
+                //word_print() only at the best level
+                for (int l = k == 4 ? top : KERN_SCALAR; l <= top; l++) {
+                    bool ok = check(k, l, buf, work, ref, len);
+                    double best = 0, start = now();
+                    uint64_t best_ticks = 0;
+                    size_t batch = len < BENCH_BATCH ? BENCH_BATCH / len : 1;
+                    kern_stats_t st;
+                    size_t wc;
+
+                    memcpy(work, buf, len + 1);
+                    kern_set_level(l);
+                    fflush(stdout);
+                    if (k == 4)
+                        dup2(null_fd, STDOUT_FILENO);
+                    do {
+                        double t = now();
+                        uint64_t c = ticks();
+
+                        for (size_t r = 0; r < batch; r++)
+                            run(k, buf, work, len, &st, &wc);
+                        c = (ticks() - c) / batch;
+                        t = (now() - t) / batch;
+                        if (best == 0 || t < best) {
+                            best = t;
+                            best_ticks = c;
+                        }
+                    } while (now() - start < BENCH_MIN_TIME);
+                    if (k == 4)
+                        dup2(saved_stdout, STDOUT_FILENO);
+
+                    if (!ok)
+                        bad++;
+                    printf("%-10s %-7s %-8s %11zu %9.2f ", kernel_names[k], kern_level_name(l),
+                           dists[d].name, len, best > 0 ? len / best / 1e9 : 0);
+                    if (BENCH_TSC)
+                        printf("%8.3f", (double)best_ticks / len);
+                    else
+                        printf("%8s", "-");
+                    printf("  %s\n", k == 4 ? "-" : ok ? "ok" : "MISMATCH");
+                }
+            }
+        }
+        free(buf);
+        free(work);
+        free(ref);
+    }
+    if (bad > 0)
+        printf("%d results did not match the reference\n", bad);
+    return bad > 0;
+}
@@ -0,0 +1,252 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "kernels.h"
+#include "freq.h"
+
+struct freq_block{
+    freq_block_t *next;
+    size_t        used;
+    size_t        size;
+    char          data[];
+};
+
+freq_t *freq_open(void) {
+    freq_t *ft = calloc(1, sizeof(freq_t));
+
+    if (ft == NULL)
+        return NULL;
+    ft->slots = calloc(FREQ_MIN_SLOTS, sizeof(freq_entry_t));
+    if (ft->slots == NULL) {
+        free(ft);
+        return NULL;
+    }
+    ft->n_slots = FREQ_MIN_SLOTS;
+    return ft;
+}
+
+void freq_close(freq_t *ft) {
+    freq_block_t *b, *next;
+
+    if (ft == NULL)
+        return;
+    for (b = ft->arena; b != NULL; b = next) {
+        next = b->next;
+        free(b);
+    }
+    free(ft->slots);
+    free(ft->carry);
+    free(ft);
+}
+
+//A copy of the word in the arena.  A word too big for what is left of the
+//current block starts a new one, a word bigger than a block gets a block
+//of its own behind the current one so the space left there is not lost.
+static const char *arena_copy(freq_t *ft, const char *word, size_t len) {
+    freq_block_t *b = ft->arena;
+
+    if (b == NULL || b->size - b->used < len) {
+        size_t size = len > FREQ_ARENA_BLOCK ? len : FREQ_ARENA_BLOCK;
+        freq_block_t *nb = malloc(sizeof(freq_block_t) + size);
+
+        if (nb == NULL)
+            return NULL;
+        nb->used = 0;
+        nb->size = size;
+        if (b != NULL && size > FREQ_ARENA_BLOCK) {
+            nb->next = b->next;
+            b->next = nb;
+        } else {
+            nb->next = b;
+            ft->arena = nb;
+        }
+        b = nb;
+    }
+    memcpy(b->data + b->used, word, len);
+    b->used += len;
+    return b->data + b->used - len;
+}
+
+//8 bytes at a time through a multiply and a shift, then a final mix so
+//the low bits that pick the slot depend on every byte
+static uint64_t hash_word(const char *word, size_t len) {
+    uint64_t h = len * 0x9E3779B97F4A7C15ULL;
+    uint64_t w;
+
+    for (; len >= 8; word += 8, len -= 8) {
+        memcpy(&w, word, 8);
+        h = (h ^ w) * 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 32;
+    }
+    if (len > 0) {
+        w = 0;
+        memcpy(&w, word, len);
+        h = (h ^ w) * 0xC4CEB9FE1A85EC53ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    return h;
+}
+
+//The slot that holds word, or the empty one it would go in
+static freq_entry_t *find_slot(freq_entry_t *slots, size_t n_slots, const char *word,
+                               size_t len, uint64_t hash) {
+    size_t mask = n_slots - 1;
+
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        freq_entry_t *e = &slots[i];
+
+        if (e->word == NULL)
+            return e;
+        if (e->hash == hash && e->len == len && memcmp(e->word, word, len) == 0)
+            return e;
+    }
+}
+
+//Twice the slots.  The keys stay where they are in the arena.
+static int grow(freq_t *ft) {
+    size_t n_slots = ft->n_slots * 2;
+    freq_entry_t *slots = calloc(n_slots, sizeof(freq_entry_t));
+
+    if (slots == NULL)
+        return -1;
+    for (size_t i = 0; i < ft->n_slots; i++) {
+        freq_entry_t *e = &ft->slots[i];
+
+        if (e->word != NULL)
+            *find_slot(slots, n_slots, e->word, e->len, e->hash) = *e;
+    }
+    free(ft->slots);
+    ft->slots = slots;
+    ft->n_slots = n_slots;
+    return 0;
+}
+
+static int add_hashed(freq_t *ft, const char *word, size_t len, uint64_t hash, size_t count) {
+    freq_entry_t *e = find_slot(ft->slots, ft->n_slots, word, len, hash);
+
+    if (e->word == NULL) {
+        if ((ft->n_words + 1) * 2 > ft->n_slots) {
+            if (grow(ft) != 0)
+                return -1;
+            e = find_slot(ft->slots, ft->n_slots, word, len, hash);
+        }
+        if ((e->word = arena_copy(ft, word, len)) == NULL)
+            return -1;
+        e->len = len;
+        e->hash = hash;
+        ft->n_words++;
+    }
+    e->count += count;
+    ft->n_total += count;
+    return 0;
+}
+
+int freq_add(freq_t *ft, const char *word, size_t len, size_t count) {
+    return add_hashed(ft, word, len, hash_word(word, len), count);
+}
+
+//the start of a word that goes on in the next chunk
+static int keep(freq_t *ft, const char *part, size_t len) {
+    if (ft->carry_len + len > ft->carry_cap) {
+        size_t cap = ft->carry_cap > 0 ? ft->carry_cap : 64;
+        char *carry;
+
+        while (cap < ft->carry_len + len)
+            cap *= 2;
+        if ((carry = realloc(ft->carry, cap)) == NULL)
+            return -1;
+        ft->carry = carry;
+        ft->carry_cap = cap;
+    }
+    memcpy(ft->carry + ft->carry_len, part, len);
+    ft->carry_len += len;
+    return 0;
+}
+
+//The word_print_chunk() loop: kern_find_delim() finds where each word ends
+int freq_chunk(freq_t *ft, const char *buf, size_t len) {
+    size_t i = 0;
+
+    while (i < len) {
+        size_t n;
+
+        if (!ft->in_word) {
+            while (i < len && kern_is_delim(buf[i]))
+                i++;
+            if (i == len)
+                break;
+        }
+
+        n = kern_find_delim(buf + i, len - i);
+        if (i + n == len) {
+            ft->in_word = true;
+            return keep(ft, buf + i, n);
+        }
+        if (ft->in_word) {
+            if (keep(ft, buf + i, n) != 0 || freq_end(ft) != 0)
+                return -1;
+        } else if (freq_add(ft, buf + i, n, 1) != 0) {
+            return -1;
+        }
+        i += n + 1;
+    }
+    return 0;
+}
+
+//the word the input ends in
+int freq_end(freq_t *ft) {
+    int rc = 0;
+
+    if (ft->in_word)
+        rc = freq_add(ft, ft->carry, ft->carry_len, 1);
+    ft->in_word = false;
+    ft->carry_len = 0;
+    return rc;
+}
+
+int freq_merge(freq_t *into, const freq_t *from) {
+    for (size_t i = 0; i < from->n_slots; i++) {
+        const freq_entry_t *e = &from->slots[i];
+
+        if (e->word != NULL && add_hashed(into, e->word, e->len, e->hash, e->count) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+static int by_count(const void *a, const void *b) {
+    const freq_entry_t *x = *(const freq_entry_t * const *)a;
+    const freq_entry_t *y = *(const freq_entry_t * const *)b;
+    int c;
+
+    if (x->count != y->count)
+        return x->count > y->count ? -1 : 1;
+    c = memcmp(x->word, y->word, x->len < y->len ? x->len : y->len);
+    if (c != 0)
+        return c;
+    return (x->len > y->len) - (x->len < y->len);
+}
+
+const freq_entry_t **freq_top(const freq_t *ft, size_t n, size_t *got) {
+    const freq_entry_t **top = malloc((ft->n_words > 0 ? ft->n_words : 1) * sizeof(*top));
+    size_t k = 0;
+
+    if (top == NULL)
+        return NULL;
+    for (size_t i = 0; i < ft->n_slots; i++) {
+        if (ft->slots[i].word != NULL)
+            top[k++] = &ft->slots[i];
+    }
+    qsort(top, k, sizeof(*top), by_count);
+    *got = n > 0 && n < k ? n : k;
+    return top;
+}
+
+size_t freq_top_n(void) {
+    const char *env = getenv(FREQ_ENV);
+    long n = env != NULL ? atol(env) : FREQ_TOP;
+
+    return n > 0 ? (size_t)n : 0;
+}
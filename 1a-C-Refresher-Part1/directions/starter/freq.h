@@ -0,0 +1,62 @@
+#ifndef __FREQ_H__
+    #define __FREQ_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//Word frequencies for -f, what sort | uniq -c gives but in one pass.  A
+//word is what count_words() counts, a run of bytes that are not
+//delimiters.  Each distinct word is interned in an open addressing hash
+//table, linear probing and never more than half full.  The bytes of the
+//keys live in an arena: blocks of FREQ_ARENA_BLOCK handed out a piece at a
+//time, so a new word costs a copy rather than a malloc() and the whole
+//table goes with a few free()s.
+//
+//Input can come a chunk at a time, a word that runs over the end of one
+//chunk is put together in the table's carry buffer.  Tables built by
+//different threads over different parts of an input are merged after.
+#define FREQ_ARENA_BLOCK    (1 << 20)
+#define FREQ_MIN_SLOTS      1024
+
+//how many words -f prints, set FREQ_ENV to another number, 0 for all
+#define FREQ_TOP            10
+#define FREQ_ENV            "STRINGFUN_TOP"
+
+typedef struct freq_entry{
+    const char *word;           //in the arena, not '\0' terminated
+    size_t      len;
+    uint64_t    hash;           //checked before the bytes are
+    size_t      count;
+} freq_entry_t;
+
+typedef struct freq_block freq_block_t;
+
+typedef struct freq{
+    freq_entry_t *slots;        //word NULL when a slot is empty
+    size_t        n_slots;      //a power of 2
+    size_t        n_words;
+    size_t        n_total;      //words added, counting repeats
+    freq_block_t *arena;        //the block being filled, older ones after it
+    char         *carry;        //the start of a word that is not done yet
+    size_t        carry_len;
+    size_t        carry_cap;
+    bool          in_word;
+} freq_t;
+
+//the functions that add words return 0, or -1 with errno set when out of
+//memory
+freq_t *freq_open(void);
+void freq_close(freq_t *ft);
+int freq_add(freq_t *ft, const char *word, size_t len, size_t count);
+int freq_chunk(freq_t *ft, const char *buf, size_t len);
+int freq_end(freq_t *ft);
+int freq_merge(freq_t *into, const freq_t *from);
+
+//The n most frequent words, most frequent first and ties in byte order, or
+//all of them when n is 0.  The array is malloc()ed and points into the
+//table, *got is how many it holds.  NULL when out of memory.
+const freq_entry_t **freq_top(const freq_t *ft, size_t n, size_t *got);
+size_t freq_top_n(void);
+
+#endif
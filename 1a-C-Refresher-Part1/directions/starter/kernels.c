@@ -0,0 +1,927 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #define KERN_X86 1
+    #include <immintrin.h>
+#else
+    #define KERN_X86 0
+#endif
+
+#include "kernels.h"
+
+//-1 until the first call works out what the CPU supports.  Threads may
+//race to fill it in, they all store the same value.
+static int level = -1;
+
+static const char *level_names[] = { "scalar", "sse2", "avx2" };
+
+unsigned char kern_delim[256] = { [SPACE_CHAR] = 1 };
+
+//The same set in the forms the vector kernels want.  delim_one is the
+//delimiter when there is only one, -1 otherwise.  delim_list holds the
+//set when it has no more than KERN_DELIM_CMP bytes, delim_n is 0 when it
+//has more.  For a byte b with b >> 4 below 8, b is a delimiter when
+//nib_lo[b & 15] & nib_hi[b >> 4] is not 0: nib_lo has a bit for each high
+//nibble that makes a delimiter with that low nibble.  delim_ascii says
+//the whole set can be looked up that way.  When no two delimiters share
+//a low nibble, as with KERN_WHITESPACE, one lookup is enough: nib_one
+//holds the delimiter for each low nibble, or a byte that cannot match,
+//and b is a delimiter when nib_one[b & 15] == b.
+static int delim_one = SPACE_CHAR;
+static unsigned char delim_list[KERN_DELIM_CMP] = { SPACE_CHAR };
+static int delim_n = 1;
+static bool delim_ascii = true;
+static unsigned char nib_lo[16] = { [SPACE_CHAR & 15] = 1 << (SPACE_CHAR >> 4) };
+static const unsigned char nib_hi[16] = { 1, 2, 4, 8, 16, 32, 64, 128 };
+static unsigned char nib_one[16];
+static bool delim_unique = false;
+
+int kern_set_delims(const char *set, size_t len) {
+    unsigned used = 0;
+    int n = 0;
+
+    if (len == 0)
+        return -1;
+    memset(kern_delim, 0, sizeof(kern_delim));
+    memset(nib_lo, 0, sizeof(nib_lo));
+    for (int l = 0; l < 16; l++)
+        nib_one[l] = l ^ 1;
+    delim_ascii = true;
+    delim_unique = true;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = set[i];
+
+        if (kern_delim[c])
+            continue;
+        kern_delim[c] = 1;
+        if (n < KERN_DELIM_CMP)
+            delim_list[n] = c;
+        n++;
+        if (c < 0x80) {
+            nib_lo[c & 15] |= 1 << (c >> 4);
+            if (used & 1 << (c & 15))
+                delim_unique = false;
+            used |= 1 << (c & 15);
+            nib_one[c & 15] = c;
+        } else {
+            delim_ascii = false;
+        }
+    }
+    delim_unique = delim_unique && delim_ascii;
+    delim_one = n == 1 ? delim_list[0] : -1;
+    delim_n = n <= KERN_DELIM_CMP ? n : 0;
+    return 0;
+}
+
+//The reference, the count_words() loop from the assignment with the
+//branches taken out: a word starts at every byte that is not a delimiter
+//and follows one (or the start of the input when in_word is false).
+size_t kern_count_words_scalar(const char *buf, size_t len, bool in_word) {
+    unsigned prev = !in_word;
+    size_t wc = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        unsigned d = kern_delim[(unsigned char)buf[i]];
+
+        wc += prev & !d;
+        prev = d;
+    }
+    return wc;
+}
+
+//The reference for -a, the same loop keeping the other counts
+void kern_stats_scalar(const char *buf, size_t len, bool in_word, kern_stats_t *st) {
+    unsigned prev = !in_word;
+
+    for (size_t i = 0; i < len; i++) {
+        unsigned d = kern_delim[(unsigned char)buf[i]];
+
+        st->lines += buf[i] == '\n';
+        st->words += prev & !d;
+        prev = d;
+        if (!d) {
+            st->run++;
+        } else {
+            if (st->run > st->longest)
+                st->longest = st->run;
+            st->run = 0;
+        }
+    }
+}
+
+static size_t find_delim_scalar(const char *buf, size_t len) {
+    size_t i = 0;
+
+    while (i < len && !kern_delim[(unsigned char)buf[i]])
+        i++;
+    return i;
+}
+
+//The reference, the reverse_string() swaps from the assignment.  end_idx
+//is one past the last byte so a length of 0 needs no special case.
+void kern_reverse_scalar(char *buf, size_t len) {
+    size_t start_idx = 0;
+    size_t end_idx = len;
+    char tmp_char;
+
+    while (end_idx > start_idx + 1) {
+        end_idx--;
+        tmp_char = buf[start_idx];
+        buf[start_idx] = buf[end_idx];
+        buf[end_idx] = tmp_char;
+        start_idx++;
+    }
+}
+
+//Word starts in a 64 byte block, given a mask with a bit set for every
+//byte that is part of a word.  A word byte starts a word when the byte
+//before it is not a word byte, bit 63 of the previous block carries that
+//over the edge.  No branch per byte, just a shift and a popcount per 64.
+static inline size_t block_starts(uint64_t word, uint64_t *carry) {
+    uint64_t starts = word & ~((word << 1) | *carry);
+
+    *carry = word >> 63;
+    return (size_t)__builtin_popcountll(starts);
+}
+
+//Whether word has n set bits in a row.  Each step keeps the bits that
+//start a run twice as long as the step before, so a run of n takes
+//log2(n) steps rather than n.
+static inline bool has_run(uint64_t word, size_t n) {
+    size_t have = 1;
+
+    if (n > 64)
+        return false;
+    while (have < n && word != 0) {
+        size_t k = have < n - have ? have : n - have;
+
+        word &= word >> k;
+        have += k;
+    }
+    return word != 0;
+}
+
+//The -a counts for a 64 byte block from its word and newline masks.  A
+//word that starts in an earlier block finishes at the first bit that is
+//not a word bit, the rest is looked at only when it could hold a word
+//longer than the longest so far, which stops being true early on.
+static inline void block_stats(uint64_t word, uint64_t nl, uint64_t *carry, kern_stats_t *st) {
+    size_t head;
+
+    st->lines += (size_t)__builtin_popcountll(nl);
+    st->words += block_starts(word, carry);
+    if (word == ~(uint64_t)0) {
+        st->run += 64;
+        return;
+    }
+    head = (size_t)__builtin_ctzll(~word);
+    if (st->run + head > st->longest)
+        st->longest = st->run + head;
+    if (has_run(word, st->longest + 1)) {
+        size_t n = 0;
+
+        for (uint64_t w = word; w != 0; w &= w >> 1)
+            n++;
+        st->longest = n;
+    }
+    st->run = (size_t)__builtin_clzll(~word);
+}
+
+#if KERN_X86
+
+//4 x 16 bytes per block.  A single delimiter gets the loop to itself so
+//it costs what it did before there were sets.
+__attribute__((target("sse2")))
+size_t kern_count_words_sse2(const char *buf, size_t len, bool in_word) {
+    const __m128i one = _mm_set1_epi8((char)delim_one);
+    uint64_t carry = in_word;
+    size_t wc = 0;
+    size_t i = 0;
+
+    if (delim_n == 0)
+        return kern_count_words_scalar(buf, len, in_word);
+
+    if (delim_one >= 0) {
+        for (; i + 64 <= len; i += 64) {
+            uint64_t delims = 0;
+
+            for (int k = 0; k < 4; k++) {
+                __m128i v = _mm_loadu_si128((const __m128i *)(buf + i + 16 * k));
+                delims |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, one)) << (16 * k);
+            }
+            wc += block_starts(~delims, &carry);
+        }
+    } else {
+        __m128i list[KERN_DELIM_CMP];
+        int n = delim_n;
+
+        for (int j = 0; j < n; j++)
+            list[j] = _mm_set1_epi8((char)delim_list[j]);
+        for (; i + 64 <= len; i += 64) {
+            uint64_t delims = 0;
+
+            for (int k = 0; k < 4; k++) {
+                __m128i v = _mm_loadu_si128((const __m128i *)(buf + i + 16 * k));
+                __m128i d = _mm_cmpeq_epi8(v, list[0]);
+
+                for (int j = 1; j < n; j++)
+                    d = _mm_or_si128(d, _mm_cmpeq_epi8(v, list[j]));
+                delims |= (uint64_t)(uint16_t)_mm_movemask_epi8(d) << (16 * k);
+            }
+            wc += block_starts(~delims, &carry);
+        }
+    }
+    return wc + kern_count_words_scalar(buf + i, len - i, carry);
+}
+
+//Bit i set when byte i of v is a word byte, by the nibble lookup
+__attribute__((target("avx2")))
+static inline uint32_t word_bytes32(__m256i v, __m256i lo_tab, __m256i hi_tab) {
+    const __m256i nib = _mm256_set1_epi8(0x0F);
+    __m256i lo = _mm256_shuffle_epi8(lo_tab, _mm256_and_si256(v, nib));
+    __m256i hi = _mm256_shuffle_epi8(hi_tab, _mm256_and_si256(_mm256_srli_epi16(v, 4), nib));
+
+    return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(lo, hi),
+                                                            _mm256_setzero_si256()));
+}
+
+//The same with one lookup, when the set allows.  A byte with the high bit
+//set looks up 0, which is never equal to it.
+__attribute__((target("avx2")))
+static inline uint32_t delims32(__m256i v, __m256i one_tab) {
+    return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_shuffle_epi8(one_tab, v), v));
+}
+
+//2 x 32 bytes per block
+__attribute__((target("avx2,popcnt")))
+size_t kern_count_words_avx2(const char *buf, size_t len, bool in_word) {
+    const __m256i one = _mm256_set1_epi8((char)delim_one);
+    const __m256i lo_tab = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)nib_lo));
+    const __m256i hi_tab = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)nib_hi));
+    const __m256i one_tab = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)nib_one));
+    uint64_t carry = in_word;
+    size_t wc = 0;
+    size_t i = 0;
+
+    if (delim_one >= 0) {
+        for (; i + 64 <= len; i += 64) {
+            __m256i lo = _mm256_loadu_si256((const __m256i *)(buf + i));
+            __m256i hi = _mm256_loadu_si256((const __m256i *)(buf + i + 32));
+            uint64_t delims = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, one)) |
+                              (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, one)) << 32;
+
+            wc += block_starts(~delims, &carry);
+        }
+    } else if (delim_unique) {
+        for (; i + 64 <= len; i += 64) {
+            __m256i lo = _mm256_loadu_si256((const __m256i *)(buf + i));
+            __m256i hi = _mm256_loadu_si256((const __m256i *)(buf + i + 32));
+            uint64_t delims = delims32(lo, one_tab) | (uint64_t)delims32(hi, one_tab) << 32;
+
+            wc += block_starts(~delims, &carry);
+        }
+    } else if (delim_ascii) {
+        for (; i + 64 <= len; i += 64) {
+            __m256i lo = _mm256_loadu_si256((const __m256i *)(buf + i));
+            __m256i hi = _mm256_loadu_si256((const __m256i *)(buf + i + 32));
+            uint64_t word = word_bytes32(lo, lo_tab, hi_tab) |
+                            (uint64_t)word_bytes32(hi, lo_tab, hi_tab) << 32;
+
+            wc += block_starts(word, &carry);
+        }
+    } else {
+        return kern_count_words_sse2(buf, len, in_word);
+    }
+    return wc + kern_count_words_scalar(buf + i, len - i, carry);
+}
+
+__attribute__((target("avx2")))
+static size_t find_delim_avx2(const char *buf, size_t len) {
+    const __m256i lo_tab = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)nib_lo));
+    const __m256i hi_tab = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)nib_hi));
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        uint32_t delims = ~word_bytes32(_mm256_loadu_si256((const __m256i *)(buf + i)), lo_tab, hi_tab);
+
+        if (delims != 0)
+            return i + __builtin_ctz(delims);
+    }
+    return i + find_delim_scalar(buf + i, len - i);
+}
+
+//One load of each 16 bytes for the delimiters and the newlines
+__attribute__((target("sse2")))
+void kern_stats_sse2(const char *buf, size_t len, bool in_word, kern_stats_t *st) {
+    const __m128i nl = _mm_set1_epi8('\n');
+    __m128i list[KERN_DELIM_CMP];
+    kern_stats_t local;
+    uint64_t carry = in_word;
+    int n = delim_n;
+    size_t i = 0;
+
+    if (n == 0) {
+        kern_stats_scalar(buf, len, in_word, st);
+        return;
+    }
+    for (int j = 0; j < n; j++)
+        list[j] = _mm_set1_epi8((char)delim_list[j]);
+    //a copy the compiler can keep in registers, st could alias buf
+    local = *st;
+    for (; i + 64 <= len; i += 64) {
+        uint64_t delims = 0;
+        uint64_t lines = 0;
+
+        for (int k = 0; k < 4; k++) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(buf + i + 16 * k));
+            __m128i d = _mm_cmpeq_epi8(v, list[0]);
+
+            for (int j = 1; j < n; j++)
+                d = _mm_or_si128(d, _mm_cmpeq_epi8(v, list[j]));
+            delims |= (uint64_t)(uint16_t)_mm_movemask_epi8(d) << (16 * k);
+            lines |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl)) << (16 * k);
+        }
+        block_stats(~delims, lines, &carry, &local);
+    }
+    *st = local;
+    kern_stats_scalar(buf + i, len - i, carry, st);
+}
+
+__attribute__((target("avx2,popcnt")))
+void kern_stats_avx2(const char *buf, size_t len, bool in_word, kern_stats_t *st) {
+    const __m256i nl = _mm256_set1_epi8('\n');
+    const __m256i one = _mm256_set1_epi8((char)delim_one);
+    const __m256i lo_tab = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)nib_lo));
+    const __m256i hi_tab = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)nib_hi));
+    const __m256i one_tab = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)nib_one));
+    kern_stats_t local = *st;
+    uint64_t carry = in_word;
+    size_t i = 0;
+
+    if (delim_one < 0 && !delim_ascii) {
+        kern_stats_sse2(buf, len, in_word, st);
+        return;
+    }
+    for (; i + 64 <= len; i += 64) {
+        uint64_t word = 0;
+        uint64_t lines = 0;
+
+        for (int k = 0; k < 2; k++) {
+            __m256i v = _mm256_loadu_si256((const __m256i *)(buf + i + 32 * k));
+            uint32_t w;
+
+            //the same choice the word counter makes, the branch goes the
+            //same way every time
+            if (delim_one >= 0)
+                w = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, one));
+            else if (delim_unique)
+                w = ~delims32(v, one_tab);
+            else
+                w = word_bytes32(v, lo_tab, hi_tab);
+            word |= (uint64_t)w << (32 * k);
+            lines |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl)) << (32 * k);
+        }
+        block_stats(word, lines, &carry, &local);
+    }
+    //gcc leaves this out before the tail call, and SSE code after it
+    //then pays for the dirty upper halves
+    _mm256_zeroupper();
+    *st = local;
+    kern_stats_scalar(buf + i, len - i, carry, st);
+}
+
+//SSE2 has no byte shuffle, so reverse the dwords, then the words in each
+//dword, then the bytes in each word
+__attribute__((target("sse2")))
+static inline __m128i reverse16(__m128i v) {
+    v = _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3));
+    v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+    v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+    return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+//A block from each end, reversed and stored at the other end, until the
+//blocks would overlap.  The reference swaps the bytes left in the middle.
+__attribute__((target("sse2")))
+void kern_reverse_sse2(char *buf, size_t len) {
+    size_t i = 0;
+    size_t j = len;
+
+    for (; j - i >= 32; i += 16, j -= 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(buf + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(buf + j - 16));
+
+        _mm_storeu_si128((__m128i *)(buf + i), reverse16(b));
+        _mm_storeu_si128((__m128i *)(buf + j - 16), reverse16(a));
+    }
+    kern_reverse_scalar(buf + i, j - i);
+}
+
+//vpshufb reverses each 16 byte lane, vpermq swaps the lanes
+__attribute__((target("avx2")))
+static inline __m256i reverse32(__m256i v) {
+    const __m256i idx = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+                                         15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+
+    return _mm256_permute4x64_epi64(_mm256_shuffle_epi8(v, idx), _MM_SHUFFLE(1, 0, 3, 2));
+}
+
+__attribute__((target("avx2")))
+void kern_reverse_avx2(char *buf, size_t len) {
+    size_t i = 0;
+    size_t j = len;
+
+    for (; j - i >= 64; i += 32, j -= 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(buf + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(buf + j - 32));
+
+        _mm256_storeu_si256((__m256i *)(buf + i), reverse32(b));
+        _mm256_storeu_si256((__m256i *)(buf + j - 32), reverse32(a));
+    }
+    kern_reverse_scalar(buf + i, j - i);
+}
+
+static int cpu_level(void) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+        return KERN_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return KERN_SSE2;
+    return KERN_SCALAR;
+}
+
+#else
+
+//other CPUs only have the reference
+size_t kern_count_words_sse2(const char *buf, size_t len, bool in_word) {
+    return kern_count_words_scalar(buf, len, in_word);
+}
+
+size_t kern_count_words_avx2(const char *buf, size_t len, bool in_word) {
+    return kern_count_words_scalar(buf, len, in_word);
+}
+
+void kern_stats_sse2(const char *buf, size_t len, bool in_word, kern_stats_t *st) {
+    kern_stats_scalar(buf, len, in_word, st);
+}
+
+void kern_stats_avx2(const char *buf, size_t len, bool in_word, kern_stats_t *st) {
+    kern_stats_scalar(buf, len, in_word, st);
+}
+
+void kern_reverse_sse2(char *buf, size_t len) {
+    kern_reverse_scalar(buf, len);
+}
+
+void kern_reverse_avx2(char *buf, size_t len) {
+    kern_reverse_scalar(buf, len);
+}
+
+static int cpu_level(void) {
+    return KERN_SCALAR;
+}
+
+#endif
+
+static const kern_count_fn counters[] = {
+    kern_count_words_scalar, kern_count_words_sse2, kern_count_words_avx2,
+};
+
+static const kern_stats_fn statters[] = {
+    kern_stats_scalar, kern_stats_sse2, kern_stats_avx2,
+};
+
+static const kern_reverse_fn reversers[] = {
+    kern_reverse_scalar, kern_reverse_sse2, kern_reverse_avx2,
+};
+
+//The best level the CPU supports, lowered by KERN_ENV when it is set.
+int kern_level(void) {
+    int l = __atomic_load_n(&level, __ATOMIC_RELAXED);
+    const char *env;
+
+    if (l >= 0)
+        return l;
+    l = cpu_level();
+    if ((env = getenv(KERN_ENV)) != NULL) {
+        for (int i = 0; i < l; i++) {
+            if (strcmp(env, level_names[i]) == 0)
+                l = i;
+        }
+    }
+    __atomic_store_n(&level, l, __ATOMIC_RELAXED);
+    return l;
+}
+
+//Use level, or the best one the CPU has if that is lower.  Returns the
+//level now in use.
+int kern_set_level(int want) {
+    int l = cpu_level();
+
+    if (want >= KERN_SCALAR && want < l)
+        l = want;
+    __atomic_store_n(&level, l, __ATOMIC_RELAXED);
+    return l;
+}
+
+const char *kern_level_name(int l) {
+    return l >= KERN_SCALAR && l <= KERN_AVX2 ? level_names[l] : "unknown";
+}
+
+size_t kern_count_words(const char *buf, size_t len, bool in_word) {
+    return counters[kern_level()](buf, len, in_word);
+}
+
+void kern_stats(const char *buf, size_t len, bool in_word, kern_stats_t *st) {
+    statters[kern_level()](buf, len, in_word, st);
+    st->bytes += len;
+}
+
+//memchr() for one delimiter, it is as fast as anything here
+size_t kern_find_delim(const char *buf, size_t len) {
+    if (delim_one >= 0) {
+        const char *d = memchr(buf, delim_one, len);
+
+        return d != NULL ? (size_t)(d - buf) : len;
+    }
+#if KERN_X86
+    if (delim_ascii && kern_level() == KERN_AVX2)
+        return find_delim_avx2(buf, len);
+#endif
+    return find_delim_scalar(buf, len);
+}
+
+void kern_reverse(char *buf, size_t len) {
+    reversers[kern_level()](buf, len);
+}
+
+//UTF-8 reversal is a byte reversal and then a fix up, in the same cache
+//hot buffer, that puts the bytes of each character back in order.  After
+//the byte reversal a character reads as its code points last to first,
+//each one its continuation bytes and then its lead byte.
+
+#define UTF8_ZWJ        0x200D
+//E2 80 8D, and as it reads after a byte reversal
+#define UTF8_ZWJ_BYTES  "\xE2\x80\x8D"
+#define UTF8_JWZ_BYTES  "\x8D\x80\xE2"
+
+static inline bool utf8_cont(unsigned char c) {
+    return (c & 0xC0) == 0x80;
+}
+
+//bytes in the sequence lead starts, 1 for a byte that cannot start one
+static inline size_t utf8_len(unsigned char lead) {
+    if (lead >= 0xF0 && lead <= 0xF7)
+        return 4;
+    if (lead >= 0xE0)
+        return lead <= 0xEF ? 3 : 1;
+    if (lead >= 0xC0)
+        return 2;
+    return 1;
+}
+
+//Code points that belong to the one before them
+static bool utf8_extends(uint32_t cp) {
+    return (cp >= 0x0300 && cp <= 0x036F) ||     //combining diacritical marks
+           (cp >= 0x1AB0 && cp <= 0x1AFF) ||
+           (cp >= 0x1DC0 && cp <= 0x1DFF) ||
+           (cp >= 0x20D0 && cp <= 0x20FF) ||     //combining marks for symbols
+           (cp >= 0xFE00 && cp <= 0xFE0F) ||     //variation selectors
+           (cp >= 0xFE20 && cp <= 0xFE2F) ||     //combining half marks
+           (cp >= 0x1F3FB && cp <= 0x1F3FF) ||   //skin tones
+           (cp >= 0xE0020 && cp <= 0xE007F) ||   //tags, as in subdivision flags
+           cp == UTF8_ZWJ;
+}
+
+//The code point at buf[i], 0xFFFD when it is not valid UTF-8.  Its length
+//goes in *n, 1 for a bad byte so that byte stands on its own.
+static uint32_t utf8_decode(const unsigned char *buf, size_t len, size_t i, size_t *n) {
+    size_t want = utf8_len(buf[i]);
+    uint32_t cp;
+
+    *n = 1;
+    if (buf[i] < 0x80)
+        return buf[i];
+    if (want == 1 || len - i < want)
+        return 0xFFFD;
+    cp = buf[i] & (0x7F >> want);
+    for (size_t k = 1; k < want; k++) {
+        if (!utf8_cont(buf[i + k]))
+            return 0xFFFD;
+        cp = cp << 6 | (buf[i + k] & 0x3F);
+    }
+    *n = want;
+    return cp;
+}
+
+//The same, for a code point whose bytes have been reversed
+static uint32_t utf8_decode_back(const unsigned char *buf, size_t len, size_t i, size_t *n) {
+    size_t conts = 0;
+    uint32_t cp;
+
+    *n = 1;
+    while (conts < 3 && i + conts < len && utf8_cont(buf[i + conts]))
+        conts++;
+    if (buf[i] < 0x80)
+        return buf[i];
+    if (conts == 0 || i + conts == len || utf8_len(buf[i + conts]) != conts + 1)
+        return 0xFFFD;
+    cp = buf[i + conts] & (0x7F >> (conts + 1));
+    for (size_t k = conts; k > 0; k--)
+        cp = cp << 6 | (buf[i + k - 1] & 0x3F);
+    *n = conts + 1;
+    return cp;
+}
+
+//8 ASCII bytes, none of them '\r'
+static inline bool plain_ascii(uint64_t w) {
+    uint64_t cr = w ^ 0x0D0D0D0D0D0D0D0DULL;
+
+    return ((w | ((cr - 0x0101010101010101ULL) & ~cr)) & 0x8080808080808080ULL) == 0;
+}
+
+//Put the character at buf[i] back in order: any code points that extend
+//it, then the code point it starts with, and the one before that again
+//when a zero width joiner or a "\r\n" joins them.  Returns where the next
+//character starts.
+static size_t utf8_fix_char(unsigned char *buf, size_t len, size_t i) {
+    size_t start = i;
+    size_t n;
+    uint32_t cp;
+
+    for (;;) {
+        cp = utf8_decode_back(buf, len, i, &n);
+        i += n;
+        if (i == len)
+            break;
+        if (utf8_extends(cp))
+            continue;
+        if (len - i >= 3 && memcmp(buf + i, UTF8_JWZ_BYTES, 3) == 0) {
+            //a joiner that starts the text joins nothing before it
+            if ((i += 3) == len)
+                break;
+            continue;
+        }
+        if (cp == '\n' && buf[i] == '\r')
+            continue;
+        break;
+    }
+    if (i - start > 1)
+        kern_reverse_scalar((char *)buf + start, i - start);
+    return i;
+}
+
+//The fix up from buf[i] on, i is where a character starts
+static void utf8_fix(unsigned char *buf, size_t len, size_t i) {
+    while (i < len) {
+        //ASCII is right as it is, 32 and then 8 bytes at a time.  The byte
+        //after them must be plain too, or it may join the last of them.
+        while (len - i > 32) {
+            uint64_t w[4];
+
+            memcpy(w, buf + i, 32);
+            if (!(plain_ascii(w[0]) & plain_ascii(w[1]) & plain_ascii(w[2]) & plain_ascii(w[3])) ||
+                buf[i + 32] >= 0x80 || buf[i + 32] == '\r')
+                break;
+            i += 32;
+        }
+        while (len - i > 8) {
+            uint64_t w;
+
+            memcpy(&w, buf + i, 8);
+            if (!plain_ascii(w) || buf[i + 8] >= 0x80 || buf[i + 8] == '\r')
+                break;
+            i += 8;
+        }
+        i = utf8_fix_char(buf, len, i);
+    }
+}
+
+void kern_reverse_utf8_scalar(char *buf, size_t len) {
+    kern_reverse_scalar(buf, len);
+    utf8_fix((unsigned char *)buf, len, 0);
+}
+
+//SSE2 reverses the bytes, the fix up is the scalar one
+void kern_reverse_utf8_sse2(char *buf, size_t len) {
+    kern_reverse_sse2(buf, len);
+    utf8_fix((unsigned char *)buf, len, 0);
+}
+
+#if KERN_X86
+
+//v moved k bytes across the whole 256 bits, zeros shifted in: lane q of
+//UP gets v[q - k], lane q of DOWN gets v[q + k]
+#define UP(v, k)    _mm256_alignr_epi8(v, _mm256_permute2x128_si256(v, v, 0x08), 16 - (k))
+#define DOWN(v, k)  _mm256_alignr_epi8(_mm256_permute2x128_si256(v, v, 0x81), v, k)
+
+//The fix up 32 bytes at a time.  A window starts where a character does.
+//A byte joins the next one when it is a continuation byte, the lead of a
+//code point that extends the next one, the last byte before a joiner, or
+//a '\n' before '\r'.  A character is a run of joined bytes and the byte
+//after them, and putting it back in order reverses it, so every byte
+//comes from the character's start plus end minus its own offset.  Both
+//come from running maxima over the window, and two vpshufb, one of each
+//lane, fetch the bytes.
+//
+//Only the part of the window the scalar fix up would handle the same way
+//is kept: up to the first byte that is not well formed UTF-8, or a
+//character longer than 8 bytes.  Leads that can start a code point
+//that extends are picked out by their first two or three bytes and
+//decoded to make sure.  The window ends after the last whole character
+//in that part, one before when a joiner or "\r" comes right after it.
+//When nothing is left the scalar fix up does one character.
+__attribute__((target("avx2")))
+static void utf8_fix_avx2(unsigned char *buf, size_t len) {
+    const __m256i iota = _mm256_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+                                          16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29,
+                                          30, 31);
+    const __m256i bit_of = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64,
+                                            -128, 1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32,
+                                            64, -128);
+    const __m256i byte_of = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                                             2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    //continuation bytes a lead wants, by its high nibble, 0xF8 and up are
+    //picked out on their own
+    const __m256i lead_conts = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 2, 3,
+                                                0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 2, 3);
+    const __m256i back = _mm256_sub_epi8(_mm256_set1_epi8(-1), iota);
+    size_t i = 0;
+
+    while (len - i >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(buf + i));
+        uint32_t cr = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')));
+        uint32_t joined = 0;
+        uint32_t heads;
+        size_t adv = 32;
+
+        if (_mm256_movemask_epi8(v) != 0 || cr != 0) {
+            __m256i c = _mm256_cmpeq_epi8(_mm256_and_si256(v, _mm256_set1_epi8((char)0xC0)),
+                                          _mm256_set1_epi8((char)0x80));
+            __m256i b1 = UP(c, 1);
+            __m256i b2 = _mm256_and_si256(b1, UP(c, 2));
+            //continuation bytes before each byte, as a negative count
+            __m256i before = _mm256_add_epi8(_mm256_add_epi8(b1, b2),
+                                             _mm256_and_si256(b2, UP(c, 3)));
+            __m256i want = _mm256_shuffle_epi8(lead_conts, _mm256_and_si256(
+                                               _mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0F)));
+            __m256i p1 = UP(v, 1);
+            __m256i p2 = UP(v, 2);
+            __m256i joins;
+            uint32_t cont = _mm256_movemask_epi8(c);
+            uint32_t nl = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+            uint32_t high = _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+                                _mm256_max_epu8(v, _mm256_set1_epi8((char)0xF8)), v));
+            uint32_t bad, cand, run;
+            size_t end = 32;
+
+            bad = ~_mm256_movemask_epi8(_mm256_cmpeq_epi8(want, _mm256_sub_epi8(
+                                        _mm256_setzero_si256(), before))) & ~cont;
+            bad |= cont & cont << 1 & cont << 2 & cont << 3;
+            bad |= high;
+            if (bad != 0)
+                end = __builtin_ctz(bad);
+            joined = cont | (nl & cr >> 1);
+
+#define LEAD(b)     _mm256_cmpeq_epi8(v, _mm256_set1_epi8((char)(b)))
+#define NEXT(p, b)  _mm256_cmpeq_epi8(p, _mm256_set1_epi8((char)(b)))
+#define BELOW(p, b) _mm256_cmpgt_epi8(_mm256_set1_epi8((char)((b) ^ 0x80)), \
+                                      _mm256_xor_si256(p, _mm256_set1_epi8((char)0x80)))
+            //CC xx and CD below B0 are the combining diacritical marks
+            joined |= _mm256_movemask_epi8(_mm256_or_si256(LEAD(0xCC),
+                                           _mm256_and_si256(LEAD(0xCD), BELOW(p1, 0xB0))));
+
+            //E1 AA, E1 AB, E1 B7, E2 80, E2 83, EF B8, F0 9F 8F and F3 A0 start
+            //every other code point utf8_extends() knows.  Overlong forms
+            //decode too, C0 and C1 xx, E0 below A0 and F0 below 90 may be
+            //one of them or a '\n'.
+            joins = _mm256_or_si256(
+                _mm256_cmpeq_epi8(_mm256_and_si256(v, _mm256_set1_epi8((char)0xFE)),
+                                  _mm256_set1_epi8((char)0xC0)),
+                _mm256_and_si256(LEAD(0xE0), BELOW(p1, 0xA0)));
+            joins = _mm256_or_si256(joins, _mm256_and_si256(LEAD(0xE1), _mm256_or_si256(
+                NEXT(_mm256_and_si256(p1, _mm256_set1_epi8((char)0xFE)), 0xAA), NEXT(p1, 0xB7))));
+            joins = _mm256_or_si256(joins, _mm256_and_si256(LEAD(0xE2),
+                                    _mm256_or_si256(NEXT(p1, 0x80), NEXT(p1, 0x83))));
+            joins = _mm256_or_si256(joins, _mm256_and_si256(LEAD(0xEF), NEXT(p1, 0xB8)));
+            joins = _mm256_or_si256(joins, _mm256_and_si256(LEAD(0xF0), _mm256_or_si256(
+                BELOW(p1, 0x90), _mm256_and_si256(NEXT(p1, 0x9F), NEXT(p2, 0x8F)))));
+            joins = _mm256_or_si256(joins, _mm256_and_si256(LEAD(0xF3), NEXT(p1, 0xA0)));
+#undef LEAD
+#undef NEXT
+#undef BELOW
+            cand = _mm256_movemask_epi8(joins);
+            if (end < 32)
+                cand &= (1u << end) - 1;
+            for (; cand != 0; cand &= cand - 1) {
+                size_t q = __builtin_ctz(cand);
+                size_t s = q + 1 - utf8_len(buf[i + q]);
+                size_t n;
+                uint32_t cp = utf8_decode_back(buf, len, i + s, &n);
+
+                if (cp < 0x80) {
+                    end = q;
+                    break;
+                }
+                if (!utf8_extends(cp))
+                    continue;
+                joined |= 1u << q;
+                //a joiner joins the code point before it too, when it is
+                //spelled as UTF8_ZWJ_BYTES
+                if (cp == UTF8_ZWJ && n == 3 && s > 0)
+                    joined |= 1u << (s - 1);
+            }
+
+            run = joined & joined << 1;
+            run &= run << 2;
+            run &= run << 4;
+            if (run != 0 && (size_t)__builtin_ctz(run) < end)
+                end = __builtin_ctz(run);
+            heads = ~joined & (end < 32 ? (1u << end) - 1 : ~0u);
+            adv = heads != 0 ? 32 - __builtin_clz(heads) : 0;
+        }
+
+        if (adv > 0 && ((len - i - adv >= 3 && memcmp(buf + i + adv, UTF8_JWZ_BYTES, 3) == 0) ||
+                        (buf[i + adv - 1] == '\n' && i + adv < len && buf[i + adv] == '\r'))) {
+            heads = ~joined & ((1u << (adv - 1)) - 1);
+            adv = heads != 0 ? 32 - __builtin_clz(heads) : 0;
+        }
+        if (adv == 0) {
+            i = utf8_fix_char(buf, len, i);
+            continue;
+        }
+
+        if ((joined & (adv < 32 ? (1u << adv) - 1 : ~0u)) != 0) {
+            //lanes that end a character
+            __m256i ends = _mm256_cmpeq_epi8(_mm256_and_si256(_mm256_shuffle_epi8(
+                                     _mm256_set1_epi32(~joined), byte_of), bit_of), bit_of);
+            __m256i e, s, from;
+
+            //255 - the first end at or after each lane
+            e = _mm256_and_si256(ends, back);
+            e = _mm256_max_epu8(e, DOWN(e, 1));
+            e = _mm256_max_epu8(e, DOWN(e, 2));
+            e = _mm256_max_epu8(e, DOWN(e, 4));
+            //the first lane after the last end before each lane
+            s = UP(_mm256_and_si256(ends, _mm256_add_epi8(iota, _mm256_set1_epi8(1))), 1);
+            s = _mm256_max_epu8(s, UP(s, 1));
+            s = _mm256_max_epu8(s, UP(s, 2));
+            s = _mm256_max_epu8(s, UP(s, 4));
+            //start + end - lane, lanes from adv on stay where they are
+            from = _mm256_add_epi8(_mm256_sub_epi8(s, e), back);
+            from = _mm256_blendv_epi8(iota, from,
+                                      _mm256_cmpgt_epi8(_mm256_set1_epi8((char)adv), iota));
+            v = _mm256_blendv_epi8(_mm256_shuffle_epi8(v, from),
+                                   _mm256_shuffle_epi8(_mm256_permute2x128_si256(v, v, 0x01), from),
+                                   _mm256_cmpeq_epi8(_mm256_and_si256(_mm256_xor_si256(from, iota),
+                                                     _mm256_set1_epi8(16)), _mm256_set1_epi8(16)));
+            _mm256_storeu_si256((__m256i *)(buf + i), v);
+        }
+        i += adv;
+    }
+    _mm256_zeroupper();
+    utf8_fix(buf, len, i);
+}
+
+#undef UP
+#undef DOWN
+
+void kern_reverse_utf8_avx2(char *buf, size_t len) {
+    kern_reverse_avx2(buf, len);
+    utf8_fix_avx2((unsigned char *)buf, len);
+}
+
+#else
+
+void kern_reverse_utf8_avx2(char *buf, size_t len) {
+    kern_reverse_utf8_scalar(buf, len);
+}
+
+#endif
+
+static const kern_reverse_fn utf8_reversers[] = {
+    kern_reverse_utf8_scalar, kern_reverse_utf8_sse2, kern_reverse_utf8_avx2,
+};
+
+void kern_reverse_utf8(char *buf, size_t len) {
+    utf8_reversers[kern_level()](buf, len);
+}
+
+size_t kern_utf8_cut(const char *str, size_t len) {
+    const unsigned char *buf = (const unsigned char *)str;
+    size_t max = len < KERN_UTF8_CUT_MAX ? len : KERN_UTF8_CUT_MAX;
+    size_t n;
+
+    for (size_t i = 3; i < max; i++) {
+        if (utf8_cont(buf[i]) || utf8_extends(utf8_decode(buf, len, i, &n)))
+            continue;
+        if (memcmp(buf + i - 3, UTF8_ZWJ_BYTES, 3) == 0)
+            continue;
+        if (buf[i] == '\n' && buf[i - 1] == '\r')
+            continue;
+        return i;
+    }
+    return 0;
+}
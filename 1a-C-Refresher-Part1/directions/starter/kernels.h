@@ -0,0 +1,112 @@
+#ifndef __KERNELS_H__
+    #define __KERNELS_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define SPACE_CHAR ' '
+
+//The string kernels behind stringfun's operations.  Each one has a plain C
+//version, the reference, and vector versions for x86 that are picked at
+//run time from what the CPU supports, so one binary runs anywhere and
+//takes the fastest path it can.  A vector version must give exactly the
+//same result as the reference for every input.
+//
+//Word counting takes a buffer rather than a C string, so a big input can
+//be fed in a chunk at a time.  in_word says whether the byte just before
+//buf was part of a word; a word that straddles two chunks is counted once,
+//in the chunk it starts in.
+//
+//What separates words is a set of delimiter bytes, SPACE_CHAR alone until
+//kern_set_delims() says otherwise.  The set is compiled into kern_delim,
+//one entry per byte value, and into the tables the vector kernels use:
+//one compare per block for a single delimiter, a nibble lookup (pshufb)
+//for any set of ASCII bytes, a compare per delimiter on SSE2.  Set it
+//before any kernel runs, the threads only read it.
+//
+//kern_stats() is -a: lines, words and the longest word from one load of
+//each block.  It runs over an input a chunk at a time with the same
+//kern_stats_t.  run is the length of the word the input so far ends in,
+//so it may be the longest, check it once the input is done.  in_word
+//works as for word counting, it may be true with a run of 0 when the
+//length of the word before buf is not known (see par_stats()).
+//
+//Reversal works in place.  kern_reverse() reverses the bytes, which
+//garbles any character that takes more than one byte.  kern_reverse_utf8()
+//keeps characters whole: the bytes of a code point stay in order, and so
+//do the combining marks, variation selectors and skin tones after it, code
+//points joined by a zero width joiner, and "\r\n".  That is not all of
+//UAX #29, but it covers the text people write.  Bytes that are not valid
+//UTF-8 are reversed one at a time.  It is the byte reversal and then a fix
+//up that puts characters back in order, SSE2 does the fix up in scalar
+//code, AVX2 32 bytes at a time.
+#define KERN_SCALAR     0
+#define KERN_SSE2       1
+#define KERN_AVX2       2
+
+//set to scalar, sse2 or avx2 to use a lower level than the CPU supports
+#define KERN_ENV        "STRINGFUN_KERNEL"
+
+//what the "whitespace" preset of -d stands for
+#define KERN_WHITESPACE " \t\n\v\f\r"
+//SSE2 compares against each delimiter, more than this and it is the scalar
+//loop's job
+#define KERN_DELIM_CMP  8
+
+extern unsigned char kern_delim[256];
+
+static inline bool kern_is_delim(char c) {
+    return kern_delim[(unsigned char)c];
+}
+
+//-1 when set is empty
+int kern_set_delims(const char *set, size_t len);
+//offset of the first delimiter in buf, len when there is none
+size_t kern_find_delim(const char *buf, size_t len);
+
+typedef size_t (*kern_count_fn)(const char *buf, size_t len, bool in_word);
+
+size_t kern_count_words(const char *buf, size_t len, bool in_word);
+size_t kern_count_words_scalar(const char *buf, size_t len, bool in_word);
+size_t kern_count_words_sse2(const char *buf, size_t len, bool in_word);
+size_t kern_count_words_avx2(const char *buf, size_t len, bool in_word);
+
+typedef struct kern_stats{
+    size_t lines;           //'\n' bytes
+    size_t words;
+    size_t bytes;           //kept by kern_stats(), not the per level kernels
+    size_t longest;         //bytes in the longest word that has ended
+    size_t run;             //bytes in the word the input ends in so far
+} kern_stats_t;
+
+typedef void (*kern_stats_fn)(const char *buf, size_t len, bool in_word, kern_stats_t *st);
+
+void kern_stats(const char *buf, size_t len, bool in_word, kern_stats_t *st);
+void kern_stats_scalar(const char *buf, size_t len, bool in_word, kern_stats_t *st);
+void kern_stats_sse2(const char *buf, size_t len, bool in_word, kern_stats_t *st);
+void kern_stats_avx2(const char *buf, size_t len, bool in_word, kern_stats_t *st);
+
+typedef void (*kern_reverse_fn)(char *buf, size_t len);
+
+void kern_reverse(char *buf, size_t len);
+void kern_reverse_scalar(char *buf, size_t len);
+void kern_reverse_sse2(char *buf, size_t len);
+void kern_reverse_avx2(char *buf, size_t len);
+void kern_reverse_utf8(char *buf, size_t len);
+void kern_reverse_utf8_scalar(char *buf, size_t len);
+void kern_reverse_utf8_sse2(char *buf, size_t len);
+void kern_reverse_utf8_avx2(char *buf, size_t len);
+
+//A buffer can be reversed in pieces, last to first, as long as each cut
+//is between two characters.  Returns the first offset from 3 on where one
+//can be made, 3 bytes before it is enough to see what it follows, or 0
+//when the first KERN_UTF8_CUT_MAX bytes have none.
+#define KERN_UTF8_CUT_MAX   4096
+
+size_t kern_utf8_cut(const char *buf, size_t len);
+
+int kern_level(void);
+int kern_set_level(int level);
+const char *kern_level_name(int level);
+
+#endif
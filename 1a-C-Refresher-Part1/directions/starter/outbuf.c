@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "outbuf.h"
+
+//"00" to "99", so numbers are formatted two digits per step
+static const char digit_pairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+outbuf_t *outbuf_open(int fd) {
+    outbuf_t *out = malloc(sizeof(*out));
+
+    if (out != NULL) {
+        out->fd = fd;
+        out->err = 0;
+        out->len = 0;
+    }
+    return out;
+}
+
+//Flush and free.  Returns -1 with errno set when any write failed.
+int outbuf_close(outbuf_t *out) {
+    int rc = outbuf_flush(out);
+    int err = out->err;
+
+    free(out);
+    errno = err;
+    return rc;
+}
+
+int outbuf_flush(outbuf_t *out) {
+    size_t done = 0;
+
+    if (fflush(stdout) != 0 && out->err == 0)
+        out->err = errno;
+    while (done < out->len && out->err == 0) {
+        ssize_t n = write(out->fd, out->buf + done, out->len - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            out->err = errno;
+        else
+            done += n;
+    }
+    out->len = 0;
+    errno = out->err;
+    return out->err == 0 ? 0 : -1;
+}
+
+//s does not fit in what is left, flush and copy it in a buffer at a time
+void outbuf_write_slow(outbuf_t *out, const char *s, size_t len) {
+    while (len > 0) {
+        size_t room = OUTBUF_SIZE - out->len;
+        size_t n = len < room ? len : room;
+
+        memcpy(out->buf + out->len, s, n);
+        out->len += n;
+        s += n;
+        len -= n;
+        if (out->len == OUTBUF_SIZE)
+            outbuf_flush(out);
+    }
+}
+
+//v in decimal, what printf("%zu") prints
+void outbuf_uint(outbuf_t *out, size_t v) {
+    char tmp[24];
+    char *p = tmp + sizeof(tmp);
+
+    while (v >= 100) {
+        p -= 2;
+        memcpy(p, digit_pairs + (v % 100) * 2, 2);
+        v /= 100;
+    }
+    if (v >= 10) {
+        p -= 2;
+        memcpy(p, digit_pairs + v * 2, 2);
+    } else {
+        *--p = (char)('0' + v);
+    }
+    outbuf_write(out, p, tmp + sizeof(tmp) - p);
+}
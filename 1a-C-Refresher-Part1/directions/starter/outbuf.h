@@ -0,0 +1,39 @@
+#ifndef __OUTBUF_H__
+    #define __OUTBUF_H__
+
+#include <stddef.h>
+#include <string.h>
+
+//A big output buffer over a file descriptor for the operations that print
+//a line per word.  Text is copied in with memcpy and numbers are formatted
+//by hand, and the buffer goes out with one write() when it fills up or is
+//flushed, so output up to OUTBUF_SIZE costs a single system call.
+//
+//stdio may hold text for the same descriptor (a header printed with
+//printf), so a flush fflush()es stdout first to keep the order.
+#define OUTBUF_SIZE     (1 << 20)
+
+typedef struct outbuf{
+    int    fd;
+    int    err;             //errno of the first failed write, 0 if none
+    size_t len;
+    char   buf[OUTBUF_SIZE];
+} outbuf_t;
+
+outbuf_t *outbuf_open(int fd);
+int outbuf_close(outbuf_t *out);
+int outbuf_flush(outbuf_t *out);
+void outbuf_write_slow(outbuf_t *out, const char *s, size_t len);
+void outbuf_uint(outbuf_t *out, size_t v);
+
+//the common case inline, a copy into a buffer with room
+static inline void outbuf_write(outbuf_t *out, const char *s, size_t len) {
+    if (out->len + len <= OUTBUF_SIZE) {
+        memcpy(out->buf + out->len, s, len);
+        out->len += len;
+    } else {
+        outbuf_write_slow(out, s, len);
+    }
+}
+
+#endif
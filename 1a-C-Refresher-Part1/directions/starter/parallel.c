@@ -0,0 +1,209 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "kernels.h"
+#include "parallel.h"
+
+//How many threads to split len bytes over.
+int par_threads(size_t len) {
+    const char *env = getenv(PAR_ENV);
+    long n = env != NULL ? atol(env) : sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (n < 1)
+        n = 1;
+    if (n > PAR_MAX_THREADS)
+        n = PAR_MAX_THREADS;
+    if ((size_t)n > len / PAR_MIN_BYTES)
+        n = len / PAR_MIN_BYTES > 0 ? len / PAR_MIN_BYTES : 1;
+    return (int)n;
+}
+
+typedef struct count_job{
+    const char *buf;
+    size_t      len;
+    bool        in_word;    //the byte before buf is part of a word
+    size_t      wc;
+} count_job_t;
+
+static void *run_count(void *arg) {
+    count_job_t *job = arg;
+
+    job->wc = kern_count_words(job->buf, job->len, job->in_word);
+    return NULL;
+}
+
+//Count the words of buf on par_threads() threads.  A range that starts in
+//the middle of a word is told so through in_word, so the word is counted
+//once, by the range it starts in, and the sum is exact.
+size_t par_count_words(const char *buf, size_t len) {
+    count_job_t jobs[PAR_MAX_THREADS];
+    pthread_t threads[PAR_MAX_THREADS];
+    bool started[PAR_MAX_THREADS];
+    int n = par_threads(len);
+    size_t wc = 0;
+
+    //pick the kernel before the threads race to
+    kern_level();
+
+    for (int i = 0; i < n; i++) {
+        size_t start = len / n * i;
+        size_t end = i == n - 1 ? len : len / n * (i + 1);
+
+        jobs[i].buf = buf + start;
+        jobs[i].len = end - start;
+        jobs[i].in_word = start > 0 && !kern_is_delim(buf[start - 1]);
+    }
+
+    //the first range runs here, a thread that could not be started too
+    for (int i = 1; i < n; i++) {
+        started[i] = pthread_create(&threads[i], NULL, run_count, &jobs[i]) == 0;
+        if (!started[i])
+            run_count(&jobs[i]);
+    }
+    run_count(&jobs[0]);
+    for (int i = 1; i < n; i++) {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+    }
+
+    for (int i = 0; i < n; i++)
+        wc += jobs[i].wc;
+    return wc;
+}
+
+typedef struct stats_job{
+    const char  *buf;
+    size_t       len;
+    bool         in_word;
+    size_t       head;          //word bytes before the first delimiter
+    kern_stats_t st;
+} stats_job_t;
+
+static void *run_stats(void *arg) {
+    stats_job_t *job = arg;
+
+    job->head = kern_find_delim(job->buf, job->len);
+    kern_stats(job->buf, job->len, job->in_word, &job->st);
+    return NULL;
+}
+
+//The -a counts of buf on par_threads() threads, added to st.  Lines and
+//words stitch as for par_count_words().  A range does not know how long
+//the word it starts in already is, so each one also finds where its
+//first word ends, and the words that cross ranges are put back together
+//from those after the join.
+void par_stats(const char *buf, size_t len, kern_stats_t *st) {
+    stats_job_t jobs[PAR_MAX_THREADS];
+    pthread_t threads[PAR_MAX_THREADS];
+    bool started[PAR_MAX_THREADS];
+    int n = par_threads(len);
+
+    kern_level();
+
+    for (int i = 0; i < n; i++) {
+        size_t start = len / n * i;
+        size_t end = i == n - 1 ? len : len / n * (i + 1);
+
+        jobs[i].buf = buf + start;
+        jobs[i].len = end - start;
+        jobs[i].in_word = i == 0 ? st->run > 0 : !kern_is_delim(buf[start - 1]);
+        jobs[i].st = (kern_stats_t){0};
+    }
+    //the first range goes on from st
+    jobs[0].st = *st;
+
+    for (int i = 1; i < n; i++) {
+        started[i] = pthread_create(&threads[i], NULL, run_stats, &jobs[i]) == 0;
+        if (!started[i])
+            run_stats(&jobs[i]);
+    }
+    run_stats(&jobs[0]);
+    for (int i = 1; i < n; i++) {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+    }
+
+    *st = jobs[0].st;
+    for (int i = 1; i < n; i++) {
+        st->lines += jobs[i].st.lines;
+        st->words += jobs[i].st.words;
+        st->bytes += jobs[i].st.bytes;
+        if (jobs[i].st.longest > st->longest)
+            st->longest = jobs[i].st.longest;
+        if (jobs[i].head == jobs[i].len) {
+            //all one word, it goes on into the next range
+            st->run += jobs[i].len;
+        } else {
+            if (st->run + jobs[i].head > st->longest)
+                st->longest = st->run + jobs[i].head;
+            st->run = jobs[i].st.run;
+        }
+    }
+}
+
+typedef struct freq_job{
+    const char *buf;
+    size_t      len;
+    freq_t     *ft;
+    int         rc;
+} freq_job_t;
+
+static void *run_freq(void *arg) {
+    freq_job_t *job = arg;
+
+    job->rc = -1;
+    if (job->ft != NULL && freq_chunk(job->ft, job->buf, job->len) == 0)
+        job->rc = freq_end(job->ft);
+    return NULL;
+}
+
+//Add the words of buf to ft on par_threads() threads.  Tables cannot be
+//stitched the way counts can, so each range is moved up to the start of
+//a word instead, and a word is always whole in one range.  Each thread
+//fills its own table, the first range's is ft, and the rest are merged
+//into it after the join.  0, or -1 with errno set when out of memory.
+int par_word_freq(freq_t *ft, const char *buf, size_t len) {
+    freq_job_t jobs[PAR_MAX_THREADS];
+    pthread_t threads[PAR_MAX_THREADS];
+    bool started[PAR_MAX_THREADS];
+    int n = par_threads(len);
+    size_t start = 0;
+    int rc = 0;
+
+    for (int i = 0; i < n; i++) {
+        size_t end = i == n - 1 ? len : len / n * (i + 1);
+
+        if (end < start)
+            end = start;
+        while (end < len && !kern_is_delim(buf[end - 1]))
+            end++;
+        jobs[i].buf = buf + start;
+        jobs[i].len = end - start;
+        jobs[i].ft = i == 0 ? ft : freq_open();
+        start = end;
+    }
+
+    for (int i = 1; i < n; i++) {
+        started[i] = pthread_create(&threads[i], NULL, run_freq, &jobs[i]) == 0;
+        if (!started[i])
+            run_freq(&jobs[i]);
+    }
+    run_freq(&jobs[0]);
+    for (int i = 1; i < n; i++) {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (jobs[i].rc != 0 || (i > 0 && freq_merge(ft, jobs[i].ft) != 0))
+            rc = -1;
+        if (i > 0)
+            freq_close(jobs[i].ft);
+    }
+    if (rc != 0)
+        errno = ENOMEM;
+    return rc;
+}
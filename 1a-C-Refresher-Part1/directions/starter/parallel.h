@@ -0,0 +1,26 @@
+#ifndef __PARALLEL_H__
+    #define __PARALLEL_H__
+
+#include <stddef.h>
+
+#include "kernels.h"
+#include "freq.h"
+
+//Splitting a mapped input over threads.  Each thread takes one contiguous
+//range, and a range can start in the middle of a word, so whatever a
+//thread works out about the edges of its range is stitched together after
+//the join to give exactly the single threaded answer.
+//
+//Small inputs stay on one thread, no thread gets less than PAR_MIN_BYTES.
+#define PAR_MIN_BYTES   (4 << 20)
+#define PAR_MAX_THREADS 64
+
+//set to a number of threads to use instead of one per online CPU
+#define PAR_ENV         "STRINGFUN_THREADS"
+
+int par_threads(size_t len);
+size_t par_count_words(const char *buf, size_t len);
+void par_stats(const char *buf, size_t len, kern_stats_t *st);
+int par_word_freq(freq_t *ft, const char *buf, size_t len);
+
+#endif
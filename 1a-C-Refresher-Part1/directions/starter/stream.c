@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "stream.h"
+
+static int open_input(const char *path) {
+    if (strcmp(path, STREAM_STDIN) == 0)
+        return STDIN_FILENO;
+    return open(path, O_RDONLY);
+}
+
+static void close_input(int fd) {
+    if (fd != STDIN_FILENO)
+        close(fd);
+}
+
+//read() until len bytes or the end of the input, a pipe hands data over in
+//whatever pieces it has
+static ssize_t read_full(int fd, char *buf, size_t len) {
+    size_t got = 0;
+
+    while (got < len) {
+        ssize_t n = read(fd, buf + got, len - got);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return -1;
+        if (n == 0)
+            break;
+        got += n;
+    }
+    return got;
+}
+
+static ssize_t pread_full(int fd, char *buf, size_t len, off_t off) {
+    size_t got = 0;
+
+    while (got < len) {
+        ssize_t n = pread(fd, buf + got, len - got, off + got);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return -1;
+        if (n == 0)
+            break;
+        got += n;
+    }
+    return got;
+}
+
+//Call fn for each chunk of the input, first to last.
+int stream_read(const char *path, stream_fn fn, void *arg) {
+    char *buf = malloc(STREAM_CHUNK);
+    int fd = open_input(path);
+    int rc = 0;
+
+    if (buf == NULL || fd < 0) {
+        free(buf);
+        if (fd >= 0)
+            close_input(fd);
+        return -1;
+    }
+    while (rc == 0) {
+        ssize_t n = read_full(fd, buf, STREAM_CHUNK);
+        if (n < 0)
+            rc = -1;
+        else if (n == 0)
+            break;
+        else
+            rc = fn(buf, n, arg);
+    }
+    close_input(fd);
+    free(buf);
+    return rc;
+}
+
+//Copy a pipe into an unnamed temp file so it can be read backwards.  This
+//costs disk rather than memory.
+static int spool(int fd, char *buf, off_t *size) {
+    FILE *tmp = tmpfile();
+    int tmp_fd;
+    ssize_t n;
+
+    if (tmp == NULL)
+        return -1;
+    //the FILE is only a way to get a file that is already unlinked
+    tmp_fd = dup(fileno(tmp));
+    fclose(tmp);
+    if (tmp_fd < 0)
+        return -1;
+
+    *size = 0;
+    while ((n = read_full(fd, buf, STREAM_CHUNK)) > 0) {
+        if (write(tmp_fd, buf, n) != n) {
+            close(tmp_fd);
+            return -1;
+        }
+        *size += n;
+    }
+    if (n < 0) {
+        close(tmp_fd);
+        return -1;
+    }
+    return tmp_fd;
+}
+
+//Call fn for each chunk of the input, last to first.  The bytes within a
+//chunk are in file order.  A regular file is read with pread() from the
+//end, anything else is spooled first.  When cut is given, every chunk but
+//the first in the file starts where it says, e.g. so that no character is
+//split over two chunks.
+int stream_read_back(const char *path, stream_cut_fn cut, stream_fn fn, void *arg) {
+    char *buf = malloc(STREAM_CHUNK);
+    int fd = open_input(path);
+    struct stat st;
+    off_t off;
+    int rc = 0;
+
+    if (buf == NULL || fd < 0) {
+        free(buf);
+        if (fd >= 0)
+            close_input(fd);
+        return -1;
+    }
+
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        off = st.st_size;
+    } else {
+        int tmp_fd = spool(fd, buf, &off);
+        close_input(fd);
+        fd = tmp_fd;
+        if (fd < 0) {
+            free(buf);
+            return -1;
+        }
+    }
+
+    while (rc == 0 && off > 0) {
+        size_t len = off < STREAM_CHUNK ? (size_t)off : STREAM_CHUNK;
+        ssize_t n;
+
+        off -= len;
+        n = pread_full(fd, buf, len, off);
+        if (n < 0) {
+            rc = -1;
+        } else if ((size_t)n != len) {
+            //the file shrank under us
+            errno = EIO;
+            rc = -1;
+        } else {
+            size_t skip = cut != NULL && off > 0 ? cut(buf, len) : 0;
+
+            rc = fn(buf + skip, len - skip, arg);
+            off += skip;
+        }
+    }
+    close_input(fd);
+    free(buf);
+    return rc;
+}
+
+int stream_map(const char *path, const char **map, size_t *len) {
+    int fd = open_input(path);
+    struct stat st;
+    void *p = MAP_FAILED;
+
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+        p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close_input(fd);
+    if (p == MAP_FAILED)
+        return -1;
+
+    //every byte is read once, front to back in each thread's range
+    madvise(p, st.st_size, MADV_SEQUENTIAL);
+    *map = p;
+    *len = st.st_size;
+    return 0;
+}
+
+void stream_unmap(const char *map, size_t len) {
+    munmap((void *)map, len);
+}
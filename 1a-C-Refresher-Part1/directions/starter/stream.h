@@ -0,0 +1,35 @@
+#ifndef __STREAM_H__
+    #define __STREAM_H__
+
+#include <stddef.h>
+
+//Input that is too big for argv.  A path of STREAM_STDIN reads standard
+//input.  The input is read STREAM_CHUNK bytes at a time into one buffer,
+//so memory use does not grow with the input, and each chunk is handed to
+//a callback.  A chunk can end in the middle of a word, so callbacks keep
+//whatever state they need from one chunk to the next.
+#define STREAM_STDIN    "-"
+#define STREAM_CHUNK    (1 << 20)
+
+//called for each chunk, len is never 0.  Return 0 to keep going, any
+//other value stops the read and is returned to the caller.
+typedef int (*stream_fn)(char *buf, size_t len, void *arg);
+
+//Where a chunk read backwards may start: the bytes before the offset it
+//returns are left for the next chunk.  0 keeps the whole chunk.  Must be
+//less than len.
+typedef size_t (*stream_cut_fn)(const char *buf, size_t len);
+
+//0 when the whole input was read, -1 with errno set on a read error.  cut
+//may be NULL.
+int stream_read(const char *path, stream_fn fn, void *arg);
+int stream_read_back(const char *path, stream_cut_fn cut, stream_fn fn, void *arg);
+
+//A whole regular file mapped read only, for the operations that split it
+//over threads.  The page cache holds the data, so this does not grow the
+//heap either.  -1 when the input is not a non empty regular file or the
+//map fails, the caller then reads it with stream_read() instead.
+int stream_map(const char *path, const char **map, size_t *len);
+void stream_unmap(const char *map, size_t len);
+
+#endif
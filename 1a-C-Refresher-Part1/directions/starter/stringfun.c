@@ -2,9 +2,15 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
-
-#define SPACE_CHAR ' '
+#include "kernels.h"    //SPACE_CHAR and the vector kernels
+#include "stream.h"     //files and stdin, a chunk at a time
+#include "parallel.h"   //big files split over threads
+#include "outbuf.h"     //one write for many lines of output
+#include "freq.h"       //word frequencies
 
 //prototypes for functions to handle required functionality
 
@@ -14,12 +20,40 @@
 void  usage(char *);
 int   count_words(char *);
 void  reverse_string(char *);
+void  reverse_utf8(char *);
 void  word_print(char *);
+void  word_freq(char *);
+int   freq_print(freq_t *);
+int   process_inputs(char, char **, int);
+bool  streams(char);
+
+//word_print() state that carries over from one chunk of input to the next
+typedef struct word_printer{
+    size_t    wc;           //words so far
+    size_t    wlen;         //length of the current word
+    bool      word_start;   //in a word
+    outbuf_t *out;          //where the lines go
+} word_printer_t;
+
+void  word_print_chunk(word_printer_t *, const char *, size_t);
+void  word_print_end(word_printer_t *);
+int   set_delims(const char *);
+void  all_stats(char *);
+int   stats_width(char **, int);
+void  stats_print(const kern_stats_t *, int, const char *);
 
 
 void usage(char *exename){
-    printf("usage: %s [-h|c|r|w] \"string\" \n", exename);
+    printf("usage: %s [-h|c|r|u|w|f] \"string\" \n", exename);
     printf("\texample: %s -w \"hello class\" \n", exename);
+    printf("\t-u reverses like -r but keeps UTF-8 characters whole\n");
+    printf("\t-f prints the %d most frequent words, %s sets how many\n", FREQ_TOP, FREQ_ENV);
+    printf("\t-a prints lines, words, bytes and the longest word, as wc -lwcL does\n");
+    printf("   or: %s [-c|r|u|w|f|a] %s | -- file... \n", exename, STREAM_STDIN);
+    printf("\treads standard input, or the files after --, of any size\n");
+    printf("   -d delims after the option splits words at any of those bytes instead\n");
+    printf("\tof a space, \\t \\n \\r \\v \\f \\\\ escape, whitespace means all six\n");
+    printf("\tand is what -a uses without -d\n");
 }
 
 //count_words algorithm
@@ -40,25 +74,12 @@ void usage(char *exename){
 //                     there is nothing more to do
 //  3.  The current word count for the input string is in the wc variable
 //      so just 'return wc;' 
+//
+//  The loop lives on as kern_count_words_scalar() in kernels.c, the
+//  reference the vector kernels there are checked against.  count_words()
+//  uses whichever kernel is fastest on this CPU.
 int count_words(char *str) {
-    int len = strlen(str);  // Get the length of the string
-    int wc = 0;            // Initialize word count to 0
-    bool word_start = false; // Track if we are at the start of a word
-    
-    for (int i = 0; i < len; i++) {
-        if (!word_start) {
-            if (str[i] != SPACE_CHAR) { // If it's not a space, it's the start of a word
-                wc++;
-                word_start = true;
-            }
-        } else {
-            if (str[i] == SPACE_CHAR) { // If it's a space, the word ends
-                word_start = false;
-            }
-        }
-    }
-    
-    return wc;  // Return the word count and rhe function ends here 
+    return (int)kern_count_words(str, strlen(str), false);
 }
 
 //reverse_string() algorithm
@@ -76,26 +97,19 @@ int count_words(char *str) {
 //      2c. decrement end_indx by 1
 //
 //  3. When the loop above terminates, the string should be reversed in place
+//
+//  The loop lives on as kern_reverse_scalar() in kernels.c.  The vector
+//  kernels there swap 16 or 32 byte blocks, reversed with a shuffle, from
+//  both ends.
 void reverse_string(char *str) {
-    // Initialize variables
-    int end_idx = strlen(str) - 1;    // Length - 1 
-    int start_idx = 0;                // Start from first character
-    char tmp_char;                    // For swapping characters
-    
-    // Loop while end_idx > start_idx
-    while (end_idx > start_idx) {
-        // Swap characters
-        tmp_char = str[start_idx];
-        str[start_idx] = str[end_idx];
-        str[end_idx] = tmp_char;
-        
-        // Increment start_idx
-        start_idx++;
-        
-        //  Decrement end_idx
-        end_idx--;
-    }
-    // No return needed since it's void and modifies string in place
+    kern_reverse(str, strlen(str));
+}
+
+//Swapping bytes turns any character that is more than one byte, "é" or
+//"😀", into garbage.  This reverses by character instead, see
+//kern_reverse_utf8().
+void reverse_utf8(char *str) {
+    kern_reverse_utf8(str, strlen(str));
 }
 
 //word_print() - algorithm
@@ -133,45 +147,376 @@ void reverse_string(char *str) {
 // 2. programming (11)
 // 3. is (2)
 // 4. fun (3)
+//
+// The loop is split so it can also run over a file a chunk at a time: the
+// state that used to be local lives in a word_printer_t, word_print_chunk()
+// runs the loop over one chunk and word_print_end() finishes a word that
+// runs to the end of the input.
+//
+// Printing a character at a time with printf("%c") cost far more than
+// finding the words, so the lines are built in an outbuf_t instead: the
+// characters of a word go in with one memcpy up to the next space (found
+// with memchr), the numbers with outbuf_uint(), and the lot goes out with
+// one write().  The output is byte for byte what the printf version gave.
 void word_print(char *str) {
-    // Initialize variables as suggested
-    int len = strlen(str);
-    int last_char_idx = strlen(str) - 1;
-    int wc = 0;              // Word count
-    int wlen = 0;           // Length of current word
-    bool word_start = false; // Track if we're at start of word
-    
-    // Loop through each character
-    for (int i = 0; i <= last_char_idx; i++) {
-        if (!word_start) {
-            if (str[i] != SPACE_CHAR) {
-                // Found start of new word
-                word_start = true;
-                wc++;
-                wlen = 1;
-                printf("Word %d:", wc);
-                printf("%c", str[i]);
+    word_printer_t wp = {0};
+
+    if ((wp.out = outbuf_open(STDOUT_FILENO)) == NULL) {
+        printf("Out of memory, exiting!\n");
+        exit(1);
+    }
+    word_print_chunk(&wp, str, strlen(str));
+    word_print_end(&wp);
+    if (outbuf_close(wp.out) != 0) {
+        fprintf(stderr, "Cant write the output, %s\n", strerror(errno));
+        exit(1);
+    }
+}
+
+static void end_word(word_printer_t *wp) {
+    outbuf_write(wp->out, " (length=", 9);
+    outbuf_uint(wp->out, wp->wlen);
+    outbuf_write(wp->out, ")\n", 2);
+    wp->word_start = false;
+}
+
+void word_print_chunk(word_printer_t *wp, const char *buf, size_t len) {
+    size_t i = 0;
+
+    while (i < len) {
+        size_t n;
+
+        if (!wp->word_start) {
+            // Skip to the start of the next word
+            while (i < len && kern_is_delim(buf[i]))
+                i++;
+            if (i == len)
+                break;
+            wp->word_start = true;
+            wp->wc++;
+            wp->wlen = 0;
+            outbuf_write(wp->out, "Word ", 5);
+            outbuf_uint(wp->out, wp->wc);
+            outbuf_write(wp->out, ":", 1);
+        }
+
+        // The rest of the word in this chunk goes out in one piece, a
+        // word with no delimiter after it carries on in the next chunk
+        n = kern_find_delim(buf + i, len - i);
+        outbuf_write(wp->out, buf + i, n);
+        wp->wlen += n;
+        i += n;
+        if (i < len) {
+            end_word(wp);
+            i++;
+        }
+    }
+}
+
+void word_print_end(word_printer_t *wp) {
+    // Handle the last word if string doesn't end with space
+    if (wp->word_start)
+        end_word(wp);
+}
+
+//The argument of -d: "whitespace", or the delimiter bytes themselves with
+//C escapes for the ones a shell makes hard to type.  The words of every
+//operation are split at these instead of at SPACE_CHAR.  Returns -1 for
+//an empty set.
+int set_delims(const char *arg) {
+    char set[256];
+    size_t n = 0;
+
+    if (strcmp(arg, "whitespace") == 0)
+        return kern_set_delims(KERN_WHITESPACE, strlen(KERN_WHITESPACE));
+
+    for (const char *p = arg; *p != '\0' && n < sizeof(set); p++) {
+        if (*p != '\\' || p[1] == '\0') {
+            set[n++] = *p;
+            continue;
+        }
+        //an escape that is not one of these is the character itself
+        switch (*++p) {
+        case 't': set[n++] = '\t'; break;
+        case 'n': set[n++] = '\n'; break;
+        case 'r': set[n++] = '\r'; break;
+        case 'v': set[n++] = '\v'; break;
+        case 'f': set[n++] = '\f'; break;
+        default:  set[n++] = *p;
+        }
+    }
+    return kern_set_delims(set, n);
+}
+
+//Word frequencies, the words as count_words() finds them.  They go in a
+//freq_t, see freq.h, and the top freq_top_n() come out in the format of
+//uniq -c, most frequent first.
+void word_freq(char *str) {
+    freq_t *ft = freq_open();
+
+    if (ft == NULL || freq_chunk(ft, str, strlen(str)) != 0 || freq_end(ft) != 0) {
+        printf("Out of memory, exiting!\n");
+        exit(1);
+    }
+    if (freq_print(ft) != 0)
+        exit(1);
+    freq_close(ft);
+}
+
+//The header and the lines, returns 0 or -1 after printing why
+int freq_print(freq_t *ft) {
+    static const char pad[] = "      ";
+    const freq_entry_t **top;
+    outbuf_t *out;
+    size_t n;
+
+    printf("Word Frequency\n--------------\n");
+    if ((top = freq_top(ft, freq_top_n(), &n)) == NULL || (out = outbuf_open(STDOUT_FILENO)) == NULL) {
+        free(top);
+        fprintf(stderr, "Out of memory, exiting!\n");
+        return -1;
+    }
+    for (size_t i = 0; i < n; i++) {
+        size_t digits = 1;
+
+        //right aligned in 7 columns
+        for (size_t v = top[i]->count; v >= 10; v /= 10)
+            digits++;
+        if (digits < 7)
+            outbuf_write(out, pad, 7 - digits);
+        outbuf_uint(out, top[i]->count);
+        outbuf_write(out, " ", 1);
+        outbuf_write(out, top[i]->word, top[i]->len);
+        outbuf_write(out, "\n", 1);
+    }
+    free(top);
+    if (outbuf_close(out) != 0) {
+        fprintf(stderr, "Cant write the output, %s\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+//-a: every count in one pass over the input, printed the way wc prints
+//them, so this can stand in for wc.  The columns are those of wc -lwcL
+//except that the last is the longest word rather than the longest line.
+void all_stats(char *str) {
+    kern_stats_t st = {0};
+    size_t len = strlen(str);
+    int width = 1;
+
+    kern_stats(str, len, false, &st);
+    for (; len >= 10; len /= 10)
+        width++;
+    stats_print(&st, width, NULL);
+}
+
+//wc's column width: enough for the total size of the inputs, and at least
+//7 when one of them is not a regular file and has no size up front
+int stats_width(char **paths, int n_paths) {
+    size_t total = 0;
+    int width = 1;
+    int min = 1;
+
+    for (int i = 0; i < n_paths; i++) {
+        struct stat sb;
+        int rc = strcmp(paths[i], STREAM_STDIN) == 0 ? fstat(STDIN_FILENO, &sb) : stat(paths[i], &sb);
+
+        if (rc == 0 && S_ISREG(sb.st_mode))
+            total += sb.st_size;
+        else
+            min = 7;
+    }
+    for (; total >= 10; total /= 10)
+        width++;
+    return width > min ? width : min;
+}
+
+//the word st ends in counts too
+void stats_print(const kern_stats_t *st, int width, const char *name) {
+    size_t longest = st->run > st->longest ? st->run : st->longest;
+
+    printf("%*zu %*zu %*zu %*zu", width, st->lines, width, st->words, width, st->bytes, width, longest);
+    if (name != NULL)
+        printf(" %s", name);
+    printf("\n");
+}
+
+//stream callbacks for process_inputs()
+typedef struct count_state{
+    size_t wc;
+    bool   in_word;     //the last byte of the previous chunk was in a word
+} count_state_t;
+
+static int count_chunk(char *buf, size_t len, void *arg) {
+    count_state_t *cs = arg;
+
+    cs->wc += kern_count_words(buf, len, cs->in_word);
+    cs->in_word = !kern_is_delim(buf[len - 1]);
+    return 0;
+}
+
+//chunks come last to first, so reversing each one reverses the input
+static int reverse_chunk(char *buf, size_t len, void *arg) {
+    (void)arg;
+    kern_reverse(buf, len);
+    return fwrite(buf, 1, len, stdout) == len ? 0 : -1;
+}
+
+//The same again within a chunk for -u: pieces of it, last to first and
+//cut between characters, so each piece is still in cache when its
+//characters are put back in order
+#define UTF8_PIECE  (64 << 10)
+
+static int reverse_utf8_chunk(char *buf, size_t len, void *arg) {
+    size_t end = len;
+
+    (void)arg;
+    while (end > 0) {
+        size_t start = end > UTF8_PIECE ? end - UTF8_PIECE : 0;
+
+        if (start > 0)
+            start += kern_utf8_cut(buf + start, end - start);
+        kern_reverse_utf8(buf + start, end - start);
+        if (fwrite(buf + start, 1, end - start, stdout) != end - start)
+            return -1;
+        end = start;
+    }
+    return 0;
+}
+
+static int print_chunk(char *buf, size_t len, void *arg) {
+    word_print_chunk(arg, buf, len);
+    return 0;
+}
+
+static int freq_chunk_cb(char *buf, size_t len, void *arg) {
+    return freq_chunk(arg, buf, len);
+}
+
+//run is exact here, the chunks come in order
+static int stats_chunk(char *buf, size_t len, void *arg) {
+    kern_stats_t *st = arg;
+
+    kern_stats(buf, len, st->run > 0, st);
+    return 0;
+}
+
+//The -c, -r, -u, -w, -f and -a operations over files or stdin rather than argv[2].
+//Memory use does not depend on the input size, see stream.h.  Each input
+//is on its own: a word never runs from one file into the next.  Returns
+//the exit code.
+int process_inputs(char opt, char **paths, int n_paths) {
+    count_state_t cs = {0};
+    word_printer_t wp = {0};
+    freq_t *ft = NULL;
+    kern_stats_t st, total = {0};
+    int width = opt == 'a' ? stats_width(paths, n_paths) : 0;
+    const char *map;
+    size_t map_len;
+    int rc = 0;
+
+    if (opt == 'w') {
+        printf("Word Print\n----------\n");
+        if ((wp.out = outbuf_open(STDOUT_FILENO)) == NULL) {
+            fprintf(stderr, "Out of memory, exiting!\n");
+            return 1;
+        }
+    }
+    if (opt == 'f' && (ft = freq_open()) == NULL) {
+        fprintf(stderr, "Out of memory, exiting!\n");
+        return 1;
+    }
+
+    for (int i = 0; i < n_paths && rc == 0; i++) {
+        switch (opt) {
+        case 'c':
+            //a file that can be mapped is counted on every core
+            if (stream_map(paths[i], &map, &map_len) == 0) {
+                cs.wc += par_count_words(map, map_len);
+                stream_unmap(map, map_len);
+                break;
             }
-        } else {
-            if (str[i] == SPACE_CHAR) {
-                // Word has ended
-                word_start = false;
-                printf(" (length=%d)\n", wlen);
+            cs.in_word = false;
+            rc = stream_read(paths[i], count_chunk, &cs);
+            break;
+        case 'r':
+            printf("Reversed string: ");
+            rc = stream_read_back(paths[i], NULL, reverse_chunk, NULL);
+            printf("\n");
+            break;
+        case 'u':
+            printf("Reversed string: ");
+            rc = stream_read_back(paths[i], kern_utf8_cut, reverse_utf8_chunk, NULL);
+            printf("\n");
+            break;
+        case 'w':
+            rc = stream_read(paths[i], print_chunk, &wp);
+            word_print_end(&wp);
+            break;
+        case 'f':
+            //one table for all the inputs, built on every core for a
+            //file that can be mapped
+            if (stream_map(paths[i], &map, &map_len) == 0) {
+                rc = par_word_freq(ft, map, map_len);
+                stream_unmap(map, map_len);
+                break;
+            }
+            rc = stream_read(paths[i], freq_chunk_cb, ft);
+            if (rc == 0)
+                rc = freq_end(ft);
+            break;
+        case 'a':
+            //a line for each input, as wc gives
+            st = (kern_stats_t){0};
+            if (stream_map(paths[i], &map, &map_len) == 0) {
+                par_stats(map, map_len, &st);
+                stream_unmap(map, map_len);
             } else {
-                // Still in word, print character and increment length
-                printf("%c", str[i]);
-                wlen++;
+                rc = stream_read(paths[i], stats_chunk, &st);
             }
+            if (rc != 0)
+                break;
+            if (st.run > st.longest)
+                st.longest = st.run;
+            stats_print(&st, width, paths[i]);
+            total.lines += st.lines;
+            total.words += st.words;
+            total.bytes += st.bytes;
+            if (st.longest > total.longest)
+                total.longest = st.longest;
+            break;
         }
+        if (rc != 0)
+            fprintf(stderr, "Cant read %s, %s\n", paths[i], strerror(errno));
     }
-    
-    // Handle the last word if string doesn't end with space
-    if (word_start) {
-        printf(" (length=%d)\n", wlen);
+
+    if (rc == 0 && opt == 'c')
+        printf("Word Count: %zu\n", cs.wc);
+    if (rc == 0 && opt == 'f')
+        rc = freq_print(ft);
+    if (rc == 0 && opt == 'a' && n_paths > 1)
+        stats_print(&total, width, "total");
+    freq_close(ft);
+    if (wp.out != NULL && outbuf_close(wp.out) != 0 && rc == 0) {
+        fprintf(stderr, "Cant write the output, %s\n", strerror(errno));
+        rc = -1;
+    }
+    if (fflush(stdout) != 0 && rc == 0) {
+        fprintf(stderr, "Cant write the output, %s\n", strerror(errno));
+        rc = -1;
     }
+    return rc == 0 ? 0 : 1;
+}
+
+//the options process_inputs() handles
+bool streams(char opt) {
+    return opt == 'c' || opt == 'r' || opt == 'u' || opt == 'w' || opt == 'f' || opt == 'a';
 }
 
 
+//bench.c brings its own main() and borrows the rest of this file
+#ifndef STRINGFUN_NO_MAIN
 int main(int argc, char *argv[]){
     char *input_string;     //holds the string provided by the user on cmd line
     char *opt_string;       //holds the option string in argv[1]
@@ -199,6 +544,28 @@ int main(int argc, char *argv[]){
         exit(0);
     }
 
+    //-d goes before the input, the rest of the arguments move up.  -a
+    //splits words where wc does unless told otherwise.
+    if (opt == 'a')
+        set_delims("whitespace");
+    if (argc > 3 && strcmp(argv[2], "-d") == 0){
+        if (set_delims(argv[3]) != 0){
+            usage(argv[0]);
+            exit(1);
+        }
+        for (int i = 4; i <= argc; i++)
+            argv[i - 2] = argv[i];
+        argc -= 2;
+    }
+
+    //Big inputs come from stdin or from the files after "--" instead
+    if (argc == 3 && strcmp(argv[2], STREAM_STDIN) == 0 && streams(opt)){
+        exit(process_inputs(opt, argv + 2, 1));
+    }
+    if (argc > 3 && strcmp(argv[2], "--") == 0 && streams(opt)){
+        exit(process_inputs(opt, argv + 3, argc - 3));
+    }
+
     //Finally the input string must be in argv[2]
     if (argc != 3){
         usage(argv[0]);
@@ -232,6 +599,10 @@ int main(int argc, char *argv[]){
 // memory locations directly, so when we finish swapping all pairs of characters,
 // the original string has been modified to contain its reverse.
             break;
+        case 'u':
+            reverse_utf8(input_string);
+            printf("Reversed string: %s\n", input_string);
+            break;
         case 'w':
             printf("Word Print\n----------\n");
             word_print(input_string);
@@ -239,6 +610,12 @@ int main(int argc, char *argv[]){
             //TODO: #5. Call word_print, output should be
             //          printed by that function
             break;
+        case 'f':
+            word_freq(input_string);
+            break;
+        case 'a':
+            all_stats(input_string);
+            break;
 
         //TODO: #6. What is the purpose of the default option here?
         //          Please describe replacing this TODO comment with
@@ -257,4 +634,4 @@ int main(int argc, char *argv[]){
 // into subsequent cases. Without breaks, matching a case would cause all following
 // cases to execute unintentionally. Default doesn't need break as it's the last case.
 }
-
+#endif
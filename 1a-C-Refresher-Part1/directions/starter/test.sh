@@ -0,0 +1,294 @@
+#!/usr/bin/env bats
+
+# Inputs are made in a temporary directory per test, the big ones are sized
+# against STREAM_CHUNK (1M, stream.h) and PAR_MIN_BYTES (4M a thread)
+CHUNK=1048576
+
+# $1 bytes of the byte $2, e.g. pad 10 a
+pad() {
+    head -c "$1" /dev/zero | tr '\0' "$2"
+}
+
+# -u on a 2M input where the bytes of $2 (a printf format) are cut by the
+# chunk boundary $3 bytes in.  Read from a file, from stdin and from a pipe,
+# the character must come out whole and everything around it reversed.
+reverse_across_chunks() {
+    local dir=$1 n
+
+    printf "$2" > "$dir/char"
+    n=$(wc -c < "$dir/char")
+    { pad $((CHUNK - $3)) a; cat "$dir/char"; pad $((CHUNK + $3 - n)) b; } > "$dir/in"
+    { printf 'Reversed string: '; pad $((CHUNK + $3 - n)) b; cat "$dir/char"
+      pad $((CHUNK - $3)) a; printf '\n'; } > "$dir/want"
+
+    ./stringfun -u -- "$dir/in" | cmp - "$dir/want" &&
+    ./stringfun -u - < "$dir/in" | cmp - "$dir/want" &&
+    cat "$dir/in" | ./stringfun -u - | cmp - "$dir/want"
+}
+
+@test "Count, reverse and print the words of a string" {
+    run ./stringfun -c "hello there class"
+    [ "$status" -eq 0 ]
+    [ "$output" = "Word Count: 3" ]
+
+    run ./stringfun -r "hello there"
+    [ "$status" -eq 0 ]
+    [ "$output" = "Reversed string: ereht olleh" ]
+
+    run ./stringfun -w "hi class"
+    [ "$status" -eq 0 ]
+    [ "${lines[2]}" = "Word 1:hi (length=2)" ]
+    [ "${lines[3]}" = "Word 2:class (length=5)" ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+}
+
+@test "Bad delimiters and missing files are errors" {
+    run ./stringfun -c -d '' "a b"
+    [ "$status" -eq 1 ]
+
+    run ./stringfun -c -- no-such-file
+    [ "$status" -eq 1 ]
+    [ "$output" = "Cant read no-such-file, No such file or directory" ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+}
+
+@test "Delimiter sets from -d" {
+    run ./stringfun -c -d whitespace $'one\ttwo\nthree  four\r\nfive\v\fsix'
+    [ "$status" -eq 0 ]
+    [ "$output" = "Word Count: 6" ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    run ./stringfun -c -d '\t' $'a b\tc\t\td'
+    [ "$status" -eq 0 ]
+    [ "$output" = "Word Count: 3" ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    run ./stringfun -c -d ',\n' $'a,b\nc d,,e'
+    [ "$status" -eq 0 ]
+    [ "$output" = "Word Count: 4" ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    run ./stringfun -c -d '\\' 'a\b\\c'
+    [ "$status" -eq 0 ]
+    [ "$output" = "Word Count: 3" ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+}
+
+@test "A word across the chunk boundary counts once from a file and a pipe" {
+    dir=$(mktemp -d)
+    # "straddle" starts 2 bytes before the first chunk ends
+    { pad $((CHUNK - 2)) ' '; printf 'straddle tail\n'; } > "$dir/in"
+
+    run ./stringfun -c -- "$dir/in"
+    file_output=$output
+    run ./stringfun -c - < "$dir/in"
+    stdin_output=$output
+    run bash -c "cat '$dir/in' | ./stringfun -c -"
+    pipe_output=$output
+    run bash -c "cat '$dir/in' | ./stringfun -w -"
+    rm -rf "$dir"
+
+    [ "$file_output" = "Word Count: 2" ] || {
+        echo "Failed Output:  $file_output"
+        return 1
+    }
+    [ "$stdin_output" = "Word Count: 2" ] || {
+        echo "Failed Output:  $stdin_output"
+        return 1
+    }
+    [ "$pipe_output" = "Word Count: 2" ] || {
+        echo "Failed Output:  $pipe_output"
+        return 1
+    }
+    [ "${lines[2]}" = "Word 1:straddle (length=8)" ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+}
+
+@test "Standard input and several files" {
+    dir=$(mktemp -d)
+    printf 'a b\n' > "$dir/a"
+    printf 'cc dd ee\n' > "$dir/b"
+
+    # the newline between the files is only a delimiter to whitespace
+    run ./stringfun -c -d whitespace -- "$dir/a" "$dir/b"
+    files_output=$output
+    run bash -c "cat '$dir/a' '$dir/b' | ./stringfun -c -d whitespace -"
+    pipe_output=$output
+    run ./stringfun -r - < "$dir/b"
+    rm -rf "$dir"
+
+    [ "$files_output" = "Word Count: 5" ] || {
+        echo "Failed Output:  $files_output"
+        return 1
+    }
+    [ "$pipe_output" = "Word Count: 5" ] || {
+        echo "Failed Output:  $pipe_output"
+        return 1
+    }
+    [ "${lines[0]}" = "Reversed string: " ]
+    [ "${lines[1]}" = "ee dd cc" ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+}
+
+@test "Summary matches wc -lwc" {
+    dir=$(mktemp -d)
+    printf 'one two\tthree\n\n  four  five\r\nsix\vseven\feight' > "$dir/a"
+    yes 'the quick brown fox jumps over the lazy dog' | head -c $((3 * CHUNK + 5)) > "$dir/b"
+
+    run ./stringfun -a -- "$dir/a" "$dir/b"
+    got=$(echo "$output" | awk '{ print $1, $2, $3, $NF }')
+    want=$(wc -lwc "$dir/a" "$dir/b" | awk '{ print $1, $2, $3, $NF }')
+    run bash -c "cat '$dir/b' | ./stringfun -a -"
+    pipe_got=$(echo "$output" | awk '{ print $1, $2, $3 }')
+    pipe_want=$(wc -lwc < "$dir/b" | awk '{ print $1, $2, $3 }')
+    rm -rf "$dir"
+
+    [ "$got" = "$want" ] || {
+        echo "Failed Output:  $got"
+        echo "Expected:  $want"
+        return 1
+    }
+    [ "$pipe_got" = "$pipe_want" ] || {
+        echo "Failed Output:  $pipe_got"
+        echo "Expected:  $pipe_want"
+        return 1
+    }
+}
+
+@test "Word frequency matches sort | uniq -c" {
+    dir=$(mktemp -d)
+    for i in $(seq 1 40); do
+        printf 'w%d ' $((i % 7)) $((i % 13)) $((i * i % 11))
+        printf '\n'
+    done > "$dir/in"
+    export LC_ALL=C
+    { printf 'Word Frequency\n--------------\n'
+      tr -s ' \n' '\n\n' < "$dir/in" | grep -v '^$' | sort | uniq -c |
+          sort -k1,1nr -k2,2 | head -10; } > "$dir/want"
+    { printf 'Word Frequency\n--------------\n'
+      tr -s ' \n' '\n\n' < "$dir/in" | grep -v '^$' | sort | uniq -c |
+          sort -k1,1nr -k2,2; } > "$dir/want_all"
+
+    run ./stringfun -f -d whitespace -- "$dir/in"
+    top_ok=$(echo "$output" | cmp -s - "$dir/want" && echo yes || echo "$output")
+    run bash -c "STRINGFUN_TOP=100 ./stringfun -f -d whitespace - < '$dir/in'"
+    all_ok=$(echo "$output" | cmp -s - "$dir/want_all" && echo yes || echo "$output")
+    rm -rf "$dir"
+
+    [ "$top_ok" = "yes" ] || {
+        echo "Failed Output:  $top_ok"
+        return 1
+    }
+    [ "$all_ok" = "yes" ] || {
+        echo "Failed Output:  $all_ok"
+        return 1
+    }
+}
+
+@test "One thread and three give the same totals" {
+    dir=$(mktemp -d)
+    # 3 threads need 12M
+    yes 'alpha beta gamma delta alpha beta alpha' | tr '\n' ' ' | head -c $((13 * CHUNK + 3)) > "$dir/in"
+    printf 'x\n\ty' >> "$dir/in"
+    words=$(wc -w < "$dir/in")
+
+    for opt in -c -a -f; do
+        STRINGFUN_THREADS=1 ./stringfun $opt -- "$dir/in" > "$dir/one$opt"
+        STRINGFUN_THREADS=3 ./stringfun $opt -- "$dir/in" > "$dir/three$opt"
+    done
+    run ./stringfun -c -d whitespace -- "$dir/in"
+    ws_output=$output
+    run bash -c "cd '$dir' && cmp one-c three-c && cmp one-a three-a && cmp one-f three-f"
+    cmp_output=$output
+    cmp_status=$status
+    run cat "$dir/three-c"
+    rm -rf "$dir"
+
+    [ "$cmp_status" -eq 0 ] || {
+        echo "Failed Output:  $cmp_output"
+        return 1
+    }
+    # "x\n\ty" is one word to a space, two to whitespace
+    [ "$output" = "Word Count: $((words - 1))" ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+    [ "$ws_output" = "Word Count: $words" ] || {
+        echo "Failed Output:  $ws_output"
+        return 1
+    }
+}
+
+@test "UTF-8 reversal keeps characters whole" {
+    run ./stringfun -u $'ae\xcc\x81b'
+    [ "$status" -eq 0 ]
+    [ "$output" = $'Reversed string: be\xcc\x81a' ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    # a family, three code points joined by zero width joiners
+    run ./stringfun -u $'x\xf0\x9f\x91\xa8\xe2\x80\x8d\xf0\x9f\x91\xa9\xe2\x80\x8d\xf0\x9f\x91\xa7y'
+    [ "$status" -eq 0 ]
+    [ "$output" = $'Reversed string: y\xf0\x9f\x91\xa8\xe2\x80\x8d\xf0\x9f\x91\xa9\xe2\x80\x8d\xf0\x9f\x91\xa7x' ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    run ./stringfun -u $'one\r\ntwo'
+    [ "$status" -eq 0 ]
+    [ "$output" = $'Reversed string: owt\r\neno' ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+}
+
+@test "UTF-8 reversal keeps characters whole across chunks" {
+    dir=$(mktemp -d)
+    status=0
+    for at in 1 2; do
+        reverse_across_chunks "$dir" 'e\xcc\x81' $at || status=1
+        reverse_across_chunks "$dir" '\r\n' $at || status=1
+    done
+    for at in 1 4 5 7 12 17; do
+        reverse_across_chunks "$dir" '\xf0\x9f\x91\xa8\xe2\x80\x8d\xf0\x9f\x91\xa9\xe2\x80\x8d\xf0\x9f\x91\xa7' $at || status=1
+    done
+    rm -rf "$dir"
+
+    [ "$status" -eq 0 ]
+}
+
+@test "UTF-8 reversal is the same at every kernel level and undoes itself" {
+    dir=$(mktemp -d)
+    yes $'h\xc3\xa9llo w\xc3\xb6rld e\xcc\x81 \xf0\x9f\x91\x8d\xf0\x9f\x8f\xbd \xf0\x9f\x91\xa8\xe2\x80\x8d\xf0\x9f\x91\xa9 \xe2\x9c\x8c\xef\xb8\x8f ok\r' |
+        head -n 60000 > "$dir/in"
+    # drop the "Reversed string: " before it and the newline after
+    ./stringfun -u -- "$dir/in" | tail -c +18 | head -c -1 > "$dir/once"
+    status=0
+    for level in scalar sse2 avx2; do
+        STRINGFUN_KERNEL=$level ./stringfun -u -- "$dir/in" | tail -c +18 | head -c -1 |
+            cmp -s - "$dir/once" || status=1
+        cat "$dir/in" | STRINGFUN_KERNEL=$level ./stringfun -u - | tail -c +18 | head -c -1 |
+            cmp -s - "$dir/once" || status=1
+    done
+    ./stringfun -u - < "$dir/once" | tail -c +18 | head -c -1 | cmp -s - "$dir/in" || status=2
+    rm -rf "$dir"
+
+    [ "$status" -eq 0 ]
+}
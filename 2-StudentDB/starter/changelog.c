@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "db.h"
+#include "libsdb.h"
+#include "sdb_internal.h"
+#include "changelog.h"
+#include "stats.h"
+
+#define CHANGELOG_MODE  (S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP)
+
+//Open (or start) the change log of the database at db_path.  A handle
+//without a log (log_fd == -1) simply records nothing, sdb_shard() uses
+//that while it moves records between files.
+int changelog_open(sdb_t *db, const char *db_path) {
+    changelog_hdr_t hdr = { CHANGELOG_MAGIC, CHANGELOG_VERSION, sizeof(changelog_rec_t), 0 };
+    changelog_hdr_t found;
+    size_t len = strlen(db_path) + sizeof(CHANGELOG_SUFFIX);
+    char *path = malloc(len);
+    struct stat st;
+    int fd;
+
+    if (path == NULL)
+        return ERR_DB_MEMORY;
+    snprintf(path, len, "%s%s", db_path, CHANGELOG_SUFFIX);
+    fd = open(path, O_RDWR | O_CREAT | O_APPEND, CHANGELOG_MODE);
+    free(path);
+    if (fd == -1)
+        return ERR_DB_FILE;
+
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return ERR_DB_FILE;
+    }
+    if (st.st_size == 0) {
+        if (sdb_write(fd, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+            close(fd);
+            return ERR_DB_FILE;
+        }
+    } else if (sdb_pread(fd, &found, sizeof(found), 0) != sizeof(found) ||
+               found.magic != hdr.magic || found.version != hdr.version ||
+               found.rec_size != hdr.rec_size) {
+        close(fd);
+        return ERR_DB_FILE;
+    }
+
+    pthread_mutex_init(&db->log_lock, NULL);
+    db->log_fd = fd;
+    return NO_ERROR;
+}
+
+void changelog_close(sdb_t *db) {
+    if (db->log_fd == -1)
+        return;
+    close(db->log_fd);
+    pthread_mutex_destroy(&db->log_lock);
+    db->log_fd = -1;
+}
+
+//Called with the changed shard's lock held, so the log order of the changes
+//to one id is the order they were applied in.  O_APPEND keeps appends from
+//several processes whole.
+int changelog_append(sdb_t *db, int op, const student_t *s) {
+    return changelog_append_many(db, op, s, 1);
+}
+
+//n changes of the same kind, CHANGELOG_BLOCK to a write.  All or nothing:
+//a failed append is cut off again, the caller undoes changes it could not
+//log and the log must not keep any of them.
+int changelog_append_many(sdb_t *db, int op, const student_t *s, int n) {
+    changelog_rec_t block[CHANGELOG_BLOCK];
+    int rc = NO_ERROR;
+    off_t start;
+
+    if (db->log_fd == -1)
+        return NO_ERROR;
+
+    pthread_mutex_lock(&db->log_lock);
+    start = lseek(db->log_fd, 0, SEEK_END);
+    for (int done = 0; done < n && rc == NO_ERROR; ) {
+        int count = n - done < CHANGELOG_BLOCK ? n - done : CHANGELOG_BLOCK;
+        size_t len = count * sizeof(changelog_rec_t);
+
+        memset(block, 0, len);
+        for (int i = 0; i < count; i++) {
+            block[i].op = op;
+            if (op == SDB_CHANGE_ADD || op == SDB_CHANGE_UPDATE)
+                block[i].s = s[done + i];
+            else if (op == SDB_CHANGE_DEL)
+                block[i].s.id = s[done + i].id;
+        }
+
+        if (sdb_write(db->log_fd, block, len) != (ssize_t)len)
+            rc = ERR_DB_FILE;
+        done += count;
+    }
+    if (rc != NO_ERROR && start != -1 && ftruncate(db->log_fd, start) != 0)
+        rc = ERR_DB_FILE;
+    pthread_mutex_unlock(&db->log_lock);
+    return rc;
+}
+
+//Call fn for every change after since, oldest first.  Only the records
+//after since are read.
+int changelog_read(sdb_t *db, long long since, sdb_change_fn fn, void *arg) {
+    changelog_rec_t block[CHANGELOG_BLOCK];
+    long long seq = since < 0 ? 0 : since;
+    ssize_t n;
+    int rc;
+
+    if (db->log_fd == -1)
+        return NO_ERROR;
+
+    while (1) {
+        //a block is read under the lock so a half written record is never seen
+        pthread_mutex_lock(&db->log_lock);
+        n = sdb_pread(db->log_fd, block, sizeof(block),
+                  sizeof(changelog_hdr_t) + (off_t)seq * sizeof(changelog_rec_t));
+        pthread_mutex_unlock(&db->log_lock);
+        if (n < 0)
+            return ERR_DB_FILE;
+        if (n < (ssize_t)sizeof(changelog_rec_t))
+            return NO_ERROR;
+
+        for (size_t i = 0; i < (size_t)n / sizeof(changelog_rec_t); i++) {
+            if ((rc = fn(++seq, block[i].op, &block[i].s, arg)) != NO_ERROR)
+                return rc;
+        }
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef __CHANGELOG_H__
+    #define __CHANGELOG_H__
+
+#include <stdint.h>
+
+#include "db.h"     //get student record type
+#include "libsdb.h" //get the sdb_t handle
+
+//The change log lives next to the database, named after it with
+//CHANGELOG_SUFFIX on the end.  Every put, delete, update and truncate made
+//through an sdb_t appends one fixed size change record after the header,
+//so the sequence number of a change is its position in the file (the first
+//change is 1) and reading the changes after some seq is a single seek.  A
+//torn record at the end of the file (a crash mid append) is ignored.
+//
+//The log belongs to the database, not to a shard, so one log orders the
+//changes of every shard and it is left alone when a database is sharded.
+#define CHANGELOG_SUFFIX    ".log"
+#define CHANGELOG_MAGIC     0x43444353      //"SCDC"
+#define CHANGELOG_VERSION   1
+#define CHANGELOG_BLOCK     256             //records per read
+
+typedef struct changelog_hdr{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t rec_size;      //sizeof(changelog_rec_t), a cheap format check
+    uint32_t reserved;
+} changelog_hdr_t;
+
+typedef struct changelog_rec{
+    int32_t   op;           //SDB_CHANGE_ADD, _DEL, _CLEAR or _UPDATE
+    int32_t   reserved;
+    student_t s;            //the record for adds and updates, just the id
+                            //for deletes
+} changelog_rec_t;
+
+int changelog_open(sdb_t *db, const char *db_path);
+void changelog_close(sdb_t *db);
+int changelog_append(sdb_t *db, int op, const student_t *s);
+int changelog_append_many(sdb_t *db, int op, const student_t *s, int n);
+int changelog_read(sdb_t *db, long long since, sdb_change_fn fn, void *arg);
+
+#endif
@@ -0,0 +1,92 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "crc32c.h"
+
+#define CRC32C_POLY 0x82f63b78      //reflected Castagnoli polynomial
+
+typedef uint32_t (*crc32c_fn)(uint32_t crc, const unsigned char *p, size_t len);
+
+static uint32_t table[8][256];
+static crc32c_fn impl;
+static const char *impl_name;
+static pthread_once_t picked = PTHREAD_ONCE_INIT;
+
+static void init_table(void) {
+    for (int i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++)
+            c = c & 1 ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+        table[0][i] = c;
+    }
+    for (int i = 0; i < 256; i++) {
+        for (int t = 1; t < 8; t++)
+            table[t][i] = (table[t - 1][i] >> 8) ^ table[0][table[t - 1][i] & 0xff];
+    }
+}
+
+//slicing-by-8, eight table lookups per 8 bytes
+static uint32_t crc32c_table(uint32_t crc, const unsigned char *p, size_t len) {
+    crc = ~crc;
+    while (len >= 8) {
+        uint32_t lo, hi;
+        memcpy(&lo, p, 4);
+        memcpy(&hi, p + 4, 4);
+        lo ^= crc;
+        crc = table[7][lo & 0xff] ^ table[6][(lo >> 8) & 0xff] ^
+              table[5][(lo >> 16) & 0xff] ^ table[4][lo >> 24] ^
+              table[3][hi & 0xff] ^ table[2][(hi >> 8) & 0xff] ^
+              table[1][(hi >> 16) & 0xff] ^ table[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+    while (len--)
+        crc = (crc >> 8) ^ table[0][(crc ^ *p++) & 0xff];
+    return ~crc;
+}
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+
+//compiled for sse4.2 on its own, the rest of the file stays baseline x86-64
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const unsigned char *p, size_t len) {
+    uint64_t c = ~crc;
+
+    while (len >= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        c = _mm_crc32_u64(c, v);
+        p += 8;
+        len -= 8;
+    }
+    while (len--)
+        c = _mm_crc32_u8((uint32_t)c, *p++);
+    return ~(uint32_t)c;
+}
+#endif
+
+static void pick_impl(void) {
+    init_table();
+    impl = crc32c_table;
+    impl_name = "table";
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+        impl = crc32c_sse42;
+        impl_name = "sse4.2";
+    }
+#endif
+}
+
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len) {
+    pthread_once(&picked, pick_impl);
+    return impl(crc, buf, len);
+}
+
+const char *crc32c_impl(void) {
+    pthread_once(&picked, pick_impl);
+    return impl_name;
+}
@@ -0,0 +1,13 @@
+#ifndef __CRC32C_H__
+    #define __CRC32C_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+//CRC32C (Castagnoli).  Uses the SSE4.2 crc32 instruction when the cpu has
+//it and a slicing-by-8 table otherwise, picked once at the first call.
+//Start with crc 0, pass the previous result to continue over more data.
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len);
+const char *crc32c_impl(void);
+
+#endif
@@ -32,4 +32,9 @@ static const int DELETED_STUDENT_ID = 0;
 #define DB_FILE     "student.db"            //name of database file
 #define TMP_DB_FILE ".tmp_student.db"       //for extra credit
 
+//files that live next to a database are named after it, for example
+//student.db.idx for the name index and .tmp_student.db while compressing
+#define TMP_FILE_PREFIX ".tmp_"
+#define NAME_IDX_SUFFIX ".idx"                 //name index, see nameidx.h
+
 #endif
\ No newline at end of file
@@ -0,0 +1,1733 @@
+#define _GNU_SOURCE     //fallocate()
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "db.h"
+#include "libsdb.h"
+#include "sdb_internal.h"
+#include "nameidx.h"
+#include "query.h"
+#include "changelog.h"
+#include "pagecrc.h"
+#include "rows.h"
+#include "stats.h"
+
+#define SDB_FILE_MODE   (S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP)
+#define SHARD_MAP_LINE  1024
+
+//length of the directory part of path including the '/', 0 if there is none
+static size_t dir_len(const char *path) {
+    const char *slash = strrchr(path, '/');
+
+    return slash == NULL ? 0 : (size_t)(slash - path) + 1;
+}
+
+char *sdb_side_path(const char *path, const char *prefix, const char *suffix) {
+    size_t dlen = dir_len(path);
+    size_t len = strlen(path) + strlen(prefix) + strlen(suffix) + 1;
+    char *p = malloc(len);
+
+    if (p != NULL)
+        snprintf(p, len, "%.*s%s%s%s", (int)dlen, path, prefix, path + dlen, suffix);
+    return p;
+}
+
+//a shard path from the map, relative ones are relative to the map's directory
+static char *map_entry_path(const char *map_path, const char *name) {
+    size_t dlen = name[0] == '/' ? 0 : dir_len(map_path);
+    size_t len = dlen + strlen(name) + 1;
+    char *p = malloc(len);
+
+    if (p != NULL)
+        snprintf(p, len, "%.*s%s", (int)dlen, map_path, name);
+    return p;
+}
+
+static bool shard_owns(const sdb_shard_t *sh, int id) {
+    return id >= sh->lo && id <= sh->hi && id % sh->stride == sh->rem;
+}
+
+static off_t shard_offset(const sdb_shard_t *sh, int id) {
+    return sh->data_off + (off_t)((id - sh->base) / sh->stride) * sh->rec_size;
+}
+
+//the shard that owns id, NULL when no shard does
+static sdb_shard_t *shard_for(sdb_t *db, int id) {
+    int lo = 0, hi = db->n_shards - 1;
+
+    if (id < MIN_STD_ID || id > MAX_STD_ID)
+        return NULL;
+    if (db->scheme == SDB_SHARD_HASH)
+        return &db->shards[id % db->n_shards];
+
+    //range shards are sorted and do not overlap
+    while (lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (id < db->shards[mid].lo)
+            hi = mid - 1;
+        else if (id > db->shards[mid].hi)
+            lo = mid + 1;
+        else
+            return &db->shards[mid];
+    }
+    return NULL;
+}
+
+static void free_shard_paths(sdb_shard_t *sh) {
+    free(sh->path);
+    free(sh->tmp_path);
+    free(sh->idx_path);
+    free(sh->idx_tmp_path);
+    free(sh->crc_path);
+    free(sh->heap_path);
+    free(sh->heap_tmp_path);
+}
+
+//Pick the shard's format.  A truncated file keeps the format it had and an
+//empty one is in the original format, unless SDB_OPEN_ROWS asks for rows.
+//*empty says the file has no header yet.
+static int open_format(sdb_shard_t *sh, int flags, bool *empty) {
+    struct stat st;
+    int rc;
+
+    if ((rc = rows_detect(sh->fd, &sh->format)) != NO_ERROR)
+        return rc;
+    if ((flags & SDB_OPEN_TRUNCATE) && ftruncate(sh->fd, 0) != 0)
+        return ERR_DB_FILE;
+    if (fstat(sh->fd, &st) != 0)
+        return ERR_DB_FILE;
+    *empty = st.st_size == 0;
+    if (*empty && (flags & SDB_OPEN_ROWS))
+        sh->format = SDB_FORMAT_ROWS;
+
+    sh->rec_size = sh->format == SDB_FORMAT_ROWS ? (int)sizeof(sdb_row_t) : STUDENT_RECORD_SIZE;
+    sh->data_off = sh->format == SDB_FORMAT_ROWS ? ROWS_DATA_OFFSET : 0;
+    return NO_ERROR;
+}
+
+//the name heap of a row format shard
+static int open_heap(sdb_shard_t *sh, int flags) {
+    struct stat st;
+
+    sh->heap_end = 0;
+    if (sh->format != SDB_FORMAT_ROWS)
+        return NO_ERROR;
+    sh->heap_fd = open(sh->heap_path, O_RDWR | O_CREAT, SDB_FILE_MODE);
+    if (sh->heap_fd == -1)
+        return ERR_DB_FILE;
+    if (((flags & SDB_OPEN_TRUNCATE) && ftruncate(sh->heap_fd, 0) != 0) ||
+        fstat(sh->heap_fd, &st) != 0) {
+        close(sh->heap_fd);
+        sh->heap_fd = -1;
+        return ERR_DB_FILE;
+    }
+    sh->heap_end = st.st_size;
+    return NO_ERROR;
+}
+
+//The geometry (lo, hi, stride, base, rem) must already be set.
+static int open_shard(sdb_shard_t *sh, const char *path, int flags) {
+    bool empty;
+    int rc;
+
+    sh->heap_fd = -1;
+    sh->path = strdup(path);
+    sh->tmp_path = sdb_side_path(path, TMP_FILE_PREFIX, "");
+    sh->idx_path = sdb_side_path(path, "", NAME_IDX_SUFFIX);
+    sh->idx_tmp_path = sdb_side_path(path, TMP_FILE_PREFIX, NAME_IDX_SUFFIX);
+    sh->crc_path = sdb_side_path(path, "", CRC_SUFFIX);
+    sh->heap_path = sdb_side_path(path, "", ROWS_HEAP_SUFFIX);
+    sh->heap_tmp_path = sdb_side_path(path, TMP_FILE_PREFIX, ROWS_HEAP_SUFFIX);
+    if (sh->path == NULL || sh->tmp_path == NULL || sh->idx_path == NULL ||
+        sh->idx_tmp_path == NULL || sh->crc_path == NULL ||
+        sh->heap_path == NULL || sh->heap_tmp_path == NULL) {
+        free_shard_paths(sh);
+        return ERR_DB_MEMORY;
+    }
+
+    sh->fd = open(path, O_RDWR | O_CREAT, SDB_FILE_MODE);
+    if (sh->fd == -1) {
+        free_shard_paths(sh);
+        return ERR_DB_FILE;
+    }
+    if ((rc = open_format(sh, flags, &empty)) != NO_ERROR || (rc = open_heap(sh, flags)) != NO_ERROR) {
+        close(sh->fd);
+        free_shard_paths(sh);
+        return rc;
+    }
+    //a new row format file starts with its header, summed like any page
+    if (pagecrc_open(sh, flags) != NO_ERROR ||
+        (empty && sh->format == SDB_FORMAT_ROWS &&
+         (rows_write_hdr(sh->fd) != NO_ERROR || pagecrc_rebuild(sh) != NO_ERROR))) {
+        pagecrc_close(sh);
+        if (sh->heap_fd != -1)
+            close(sh->heap_fd);
+        close(sh->fd);
+        free_shard_paths(sh);
+        return ERR_DB_FILE;
+    }
+    //an index left from before the truncate would only hold stale entries
+    if (flags & SDB_OPEN_TRUNCATE)
+        unlink(sh->idx_path);
+
+    pthread_rwlock_init(&sh->lock, NULL);
+    pthread_mutex_init(&sh->idx_lock, NULL);
+    return NO_ERROR;
+}
+
+static int close_shard(sdb_shard_t *sh) {
+    int rc = NO_ERROR;
+
+    nameidx_close(sh);
+    pagecrc_close(sh);
+    if (close(sh->fd) != 0)
+        rc = ERR_DB_FILE;
+    if (sh->heap_fd != -1 && close(sh->heap_fd) != 0)
+        rc = ERR_DB_FILE;
+    pthread_rwlock_destroy(&sh->lock);
+    pthread_mutex_destroy(&sh->idx_lock);
+    free_shard_paths(sh);
+    return rc;
+}
+
+int sdb_close(sdb_t *db) {
+    int rc = NO_ERROR;
+
+    if (db == NULL)
+        return NO_ERROR;
+
+    changelog_close(db);
+    for (int i = 0; i < db->n_shards; i++) {
+        if (close_shard(&db->shards[i]) != NO_ERROR)
+            rc = ERR_DB_FILE;
+    }
+    free(db->shards);
+    free(db);
+    return rc;
+}
+
+//Read the shard map at map_path into db->shards, see libsdb.h for the
+//format.  Shard paths with spaces are not supported.
+static int read_map(const char *map_path, sdb_t *db, char **names) {
+    char line[SHARD_MAP_LINE];
+    char name[SHARD_MAP_LINE];
+    char word[16];
+    int lo, hi;
+    int rc = NO_ERROR;
+    FILE *f;
+
+    f = fopen(map_path, "r");
+    if (f == NULL)
+        return ERR_DB_FILE;
+
+    db->scheme = -1;
+    while (rc == NO_ERROR && fgets(line, sizeof(line), f) != NULL) {
+        char *p = line;
+        sdb_shard_t *sh = &db->shards[db->n_shards];
+
+        while (isspace((unsigned char)*p))
+            p++;
+        if (*p == '\0' || *p == '#')
+            continue;
+
+        if (sscanf(p, "scheme %15s", word) == 1 && db->scheme == -1) {
+            if (strcmp(word, "hash") == 0)
+                db->scheme = SDB_SHARD_HASH;
+            else if (strcmp(word, "range") == 0)
+                db->scheme = SDB_SHARD_RANGE;
+            else
+                rc = ERR_DB_FILE;
+            continue;
+        }
+
+        if (db->n_shards == SDB_MAX_SHARDS) {
+            rc = ERR_DB_FILE;
+        } else if (db->scheme == SDB_SHARD_HASH && sscanf(p, "shard %1023s", name) == 1) {
+            sh->lo = MIN_STD_ID;
+            sh->hi = MAX_STD_ID;
+        } else if (db->scheme == SDB_SHARD_RANGE &&
+                   sscanf(p, "shard %d %d %1023s", &lo, &hi, name) == 3 &&
+                   lo >= MIN_STD_ID && lo <= hi && hi <= MAX_STD_ID &&
+                   (db->n_shards == 0 || lo > sh[-1].hi)) {
+            sh->lo = lo;
+            sh->hi = hi;
+        } else {
+            rc = ERR_DB_FILE;
+        }
+
+        if (rc == NO_ERROR) {
+            names[db->n_shards] = map_entry_path(map_path, name);
+            if (names[db->n_shards++] == NULL)
+                rc = ERR_DB_MEMORY;
+        }
+    }
+
+    if (ferror(f) || db->n_shards == 0)
+        rc = ERR_DB_FILE;
+    fclose(f);
+    return rc;
+}
+
+//Open every shard listed in the map at map_path.
+static int open_map(const char *map_path, int flags, sdb_t *db) {
+    char *names[SDB_MAX_SHARDS] = {0};
+    int opened = 0;
+    int rc;
+
+    db->shards = calloc(SDB_MAX_SHARDS, sizeof(sdb_shard_t));
+    if (db->shards == NULL)
+        return ERR_DB_MEMORY;
+
+    rc = read_map(map_path, db, names);
+    for (int i = 0; rc == NO_ERROR && i < db->n_shards; i++) {
+        sdb_shard_t *sh = &db->shards[i];
+
+        if (db->scheme == SDB_SHARD_HASH) {
+            sh->stride = db->n_shards;
+            sh->base = 0;
+            sh->rem = i;
+        } else {
+            sh->stride = 1;
+            sh->base = sh->lo - 1;
+            sh->rem = 0;
+        }
+        if ((rc = open_shard(sh, names[i], flags)) == NO_ERROR)
+            opened++;
+    }
+
+    for (int i = 0; i < db->n_shards; i++)
+        free(names[i]);
+    if (rc != NO_ERROR) {
+        for (int i = 0; i < opened; i++)
+            close_shard(&db->shards[i]);
+        free(db->shards);
+        db->shards = NULL;
+        db->n_shards = 0;
+    }
+    return rc;
+}
+
+//Open the database at path.  If a shard map sits next to it the shards it
+//lists are opened, otherwise path itself is the one and only shard.
+static int open_path(const char *path, const char *map_path, int flags, sdb_t **db) {
+    sdb_t *h;
+    int rc;
+
+    *db = NULL;
+    h = calloc(1, sizeof(*h));
+    if (h == NULL)
+        return ERR_DB_MEMORY;
+    h->log_fd = -1;
+
+    if (map_path != NULL) {
+        rc = open_map(map_path, flags, h);
+    } else {
+        h->scheme = SDB_SHARD_HASH;
+        h->shards = calloc(1, sizeof(sdb_shard_t));
+        if (h->shards == NULL) {
+            rc = ERR_DB_MEMORY;
+        } else {
+            sdb_shard_t *sh = &h->shards[0];
+            sh->lo = MIN_STD_ID;
+            sh->hi = MAX_STD_ID;
+            sh->stride = 1;
+            rc = open_shard(sh, path, flags);
+            if (rc == NO_ERROR)
+                h->n_shards = 1;
+        }
+    }
+
+    if (rc != NO_ERROR) {
+        free(h->shards);
+        free(h);
+        return rc;
+    }
+    *db = h;
+    return NO_ERROR;
+}
+
+int sdb_open(const char *path, int flags, sdb_t **db) {
+    char *map_path = sdb_side_path(path, "", SHARD_MAP_SUFFIX);
+    int rc;
+
+    if (map_path == NULL)
+        return ERR_DB_MEMORY;
+    rc = open_path(path, access(map_path, F_OK) == 0 ? map_path : NULL, flags, db);
+    free(map_path);
+
+    if (rc == NO_ERROR && (rc = changelog_open(*db, path)) != NO_ERROR) {
+        sdb_close(*db);
+        *db = NULL;
+    }
+    return rc;
+}
+
+int sdb_shard_count(sdb_t *db) {
+    return db->n_shards;
+}
+
+//Read the checksummed page that holds id.  *len is how much of the page
+//is in the file.
+static int read_page(sdb_shard_t *sh, int id, shard_page_t *page, size_t *len, off_t *page_off) {
+    off_t offset = shard_offset(sh, id);
+    ssize_t n;
+
+    *page_off = offset - offset % CRC_PAGE_SIZE;
+    n = sdb_pread(sh->fd, page, CRC_PAGE_SIZE, *page_off);
+    if (n < 0)
+        return ERR_DB_FILE;
+    *len = n;
+    return pagecrc_check(sh, *page_off, page, n);
+}
+
+//the id kept in the slot at p, it comes first in both formats
+static int slot_id(const char *p) {
+    int32_t id;
+
+    memcpy(&id, p, sizeof(id));
+    return id;
+}
+
+//The slot for rec in the shard's format.  A row format shard stores the
+//names in its heap here, a free slot (rec is EMPTY_STUDENT_RECORD) is all
+//zeros in both formats.  Called with the shard locked exclusively.
+static int pack_slot(sdb_shard_t *sh, const student_t *rec, shard_slot_t *slot) {
+    if (sh->format == SDB_FORMAT_RECORDS) {
+        slot->rec = *rec;
+        return NO_ERROR;
+    }
+    if (rec->id == DELETED_STUDENT_ID) {
+        memset(&slot->row, 0, sizeof(slot->row));
+        return NO_ERROR;
+    }
+    return rows_put(sh, rec, &slot->row);
+}
+
+//the student in the slot at p, span is only used by row format scans
+static int unpack_slot(sdb_shard_t *sh, const char *p, const rows_span_t *span, student_t *s) {
+    if (sh->format == SDB_FORMAT_RECORDS) {
+        memcpy(s, p, sizeof(*s));
+        return NO_ERROR;
+    }
+    return rows_get(sh, (const sdb_row_t *)p, span, s);
+}
+
+//An id past the end of the file has simply never been written, so it is
+//not found rather than a read error.  The whole page is read so it can be
+//checked, that is still one read, plus one heap read for a row.
+int shard_get_nolock(sdb_shard_t *sh, int id, student_t *s) {
+    shard_page_t page;
+    off_t page_off;
+    size_t len;
+    size_t i;
+    int rc;
+
+    if (!shard_owns(sh, id))
+        return SRCH_NOT_FOUND;
+
+    if ((rc = read_page(sh, id, &page, &len, &page_off)) != NO_ERROR)
+        return rc;
+    i = shard_offset(sh, id) - page_off;
+    if (i + sh->rec_size > len || slot_id(page.bytes + i) != id)
+        return SRCH_NOT_FOUND;
+    STATS_ADD(visited, 1);
+    return unpack_slot(sh, page.bytes + i, NULL, s);
+}
+
+//Write rec into id's slot and sum its page again.  Called with the shard
+//locked exclusively.
+static int shard_write_nolock(sdb_shard_t *sh, int id, const student_t *rec) {
+    shard_page_t page;
+    shard_slot_t slot;
+    off_t page_off;
+    size_t len;
+    size_t i;
+    int rc;
+
+    //a page that is already bad must not get a fresh sum
+    if ((rc = read_page(sh, id, &page, &len, &page_off)) != NO_ERROR)
+        return rc;
+    i = shard_offset(sh, id) - page_off;
+
+    if ((rc = pack_slot(sh, rec, &slot)) != NO_ERROR)
+        return rc;
+    if (sdb_pwrite(sh->fd, &slot, sh->rec_size, shard_offset(sh, id)) != sh->rec_size)
+        return ERR_DB_FILE;
+
+    //the bytes between the old end of the file and the record are a hole
+    if (len < i)
+        memset(page.bytes + len, 0, i - len);
+    if (len < i + sh->rec_size)
+        len = i + sh->rec_size;
+    memcpy(page.bytes + i, &slot, sh->rec_size);
+    pagecrc_update(sh, page_off, &page, len);
+    return NO_ERROR;
+}
+
+int sdb_get(sdb_t *db, int id, student_t *s) {
+    sdb_shard_t *sh = shard_for(db, id);
+    int rc;
+
+    if (sh == NULL)
+        return SRCH_NOT_FOUND;
+
+    pthread_rwlock_rdlock(&sh->lock);
+    rc = shard_get_nolock(sh, id, s);
+    pthread_rwlock_unlock(&sh->lock);
+    if (rc == NO_ERROR)
+        STATS_ADD(returned, 1);
+    return rc;
+}
+
+//src cut to fit a name field of size bytes, dst is already zeroed so the
+//name stays padded and terminated
+static void copy_name(char *dst, size_t size, const char *src) {
+    memcpy(dst, src, strnlen(src, size - 1));
+}
+
+int sdb_put(sdb_t *db, const student_t *s) {
+    student_t rec = {0};
+    student_t existing;
+    sdb_shard_t *sh;
+    int rc;
+
+    sh = shard_for(db, s->id);
+    if (sh == NULL || s->gpa < MIN_STD_GPA || s->gpa > MAX_STD_GPA)
+        return ERR_DB_RANGE;
+
+    //names are stored zero padded and always terminated
+    rec.id = s->id;
+    copy_name(rec.fname, sizeof(rec.fname), s->fname);
+    copy_name(rec.lname, sizeof(rec.lname), s->lname);
+    rec.gpa = s->gpa;
+
+    pthread_rwlock_wrlock(&sh->lock);
+    rc = shard_get_nolock(sh, rec.id, &existing);
+    if (rc == NO_ERROR) {
+        rc = ERR_DB_EXISTS;
+    } else if (rc == SRCH_NOT_FOUND) {
+        rc = shard_write_nolock(sh, rec.id, &rec);
+        if (rc != NO_ERROR) {
+            //nothing was written
+        } else if (changelog_append(db, SDB_CHANGE_ADD, &rec) != NO_ERROR) {
+            //a change the log missed would never reach its readers, undo it
+            shard_write_nolock(sh, rec.id, &EMPTY_STUDENT_RECORD);
+            rc = ERR_DB_FILE;
+        } else if (nameidx_add(sh, &rec) != NO_ERROR) {
+            //an index that missed this put would hide it from name lookups,
+            //so drop the index and let the next search rebuild it
+            nameidx_remove(sh);
+        }
+    }
+    pthread_rwlock_unlock(&sh->lock);
+    return rc;
+}
+
+int sdb_del(sdb_t *db, int id) {
+    sdb_shard_t *sh = shard_for(db, id);
+    student_t existing;
+    int rc;
+
+    if (sh == NULL)
+        return SRCH_NOT_FOUND;
+
+    pthread_rwlock_wrlock(&sh->lock);
+    rc = shard_get_nolock(sh, id, &existing);
+    if (rc == NO_ERROR) {
+        rc = shard_write_nolock(sh, id, &EMPTY_STUDENT_RECORD);
+        if (rc == NO_ERROR && changelog_append(db, SDB_CHANGE_DEL, &existing) != NO_ERROR) {
+            shard_write_nolock(sh, id, &existing);
+            rc = ERR_DB_FILE;
+        }
+    }
+    pthread_rwlock_unlock(&sh->lock);
+    return rc;
+}
+
+//Block scanner shared by every full pass over a shard.  The slots for ids
+//first_id..last_id are read SCAN_BLOCK_RECORDS * STUDENT_RECORD_SIZE bytes
+//at a time with pread() (4 times as many students for the row format) and
+//fn is called for each record in that range that is in use.  A non zero
+//return from fn stops the scan and is passed back to the caller.  Reads
+//are rounded out to whole pages so every page can be checked.
+int shard_scan_nolock(sdb_shard_t *sh, int first_id, int last_id, sdb_scan_fn fn, void *arg) {
+    shard_page_t block[SCAN_BLOCK_RECORDS / CRC_PAGE_RECORDS];
+    rows_span_t *span = NULL;
+    student_t student;
+    off_t offset;
+    off_t end;
+    ssize_t n;
+    int rc = NO_ERROR;
+
+    if (first_id < sh->lo)
+        first_id = sh->lo;
+    if (last_id > sh->hi)
+        last_id = sh->hi;
+    if (first_id > last_id)
+        return NO_ERROR;
+    if (sh->format == SDB_FORMAT_ROWS && (span = malloc(sizeof(rows_span_t))) == NULL)
+        return ERR_DB_MEMORY;
+    offset = shard_offset(sh, first_id);
+    offset -= offset % CRC_PAGE_SIZE;
+    end = shard_offset(sh, last_id) + sh->rec_size;
+    end += (CRC_PAGE_SIZE - end % CRC_PAGE_SIZE) % CRC_PAGE_SIZE;
+
+    while (offset < end && rc == NO_ERROR) {
+        const char *bytes = block[0].bytes;
+        size_t start = offset < sh->data_off ? sh->data_off - offset : 0;
+        size_t want = sizeof(block);
+        size_t n_slots;
+        long seen = 0;
+
+        if ((off_t)want > end - offset)
+            want = end - offset;
+
+        n = sdb_pread(sh->fd, block, want, offset);
+        if (n < 0) {
+            rc = ERR_DB_FILE;
+            break;
+        }
+        if ((size_t)n < start + sh->rec_size)
+            break;
+
+        for (ssize_t p = 0; p < n && rc == NO_ERROR; p += CRC_PAGE_SIZE) {
+            size_t len = n - p < CRC_PAGE_SIZE ? (size_t)(n - p) : CRC_PAGE_SIZE;
+            rc = pagecrc_check(sh, offset + p, bytes + p, len);
+        }
+        n_slots = (n - start) / sh->rec_size;
+        if (rc == NO_ERROR && span != NULL)
+            rc = rows_load_span(sh, (const sdb_row_t *)(bytes + start), n_slots, span);
+
+        for (size_t i = 0; i < n_slots && rc == NO_ERROR; i++) {
+            const char *p = bytes + start + i * sh->rec_size;
+            int id = slot_id(p);
+
+            if (id == DELETED_STUDENT_ID || id < first_id || id > last_id)
+                continue;
+            seen++;
+            //records are handed over in place
+            if (sh->format == SDB_FORMAT_RECORDS)
+                rc = fn((const student_t *)p, arg);
+            else if ((rc = unpack_slot(sh, p, span, &student)) == NO_ERROR)
+                rc = fn(&student, arg);
+        }
+        STATS_ADD(visited, seen);
+        offset += start + n_slots * sh->rec_size;
+    }
+    free(span);
+    return rc;
+}
+
+//Fan out.  An operation that touches every shard fills one job per shard
+//and fan_out() runs them, one thread per shard.  Each shard's records come
+//out in id order, with a single shard they go straight to the caller's
+//callback, with more they are buffered and merge_jobs() interleaves them.
+typedef struct rec_buf{
+    student_t *recs;
+    int        len;
+    int        cap;
+} rec_buf_t;
+
+typedef struct shard_job shard_job_t;
+typedef int (*shard_run_fn)(shard_job_t *job);
+
+struct shard_job{
+    sdb_shard_t          *sh;
+    shard_run_fn          run;
+    int                   first_id;     //scans
+    int                   last_id;
+    const name_pattern_t *pat;          //name lookups
+    const query_t        *q;            //queries
+    sdb_scan_fn           fn;           //where the shard's records go
+    void                 *arg;
+    rec_buf_t             out;          //the shard's records when buffered
+    int                   count;
+    int                   n_threads;    //verify
+    sdb_verify_t          verify;
+    const student_t      *recs;         //bulk puts
+    int                   n_recs;
+    const sdb_update_t   *ups;          //updates
+    int                   n_ups;
+    int                   rc;
+};
+
+static int buffer_record(const student_t *s, void *arg) {
+    rec_buf_t *b = arg;
+
+    if (b->len == b->cap) {
+        int cap = b->cap ? b->cap * 2 : SCAN_BLOCK_RECORDS;
+        student_t *grown = realloc(b->recs, cap * sizeof(student_t));
+        if (grown == NULL)
+            return ERR_DB_MEMORY;
+        b->recs = grown;
+        b->cap = cap;
+    }
+    b->recs[b->len++] = *s;
+    return NO_ERROR;
+}
+
+static shard_job_t *new_jobs(sdb_t *db, shard_run_fn run, sdb_scan_fn fn, void *arg) {
+    shard_job_t *jobs = calloc(db->n_shards, sizeof(shard_job_t));
+
+    for (int i = 0; jobs != NULL && i < db->n_shards; i++) {
+        jobs[i].sh = &db->shards[i];
+        jobs[i].run = run;
+        jobs[i].first_id = MIN_STD_ID;
+        jobs[i].last_id = MAX_STD_ID;
+        jobs[i].fn = db->n_shards == 1 ? fn : buffer_record;
+        jobs[i].arg = db->n_shards == 1 ? arg : &jobs[i].out;
+    }
+    return jobs;
+}
+
+static void free_jobs(sdb_t *db, shard_job_t *jobs) {
+    for (int i = 0; i < db->n_shards; i++)
+        free(jobs[i].out.recs);
+    free(jobs);
+}
+
+static void *run_job(void *arg) {
+    shard_job_t *job = arg;
+
+    job->rc = job->run(job);
+    return NULL;
+}
+
+//Returns the first error any shard hit.
+static int fan_out(sdb_t *db, shard_job_t *jobs) {
+    pthread_t threads[SDB_MAX_SHARDS];
+    bool started[SDB_MAX_SHARDS];
+
+    if (db->n_shards == 1)
+        return jobs[0].rc = jobs[0].run(&jobs[0]);
+
+    //a shard whose thread could not be started runs here instead
+    for (int i = 0; i < db->n_shards; i++) {
+        started[i] = pthread_create(&threads[i], NULL, run_job, &jobs[i]) == 0;
+        if (!started[i])
+            run_job(&jobs[i]);
+    }
+    for (int i = 0; i < db->n_shards; i++) {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+    }
+    for (int i = 0; i < db->n_shards; i++) {
+        if (jobs[i].rc != NO_ERROR)
+            return jobs[i].rc;
+    }
+    return NO_ERROR;
+}
+
+//Hand the buffered records to fn in id order.  Every buffer is already in
+//id order, so this is a merge that picks the smallest head each step.
+static int merge_jobs(sdb_t *db, shard_job_t *jobs, sdb_scan_fn fn, void *arg) {
+    int pos[SDB_MAX_SHARDS] = {0};
+    int rc;
+
+    while (1) {
+        const student_t *next = NULL;
+        int from = -1;
+
+        for (int i = 0; i < db->n_shards; i++) {
+            if (pos[i] < jobs[i].out.len &&
+                (next == NULL || jobs[i].out.recs[pos[i]].id < next->id)) {
+                next = &jobs[i].out.recs[pos[i]];
+                from = i;
+            }
+        }
+        if (next == NULL)
+            return NO_ERROR;
+        if ((rc = fn(next, arg)) != NO_ERROR)
+            return rc;
+        pos[from]++;
+    }
+}
+
+//fan out, then deliver the buffered records
+static int run_jobs(sdb_t *db, shard_job_t *jobs, sdb_scan_fn fn, void *arg) {
+    int rc = fan_out(db, jobs);
+
+    if (rc == NO_ERROR)
+        rc = merge_jobs(db, jobs, fn, arg);
+    free_jobs(db, jobs);
+    return rc;
+}
+
+static int run_scan(shard_job_t *job) {
+    int rc;
+
+    pthread_rwlock_rdlock(&job->sh->lock);
+    rc = shard_scan_nolock(job->sh, job->first_id, job->last_id, job->fn, job->arg);
+    pthread_rwlock_unlock(&job->sh->lock);
+    return rc;
+}
+
+int sdb_scan(sdb_t *db, int first_id, int last_id, sdb_scan_fn fn, void *arg) {
+    shard_job_t *jobs;
+
+    STATS_COUNT_RETURNED(fn, arg);
+    jobs = new_jobs(db, run_scan, fn, arg);
+    if (jobs == NULL)
+        return ERR_DB_MEMORY;
+    for (int i = 0; i < db->n_shards; i++) {
+        jobs[i].first_id = first_id;
+        jobs[i].last_id = last_id;
+    }
+    return run_jobs(db, jobs, fn, arg);
+}
+
+static int count_record(const student_t *s, void *arg) {
+    (void)s;
+    (*(int *)arg)++;
+    return NO_ERROR;
+}
+
+//each shard counts into its own job, nothing is buffered
+int sdb_count(sdb_t *db, int *count) {
+    shard_job_t *jobs = new_jobs(db, run_scan, count_record, NULL);
+    int rc;
+
+    *count = 0;
+    if (jobs == NULL)
+        return ERR_DB_MEMORY;
+    for (int i = 0; i < db->n_shards; i++) {
+        jobs[i].fn = count_record;
+        jobs[i].arg = &jobs[i].count;
+    }
+
+    rc = fan_out(db, jobs);
+    for (int i = 0; i < db->n_shards; i++)
+        *count += jobs[i].count;
+    free_jobs(db, jobs);
+    return rc;
+}
+
+//Only the candidate records are read, each one is rechecked because the
+//index keeps entries for deleted or replaced students.  Those are not
+//found and skipped, a page that cannot be read or fails its sum is not.
+static int run_find_name(shard_job_t *job) {
+    sdb_shard_t *sh = job->sh;
+    student_t student;
+    int *ids;
+    int n_ids;
+    int rc;
+
+    pthread_rwlock_rdlock(&sh->lock);
+    rc = nameidx_search(sh, job->pat, &ids, &n_ids);
+    for (int i = 0; rc == NO_ERROR && i < n_ids; i++) {
+        rc = shard_get_nolock(sh, ids[i], &student);
+        if (rc == SRCH_NOT_FOUND)
+            rc = NO_ERROR;
+        else if (rc == NO_ERROR && nameidx_matches(job->pat, &student))
+            rc = job->fn(&student, job->arg);
+    }
+    pthread_rwlock_unlock(&sh->lock);
+
+    free(ids);
+    return rc;
+}
+
+int sdb_find_name(sdb_t *db, const char *pattern, sdb_scan_fn fn, void *arg) {
+    name_pattern_t pat;
+    shard_job_t *jobs;
+    int rc;
+
+    STATS_START(t);
+    rc = nameidx_parse_pattern(pattern, &pat);
+    STATS_STOP(t, parse_ns);
+    if (rc != NO_ERROR)
+        return ERR_DB_OP;
+
+    STATS_COUNT_RETURNED(fn, arg);
+    jobs = new_jobs(db, run_find_name, fn, arg);
+    if (jobs == NULL)
+        return ERR_DB_MEMORY;
+    for (int i = 0; i < db->n_shards; i++)
+        jobs[i].pat = &pat;
+    return run_jobs(db, jobs, fn, arg);
+}
+
+//the predicate runs on the raw record, rejected rows never reach fn
+static int call_if_match(const student_t *s, void *arg) {
+    shard_job_t *job = arg;
+
+    if (!query_match(job->q, s))
+        return NO_ERROR;
+    return job->fn(s, job->arg);
+}
+
+//Uses the shard's name index when every OR branch can be answered by a
+//lookup, otherwise scans only the id range the filter allows (which also
+//skips range shards that cannot hold a match).
+static int run_query(shard_job_t *job) {
+    sdb_shard_t *sh = job->sh;
+    student_t student;
+    int *ids;
+    int n_ids;
+    int lo, hi;
+    int rc;
+
+    pthread_rwlock_rdlock(&sh->lock);
+    rc = query_candidates(sh, job->q, &ids, &n_ids);
+    if (rc == NO_ERROR) {
+        for (int i = 0; rc == NO_ERROR && i < n_ids; i++) {
+            rc = shard_get_nolock(sh, ids[i], &student);
+            if (rc == SRCH_NOT_FOUND)
+                rc = NO_ERROR;
+            else if (rc == NO_ERROR)
+                rc = call_if_match(&student, job);
+        }
+        free(ids);
+    } else if (rc == SRCH_NOT_FOUND) {
+        query_id_range(job->q, &lo, &hi);
+        rc = lo <= hi ? shard_scan_nolock(sh, lo, hi, call_if_match, job) : NO_ERROR;
+    }
+    pthread_rwlock_unlock(&sh->lock);
+    return rc;
+}
+
+//On ERR_DB_OP *err_at points at the part of filter that could not be parsed.
+int sdb_query(sdb_t *db, const char *filter, sdb_scan_fn fn, void *arg, const char **err_at) {
+    shard_job_t *jobs;
+    query_t q;
+    int rc;
+
+    STATS_START(t);
+    rc = query_compile(filter, &q, err_at);
+    STATS_STOP(t, parse_ns);
+    if (rc != NO_ERROR)
+        return ERR_DB_OP;
+
+    STATS_COUNT_RETURNED(fn, arg);
+    jobs = new_jobs(db, run_query, fn, arg);
+    if (jobs == NULL)
+        return ERR_DB_MEMORY;
+    for (int i = 0; i < db->n_shards; i++)
+        jobs[i].q = &q;
+    return run_jobs(db, jobs, fn, arg);
+}
+
+typedef struct compact_state{
+    sdb_shard_t *sh;
+    int          tmp_fd;
+    int          heap_fd;       //row format only
+    off_t        heap_end;
+} compact_state_t;
+
+static int copy_record(const student_t *s, void *arg) {
+    compact_state_t *cs = arg;
+    shard_slot_t slot;
+
+    if (cs->sh->format == SDB_FORMAT_RECORDS) {
+        slot.rec = *s;
+    } else {
+        char names[ROWS_NAMES_MAX];
+        size_t len = rows_pack(s, (uint32_t)cs->heap_end, &slot.row, names);
+
+        if (sdb_pwrite(cs->heap_fd, names, len, cs->heap_end) != (ssize_t)len)
+            return ERR_DB_FILE;
+        cs->heap_end += len;
+    }
+    if (sdb_pwrite(cs->tmp_fd, &slot, cs->sh->rec_size, shard_offset(cs->sh, s->id)) != cs->sh->rec_size)
+        return ERR_DB_FILE;
+    return NO_ERROR;
+}
+
+//open the files a compaction writes, a row format shard gets a fresh heap
+static int open_compact(compact_state_t *cs) {
+    sdb_shard_t *sh = cs->sh;
+
+    cs->tmp_fd = open(sh->tmp_path, O_RDWR | O_CREAT | O_TRUNC, SDB_FILE_MODE);
+    if (cs->tmp_fd == -1)
+        return ERR_DB_FILE;
+    if (sh->format == SDB_FORMAT_RECORDS)
+        return NO_ERROR;
+
+    cs->heap_fd = open(sh->heap_tmp_path, O_RDWR | O_CREAT | O_TRUNC, SDB_FILE_MODE);
+    if (cs->heap_fd == -1 || rows_write_hdr(cs->tmp_fd) != NO_ERROR) {
+        if (cs->heap_fd != -1)
+            close(cs->heap_fd);
+        close(cs->tmp_fd);
+        unlink(sh->tmp_path);
+        unlink(sh->heap_tmp_path);
+        return ERR_DB_FILE;
+    }
+    return NO_ERROR;
+}
+
+//Copy the live records into a fresh file and rename it over the shard.
+//Ids keep their slots, so this only gives back the space of trailing
+//deleted records and the holes the file system can punch, but it is also
+//a good time to rebuild the name index without its stale entries.  A row
+//format shard also gets a heap without the names of deleted or rewritten
+//students, in id order.
+static int run_compact(shard_job_t *job) {
+    sdb_shard_t *sh = job->sh;
+    compact_state_t cs = { sh, -1, -1, 0 };
+    int fd;
+    int rc;
+
+    pthread_rwlock_wrlock(&sh->lock);
+
+    if ((rc = open_compact(&cs)) != NO_ERROR) {
+        pthread_rwlock_unlock(&sh->lock);
+        return rc;
+    }
+
+    rc = shard_scan_nolock(sh, MIN_STD_ID, MAX_STD_ID, copy_record, &cs);
+    if (close(cs.tmp_fd) != 0 && rc == NO_ERROR)
+        rc = ERR_DB_FILE;
+    if (rc == NO_ERROR && rename(sh->tmp_path, sh->path) != 0)
+        rc = ERR_DB_FILE;
+    if (cs.heap_fd != -1) {
+        if (rc == NO_ERROR && rename(sh->heap_tmp_path, sh->heap_path) != 0)
+            rc = ERR_DB_FILE;
+        if (rc == NO_ERROR) {
+            close(sh->heap_fd);
+            sh->heap_fd = cs.heap_fd;
+            sh->heap_end = cs.heap_end;
+        } else {
+            close(cs.heap_fd);
+            unlink(sh->heap_tmp_path);
+        }
+    }
+    if (rc != NO_ERROR) {
+        unlink(sh->tmp_path);
+        pthread_rwlock_unlock(&sh->lock);
+        return rc;
+    }
+
+    //the old fd still points at the replaced file
+    fd = open(sh->path, O_RDWR, SDB_FILE_MODE);
+    if (fd == -1) {
+        rc = ERR_DB_FILE;
+    } else {
+        close(sh->fd);
+        sh->fd = fd;
+        rc = pagecrc_rebuild(sh);
+        if (nameidx_build(sh) != NO_ERROR)
+            nameidx_remove(sh);
+    }
+
+    pthread_rwlock_unlock(&sh->lock);
+    return rc;
+}
+
+int sdb_compact(sdb_t *db) {
+    shard_job_t *jobs = new_jobs(db, run_compact, NULL, NULL);
+    int rc;
+
+    if (jobs == NULL)
+        return ERR_DB_MEMORY;
+    rc = fan_out(db, jobs);
+    free_jobs(db, jobs);
+    return rc;
+}
+
+//Have the file system allocate bytes [off, end) of fd now, without changing
+//the size or the contents of the file.  Slots written at scattered offsets
+//one at a time each get whatever block is free next, reserved up front the
+//range comes in a few contiguous extents and later scans read it
+//sequentially.  ERR_DB_OP when the system or the file system cannot.
+static int reserve_range(int fd, off_t off, off_t end) {
+#ifdef FALLOC_FL_KEEP_SIZE
+    if (end <= off || fallocate(fd, FALLOC_FL_KEEP_SIZE, off, end - off) == 0)
+        return NO_ERROR;
+    return errno == EOPNOTSUPP || errno == ENOSYS ? ERR_DB_OP : ERR_DB_FILE;
+#else
+    (void)fd;
+    (void)off;
+    (void)end;
+    return ERR_DB_OP;
+#endif
+}
+
+//A batch writes a page before it logs the page's changes.  When the log
+//refuses them, bytes lo to hi go back to what orig had and the page is
+//summed again, so the shard never holds a change its log readers miss.
+static void undo_page_write(sdb_shard_t *sh, off_t page_off, const shard_page_t *orig,
+                            size_t lo, size_t hi, size_t len) {
+    if (sdb_pwrite(sh->fd, orig->bytes + lo, hi - lo, page_off + lo) == (ssize_t)(hi - lo))
+        pagecrc_update(sh, page_off, orig, len);
+}
+
+//Write the job's records, which all belong to its shard and are sorted by
+//id.  The records that share a page are patched into it and written with
+//one pwrite, so a dense load costs about one read and one write per page.
+//A row format shard also writes the names of the page with one heap write
+//before the rows that point at them.  The name index is dropped rather
+//than appended to record by record, the next search rebuilds it in one
+//pass.
+static int run_put_many(shard_job_t *job) {
+    shard_page_t page, orig;
+    sdb_shard_t *sh = job->sh;
+    sdb_t *db = job->arg;
+    char *names = NULL;
+    int rc = NO_ERROR;
+    int i = 0;
+
+    //enough heap bytes for every row of a page
+    if (sh->format == SDB_FORMAT_ROWS &&
+        (names = malloc(CRC_PAGE_SIZE / sizeof(sdb_row_t) * ROWS_NAMES_MAX)) == NULL)
+        return ERR_DB_MEMORY;
+
+    pthread_rwlock_wrlock(&sh->lock);
+
+    //the whole share is allocated at once, a file system that cannot do
+    //that just gets the writes
+    if (job->n_recs > 0) {
+        off_t names_len = 0;
+
+        reserve_range(sh->fd, shard_offset(sh, job->recs[0].id),
+                      shard_offset(sh, job->recs[job->n_recs - 1].id) + sh->rec_size);
+        for (int k = 0; names != NULL && k < job->n_recs; k++)
+            names_len += strnlen(job->recs[k].fname, sizeof(job->recs[k].fname)) +
+                         strnlen(job->recs[k].lname, sizeof(job->recs[k].lname));
+        if (names != NULL)
+            reserve_range(sh->heap_fd, sh->heap_end, sh->heap_end + names_len);
+    }
+
+    while (i < job->n_recs && rc == NO_ERROR) {
+        off_t page_off;
+        size_t len;
+        size_t first, last;
+        size_t names_len = 0;
+        int j = i;
+
+        if ((rc = read_page(sh, job->recs[i].id, &page, &len, &page_off)) != NO_ERROR)
+            break;
+        //what to put back if the log refuses the page's records, past the
+        //old end of the file that is a hole
+        memcpy(orig.bytes, page.bytes, len);
+        memset(orig.bytes + len, 0, CRC_PAGE_SIZE - len);
+        first = shard_offset(sh, job->recs[i].id) - page_off;
+        last = first;
+
+        for (; j < job->n_recs && shard_offset(sh, job->recs[j].id) - page_off < CRC_PAGE_SIZE; j++) {
+            size_t at = shard_offset(sh, job->recs[j].id) - page_off;
+            shard_slot_t slot;
+
+            if (at + sh->rec_size <= len && slot_id(page.bytes + at) != DELETED_STUDENT_ID) {
+                rc = ERR_DB_EXISTS;
+                break;
+            }
+            if (sh->format == SDB_FORMAT_RECORDS)
+                slot.rec = job->recs[j];
+            else
+                names_len += rows_pack(&job->recs[j], (uint32_t)(sh->heap_end + names_len),
+                                       &slot.row, names + names_len);
+            if (len < at)
+                memset(page.bytes + len, 0, at - len);
+            if (len < at + sh->rec_size)
+                len = at + sh->rec_size;
+            memcpy(page.bytes + at, &slot, sh->rec_size);
+            last = at;
+        }
+        if (j == i)
+            break;
+
+        //the records in between are rewritten unchanged
+        if ((names != NULL && rows_append(sh, names, names_len) != NO_ERROR) ||
+            sdb_pwrite(sh->fd, page.bytes + first, last - first + sh->rec_size,
+                   page_off + first) != (ssize_t)(last - first + sh->rec_size)) {
+            rc = ERR_DB_FILE;
+            break;
+        }
+        pagecrc_update(sh, page_off, &page, len);
+        if (changelog_append_many(db, SDB_CHANGE_ADD, &job->recs[i], j - i) != NO_ERROR) {
+            undo_page_write(sh, page_off, &orig, first, last + sh->rec_size, len);
+            rc = ERR_DB_FILE;
+            break;
+        }
+        i = j;
+    }
+    if (i > 0)
+        nameidx_remove(sh);
+    pthread_rwlock_unlock(&sh->lock);
+    free(names);
+    return rc;
+}
+
+//Put n records sorted by id, for bulk loads.  Every record must be new and
+//is stored as given, so names must already be zero padded.  Each shard
+//takes its share at the same time.  On an error the records before the
+//failing one may have been stored.
+int sdb_put_many(sdb_t *db, const student_t *recs, int n) {
+    student_t *parts = NULL;
+    shard_job_t *jobs;
+    int rc;
+
+    for (int i = 0; i < n; i++) {
+        if (shard_for(db, recs[i].id) == NULL || recs[i].gpa < MIN_STD_GPA || recs[i].gpa > MAX_STD_GPA)
+            return ERR_DB_RANGE;
+        if (i > 0 && recs[i].id <= recs[i - 1].id)
+            return ERR_DB_OP;
+    }
+
+    jobs = new_jobs(db, run_put_many, NULL, db);
+    if (jobs == NULL)
+        return ERR_DB_MEMORY;
+
+    if (db->n_shards == 1) {
+        jobs[0].recs = recs;
+        jobs[0].n_recs = n;
+    } else {
+        //split the records by shard, each share stays sorted
+        parts = malloc((n > 0 ? n : 1) * sizeof(student_t));
+        if (parts == NULL) {
+            free_jobs(db, jobs);
+            return ERR_DB_MEMORY;
+        }
+        int at[SDB_MAX_SHARDS];
+
+        for (int i = 0; i < n; i++)
+            jobs[shard_for(db, recs[i].id) - db->shards].n_recs++;
+        for (int k = 0; k < db->n_shards; k++) {
+            at[k] = k == 0 ? 0 : at[k - 1] + jobs[k - 1].n_recs;
+            jobs[k].recs = parts + at[k];
+        }
+        for (int i = 0; i < n; i++)
+            parts[at[shard_for(db, recs[i].id) - db->shards]++] = recs[i];
+    }
+    for (int k = 0; k < db->n_shards; k++)
+        jobs[k].arg = db;
+
+    rc = fan_out(db, jobs);
+    free_jobs(db, jobs);
+    free(parts);
+    return rc;
+}
+
+static int run_reserve(shard_job_t *job) {
+    sdb_shard_t *sh = job->sh;
+    int last = job->last_id < sh->hi ? job->last_id : sh->hi;
+    int rc;
+
+    if (last < sh->lo)
+        return NO_ERROR;
+    pthread_rwlock_rdlock(&sh->lock);
+    rc = reserve_range(sh->fd, 0, shard_offset(sh, last) + sh->rec_size);
+    pthread_rwlock_unlock(&sh->lock);
+    return rc;
+}
+
+//Allocate the slots of every id up to last_id on disk ahead of a load, see
+//reserve_range().  No record changes and the files keep their size.  A row
+//format shard only gets its rows reserved, how much heap the names will
+//take is not known yet.
+int sdb_reserve(sdb_t *db, int last_id) {
+    shard_job_t *jobs;
+    int rc;
+
+    if (last_id < MIN_STD_ID || last_id > MAX_STD_ID)
+        return ERR_DB_RANGE;
+    if ((jobs = new_jobs(db, run_reserve, NULL, NULL)) == NULL)
+        return ERR_DB_MEMORY;
+    for (int k = 0; k < db->n_shards; k++)
+        jobs[k].last_id = last_id;
+    rc = fan_out(db, jobs);
+    free_jobs(db, jobs);
+    return rc;
+}
+
+//Apply the updates of one record to s in order.  Returns true when a name
+//changed.
+static bool apply_updates(student_t *s, const sdb_update_t *ups, int n) {
+    bool renamed = false;
+
+    for (int i = 0; i < n; i++) {
+        switch (ups[i].field) {
+        case SDB_FIELD_GPA:
+            s->gpa = ups[i].gpa;
+            break;
+        case SDB_FIELD_FNAME:
+            memset(s->fname, 0, sizeof(s->fname));
+            copy_name(s->fname, sizeof(s->fname), ups[i].name);
+            renamed = true;
+            break;
+        case SDB_FIELD_LNAME:
+            memset(s->lname, 0, sizeof(s->lname));
+            copy_name(s->lname, sizeof(s->lname), ups[i].name);
+            renamed = true;
+            break;
+        }
+    }
+    return renamed;
+}
+
+//Updates sorted by id.  Like run_put_many every page is read once and
+//written once, but only from the first to the last byte that changed, so
+//a page with one gpa update gets a 4 byte write (2 for a row).  The
+//updates of one id are applied together and logged as one change.  A row
+//format shard appends new names to its heap and points the row at them,
+//a gpa update leaves the names where they are.  A few renames are added
+//to the name index, more than UPDATE_IDX_ADD_MAX drop it like a bulk put.
+#define UPDATE_IDX_ADD_MAX  64
+
+static int run_update_many(shard_job_t *job) {
+    shard_page_t page, orig;
+    student_t changed[CRC_PAGE_SIZE / sizeof(sdb_row_t)];
+    bool renamed[CRC_PAGE_SIZE / sizeof(sdb_row_t)];
+    const sdb_update_t *ups = job->ups;
+    sdb_shard_t *sh = job->sh;
+    sdb_t *db = job->arg;
+    char *names = NULL;
+    int n_renames = 0;
+    int rc = NO_ERROR;
+    int i = 0;
+
+    for (int k = 0; k < job->n_ups; k++) {
+        if (ups[k].field != SDB_FIELD_GPA)
+            n_renames++;
+    }
+    if (sh->format == SDB_FORMAT_ROWS &&
+        (names = malloc(CRC_PAGE_SIZE / sizeof(sdb_row_t) * ROWS_NAMES_MAX)) == NULL)
+        return ERR_DB_MEMORY;
+
+    pthread_rwlock_wrlock(&sh->lock);
+    while (i < job->n_ups && rc == NO_ERROR) {
+        off_t page_off;
+        size_t len;
+        size_t lo = CRC_PAGE_SIZE, hi = 0;
+        size_t names_len = 0;
+        int n_changed = 0;
+        int j = i;
+
+        if ((rc = read_page(sh, ups[i].id, &page, &len, &page_off)) != NO_ERROR)
+            break;
+        memcpy(orig.bytes, page.bytes, len);
+
+        while (j < job->n_ups && shard_offset(sh, ups[j].id) - page_off < CRC_PAGE_SIZE) {
+            size_t at = shard_offset(sh, ups[j].id) - page_off;
+            student_t *s = &changed[n_changed];
+            shard_slot_t slot;
+            int k = j;
+
+            while (k < job->n_ups && ups[k].id == ups[j].id)
+                k++;
+            if (at + sh->rec_size > len || slot_id(page.bytes + at) != ups[j].id) {
+                rc = SRCH_NOT_FOUND;
+                break;
+            }
+            if ((rc = unpack_slot(sh, page.bytes + at, NULL, s)) != NO_ERROR)
+                break;
+            STATS_ADD(visited, 1);
+
+            memcpy(&slot, page.bytes + at, sh->rec_size);
+            renamed[n_changed] = apply_updates(s, ups + j, k - j);
+            if (sh->format == SDB_FORMAT_RECORDS)
+                slot.rec = *s;
+            else if (renamed[n_changed])
+                names_len += rows_pack(s, (uint32_t)(sh->heap_end + names_len),
+                                       &slot.row, names + names_len);
+            else
+                slot.row.gpa = s->gpa;
+
+            for (size_t b = 0; b < (size_t)sh->rec_size; b++) {
+                if (((const char *)&slot)[b] == page.bytes[at + b])
+                    continue;
+                if (at + b < lo)
+                    lo = at + b;
+                hi = at + b + 1;
+            }
+            memcpy(page.bytes + at, &slot, sh->rec_size);
+            n_changed++;
+            j = k;
+        }
+        if (j == i)
+            break;
+
+        if ((names != NULL && rows_append(sh, names, names_len) != NO_ERROR) ||
+            (hi > lo && sdb_pwrite(sh->fd, page.bytes + lo, hi - lo, page_off + lo) != (ssize_t)(hi - lo))) {
+            rc = ERR_DB_FILE;
+            break;
+        }
+        if (hi > lo)
+            pagecrc_update(sh, page_off, &page, len);
+        if (changelog_append_many(db, SDB_CHANGE_UPDATE, changed, n_changed) != NO_ERROR) {
+            if (hi > lo)
+                undo_page_write(sh, page_off, &orig, lo, hi, len);
+            rc = ERR_DB_FILE;
+            break;
+        }
+        for (int k = 0; k < n_changed && n_renames <= UPDATE_IDX_ADD_MAX; k++) {
+            if (renamed[k] && nameidx_add(sh, &changed[k]) != NO_ERROR)
+                n_renames = UPDATE_IDX_ADD_MAX + 1;
+        }
+        job->count += j - i;
+        i = j;
+    }
+    if (n_renames > UPDATE_IDX_ADD_MAX && job->count > 0)
+        nameidx_remove(sh);
+    pthread_rwlock_unlock(&sh->lock);
+    free(names);
+    return rc;
+}
+
+typedef struct ordered_update{
+    sdb_update_t u;
+    int          pos;
+} ordered_update_t;
+
+//by id, updates of the same id keep the order they were given in
+static int cmp_update(const void *a, const void *b) {
+    const ordered_update_t *x = a, *y = b;
+
+    if (x->u.id != y->u.id)
+        return (x->u.id > y->u.id) - (x->u.id < y->u.id);
+    return (x->pos > y->pos) - (x->pos < y->pos);
+}
+
+//Change single fields of existing records, in any order.  The updates are
+//sorted by id and each shard applies its share at the same time.  Every
+//updated record is logged as an SDB_CHANGE_UPDATE once its page is
+//written.  *applied is how many updates were applied, on an error that
+//can be some of them: the ones before the failing update in id order on
+//its shard, and any on the other shards.
+int sdb_update_many(sdb_t *db, const sdb_update_t *ups, int n, int *applied) {
+    ordered_update_t *sorted;
+    sdb_update_t *parts;
+    shard_job_t *jobs;
+    int at[SDB_MAX_SHARDS];
+    int rc;
+
+    *applied = 0;
+    for (int i = 0; i < n; i++) {
+        if (ups[i].field != SDB_FIELD_FNAME && ups[i].field != SDB_FIELD_LNAME &&
+            ups[i].field != SDB_FIELD_GPA)
+            return ERR_DB_OP;
+        if (shard_for(db, ups[i].id) == NULL ||
+            (ups[i].field == SDB_FIELD_GPA && (ups[i].gpa < MIN_STD_GPA || ups[i].gpa > MAX_STD_GPA)))
+            return ERR_DB_RANGE;
+    }
+
+    sorted = malloc((n > 0 ? n : 1) * sizeof(ordered_update_t));
+    parts = malloc((n > 0 ? n : 1) * sizeof(sdb_update_t));
+    jobs = new_jobs(db, run_update_many, NULL, db);
+    if (sorted == NULL || parts == NULL || jobs == NULL) {
+        free(sorted);
+        free(parts);
+        if (jobs != NULL)
+            free_jobs(db, jobs);
+        return ERR_DB_MEMORY;
+    }
+    for (int i = 0; i < n; i++) {
+        sorted[i].u = ups[i];
+        sorted[i].pos = i;
+    }
+    qsort(sorted, n, sizeof(ordered_update_t), cmp_update);
+
+    //split the updates by shard, each share stays sorted
+    for (int i = 0; i < n; i++)
+        jobs[shard_for(db, sorted[i].u.id) - db->shards].n_ups++;
+    for (int k = 0; k < db->n_shards; k++) {
+        at[k] = k == 0 ? 0 : at[k - 1] + jobs[k - 1].n_ups;
+        jobs[k].ups = parts + at[k];
+        jobs[k].arg = db;
+    }
+    for (int i = 0; i < n; i++)
+        parts[at[shard_for(db, sorted[i].u.id) - db->shards]++] = sorted[i].u;
+
+    rc = fan_out(db, jobs);
+    for (int k = 0; k < db->n_shards; k++)
+        *applied += jobs[k].count;
+    free_jobs(db, jobs);
+    free(parts);
+    free(sorted);
+    return rc;
+}
+
+static int run_verify(shard_job_t *job) {
+    int rc;
+
+    pthread_rwlock_rdlock(&job->sh->lock);
+    rc = pagecrc_verify(job->sh, job->n_threads, &job->verify);
+    pthread_rwlock_unlock(&job->sh->lock);
+    return rc;
+}
+
+//Every shard is checked at once, and the cpus left over are shared out so
+//the pages of each shard are checked in parallel too.  Returns
+//ERR_DB_CORRUPT when any page is bad, result says which.
+int sdb_verify(sdb_t *db, sdb_verify_t *result) {
+    shard_job_t *jobs = new_jobs(db, run_verify, NULL, NULL);
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int rc;
+
+    memset(result, 0, sizeof(*result));
+    if (jobs == NULL)
+        return ERR_DB_MEMORY;
+    for (int i = 0; i < db->n_shards; i++)
+        jobs[i].n_threads = cpus > db->n_shards ? cpus / db->n_shards : 1;
+
+    rc = fan_out(db, jobs);
+    for (int i = 0; i < db->n_shards; i++) {
+        const sdb_verify_t *v = &jobs[i].verify;
+        result->pages += v->pages;
+        result->unchecked += v->unchecked;
+        result->bad += v->bad;
+        if (v->first_bad_id != 0 && (result->first_bad_id == 0 || v->first_bad_id < result->first_bad_id))
+            result->first_bad_id = v->first_bad_id;
+    }
+    free_jobs(db, jobs);
+
+    if (rc == NO_ERROR && result->bad > 0)
+        rc = ERR_DB_CORRUPT;
+    return rc;
+}
+
+static int run_truncate(shard_job_t *job) {
+    sdb_shard_t *sh = job->sh;
+    int rc = NO_ERROR;
+
+    //a row format shard keeps its header and drops every name
+    pthread_rwlock_wrlock(&sh->lock);
+    if (ftruncate(sh->fd, sh->data_off) != 0 ||
+        (sh->heap_fd != -1 && ftruncate(sh->heap_fd, 0) != 0)) {
+        rc = ERR_DB_FILE;
+    } else {
+        sh->heap_end = 0;
+        pagecrc_clear(sh);
+        nameidx_remove(sh);
+    }
+    pthread_rwlock_unlock(&sh->lock);
+    return rc;
+}
+
+int sdb_truncate(sdb_t *db) {
+    shard_job_t *jobs = new_jobs(db, run_truncate, NULL, NULL);
+    int rc;
+
+    if (jobs == NULL)
+        return ERR_DB_MEMORY;
+    rc = fan_out(db, jobs);
+    free_jobs(db, jobs);
+    if (rc == NO_ERROR)
+        rc = changelog_append(db, SDB_CHANGE_CLEAR, &EMPTY_STUDENT_RECORD);
+    return rc;
+}
+
+//Stream the changes made after seq, so a reader that remembers the last
+//seq it saw only ever reads what is new.
+int sdb_changes_since(sdb_t *db, long long seq, sdb_change_fn fn, void *arg) {
+    return changelog_read(db, seq, fn, arg);
+}
+
+static int write_map(const char *map_path, const char *path, int scheme,
+                     int n_shards, char *const *dirs, int n_dirs) {
+    const char *base = path + dir_len(path);
+    long span = (long)MAX_STD_ID - MIN_STD_ID + 1;
+    FILE *f;
+
+    f = fopen(map_path, "w");
+    if (f == NULL)
+        return ERR_DB_FILE;
+
+    fprintf(f, "# student database shard map, see libsdb.h\n");
+    fprintf(f, "scheme %s\n", scheme == SDB_SHARD_HASH ? "hash" : "range");
+    for (int i = 0; i < n_shards; i++) {
+        fprintf(f, "shard ");
+        if (scheme == SDB_SHARD_RANGE)
+            fprintf(f, "%ld %ld ", MIN_STD_ID + span * i / n_shards,
+                    MIN_STD_ID + span * (i + 1) / n_shards - 1);
+        if (n_dirs > 0)
+            fprintf(f, "%s/", dirs[i % n_dirs]);
+        fprintf(f, "%s.%d\n", base, i);
+    }
+
+    if (fclose(f) != 0)
+        return ERR_DB_FILE;
+    return NO_ERROR;
+}
+
+//Split the database at path into n_shards shard files.  The shard files
+//are named after the database with the shard number on the end and are put
+//in dirs round robin (relative dirs are relative to the database's
+//directory and must exist), or next to the database when n_dirs is 0.
+//The records are moved into the new shards before the map is renamed into
+//place, so a failure part way leaves the database as it was.  The shards
+//are in the database's format and are bulk loaded like sdb_convert does,
+//so each is written in order into space allocated up front.  Only an
+//unsharded database can be split, and nothing may have it open meanwhile.
+int sdb_shard(const char *path, int scheme, int n_shards, char *const *dirs, int n_dirs) {
+    char *map_path = sdb_side_path(path, "", SHARD_MAP_SUFFIX);
+    char *tmp_map_path = sdb_side_path(path, TMP_FILE_PREFIX, SHARD_MAP_SUFFIX);
+    char *idx_path = sdb_side_path(path, "", NAME_IDX_SUFFIX);
+    char *crc_path = sdb_side_path(path, "", CRC_SUFFIX);
+    char *heap_path = sdb_side_path(path, "", ROWS_HEAP_SUFFIX);
+    rec_buf_t all = { NULL, 0, 0 };
+    sdb_t *old_db = NULL;
+    sdb_t *new_db = NULL;
+    int rc;
+
+    if (map_path == NULL || tmp_map_path == NULL || idx_path == NULL || crc_path == NULL ||
+        heap_path == NULL) {
+        rc = ERR_DB_MEMORY;
+    } else if (n_shards < 1 || n_shards > SDB_MAX_SHARDS ||
+               (scheme != SDB_SHARD_HASH && scheme != SDB_SHARD_RANGE)) {
+        rc = ERR_DB_RANGE;
+    } else if (access(map_path, F_OK) == 0) {
+        rc = ERR_DB_EXISTS;
+    } else {
+        rc = write_map(tmp_map_path, path, scheme, n_shards, dirs, n_dirs);
+        if (rc == NO_ERROR)
+            rc = open_path(path, NULL, 0, &old_db);
+        if (rc == NO_ERROR)
+            rc = open_path(path, tmp_map_path, SDB_OPEN_TRUNCATE |
+                           (old_db->shards[0].format == SDB_FORMAT_ROWS ? SDB_OPEN_ROWS : 0), &new_db);
+        if (rc == NO_ERROR)
+            rc = sdb_scan(old_db, MIN_STD_ID, MAX_STD_ID, buffer_record, &all);
+        if (rc == NO_ERROR)
+            rc = sdb_put_many(new_db, all.recs, all.len);
+
+        //clean up the half made shards so the old database stays the only one
+        if (rc != NO_ERROR && new_db != NULL) {
+            for (int i = 0; i < new_db->n_shards; i++) {
+                unlink(new_db->shards[i].path);
+                unlink(new_db->shards[i].idx_path);
+                unlink(new_db->shards[i].crc_path);
+                unlink(new_db->shards[i].heap_path);
+            }
+        }
+        sdb_close(old_db);
+        if (sdb_close(new_db) != NO_ERROR && rc == NO_ERROR)
+            rc = ERR_DB_FILE;
+
+        if (rc == NO_ERROR && rename(tmp_map_path, map_path) != 0)
+            rc = ERR_DB_FILE;
+        if (rc == NO_ERROR) {
+            unlink(path);
+            unlink(idx_path);
+            unlink(crc_path);
+            unlink(heap_path);
+        } else {
+            unlink(tmp_map_path);
+        }
+    }
+
+    free(all.recs);
+    free(map_path);
+    free(tmp_map_path);
+    free(idx_path);
+    free(crc_path);
+    free(heap_path);
+    return rc;
+}
+
+//A handle on a new, empty copy of every shard of db, next to it at the
+//shard's tmp_path and with the same geometry.
+static int open_twin(sdb_t *db, int flags, sdb_t **twin) {
+    sdb_t *h = calloc(1, sizeof(*h));
+    int rc = NO_ERROR;
+
+    *twin = NULL;
+    if (h == NULL || (h->shards = calloc(db->n_shards, sizeof(sdb_shard_t))) == NULL) {
+        free(h);
+        return ERR_DB_MEMORY;
+    }
+    h->scheme = db->scheme;
+    h->log_fd = -1;
+
+    for (int i = 0; i < db->n_shards && rc == NO_ERROR; i++) {
+        sdb_shard_t *from = &db->shards[i];
+        sdb_shard_t *sh = &h->shards[i];
+
+        sh->lo = from->lo;
+        sh->hi = from->hi;
+        sh->stride = from->stride;
+        sh->base = from->base;
+        sh->rem = from->rem;
+        if ((rc = open_shard(sh, from->tmp_path, flags)) == NO_ERROR)
+            h->n_shards++;
+    }
+    if (rc != NO_ERROR) {
+        for (int i = 0; i < h->n_shards; i++)
+            unlink(h->shards[i].path);
+        sdb_close(h);
+        return rc;
+    }
+    *twin = h;
+    return NO_ERROR;
+}
+
+//Move the converted copy of a shard over it.  The old sums go first, a
+//crash part way leaves pages unchecked rather than failing their sums.
+static int swap_shard(sdb_shard_t *sh, sdb_shard_t *copy) {
+    unlink(sh->crc_path);
+    if (copy->format == SDB_FORMAT_ROWS && rename(copy->heap_path, sh->heap_path) != 0)
+        return ERR_DB_FILE;
+    if (rename(copy->path, sh->path) != 0 || rename(copy->crc_path, sh->crc_path) != 0)
+        return ERR_DB_FILE;
+    if (copy->format == SDB_FORMAT_RECORDS)
+        unlink(sh->heap_path);
+    return NO_ERROR;
+}
+
+//Rewrite every shard of the database at path in format, see libsdb.h.  The
+//records are loaded into a copy of each shard which is then renamed over
+//it, the name index and the change log stay as they are since no record
+//changes.  Each shard file says which format it is in, so a failure part
+//way leaves a database whose shards are in either format.  Nothing may
+//have the database open meanwhile.
+int sdb_convert(const char *path, int format) {
+    char *map_path = sdb_side_path(path, "", SHARD_MAP_SUFFIX);
+    rec_buf_t all = { NULL, 0, 0 };
+    sdb_t *old_db = NULL;
+    sdb_t *new_db = NULL;
+    int rc;
+
+    if (map_path == NULL)
+        return ERR_DB_MEMORY;
+    if (format != SDB_FORMAT_RECORDS && format != SDB_FORMAT_ROWS) {
+        free(map_path);
+        return ERR_DB_RANGE;
+    }
+
+    rc = open_path(path, access(map_path, F_OK) == 0 ? map_path : NULL, 0, &old_db);
+    if (rc == NO_ERROR)
+        rc = open_twin(old_db, SDB_OPEN_TRUNCATE | (format == SDB_FORMAT_ROWS ? SDB_OPEN_ROWS : 0), &new_db);
+    if (rc == NO_ERROR)
+        rc = sdb_scan(old_db, MIN_STD_ID, MAX_STD_ID, buffer_record, &all);
+    if (rc == NO_ERROR)
+        rc = sdb_put_many(new_db, all.recs, all.len);
+
+    for (int i = 0; rc == NO_ERROR && i < old_db->n_shards; i++)
+        rc = swap_shard(&old_db->shards[i], &new_db->shards[i]);
+    if (rc != NO_ERROR && new_db != NULL) {
+        for (int i = 0; i < new_db->n_shards; i++) {
+            unlink(new_db->shards[i].path);
+            unlink(new_db->shards[i].crc_path);
+            unlink(new_db->shards[i].heap_path);
+        }
+    }
+    sdb_close(old_db);
+    if (sdb_close(new_db) != NO_ERROR && rc == NO_ERROR)
+        rc = ERR_DB_FILE;
+
+    free(all.recs);
+    free(map_path);
+    return rc;
+}
+
+const char *sdb_strerror(int rc) {
+    switch (rc) {
+    case NO_ERROR:       return "no error";
+    case ERR_DB_FILE:    return "database file error";
+    case ERR_DB_OP:      return "invalid operation";
+    case SRCH_NOT_FOUND: return "student not found";
+    case ERR_DB_MEMORY:  return "out of memory";
+    case ERR_DB_EXISTS:  return "already exists";
+    case ERR_DB_RANGE:   return "id, gpa, shard count or format out of range";
+    case ERR_DB_CORRUPT: return "checksum mismatch, the data is corrupt";
+    default:             return "unknown error";
+    }
+}
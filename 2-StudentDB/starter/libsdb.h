@@ -0,0 +1,175 @@
+#ifndef __LIBSDB_H__
+    #define __LIBSDB_H__
+
+#include "db.h" //get student record type
+
+//libsdb - the student database as a library.  sdbsc is a thin command line
+//wrapper around it, other programs can link libsdb.a directly instead of
+//running sdbsc and parsing its output.
+//
+//An sdb_t handle owns the open database files and the cached name index
+//state.  Functions never print, they return one of the error codes below.
+//A handle can be shared between threads: lookups and scans run in
+//parallel, puts, deletes and the maintenance calls are exclusive.  Records
+//are read and written with pread/pwrite so nothing depends on a shared
+//file offset.
+//
+//A database can be split into shards with sdb_shard().  The split is
+//described by a shard map, a text file named after the database with
+//SHARD_MAP_SUFFIX on the end:
+//
+//      scheme hash                     scheme range
+//      shard student.db.0              shard 1 50000 student.db.0
+//      shard /disk2/student.db.1       shard 50001 100000 /disk2/student.db.1
+//
+//Relative shard paths are relative to the directory of the database.  When
+//there is no map the database is the single file it always was.  Puts,
+//gets and deletes go to the one shard that owns the id, scans, counts and
+//lookups run on every shard at once, one thread per shard.
+//
+//Every shard keeps CRC32C checksums of its 4K pages, see pagecrc.h.  Reads
+//check the pages they touch and fail with ERR_DB_CORRUPT on a mismatch,
+//sdb_verify checks every page.
+//
+//Shard files come in two formats.  The original one stores each student_t
+//as it is, the row format keeps 4 times as many students per page for
+//scans and leaves the padding of short names out, sdb_convert switches.
+//Either way the API deals in student_t records, so names are cut to the
+//student_t fields in both formats.
+//
+//sdb_update_many changes single fields of existing records in place and
+//only writes the bytes that change, a gpa update does not rewrite the
+//whole record.
+//
+//Slots written one at a time at scattered ids leave the files fragmented.
+//sdb_put_many allocates the range it loads up front, sdb_reserve does it
+//ahead of time for every id up to some id, neither changes the file size.
+//
+//sdb_export and sdb_import copy a whole database to and from a compressed
+//snapshot file, see snapshot.h.  A snapshot does not care how either
+//database is sharded.
+typedef struct sdb sdb_t;
+
+//called for each record by the scanning functions, in id order.  Return
+//NO_ERROR to keep going.  Any other value stops the scan and is returned
+//to the caller.  The handle may be locked while the callback runs, so the
+//callback must not call sdb_put, sdb_del, sdb_compact or sdb_truncate.
+typedef int (*sdb_scan_fn)(const student_t *s, void *arg);
+
+//called by sdb_changes_since for each change, oldest first.  Return
+//NO_ERROR to keep going, any other value stops and is returned.
+typedef int (*sdb_change_fn)(long long seq, int op, const student_t *s, void *arg);
+
+//change log operations passed to sdb_change_fn
+#define SDB_CHANGE_ADD      1       //s is the new record
+#define SDB_CHANGE_DEL      2       //only s->id is set
+#define SDB_CHANGE_CLEAR    3       //every record was removed, s is empty
+#define SDB_CHANGE_UPDATE   4       //s is the record after the change
+
+//fields an sdb_update_t can change
+#define SDB_FIELD_FNAME     1
+#define SDB_FIELD_LNAME     2
+#define SDB_FIELD_GPA       3
+
+//one field change for sdb_update_many
+typedef struct sdb_update{
+    int  id;
+    int  field;             //SDB_FIELD_FNAME, _LNAME or _GPA
+    int  gpa;               //for SDB_FIELD_GPA
+    char name[32];          //for the names, cut to fit like sdb_put does
+} sdb_update_t;
+
+//filled in by sdb_verify
+typedef struct sdb_verify{
+    long pages;             //pages checked against their checksum
+    long unchecked;         //pages not written since checksums were kept
+    long bad;               //pages whose checksum does not match
+    int  first_bad_id;      //lowest id kept in a bad page, 0 if none
+} sdb_verify_t;
+
+//Filled in by sdb_stats_get, everything the library did since stats were
+//enabled.  Only read and write system calls are counted, the name index
+//and the page checksums are mapped and cost none.  Times are in ns and
+//are summed over threads, so a fanned out scan can spend more io_ns than
+//it took.
+typedef struct sdb_stats{
+    long long syscalls;         //reads + writes
+    long long reads;
+    long long writes;
+    long long bytes_read;
+    long long bytes_written;
+    long long visited;          //records looked at
+    long long returned;         //records handed to a caller
+    long long io_ns;            //inside read and write calls
+    long long parse_ns;         //compiling filters and name patterns
+} sdb_stats_t;
+
+//flags for sdb_open
+#define SDB_OPEN_TRUNCATE   0x01    //start with an empty database
+#define SDB_OPEN_ROWS       0x02    //new or truncated files use SDB_FORMAT_ROWS
+
+//shard file formats for sdb_convert, each shard file says which it is in
+#define SDB_FORMAT_RECORDS  1       //the original 64 byte student_t slots
+#define SDB_FORMAT_ROWS     2       //16 byte rows and a name heap, see rows.h
+
+//sharding schemes for sdb_shard
+#define SDB_SHARD_HASH      0       //shard k of n holds the ids with id % n == k
+#define SDB_SHARD_RANGE     1       //each shard holds one contiguous id range
+#define SDB_MAX_SHARDS      64
+#define SHARD_MAP_SUFFIX    ".shards"
+
+//error codes to be returned from individual functions
+// NO_ERROR is returned if there are no errors
+// ERR_DB_FILE is returned if there is are any issues with the database file itself
+// ERR_DB_OP is returned if an operation did not work, e.g. a bad name pattern or query
+// SRCH_NOT_FOUND is returned if the student is not found (get_student, and del_student)
+// ERR_DB_MEMORY is returned if a working buffer could not be allocated
+// ERR_DB_EXISTS is returned when adding a student whose id is already in use
+// ERR_DB_RANGE is returned when an id or gpa is outside the allowed range
+// ERR_DB_CORRUPT is returned when a page of the database or a snapshot block fails its checksum
+#define NO_ERROR        0
+#define ERR_DB_FILE     -1
+#define ERR_DB_OP       -2
+#define SRCH_NOT_FOUND  -3
+#define ERR_DB_MEMORY   -4
+#define ERR_DB_EXISTS   -5
+#define ERR_DB_RANGE    -6
+#define ERR_DB_CORRUPT  -7
+
+#define SCAN_BLOCK_RECORDS  256     //records per read during scans, 16K
+
+int sdb_open(const char *path, int flags, sdb_t **db);
+int sdb_close(sdb_t *db);
+
+int sdb_get(sdb_t *db, int id, student_t *s);
+int sdb_put(sdb_t *db, const student_t *s);
+int sdb_put_many(sdb_t *db, const student_t *recs, int n);
+int sdb_del(sdb_t *db, int id);
+int sdb_update_many(sdb_t *db, const sdb_update_t *ups, int n, int *applied);
+int sdb_reserve(sdb_t *db, int last_id);
+
+int sdb_scan(sdb_t *db, int first_id, int last_id, sdb_scan_fn fn, void *arg);
+int sdb_count(sdb_t *db, int *count);
+int sdb_find_name(sdb_t *db, const char *pattern, sdb_scan_fn fn, void *arg);
+int sdb_query(sdb_t *db, const char *filter, sdb_scan_fn fn, void *arg, const char **err_at);
+
+int sdb_changes_since(sdb_t *db, long long seq, sdb_change_fn fn, void *arg);
+
+int sdb_export(sdb_t *db, const char *path, int *n_records);
+int sdb_import(sdb_t *db, const char *path, int *n_records);
+
+int sdb_verify(sdb_t *db, sdb_verify_t *result);
+int sdb_compact(sdb_t *db);
+int sdb_truncate(sdb_t *db);
+
+int sdb_shard(const char *path, int scheme, int n_shards, char *const *dirs, int n_dirs);
+int sdb_shard_count(sdb_t *db);
+int sdb_convert(const char *path, int format);
+
+//ERR_DB_OP when the library was built without stats, see stats.h
+int sdb_stats_enable(int on);
+int sdb_stats_get(sdb_stats_t *s);
+
+const char *sdb_strerror(int rc);
+
+#endif
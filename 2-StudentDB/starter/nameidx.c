@@ -0,0 +1,548 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+#include "db.h"
+#include "libsdb.h"
+#include "sdb_internal.h"
+#include "nameidx.h"
+#include "stats.h"
+
+//growable arrays used while building the index and collecting ids
+typedef struct vec{
+    void  *data;
+    size_t len;
+    size_t cap;
+    size_t elem;
+} vec_t;
+
+static int vec_push(vec_t *v, const void *item) {
+    if (v->len == v->cap) {
+        size_t cap = v->cap ? v->cap * 2 : 1024;
+        void *data = realloc(v->data, cap * v->elem);
+        if (data == NULL)
+            return ERR_DB_MEMORY;
+        v->data = data;
+        v->cap = cap;
+    }
+    memcpy((char *)v->data + v->len * v->elem, item, v->elem);
+    v->len++;
+    return NO_ERROR;
+}
+
+static void make_key(char *key, const char *name, size_t max) {
+    size_t i;
+
+    memset(key, 0, NAME_KEY_LEN);
+    for (i = 0; i < max && i < NAME_KEY_LEN - 1 && name[i] != '\0'; i++)
+        key[i] = tolower((unsigned char)name[i]);
+}
+
+static uint32_t make_gram(int field, const char *s) {
+    return ((uint32_t)field << 24) | ((uint32_t)(unsigned char)s[0] << 16) |
+           ((uint32_t)(unsigned char)s[1] << 8) | (uint32_t)(unsigned char)s[2];
+}
+
+static int cmp_name(const void *a, const void *b) {
+    const name_entry_t *x = a, *y = b;
+    int rc = strcmp(x->key, y->key);
+
+    if (rc != 0)
+        return rc;
+    if (x->field != y->field)
+        return x->field - y->field;
+    return (x->id > y->id) - (x->id < y->id);
+}
+
+static int cmp_gram(const void *a, const void *b) {
+    const gram_entry_t *x = a, *y = b;
+
+    if (x->gram != y->gram)
+        return (x->gram > y->gram) - (x->gram < y->gram);
+    return (x->id > y->id) - (x->id < y->id);
+}
+
+static int cmp_int(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+static void fill_entry(name_entry_t *e, int id, int field, const char *name, size_t max) {
+    memset(e, 0, sizeof(*e));
+    e->id = id;
+    e->field = (char)field;
+    make_key(e->key, name, max);
+}
+
+static int add_record(vec_t *names, vec_t *grams, const student_t *s) {
+    name_entry_t e[2];
+
+    fill_entry(&e[0], s->id, NAME_FIELD_FNAME, s->fname, sizeof(s->fname));
+    fill_entry(&e[1], s->id, NAME_FIELD_LNAME, s->lname, sizeof(s->lname));
+
+    for (int i = 0; i < 2; i++) {
+        if (vec_push(names, &e[i]) != NO_ERROR)
+            return ERR_DB_MEMORY;
+
+        int len = strlen(e[i].key);
+        for (int j = 0; j + 3 <= len; j++) {
+            gram_entry_t g = { make_gram(e[i].field, e[i].key + j), s->id };
+            if (vec_push(grams, &g) != NO_ERROR)
+                return ERR_DB_MEMORY;
+        }
+    }
+    return NO_ERROR;
+}
+
+static int write_all(int fd, const void *buff, size_t len) {
+    const char *p = buff;
+
+    while (len > 0) {
+        ssize_t n = sdb_write(fd, p, len);
+        if (n <= 0)
+            return ERR_DB_FILE;
+        p += n;
+        len -= n;
+    }
+    return NO_ERROR;
+}
+
+typedef struct build_state{
+    vec_t names;
+    vec_t grams;
+} build_state_t;
+
+static int build_record(const student_t *s, void *arg) {
+    build_state_t *b = arg;
+    return add_record(&b->names, &b->grams, s);
+}
+
+//drop the cached mapping, the next search maps the file again
+static void unmap_index(sdb_shard_t *sh) {
+    if (sh->idx.map != NULL)
+        munmap(sh->idx.map, sh->idx.size);
+    sh->idx.map = NULL;
+    sh->idx.size = 0;
+}
+
+//Rebuild the index from scratch with one sequential pass over the
+//database.  The new index is written to a temp file and renamed into place
+//so a reader never sees a half written index.  Called with idx_lock held.
+static int build_index(sdb_shard_t *sh) {
+    build_state_t b = {
+        { NULL, 0, 0, sizeof(name_entry_t) },
+        { NULL, 0, 0, sizeof(gram_entry_t) },
+    };
+    vec_t *names = &b.names;
+    vec_t *grams = &b.grams;
+    name_idx_hdr_t hdr = { NAME_IDX_MAGIC, NAME_IDX_VERSION, 0, 0 };
+    int rc;
+    int fd;
+
+    unmap_index(sh);
+    rc = shard_scan_nolock(sh, 0, MAX_STD_ID, build_record, &b);
+
+    if (rc == NO_ERROR) {
+        qsort(names->data, names->len, names->elem, cmp_name);
+        qsort(grams->data, grams->len, grams->elem, cmp_gram);
+        hdr.base_names = names->len;
+        hdr.base_grams = grams->len;
+
+        fd = open(sh->idx_tmp_path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+        if (fd == -1) {
+            rc = ERR_DB_FILE;
+        } else {
+            if (write_all(fd, &hdr, sizeof(hdr)) != NO_ERROR ||
+                write_all(fd, names->data, names->len * names->elem) != NO_ERROR ||
+                write_all(fd, grams->data, grams->len * grams->elem) != NO_ERROR)
+                rc = ERR_DB_FILE;
+            close(fd);
+            if (rc == NO_ERROR && rename(sh->idx_tmp_path, sh->idx_path) != 0)
+                rc = ERR_DB_FILE;
+            if (rc != NO_ERROR)
+                unlink(sh->idx_tmp_path);
+        }
+    }
+
+    free(names->data);
+    free(grams->data);
+    return rc;
+}
+
+//Returns the byte offset where the tail starts or ERR_DB_FILE if the file
+//is not a usable index
+static off_t check_index(int fd, name_idx_hdr_t *hdr, off_t *size) {
+    struct stat st;
+    off_t base_end;
+
+    if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(*hdr))
+        return ERR_DB_FILE;
+    if (sdb_pread(fd, hdr, sizeof(*hdr), 0) != sizeof(*hdr))
+        return ERR_DB_FILE;
+    if (hdr->magic != NAME_IDX_MAGIC || hdr->version != NAME_IDX_VERSION)
+        return ERR_DB_FILE;
+
+    base_end = sizeof(*hdr) + (off_t)hdr->base_names * sizeof(name_entry_t) +
+               (off_t)hdr->base_grams * sizeof(gram_entry_t);
+    if (st.st_size < base_end || (st.st_size - base_end) % sizeof(name_entry_t) != 0)
+        return ERR_DB_FILE;
+
+    *size = st.st_size;
+    return base_end;
+}
+
+int nameidx_build(sdb_shard_t *sh) {
+    int rc;
+
+    pthread_mutex_lock(&sh->idx_lock);
+    rc = build_index(sh);
+    pthread_mutex_unlock(&sh->idx_lock);
+    return rc;
+}
+
+//Called after s has been written to the database.  The two name keys go on
+//the end of the tail, so an add costs one small append.  If there is no
+//usable index yet, or the tail is full, rebuild instead (the rebuild will
+//pick up s from the database).
+static int add_entry(sdb_shard_t *sh, const student_t *s) {
+    name_idx_hdr_t hdr;
+    name_entry_t e[2];
+    off_t base_end;
+    off_t size;
+    int fd;
+    int rc;
+
+    fd = open(sh->idx_path, O_RDWR | O_APPEND);
+    if (fd == -1)
+        return build_index(sh);
+
+    base_end = check_index(fd, &hdr, &size);
+    if (base_end < 0 ||
+        (size - base_end) / (off_t)sizeof(name_entry_t) + 2 > NAME_IDX_TAIL_MAX) {
+        close(fd);
+        return build_index(sh);
+    }
+
+    fill_entry(&e[0], s->id, NAME_FIELD_FNAME, s->fname, sizeof(s->fname));
+    fill_entry(&e[1], s->id, NAME_FIELD_LNAME, s->lname, sizeof(s->lname));
+    rc = write_all(fd, e, sizeof(e));
+    close(fd);
+
+    //the cached mapping ends before the new entries
+    unmap_index(sh);
+
+    //a torn append would leave the tail misaligned, start over in that case
+    if (rc != NO_ERROR)
+        return build_index(sh);
+    return NO_ERROR;
+}
+
+int nameidx_add(sdb_shard_t *sh, const student_t *s) {
+    int rc;
+
+    pthread_mutex_lock(&sh->idx_lock);
+    rc = add_entry(sh, s);
+    pthread_mutex_unlock(&sh->idx_lock);
+    return rc;
+}
+
+int nameidx_remove(sdb_shard_t *sh) {
+    int rc = NO_ERROR;
+
+    pthread_mutex_lock(&sh->idx_lock);
+    unmap_index(sh);
+    if (unlink(sh->idx_path) != 0 && access(sh->idx_path, F_OK) == 0)
+        rc = ERR_DB_FILE;
+    pthread_mutex_unlock(&sh->idx_lock);
+    return rc;
+}
+
+void nameidx_close(sdb_shard_t *sh) {
+    unmap_index(sh);
+}
+
+//Pattern syntax: [fname:|lname:]text with an optional leading and/or
+//trailing '*', e.g. "lname:mc*" or "*son*".  Matching is case insensitive.
+int nameidx_parse_pattern(const char *pattern, name_pattern_t *p) {
+    const char *text = pattern;
+    bool lead, trail;
+    int len;
+
+    memset(p, 0, sizeof(*p));
+    p->field = NAME_FIELD_ANY;
+    if (strncmp(text, "fname:", 6) == 0) {
+        p->field = NAME_FIELD_FNAME;
+        text += 6;
+    } else if (strncmp(text, "lname:", 6) == 0) {
+        p->field = NAME_FIELD_LNAME;
+        text += 6;
+    }
+
+    len = strlen(text);
+    lead = len > 0 && text[0] == '*';
+    trail = len > (lead ? 1 : 0) && text[len - 1] == '*';
+    if (lead) {
+        text++;
+        len--;
+    }
+    if (trail)
+        len--;
+
+    if (len <= 0 || len >= NAME_KEY_LEN || memchr(text, '*', len) != NULL)
+        return ERR_DB_OP;
+
+    for (int i = 0; i < len; i++)
+        p->text[i] = tolower((unsigned char)text[i]);
+    p->len = len;
+
+    if (lead && trail)
+        p->kind = NAME_MATCH_SUBSTR;
+    else if (lead)
+        p->kind = NAME_MATCH_SUFFIX;
+    else if (trail)
+        p->kind = NAME_MATCH_PREFIX;
+    else
+        p->kind = NAME_MATCH_EXACT;
+    return NO_ERROR;
+}
+
+static bool key_matches(const name_pattern_t *p, const char *key) {
+    int klen;
+
+    switch (p->kind) {
+    case NAME_MATCH_EXACT:
+        return strcmp(key, p->text) == 0;
+    case NAME_MATCH_PREFIX:
+        return strncmp(key, p->text, p->len) == 0;
+    case NAME_MATCH_SUFFIX:
+        klen = strlen(key);
+        return klen >= p->len && strcmp(key + klen - p->len, p->text) == 0;
+    default:
+        return strstr(key, p->text) != NULL;
+    }
+}
+
+static bool field_matches(const name_pattern_t *p, int field) {
+    return p->field == NAME_FIELD_ANY || p->field == field;
+}
+
+//Checks a real record against the pattern, used to weed out stale index
+//entries and trigram false positives
+int nameidx_matches(const name_pattern_t *p, const student_t *s) {
+    char key[NAME_KEY_LEN];
+
+    if (field_matches(p, NAME_FIELD_FNAME)) {
+        make_key(key, s->fname, sizeof(s->fname));
+        if (key_matches(p, key))
+            return 1;
+    }
+    if (field_matches(p, NAME_FIELD_LNAME)) {
+        make_key(key, s->lname, sizeof(s->lname));
+        if (key_matches(p, key))
+            return 1;
+    }
+    return 0;
+}
+
+//first name entry whose key is >= text (compared over len bytes)
+static size_t names_lower_bound(const name_entry_t *names, size_t n, const char *text, int len) {
+    size_t lo = 0, hi = n;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (strncmp(names[mid].key, text, len) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+//[*lo, *hi) is the posting list for gram
+static void gram_range(const gram_entry_t *grams, size_t n, uint32_t gram, size_t *lo, size_t *hi) {
+    size_t l = 0, h = n;
+
+    while (l < h) {
+        size_t mid = l + (h - l) / 2;
+        if (grams[mid].gram < gram)
+            l = mid + 1;
+        else
+            h = mid;
+    }
+    *lo = l;
+    h = n;
+    while (l < h) {
+        size_t mid = l + (h - l) / 2;
+        if (grams[mid].gram <= gram)
+            l = mid + 1;
+        else
+            h = mid;
+    }
+    *hi = l;
+}
+
+static bool posting_has(const gram_entry_t *grams, size_t lo, size_t hi, int id) {
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (grams[mid].id == id)
+            return true;
+        if (grams[mid].id < id)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return false;
+}
+
+//Intersect the posting lists of every trigram in the pattern, starting
+//from the shortest list
+static int search_grams(const gram_entry_t *grams, size_t n, const name_pattern_t *p, int field, vec_t *out) {
+    int ngrams = p->len - 2;
+    size_t lo[NAME_KEY_LEN], hi[NAME_KEY_LEN];
+    int best = 0;
+
+    for (int i = 0; i < ngrams; i++) {
+        gram_range(grams, n, make_gram(field, p->text + i), &lo[i], &hi[i]);
+        if (hi[i] - lo[i] < hi[best] - lo[best])
+            best = i;
+    }
+
+    for (size_t k = lo[best]; k < hi[best]; k++) {
+        int id = grams[k].id;
+        bool all = true;
+
+        for (int i = 0; i < ngrams && all; i++) {
+            if (i != best)
+                all = posting_has(grams, lo[i], hi[i], id);
+        }
+        if (all && vec_push(out, &id) != NO_ERROR)
+            return ERR_DB_MEMORY;
+    }
+    return NO_ERROR;
+}
+
+static int search_mapped(const char *map, const name_idx_hdr_t *hdr, off_t base_end, off_t size,
+                         const name_pattern_t *p, vec_t *out) {
+    const name_entry_t *names = (const name_entry_t *)(map + sizeof(*hdr));
+    const gram_entry_t *grams = (const gram_entry_t *)(names + hdr->base_names);
+    const name_entry_t *tail = (const name_entry_t *)(map + base_end);
+    size_t n_tail = (size - base_end) / sizeof(name_entry_t);
+    int rc = NO_ERROR;
+
+    if (p->kind == NAME_MATCH_EXACT || p->kind == NAME_MATCH_PREFIX) {
+        //sorted keys: everything with the prefix is one contiguous run
+        for (size_t i = names_lower_bound(names, hdr->base_names, p->text, p->len);
+             i < hdr->base_names && strncmp(names[i].key, p->text, p->len) == 0 && rc == NO_ERROR; i++) {
+            if (field_matches(p, names[i].field) && key_matches(p, names[i].key))
+                rc = vec_push(out, &names[i].id);
+        }
+    } else if (p->len >= 3) {
+        if (field_matches(p, NAME_FIELD_FNAME))
+            rc = search_grams(grams, hdr->base_grams, p, NAME_FIELD_FNAME, out);
+        if (rc == NO_ERROR && field_matches(p, NAME_FIELD_LNAME))
+            rc = search_grams(grams, hdr->base_grams, p, NAME_FIELD_LNAME, out);
+    } else {
+        //too short for a trigram, walk the keys (still never touches the db)
+        for (size_t i = 0; i < hdr->base_names && rc == NO_ERROR; i++) {
+            if (field_matches(p, names[i].field) && key_matches(p, names[i].key))
+                rc = vec_push(out, &names[i].id);
+        }
+    }
+
+    for (size_t i = 0; i < n_tail && rc == NO_ERROR; i++) {
+        if (field_matches(p, tail[i].field) && key_matches(p, tail[i].key))
+            rc = vec_push(out, &tail[i].id);
+    }
+    return rc;
+}
+
+//Map the index if it is not mapped yet, building it first if it is missing
+//or unusable.  Another process may have appended to or rebuilt the file
+//since it was mapped, so the cached mapping is only reused while the file
+//is unchanged.  Called with idx_lock held.
+static int map_index(sdb_shard_t *sh) {
+    name_idx_hdr_t hdr;
+    struct stat st;
+    off_t base_end = ERR_DB_FILE;
+    off_t size = 0;
+    char *map;
+    int rc;
+    int fd = -1;
+
+    if (sh->idx.map != NULL) {
+        if (stat(sh->idx_path, &st) == 0 && st.st_ino == sh->idx.ino && st.st_size == sh->idx.size)
+            return NO_ERROR;
+        unmap_index(sh);
+    }
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        fd = open(sh->idx_path, O_RDONLY);
+        if (fd != -1) {
+            base_end = check_index(fd, &hdr, &size);
+            if (base_end >= 0)
+                break;
+            close(fd);
+            fd = -1;
+        }
+        if (attempt == 0 && (rc = build_index(sh)) != NO_ERROR)
+            return rc;
+    }
+    if (fd == -1)
+        return ERR_DB_FILE;
+
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return ERR_DB_FILE;
+    }
+    map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return ERR_DB_FILE;
+
+    sh->idx.map = map;
+    sh->idx.size = size;
+    sh->idx.ino = st.st_ino;
+    sh->idx.base_end = base_end;
+    sh->idx.hdr = hdr;
+    return NO_ERROR;
+}
+
+//Collect the candidate ids for pattern p in ascending order without
+//duplicates.  Candidates still need to be checked with nameidx_matches()
+//against the current record.  The caller frees *ids.
+int nameidx_search(sdb_shard_t *sh, const name_pattern_t *p, int **ids, int *n_ids) {
+    vec_t out = { NULL, 0, 0, sizeof(int) };
+    int rc;
+
+    *ids = NULL;
+    *n_ids = 0;
+
+    pthread_mutex_lock(&sh->idx_lock);
+    rc = map_index(sh);
+    if (rc == NO_ERROR)
+        rc = search_mapped(sh->idx.map, &sh->idx.hdr, sh->idx.base_end, sh->idx.size, p, &out);
+    pthread_mutex_unlock(&sh->idx_lock);
+
+    if (rc != NO_ERROR) {
+        free(out.data);
+        return rc;
+    }
+
+    qsort(out.data, out.len, sizeof(int), cmp_int);
+    int *v = out.data;
+    size_t n = 0;
+    for (size_t i = 0; i < out.len; i++) {
+        if (n == 0 || v[n - 1] != v[i])
+            v[n++] = v[i];
+    }
+
+    *ids = v;
+    *n_ids = n;
+    return NO_ERROR;
+}
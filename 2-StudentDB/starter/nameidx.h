@@ -0,0 +1,87 @@
+#ifndef __NAMEIDX_H__
+    #define __NAMEIDX_H__
+
+#include <stdint.h>
+
+#include <sys/types.h>
+
+#include "db.h"     //get student record type
+
+//one shard of an sdb_t, see sdb_internal.h
+typedef struct sdb_shard sdb_shard_t;
+
+//Each shard has its own name index next to the shard file, named after it
+//with NAME_IDX_SUFFIX on the end.  It has three parts:
+//  1. a header
+//  2. a "base" that is sorted and searched with binary search.  The sorted
+//     name keys act as a flattened trie for prefix lookups and the trigram
+//     postings serve substring lookups.
+//  3. a "tail" of unsorted name entries that add_student() appends to.  When
+//     the tail grows past NAME_IDX_TAIL_MAX entries the index is rebuilt.
+//
+//Entries are never removed when a student is deleted.  Every id the index
+//returns is checked against the real record, so stale entries just fall out.
+#define NAME_IDX_MAGIC      0x58494e53      //"SNIX"
+#define NAME_IDX_VERSION    1
+#define NAME_IDX_TAIL_MAX   4096
+#define NAME_KEY_LEN        32              //big enough for lname + '\0'
+
+//which name a key came from, also used to limit a search to one field
+#define NAME_FIELD_ANY      0
+#define NAME_FIELD_FNAME    1
+#define NAME_FIELD_LNAME    2
+
+typedef struct name_idx_hdr{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t base_names;    //sorted name entries that follow the header
+    uint32_t base_grams;    //sorted trigram entries that follow the names
+} name_idx_hdr_t;
+
+typedef struct name_entry{
+    int32_t id;
+    char    field;
+    char    key[NAME_KEY_LEN];  //lower cased, zero padded
+} name_entry_t;
+
+//trigram postings pack the field into the top byte and the three lower
+//cased characters into the bottom 3 bytes of gram
+typedef struct gram_entry{
+    uint32_t gram;
+    int32_t  id;
+} gram_entry_t;
+
+//a parsed -n pattern
+#define NAME_MATCH_EXACT    0   //doe
+#define NAME_MATCH_PREFIX   1   //mc*
+#define NAME_MATCH_SUFFIX   2   //*son
+#define NAME_MATCH_SUBSTR   3   //*son*
+
+typedef struct name_pattern{
+    int  field;
+    int  kind;
+    int  len;
+    char text[NAME_KEY_LEN];    //lower cased, wildcards stripped
+} name_pattern_t;
+
+//the mapped index cached in the shard between searches
+typedef struct nameidx_map{
+    char          *map;
+    off_t          size;
+    ino_t          ino;         //to notice a rebuild by another process
+    off_t          base_end;    //where the tail starts
+    name_idx_hdr_t hdr;
+} nameidx_map_t;
+
+//the shard's record lock must be held (read or write) around these, they
+//take the shard's idx_lock themselves
+int nameidx_build(sdb_shard_t *sh);
+int nameidx_add(sdb_shard_t *sh, const student_t *s);
+int nameidx_remove(sdb_shard_t *sh);
+int nameidx_search(sdb_shard_t *sh, const name_pattern_t *p, int **ids, int *n_ids);
+void nameidx_close(sdb_shard_t *sh);
+
+int nameidx_parse_pattern(const char *pattern, name_pattern_t *p);
+int nameidx_matches(const name_pattern_t *p, const student_t *s);
+
+#endif
@@ -0,0 +1,253 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdbool.h>
+
+#include "db.h"
+#include "libsdb.h"
+#include "sdb_internal.h"
+#include "crc32c.h"
+#include "pagecrc.h"
+#include "stats.h"
+
+#define CRC_FILE_MODE   (S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP)
+
+//the sum of a page of len bytes padded with zeros to CRC_PAGE_SIZE
+static uint32_t page_sum(const void *data, size_t len) {
+    static const unsigned char zeros[CRC_PAGE_SIZE];
+    uint32_t c = crc32c(0, data, len);
+
+    if (len < CRC_PAGE_SIZE)
+        c = crc32c(c, zeros, CRC_PAGE_SIZE - len);
+    return c == CRC_UNCHECKED ? CRC_ZERO_SUM : c;
+}
+
+//lowest id the shard can keep in page
+static int page_first_id(const sdb_shard_t *sh, size_t page) {
+    long at = (long)page * CRC_PAGE_SIZE - sh->data_off;
+    long slot = at <= 0 ? 0 : (at + sh->rec_size - 1) / sh->rec_size;
+    long id = slot * sh->stride + sh->base + sh->rem;
+
+    return id < sh->lo ? sh->lo : (int)id;
+}
+
+//Map the shard's sidecar, sized for every page the shard can ever use.
+//Pages past the end of a shorter (or new) sidecar read as CRC_UNCHECKED.
+//The shard's format must already be known.
+int pagecrc_open(sdb_shard_t *sh, int flags) {
+    size_t slots = (size_t)(sh->hi - sh->base) / sh->stride + 1;
+    size_t bytes = sh->data_off + slots * sh->rec_size;
+    size_t n_pages = (bytes + CRC_PAGE_SIZE - 1) / CRC_PAGE_SIZE;
+    size_t size = n_pages * sizeof(uint32_t);
+    struct stat st;
+    void *map;
+    int fd;
+
+    fd = open(sh->crc_path, O_RDWR | O_CREAT, CRC_FILE_MODE);
+    if (fd == -1)
+        return ERR_DB_FILE;
+    if ((flags & SDB_OPEN_TRUNCATE) && ftruncate(fd, 0) != 0) {
+        close(fd);
+        return ERR_DB_FILE;
+    }
+    if (fstat(fd, &st) != 0 || ((size_t)st.st_size < size && ftruncate(fd, size) != 0)) {
+        close(fd);
+        return ERR_DB_FILE;
+    }
+
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return ERR_DB_FILE;
+
+    sh->crc.sums = map;
+    sh->crc.n_pages = n_pages;
+    return NO_ERROR;
+}
+
+void pagecrc_close(sdb_shard_t *sh) {
+    if (sh->crc.sums != NULL)
+        munmap(sh->crc.sums, sh->crc.n_pages * sizeof(uint32_t));
+    sh->crc.sums = NULL;
+    sh->crc.n_pages = 0;
+}
+
+//data holds the len bytes of the page at page_off that are in the file
+int pagecrc_check(sdb_shard_t *sh, off_t page_off, const void *data, size_t len) {
+    size_t page = page_off / CRC_PAGE_SIZE;
+    uint32_t sum;
+
+    if (page >= sh->crc.n_pages || (sum = sh->crc.sums[page]) == CRC_UNCHECKED)
+        return NO_ERROR;
+    return page_sum(data, len) == sum ? NO_ERROR : ERR_DB_CORRUPT;
+}
+
+void pagecrc_update(sdb_shard_t *sh, off_t page_off, const void *data, size_t len) {
+    size_t page = page_off / CRC_PAGE_SIZE;
+
+    if (page < sh->crc.n_pages)
+        sh->crc.sums[page] = page_sum(data, len);
+}
+
+void pagecrc_clear(sdb_shard_t *sh) {
+    memset(sh->crc.sums, 0, sh->crc.n_pages * sizeof(uint32_t));
+}
+
+//Sum every page of the shard file again, after it has been rewritten.
+int pagecrc_rebuild(sdb_shard_t *sh) {
+    unsigned char *buff = malloc(CRC_VERIFY_CHUNK * CRC_PAGE_SIZE);
+    size_t page = 0;
+    ssize_t n = 1;
+
+    if (buff == NULL)
+        return ERR_DB_MEMORY;
+
+    while (page < sh->crc.n_pages && n > 0) {
+        n = sdb_pread(sh->fd, buff, CRC_VERIFY_CHUNK * CRC_PAGE_SIZE, (off_t)page * CRC_PAGE_SIZE);
+        if (n < 0) {
+            free(buff);
+            return ERR_DB_FILE;
+        }
+        for (ssize_t done = 0; done < n && page < sh->crc.n_pages; done += CRC_PAGE_SIZE, page++) {
+            size_t len = n - done < CRC_PAGE_SIZE ? (size_t)(n - done) : CRC_PAGE_SIZE;
+            sh->crc.sums[page] = page_sum(buff + done, len);
+        }
+    }
+    //nothing past the end of the file has been written
+    memset(sh->crc.sums + page, 0, (sh->crc.n_pages - page) * sizeof(uint32_t));
+    free(buff);
+    return NO_ERROR;
+}
+
+typedef struct verify_part{
+    sdb_shard_t *sh;
+    size_t       first_page;
+    size_t       end_page;
+    sdb_verify_t result;
+    int          rc;
+} verify_part_t;
+
+static void note_bad_id(sdb_verify_t *r, int id) {
+    if (id != 0 && (r->first_bad_id == 0 || id < r->first_bad_id))
+        r->first_bad_id = id;
+}
+
+static void *verify_pages(void *arg) {
+    verify_part_t *part = arg;
+    sdb_shard_t *sh = part->sh;
+    unsigned char *buff = malloc(CRC_VERIFY_CHUNK * CRC_PAGE_SIZE);
+    size_t page = part->first_page;
+
+    if (buff == NULL) {
+        part->rc = ERR_DB_MEMORY;
+        return NULL;
+    }
+
+    while (page < part->end_page) {
+        size_t want = part->end_page - page;
+        ssize_t n;
+
+        if (want > CRC_VERIFY_CHUNK)
+            want = CRC_VERIFY_CHUNK;
+        n = sdb_pread(sh->fd, buff, want * CRC_PAGE_SIZE, (off_t)page * CRC_PAGE_SIZE);
+        if (n < 0) {
+            part->rc = ERR_DB_FILE;
+            break;
+        }
+
+        for (size_t i = 0; i < want; i++, page++) {
+            ssize_t done = (ssize_t)(i * CRC_PAGE_SIZE);
+            size_t len = n <= done ? 0 : n - done < CRC_PAGE_SIZE ? (size_t)(n - done) : CRC_PAGE_SIZE;
+            uint32_t sum = sh->crc.sums[page];
+
+            if (sum == CRC_UNCHECKED) {
+                part->result.unchecked++;
+                continue;
+            }
+            part->result.pages++;
+            if (page_sum(buff + done, len) != sum) {
+                part->result.bad++;
+                note_bad_id(&part->result, page_first_id(sh, page));
+            }
+        }
+    }
+    free(buff);
+    return NULL;
+}
+
+//Check every page of the shard file against its sum, the pages are split
+//into n_threads runs checked at the same time.  A page past the end of the
+//file that still has a sum was lost and counts as bad.
+int pagecrc_verify(sdb_shard_t *sh, int n_threads, sdb_verify_t *result) {
+    verify_part_t *parts;
+    pthread_t *threads;
+    bool *started;
+    struct stat st;
+    size_t file_pages;
+    int rc = NO_ERROR;
+
+    memset(result, 0, sizeof(*result));
+    if (fstat(sh->fd, &st) != 0)
+        return ERR_DB_FILE;
+    file_pages = (st.st_size + CRC_PAGE_SIZE - 1) / CRC_PAGE_SIZE;
+    if (file_pages > sh->crc.n_pages)
+        file_pages = sh->crc.n_pages;
+    if (n_threads < 1)
+        n_threads = 1;
+    if ((size_t)n_threads > file_pages / CRC_VERIFY_CHUNK + 1)
+        n_threads = file_pages / CRC_VERIFY_CHUNK + 1;
+
+    parts = calloc(n_threads, sizeof(verify_part_t));
+    threads = calloc(n_threads, sizeof(pthread_t));
+    started = calloc(n_threads, sizeof(bool));
+    if (parts == NULL || threads == NULL || started == NULL) {
+        free(parts);
+        free(threads);
+        free(started);
+        return ERR_DB_MEMORY;
+    }
+
+    for (int i = 0; i < n_threads; i++) {
+        parts[i].sh = sh;
+        parts[i].first_page = file_pages * i / n_threads;
+        parts[i].end_page = file_pages * (i + 1) / n_threads;
+    }
+    //the first run, and any whose thread could not be started, is checked
+    //on this thread
+    for (int i = 1; i < n_threads; i++)
+        started[i] = pthread_create(&threads[i], NULL, verify_pages, &parts[i]) == 0;
+    for (int i = 0; i < n_threads; i++) {
+        if (!started[i])
+            verify_pages(&parts[i]);
+    }
+    for (int i = 1; i < n_threads; i++) {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+    }
+
+    for (int i = 0; i < n_threads; i++) {
+        if (parts[i].rc != NO_ERROR)
+            rc = parts[i].rc;
+        result->pages += parts[i].result.pages;
+        result->unchecked += parts[i].result.unchecked;
+        result->bad += parts[i].result.bad;
+        note_bad_id(result, parts[i].result.first_bad_id);
+    }
+    for (size_t page = file_pages; page < sh->crc.n_pages; page++) {
+        if (sh->crc.sums[page] != CRC_UNCHECKED) {
+            result->pages++;
+            result->bad++;
+            note_bad_id(result, page_first_id(sh, page));
+        }
+    }
+
+    free(parts);
+    free(threads);
+    free(started);
+    return rc;
+}
@@ -0,0 +1,46 @@
+#ifndef __PAGECRC_H__
+    #define __PAGECRC_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "libsdb.h" //get sdb_verify_t
+
+//Page checksums.  Every shard file is split into CRC_PAGE_SIZE pages (64
+//records or 256 rows each) and the CRC32C of every page is kept in a sidecar named
+//after the shard with CRC_SUFFIX on the end, one uint32_t per page.  The
+//record files themselves keep their layout.
+//
+//A page is checksummed as if it were always CRC_PAGE_SIZE long, the part
+//past the end of the file counting as zeros, so growing the file does not
+//change the sum of the page that used to be last.  A stored sum of
+//CRC_UNCHECKED means the page has not been written since checksums were
+//kept, a real sum of 0 is stored as CRC_ZERO_SUM instead.
+//
+//The sidecar is mapped shared, so a sum written by one process is seen by
+//the others.  The shard's lock must be held around these, exclusively for
+//the ones that change sums.
+#define CRC_SUFFIX          ".crc"
+#define CRC_PAGE_SIZE       4096
+#define CRC_PAGE_RECORDS    (CRC_PAGE_SIZE / 64)
+#define CRC_UNCHECKED       0
+#define CRC_ZERO_SUM        1
+#define CRC_VERIFY_CHUNK    64              //pages per read while verifying
+
+typedef struct sdb_shard sdb_shard_t;
+
+typedef struct pagecrc{
+    uint32_t *sums;
+    size_t    n_pages;
+} pagecrc_t;
+
+int pagecrc_open(sdb_shard_t *sh, int flags);
+void pagecrc_close(sdb_shard_t *sh);
+int pagecrc_check(sdb_shard_t *sh, off_t page_off, const void *data, size_t len);
+void pagecrc_update(sdb_shard_t *sh, off_t page_off, const void *data, size_t len);
+void pagecrc_clear(sdb_shard_t *sh);
+int pagecrc_rebuild(sdb_shard_t *sh);
+int pagecrc_verify(sdb_shard_t *sh, int n_threads, sdb_verify_t *result);
+
+#endif
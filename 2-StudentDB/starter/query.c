@@ -0,0 +1,352 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "db.h"
+#include "libsdb.h"
+#include "nameidx.h"
+#include "query.h"
+
+static bool int_eq(const query_term_t *t, const student_t *s);
+static bool int_ne(const query_term_t *t, const student_t *s);
+static bool int_lt(const query_term_t *t, const student_t *s);
+static bool int_le(const query_term_t *t, const student_t *s);
+static bool int_gt(const query_term_t *t, const student_t *s);
+static bool int_ge(const query_term_t *t, const student_t *s);
+static bool name_eq(const query_term_t *t, const student_t *s);
+static bool name_ne(const query_term_t *t, const student_t *s);
+static bool name_lt(const query_term_t *t, const student_t *s);
+static bool name_le(const query_term_t *t, const student_t *s);
+static bool name_gt(const query_term_t *t, const student_t *s);
+static bool name_ge(const query_term_t *t, const student_t *s);
+
+static const query_match_fn int_matchers[] = { int_eq, int_ne, int_lt, int_le, int_gt, int_ge };
+static const query_match_fn name_matchers[] = { name_eq, name_ne, name_lt, name_le, name_gt, name_ge };
+
+static int field_value(const query_term_t *t, const student_t *s) {
+    return t->field == Q_FIELD_ID ? s->id : s->gpa;
+}
+
+static bool int_eq(const query_term_t *t, const student_t *s) { return field_value(t, s) == t->value; }
+static bool int_ne(const query_term_t *t, const student_t *s) { return field_value(t, s) != t->value; }
+static bool int_lt(const query_term_t *t, const student_t *s) { return field_value(t, s) < t->value; }
+static bool int_le(const query_term_t *t, const student_t *s) { return field_value(t, s) <= t->value; }
+static bool int_gt(const query_term_t *t, const student_t *s) { return field_value(t, s) > t->value; }
+static bool int_ge(const query_term_t *t, const student_t *s) { return field_value(t, s) >= t->value; }
+
+//case insensitive compare of a zero padded name against a lower cased value
+static int name_cmp(const query_term_t *t, const student_t *s) {
+    const char *name = t->field == Q_FIELD_FNAME ? s->fname : s->lname;
+    size_t max = t->field == Q_FIELD_FNAME ? sizeof(s->fname) : sizeof(s->lname);
+
+    for (size_t i = 0; i < max; i++) {
+        int a = tolower((unsigned char)name[i]);
+        int b = (unsigned char)t->pat.text[i];
+        if (a != b || a == '\0')
+            return a - b;
+    }
+    return 0;
+}
+
+static bool name_eq(const query_term_t *t, const student_t *s) { return nameidx_matches(&t->pat, s); }
+static bool name_ne(const query_term_t *t, const student_t *s) { return !name_eq(t, s); }
+static bool name_lt(const query_term_t *t, const student_t *s) { return name_cmp(t, s) < 0; }
+static bool name_le(const query_term_t *t, const student_t *s) { return name_cmp(t, s) <= 0; }
+static bool name_gt(const query_term_t *t, const student_t *s) { return name_cmp(t, s) > 0; }
+static bool name_ge(const query_term_t *t, const student_t *s) { return name_cmp(t, s) >= 0; }
+
+static const char *skip_space(const char *p) {
+    while (isspace((unsigned char)*p))
+        p++;
+    return p;
+}
+
+static const char *parse_field(const char *p, int *field) {
+    static const struct { const char *name; int field; } fields[] = {
+        { "id", Q_FIELD_ID }, { "gpa", Q_FIELD_GPA },
+        { "fname", Q_FIELD_FNAME }, { "lname", Q_FIELD_LNAME },
+    };
+    size_t len = 0;
+
+    while (isalpha((unsigned char)p[len]))
+        len++;
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        if (strlen(fields[i].name) == len && strncmp(p, fields[i].name, len) == 0) {
+            *field = fields[i].field;
+            return p + len;
+        }
+    }
+    return NULL;
+}
+
+static const char *parse_op(const char *p, int *op) {
+    if (p[0] == '=' && p[1] == '=') { *op = Q_OP_EQ; return p + 2; }
+    if (p[0] == '!' && p[1] == '=') { *op = Q_OP_NE; return p + 2; }
+    if (p[0] == '<' && p[1] == '=') { *op = Q_OP_LE; return p + 2; }
+    if (p[0] == '>' && p[1] == '=') { *op = Q_OP_GE; return p + 2; }
+    if (p[0] == '=') { *op = Q_OP_EQ; return p + 1; }
+    if (p[0] == '<') { *op = Q_OP_LT; return p + 1; }
+    if (p[0] == '>') { *op = Q_OP_GT; return p + 1; }
+    return NULL;
+}
+
+//ints for id, for gpa a value with a '.' is a real gpa and is scaled by 100.
+//A value that does not fit an int is an error rather than wrapped.
+static const char *parse_number(const char *p, int field, int *value) {
+    char *end;
+    double d;
+    long l;
+
+    errno = 0;
+    l = strtol(p, &end, 10);
+    if (end == p)
+        return NULL;
+    if (*end == '.' && field == Q_FIELD_GPA) {
+        d = strtod(p, &end) * 100.0;
+        if (!(d > INT_MIN - 1.0 && d < INT_MAX + 1.0))
+            return NULL;
+        l = (long)(d + (d < 0 ? -0.5 : 0.5));
+    } else if (errno == ERANGE) {
+        return NULL;
+    }
+    if (isalnum((unsigned char)*end) || *end == '.')
+        return NULL;
+    if (l < INT_MIN || l > INT_MAX)
+        return NULL;
+    *value = (int)l;
+    return end;
+}
+
+static const char *parse_name(const char *p, query_term_t *t) {
+    char buff[NAME_KEY_LEN + 8];
+    size_t len = 0;
+    char quote = 0;
+
+    if (*p == '\'' || *p == '"')
+        quote = *p++;
+    while (*p != '\0' && len < sizeof(buff) - 1) {
+        if (quote ? *p == quote : !(isalnum((unsigned char)*p) || strchr("*_-.'", *p)))
+            break;
+        buff[len++] = *p++;
+    }
+    if (quote) {
+        if (*p != quote)
+            return NULL;
+        p++;
+    }
+    buff[len] = '\0';
+
+    if (nameidx_parse_pattern(buff, &t->pat) != NO_ERROR)
+        return NULL;
+    //ordering only makes sense against a plain name
+    if (t->op != Q_OP_EQ && t->op != Q_OP_NE && t->pat.kind != NAME_MATCH_EXACT)
+        return NULL;
+    t->pat.field = t->field == Q_FIELD_FNAME ? NAME_FIELD_FNAME : NAME_FIELD_LNAME;
+    return p;
+}
+
+//Parse text into q.  On error *err_at points at the part of text that could
+//not be parsed.
+int query_compile(const char *text, query_t *q, const char **err_at) {
+    const char *p = skip_space(text);
+    bool new_group = true;
+
+    memset(q, 0, sizeof(*q));
+    *err_at = p;
+
+    while (1) {
+        query_term_t *t;
+        const char *next;
+
+        if (q->n_terms == QUERY_MAX_TERMS)
+            return ERR_DB_OP;
+        t = &q->terms[q->n_terms];
+        t->new_group = new_group;
+
+        *err_at = p;
+        if ((next = parse_field(p, &t->field)) == NULL)
+            return ERR_DB_OP;
+        p = skip_space(next);
+        *err_at = p;
+        if ((next = parse_op(p, &t->op)) == NULL)
+            return ERR_DB_OP;
+        p = skip_space(next);
+        *err_at = p;
+        if (t->field == Q_FIELD_ID || t->field == Q_FIELD_GPA) {
+            next = parse_number(p, t->field, &t->value);
+            t->match = int_matchers[t->op];
+        } else {
+            next = parse_name(p, t);
+            t->match = name_matchers[t->op];
+        }
+        if (next == NULL)
+            return ERR_DB_OP;
+        q->n_terms++;
+
+        p = skip_space(next);
+        *err_at = p;
+        if (*p == '\0')
+            return NO_ERROR;
+        if (p[0] == '&' && p[1] == '&')
+            new_group = false;
+        else if (p[0] == '|' && p[1] == '|')
+            new_group = true;
+        else
+            return ERR_DB_OP;
+        p = skip_space(p + 2);
+    }
+}
+
+//A record matches when every term of at least one OR branch matches.  A
+//failed term skips the rest of its branch.
+bool query_match(const query_t *q, const student_t *s) {
+    bool ok = true;
+
+    for (int i = 0; i < q->n_terms; i++) {
+        const query_term_t *t = &q->terms[i];
+
+        if (t->new_group && i > 0) {
+            if (ok)
+                return true;
+            ok = true;
+        }
+        if (ok)
+            ok = t->match(t, s);
+    }
+    return ok;
+}
+
+//Smallest [lo, hi] id range that can hold a match, so the scan only has to
+//read that part of the file
+void query_id_range(const query_t *q, int *lo, int *hi) {
+    int all_lo = MAX_STD_ID + 1, all_hi = MIN_STD_ID - 1;
+    int g_lo = MIN_STD_ID, g_hi = MAX_STD_ID;
+
+    for (int i = 0; i <= q->n_terms; i++) {
+        const query_term_t *t = i < q->n_terms ? &q->terms[i] : NULL;
+
+        if (t == NULL || (t->new_group && i > 0)) {
+            if (g_lo <= g_hi && g_lo < all_lo) all_lo = g_lo;
+            if (g_lo <= g_hi && g_hi > all_hi) all_hi = g_hi;
+            g_lo = MIN_STD_ID;
+            g_hi = MAX_STD_ID;
+        }
+        if (t == NULL || t->field != Q_FIELD_ID)
+            continue;
+
+        switch (t->op) {
+        case Q_OP_EQ:
+            if (t->value > g_lo) g_lo = t->value;
+            if (t->value < g_hi) g_hi = t->value;
+            break;
+        case Q_OP_LT:
+            //g_lo never drops below MIN_STD_ID, so neither side overflows
+            if (t->value <= g_lo) g_hi = g_lo - 1;
+            else if (t->value - 1 < g_hi) g_hi = t->value - 1;
+            break;
+        case Q_OP_LE:
+            if (t->value < g_hi) g_hi = t->value;
+            break;
+        case Q_OP_GT:
+            //and g_hi never rises above MAX_STD_ID
+            if (t->value >= g_hi) g_lo = g_hi + 1;
+            else if (t->value + 1 > g_lo) g_lo = t->value + 1;
+            break;
+        case Q_OP_GE:
+            if (t->value > g_lo) g_lo = t->value;
+            break;
+        }
+    }
+
+    *lo = all_lo;
+    *hi = all_hi;
+}
+
+static int cmp_int(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+static int append_ids(int **ids, int *n_ids, int *more, int n_more) {
+    int *grown = realloc(*ids, (*n_ids + n_more + 1) * sizeof(int));
+
+    if (grown == NULL)
+        return ERR_DB_MEMORY;
+    memcpy(grown + *n_ids, more, n_more * sizeof(int));
+    *ids = grown;
+    *n_ids += n_more;
+    return NO_ERROR;
+}
+
+//Index pushdown.  If every OR branch has an "id == n" or a "name == pattern"
+//term, the union of those lookups holds every possible match and only those
+//records need to be read.  Returns SRCH_NOT_FOUND when some branch has no
+//usable term and the caller has to scan instead.  The ids come back sorted
+//without duplicates, the caller frees *ids and still has to apply the query
+//to each record.  An id from an "id == n" term may belong to another shard,
+//shard_get_nolock() simply does not find it in this one.
+int query_candidates(sdb_shard_t *sh, const query_t *q, int **ids, int *n_ids) {
+    int rc = NO_ERROR;
+    int start = 0;
+
+    *ids = NULL;
+    *n_ids = 0;
+
+    while (start < q->n_terms && rc == NO_ERROR) {
+        const query_term_t *pick = NULL;
+        int end = start + 1;
+
+        while (end < q->n_terms && !q->terms[end].new_group)
+            end++;
+
+        for (int i = start; i < end; i++) {
+            const query_term_t *t = &q->terms[i];
+            if (t->op != Q_OP_EQ || t->field == Q_FIELD_GPA)
+                continue;
+            //a single id beats any name lookup
+            if (t->field == Q_FIELD_ID) {
+                pick = t;
+                break;
+            }
+            if (pick == NULL)
+                pick = t;
+        }
+
+        if (pick == NULL) {
+            rc = SRCH_NOT_FOUND;
+        } else if (pick->field == Q_FIELD_ID) {
+            int id = pick->value;
+            rc = append_ids(ids, n_ids, &id, 1);
+        } else {
+            int *found;
+            int n_found;
+            rc = nameidx_search(sh, &pick->pat, &found, &n_found);
+            if (rc == NO_ERROR) {
+                rc = append_ids(ids, n_ids, found, n_found);
+                free(found);
+            }
+        }
+        start = end;
+    }
+
+    if (rc != NO_ERROR) {
+        free(*ids);
+        *ids = NULL;
+        *n_ids = 0;
+        return rc;
+    }
+
+    qsort(*ids, *n_ids, sizeof(int), cmp_int);
+    int n = 0;
+    for (int i = 0; i < *n_ids; i++) {
+        if (n == 0 || (*ids)[n - 1] != (*ids)[i])
+            (*ids)[n++] = (*ids)[i];
+    }
+    *n_ids = n;
+    return NO_ERROR;
+}
@@ -0,0 +1,57 @@
+#ifndef __QUERY_H__
+    #define __QUERY_H__
+
+#include <stdbool.h>
+
+#include "db.h"         //get student record type
+#include "nameidx.h"    //name patterns are shared with -n
+
+//A -q filter such as "gpa>=350 && lname==doe || id<10" is parsed once into
+//a flat list of terms.  Terms are ANDed together, a term with new_group set
+//starts a new OR branch (so && binds tighter than ||, no parentheses).
+//
+//  fields:   id, gpa, fname, lname
+//  ops:      == (or =), !=, <, <=, >, >=
+//  values:   id takes an int, gpa takes the stored int (350) or a real
+//            gpa (3.5).  Names are case insensitive words, optionally
+//            quoted, and == / != accept the -n wildcards (mc*, *son*).
+#define QUERY_MAX_TERMS 32
+
+#define Q_FIELD_ID      0
+#define Q_FIELD_GPA     1
+#define Q_FIELD_FNAME   2
+#define Q_FIELD_LNAME   3
+
+#define Q_OP_EQ         0
+#define Q_OP_NE         1
+#define Q_OP_LT         2
+#define Q_OP_LE         3
+#define Q_OP_GT         4
+#define Q_OP_GE         5
+
+typedef struct query_term query_term_t;
+
+//each term gets the matcher for its field/op picked at compile time, so
+//evaluating a record is just a walk over function pointers
+typedef bool (*query_match_fn)(const query_term_t *t, const student_t *s);
+
+struct query_term{
+    query_match_fn match;
+    int            field;
+    int            op;
+    int            value;       //id and gpa terms
+    name_pattern_t pat;         //fname and lname terms
+    bool           new_group;   //first term of an OR branch
+};
+
+typedef struct query{
+    int          n_terms;
+    query_term_t terms[QUERY_MAX_TERMS];
+} query_t;
+
+int query_compile(const char *text, query_t *q, const char **err_at);
+bool query_match(const query_t *q, const student_t *s);
+void query_id_range(const query_t *q, int *lo, int *hi);
+int query_candidates(sdb_shard_t *sh, const query_t *q, int **ids, int *n_ids);
+
+#endif
@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "db.h"
+#include "libsdb.h"
+#include "sdb_internal.h"
+#include "crc32c.h"
+#include "rows.h"
+#include "stats.h"
+
+//Find out which format the shard file on fd is in.  A file that does not
+//start with ROWS_MAGIC, an empty one included, is in the original format.
+int rows_detect(int fd, int *format) {
+    rows_hdr_t hdr;
+    ssize_t n = sdb_pread(fd, &hdr, sizeof(hdr), 0);
+
+    if (n < 0)
+        return ERR_DB_FILE;
+    *format = SDB_FORMAT_RECORDS;
+    if ((size_t)n < sizeof(hdr.magic) || hdr.magic != ROWS_MAGIC)
+        return NO_ERROR;
+    if ((size_t)n < sizeof(hdr) || hdr.format != SDB_FORMAT_ROWS || hdr.row_size != sizeof(sdb_row_t))
+        return ERR_DB_FILE;
+    *format = SDB_FORMAT_ROWS;
+    return NO_ERROR;
+}
+
+int rows_write_hdr(int fd) {
+    rows_hdr_t hdr = { ROWS_MAGIC, SDB_FORMAT_ROWS, sizeof(sdb_row_t), {0} };
+
+    if (sdb_pwrite(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+        return ERR_DB_FILE;
+    return NO_ERROR;
+}
+
+//Fill row for s with its names placed at heap offset off.  The names are
+//copied to the names buffer (ROWS_NAMES_MAX bytes), returns how many.
+size_t rows_pack(const student_t *s, uint32_t off, sdb_row_t *row, char *names) {
+    size_t flen = strnlen(s->fname, sizeof(s->fname));
+    size_t llen = strnlen(s->lname, sizeof(s->lname));
+
+    memcpy(names, s->fname, flen);
+    memcpy(names + flen, s->lname, llen);
+    row->id = s->id;
+    row->gpa = s->gpa;
+    row->flen = flen;
+    row->llen = llen;
+    row->name_off = off;
+    row->name_sum = crc32c(0, names, flen + llen);
+    return flen + llen;
+}
+
+//Append names packed for offset sh->heap_end to the heap.  Row offsets are
+//32 bits, a heap that would outgrow them has to be compacted first.
+int rows_append(sdb_shard_t *sh, const char *names, size_t len) {
+    if (sh->heap_end + (off_t)len > (off_t)UINT32_MAX)
+        return ERR_DB_FILE;
+    if (len > 0 && sdb_pwrite(sh->heap_fd, names, len, sh->heap_end) != (ssize_t)len)
+        return ERR_DB_FILE;
+    sh->heap_end += len;
+    return NO_ERROR;
+}
+
+//Store the names of s in the heap and fill in its row.  Called with the
+//shard locked exclusively.
+int rows_put(sdb_shard_t *sh, const student_t *s, sdb_row_t *row) {
+    char names[ROWS_NAMES_MAX];
+    size_t len = rows_pack(s, (uint32_t)sh->heap_end, row, names);
+
+    return rows_append(sh, names, len);
+}
+
+//Read the heap bytes the live rows point at with one read, as long as they
+//are close enough together.  When they are not span->len is 0 and
+//rows_get() reads each row's names on its own.
+int rows_load_span(sdb_shard_t *sh, const sdb_row_t *rows, int n, rows_span_t *span) {
+    off_t lo = -1, hi = 0;
+    ssize_t got;
+
+    span->off = 0;
+    span->len = 0;
+    for (int i = 0; i < n; i++) {
+        off_t end = (off_t)rows[i].name_off + rows[i].flen + rows[i].llen;
+
+        if (rows[i].id == DELETED_STUDENT_ID)
+            continue;
+        if (lo == -1 || rows[i].name_off < lo)
+            lo = rows[i].name_off;
+        if (end > hi)
+            hi = end;
+    }
+    if (lo == -1 || hi - lo > ROWS_SPAN_MAX)
+        return NO_ERROR;
+
+    got = sdb_pread(sh->heap_fd, span->data, hi - lo, lo);
+    if (got < 0)
+        return ERR_DB_FILE;
+    span->off = lo;
+    span->len = got;
+    return NO_ERROR;
+}
+
+//Turn row back into a student, reading its names from span when it holds
+//them and from the heap otherwise.  Names whose checksum does not match,
+//or that are missing from the heap, make the row ERR_DB_CORRUPT.
+int rows_get(sdb_shard_t *sh, const sdb_row_t *row, const rows_span_t *span, student_t *s) {
+    char buff[ROWS_NAMES_MAX];
+    const char *names = buff;
+    size_t len = row->flen + row->llen;
+
+    if (span != NULL && row->name_off >= span->off &&
+        (off_t)row->name_off + (off_t)len <= span->off + (off_t)span->len) {
+        names = span->data + (row->name_off - span->off);
+    } else {
+        ssize_t got = sdb_pread(sh->heap_fd, buff, len, row->name_off);
+        if (got < 0)
+            return ERR_DB_FILE;
+        if ((size_t)got != len)
+            return ERR_DB_CORRUPT;
+    }
+    if (crc32c(0, names, len) != row->name_sum)
+        return ERR_DB_CORRUPT;
+
+    memset(s, 0, sizeof(*s));
+    s->id = row->id;
+    s->gpa = row->gpa;
+    memcpy(s->fname, names, row->flen < sizeof(s->fname) ? row->flen : sizeof(s->fname));
+    memcpy(s->lname, names + row->flen, row->llen < sizeof(s->lname) ? row->llen : sizeof(s->lname));
+    return NO_ERROR;
+}
@@ -0,0 +1,75 @@
+#ifndef __ROWS_H__
+    #define __ROWS_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "db.h"     //get student record type
+
+//one shard of an sdb_t, see sdb_internal.h
+typedef struct sdb_shard sdb_shard_t;
+
+//The row format (SDB_FORMAT_ROWS).  A shard file in this format starts
+//with a rows_hdr_t and then holds one 16 byte row per slot instead of a
+//64 byte student_t, so a 4K page holds 256 students instead of 64:
+//
+//      ROWS_DATA_OFFSET + slot * sizeof(sdb_row_t)
+//
+//The names live in a heap file next to the shard, named after it with
+//ROWS_HEAP_SUFFIX on the end.  A row points at its fname bytes, which are
+//followed by the lname bytes, stored without the padding of student_t.
+//The names come from a student_t, so they are already cut to its fields;
+//the row saves space, it does not keep longer names.
+//The heap is append only, so a delete or a rewrite leaves the old names
+//behind until the shard is compacted.  Every row keeps the CRC32C of its
+//names, the heap is not covered by the page checksums.
+//
+//A get is still one page read plus one heap read at a known offset.  A
+//scan reads the heap span a block of rows points at with one read, after
+//a bulk load or a compaction the names are in id order so that span is
+//short and sequential.
+//
+//The header fills what would be slot 0 of an unsharded database, which no
+//student can use, so a shard in the original format never starts with
+//ROWS_MAGIC.
+#define ROWS_MAGIC          0x32424453      //"SDB2"
+#define ROWS_HEAP_SUFFIX    ".heap"
+#define ROWS_DATA_OFFSET    64
+#define ROWS_SPAN_MAX       (64 * 1024)     //heap bytes read at once by scans
+
+typedef struct rows_hdr{
+    uint32_t magic;
+    uint32_t format;        //SDB_FORMAT_ROWS
+    uint32_t row_size;      //sizeof(sdb_row_t), a cheap format check
+    uint32_t reserved[13];
+} rows_hdr_t;
+
+typedef struct sdb_row{
+    int32_t  id;            //first, like student_t, DELETED_STUDENT_ID if free
+    uint16_t gpa;
+    uint8_t  flen;
+    uint8_t  llen;
+    uint32_t name_off;      //heap offset of fname, lname follows it
+    uint32_t name_sum;      //CRC32C of the flen + llen heap bytes
+} sdb_row_t;
+
+//heap bytes read ahead for a block of rows
+typedef struct rows_span{
+    off_t  off;
+    size_t len;
+    char   data[ROWS_SPAN_MAX];
+} rows_span_t;
+
+//heap bytes one row can point at
+#define ROWS_NAMES_MAX      (2 * UINT8_MAX)
+
+int rows_detect(int fd, int *format);
+int rows_write_hdr(int fd);
+size_t rows_pack(const student_t *s, uint32_t off, sdb_row_t *row, char *names);
+int rows_append(sdb_shard_t *sh, const char *names, size_t len);
+int rows_put(sdb_shard_t *sh, const student_t *s, sdb_row_t *row);
+int rows_load_span(sdb_shard_t *sh, const sdb_row_t *rows, int n, rows_span_t *span);
+int rows_get(sdb_shard_t *sh, const sdb_row_t *row, const rows_span_t *span, student_t *s);
+
+#endif
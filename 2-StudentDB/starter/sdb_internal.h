@@ -0,0 +1,84 @@
+#ifndef __SDB_INTERNAL_H__
+    #define __SDB_INTERNAL_H__
+
+#include <pthread.h>
+
+#include "db.h"         //get student record type
+#include "libsdb.h"     //get the public handle type
+#include "nameidx.h"    //get the cached index mapping
+#include "pagecrc.h"    //get the page checksums
+#include "rows.h"       //get the row format
+
+//What is behind an sdb_t.  Only the library's own files include this.
+//
+//A database is one or more shards.  Each shard is a file in one of the
+//formats, records (or rows) sit at data_off + slot * rec_size where
+//
+//      slot = (id - base) / stride
+//
+//The original format has data_off 0 and rec_size STUDENT_RECORD_SIZE, the
+//row format is described in rows.h.
+//Hash shard k of n holds the ids with id % n == k (stride n, base 0), a
+//range shard holds lo..hi (stride 1, base lo - 1).  An unsharded database
+//is the single hash shard with stride 1, so slot == id as it always was.
+//
+//Locking: each shard has its own locks.  lock guards the shard file and fd,
+//readers (get, scan, name and query lookups) share it and writers take it
+//exclusively.  idx_lock guards the shard's name index file and the cached
+//mapping in idx, it is only ever taken while lock is already held so the
+//order is always lock, idx_lock.  No call holds two shards' locks.  The
+//change log has one log_lock for the whole database, taken last.
+struct sdb_shard{
+    int              fd;
+    int              lo, hi;        //ids the shard may hold
+    int              stride;
+    int              base;
+    int              rem;           //id % stride for every id in the shard
+    int              format;        //SDB_FORMAT_RECORDS or SDB_FORMAT_ROWS
+    int              rec_size;      //bytes per slot
+    int              data_off;      //where slot 0 starts
+    int              heap_fd;       //row format names, -1 for records
+    off_t            heap_end;
+    char            *path;          //student.db or one shard file
+    char            *tmp_path;      //.tmp_student.db, used while compacting
+    char            *idx_path;      //student.db.idx
+    char            *idx_tmp_path;  //.tmp_student.db.idx, used while rebuilding
+    char            *crc_path;      //student.db.crc
+    char            *heap_path;     //student.db.heap
+    char            *heap_tmp_path; //.tmp_student.db.heap, used while compacting
+    pthread_rwlock_t lock;
+    pthread_mutex_t  idx_lock;
+    nameidx_map_t    idx;
+    pagecrc_t        crc;
+};
+
+struct sdb{
+    int             scheme;         //SDB_SHARD_HASH or SDB_SHARD_RANGE
+    int             n_shards;
+    sdb_shard_t    *shards;
+    int             log_fd;         //change log, -1 when not logging
+    pthread_mutex_t log_lock;
+};
+
+//a page, or one slot, of a shard file in either format
+typedef union shard_page{
+    student_t recs[CRC_PAGE_RECORDS];
+    sdb_row_t rows[CRC_PAGE_SIZE / sizeof(sdb_row_t)];
+    char      bytes[CRC_PAGE_SIZE];
+} shard_page_t;
+
+typedef union shard_slot{
+    student_t rec;
+    sdb_row_t row;
+} shard_slot_t;
+
+//path with prefix put in front of the file name and suffix on the end,
+//"dir/student.db" -> "dir/.tmp_student.db.idx".  The caller frees it.
+char *sdb_side_path(const char *path, const char *prefix, const char *suffix);
+
+//the same as the public calls limited to one shard, for callers that
+//already hold sh->lock
+int shard_get_nolock(sdb_shard_t *sh, int id, student_t *s);
+int shard_scan_nolock(sdb_shard_t *sh, int first_id, int last_id, sdb_scan_fn fn, void *arg);
+
+#endif
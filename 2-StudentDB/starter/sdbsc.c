@@ -1,65 +1,46 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <fcntl.h>
 #include <string.h>
-#include <sys/stat.h>
-#include <unistd.h>
 #include <stdbool.h>
+#include <time.h>
 
 #include "db.h"
 #include "sdbsc.h"
+#include "libsdb.h"
 
-int open_db(char *dbFile, bool should_truncate) {
-    mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP;
-    int flags = O_RDWR | O_CREAT;
+//--stats, the library counts its own work and the front end adds the time
+//spent printing
+static bool stats_shown;
+static long long format_ns;
 
-    if (should_truncate)
-        flags |= O_TRUNC;
+static long long now_ns(clockid_t clock) {
+    struct timespec ts;
 
-    int fd = open(dbFile, flags, mode);
-    if (fd == -1) {
+    clock_gettime(clock, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+sdb_t *open_db(char *dbFile, bool should_truncate) {
+    sdb_t *db;
+
+    if (sdb_open(dbFile, should_truncate ? SDB_OPEN_TRUNCATE : 0, &db) != NO_ERROR) {
         printf(M_ERR_DB_OPEN);
-        return ERR_DB_FILE;
+        return NULL;
     }
-    return fd;
+    return db;
 }
 
-int get_student(int fd, int id, student_t *s) {
-    off_t offset = id * STUDENT_RECORD_SIZE;
-    
-    if (lseek(fd, offset, SEEK_SET) == -1) {
-        return ERR_DB_FILE;
-    }
-    
-    ssize_t bytes_read = read(fd, s, STUDENT_RECORD_SIZE);
-    if (bytes_read != STUDENT_RECORD_SIZE) {
-        return ERR_DB_FILE;
-    }
-    
-    if (memcmp(s, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE) == 0) {
-        return SRCH_NOT_FOUND;
-    }
-    
-    if (s->id == id) {
-        return NO_ERROR;
-    }
-    
-    return SRCH_NOT_FOUND;
+int get_student(sdb_t *db, int id, student_t *s) {
+    return sdb_get(db, id, s);
 }
 
-int count_db_records(int fd) {
-    student_t student;
-    int count = 0;
-    
-    if (lseek(fd, 0, SEEK_SET) == -1) {
-        printf(M_ERR_DB_READ);
-        return ERR_DB_FILE;
-    }
+int count_db_records(sdb_t *db) {
+    int count;
+    int rc;
     
-    while (read(fd, &student, STUDENT_RECORD_SIZE) == STUDENT_RECORD_SIZE) {
-        if (memcmp(&student, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE) != 0) {
-            count++;
-        }
+    if ((rc = sdb_count(db, &count)) != NO_ERROR) {
+        printf(rc == ERR_DB_CORRUPT ? M_ERR_DB_CORRUPT : M_ERR_DB_READ);
+        return rc == ERR_DB_CORRUPT ? rc : ERR_DB_FILE;
     }
     
     if (count == 0) {
@@ -71,61 +52,212 @@ int count_db_records(int fd) {
     return count;
 }
 
-int add_student(int fd, int id, char *fname, char *lname, int gpa) {
+int add_student(sdb_t *db, int id, char *fname, char *lname, int gpa) {
     student_t new_student = {0};
-    student_t existing_student = {0};
-    
-    int rc = get_student(fd, id, &existing_student);
-    if (rc == NO_ERROR) {
-        printf(M_ERR_DB_ADD_DUP, id);
-        return ERR_DB_OP;
-    }
     
     new_student.id = id;
     strncpy(new_student.fname, fname, sizeof(new_student.fname) - 1);
     strncpy(new_student.lname, lname, sizeof(new_student.lname) - 1);
     new_student.gpa = gpa;
     
-    off_t offset = id * STUDENT_RECORD_SIZE;
-    if (lseek(fd, offset, SEEK_SET) == -1) {
+    switch (sdb_put(db, &new_student)) {
+    case NO_ERROR:
+        printf(M_STD_ADDED, id);
+        //student_t has fixed size names in every format, say so when one
+        //did not fit
+        if (strlen(fname) >= sizeof(new_student.fname))
+            printf(M_WARN_NAME_CUT, fname, (int)sizeof(new_student.fname) - 1);
+        if (strlen(lname) >= sizeof(new_student.lname))
+            printf(M_WARN_NAME_CUT, lname, (int)sizeof(new_student.lname) - 1);
+        return NO_ERROR;
+    case ERR_DB_EXISTS:
+        printf(M_ERR_DB_ADD_DUP, id);
+        return ERR_DB_OP;
+    case ERR_DB_RANGE:
+        printf(M_ERR_STD_RNG);
+        return ERR_DB_OP;
+    case ERR_DB_CORRUPT:
+        printf(M_ERR_DB_CORRUPT);
+        return ERR_DB_CORRUPT;
+    default:
         printf(M_ERR_DB_WRITE);
         return ERR_DB_FILE;
     }
-    
-    if (write(fd, &new_student, STUDENT_RECORD_SIZE) != STUDENT_RECORD_SIZE) {
+}
+
+int del_student(sdb_t *db, int id) {
+    switch (sdb_del(db, id)) {
+    case NO_ERROR:
+        printf(M_STD_DEL_MSG, id);
+        return NO_ERROR;
+    case SRCH_NOT_FOUND:
+        printf(M_STD_NOT_FND_MSG, id);
+        return ERR_DB_OP;
+    case ERR_DB_CORRUPT:
+        printf(M_ERR_DB_CORRUPT);
+        return ERR_DB_CORRUPT;
+    default:
         printf(M_ERR_DB_WRITE);
         return ERR_DB_FILE;
     }
-    
-    printf(M_STD_ADDED, id);
+}
+
+//"field=value" for -u and -U, the field is fname, lname or gpa.  A gpa
+//with a '.' is a real gpa and is scaled by 100, like in -q filters.  A
+//name that does not fit is counted in *cut.
+static int parse_update(int id, char *text, sdb_update_t *u, int *cut) {
+    char *value = strchr(text, '=');
+    size_t len = value != NULL ? (size_t)(value - text) : 0;
+    char *end;
+    double d;
+
+    memset(u, 0, sizeof(*u));
+    u->id = id;
+    if (value == NULL || *++value == '\0')
+        return ERR_DB_RANGE;
+
+    if (len == 3 && strncmp(text, "gpa", len) == 0) {
+        u->field = SDB_FIELD_GPA;
+        d = strtod(value, &end);
+        if (*end != '\0')
+            return ERR_DB_RANGE;
+        if (strchr(value, '.') != NULL)
+            d = d * 100.0 + (d < 0 ? -0.5 : 0.5);
+        //checked before the cast, a double out of the int range is not an int
+        if (!(d > MIN_STD_GPA - 1 && d < MAX_STD_GPA + 1))
+            return ERR_DB_RANGE;
+        u->gpa = (int)d;
+        return NO_ERROR;
+    }
+
+    if (len == 5 && strncmp(text, "fname", len) == 0)
+        u->field = SDB_FIELD_FNAME;
+    else if (len == 5 && strncmp(text, "lname", len) == 0)
+        u->field = SDB_FIELD_LNAME;
+    else
+        return ERR_DB_RANGE;
+    strncpy(u->name, value, sizeof(u->name) - 1);
+    //the same cut sdb_put makes
+    len = u->field == SDB_FIELD_FNAME ? sizeof(((student_t *)0)->fname) : sizeof(((student_t *)0)->lname);
+    if (strlen(value) >= len)
+        (*cut)++;
     return NO_ERROR;
 }
 
-int del_student(int fd, int id) {
-    student_t student = {0};
-    
-    int rc = get_student(fd, id, &student);
-    if (rc != NO_ERROR) {
+int update_student(sdb_t *db, int id, char **changes, int n_changes) {
+    sdb_update_t *ups = malloc(n_changes * sizeof(sdb_update_t));
+    int applied;
+    int cut = 0;
+    int rc;
+
+    if (ups == NULL) {
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_MEMORY;
+    }
+    for (int i = 0; i < n_changes; i++) {
+        if (parse_update(id, changes[i], &ups[i], &cut) != NO_ERROR) {
+            printf(M_ERR_UPDATE, changes[i]);
+            free(ups);
+            return ERR_DB_RANGE;
+        }
+    }
+    rc = sdb_update_many(db, ups, n_changes, &applied);
+    free(ups);
+
+    switch (rc) {
+    case NO_ERROR:
+        printf(M_STD_UPDATED, id);
+        if (cut > 0)
+            printf(M_WARN_NAMES_CUT, cut);
+        return NO_ERROR;
+    case SRCH_NOT_FOUND:
+    case ERR_DB_RANGE:
         printf(M_STD_NOT_FND_MSG, id);
         return ERR_DB_OP;
-    }
-    
-    off_t offset = id * STUDENT_RECORD_SIZE;
-    if (lseek(fd, offset, SEEK_SET) == -1) {
+    case ERR_DB_CORRUPT:
+        printf(M_ERR_DB_CORRUPT);
+        return ERR_DB_CORRUPT;
+    default:
         printf(M_ERR_DB_WRITE);
         return ERR_DB_FILE;
     }
-    
-    if (write(fd, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE) != STUDENT_RECORD_SIZE) {
-        printf(M_ERR_DB_WRITE);
+}
+
+//Each line of the file is "id field=value [field=value ...]", blank lines
+//and lines starting with '#' are skipped.  The whole file is checked and
+//then goes to the library in one call, so updates to the same page cost
+//one read and one write between them.
+int update_from_file(sdb_t *db, char *path) {
+    FILE *f = fopen(path, "r");
+    sdb_update_t *ups = NULL;
+    char line[512];
+    int line_no = 0;
+    int n = 0, cap = 0;
+    int applied;
+    int cut = 0;
+    int rc = NO_ERROR;
+
+    if (f == NULL) {
+        printf(M_ERR_UPDATE_FILE, path);
         return ERR_DB_FILE;
     }
-    
-    printf(M_STD_DEL_MSG, id);
+    while (rc == NO_ERROR && fgets(line, sizeof(line), f) != NULL) {
+        bool whole = strchr(line, '\n') != NULL || feof(f);
+        char *tok = strtok(line, " \t\r\n");
+        char *end;
+        long id;
+
+        line_no++;
+        if (tok == NULL || *tok == '#')
+            continue;
+        id = strtol(tok, &end, 10);
+        tok = strtok(NULL, " \t\r\n");
+        if (!whole || *end != '\0' || id < MIN_STD_ID || id > MAX_STD_ID || tok == NULL)
+            rc = ERR_DB_RANGE;
+
+        for (; tok != NULL && rc == NO_ERROR; tok = strtok(NULL, " \t\r\n")) {
+            if (n == cap) {
+                sdb_update_t *grown = realloc(ups, (cap = cap ? cap * 2 : 256) * sizeof(sdb_update_t));
+                if (grown == NULL) {
+                    rc = ERR_DB_MEMORY;
+                    break;
+                }
+                ups = grown;
+            }
+            rc = parse_update((int)id, tok, &ups[n++], &cut);
+        }
+    }
+    if (rc == NO_ERROR && ferror(f))
+        rc = ERR_DB_FILE;
+    fclose(f);
+
+    if (rc != NO_ERROR) {
+        if (rc == ERR_DB_RANGE)
+            printf(M_ERR_UPDATE_LINE, line_no, path);
+        else
+            printf(M_ERR_UPDATE_FILE, path);
+        free(ups);
+        return rc;
+    }
+
+    rc = sdb_update_many(db, ups, n, &applied);
+    free(ups);
+    if (rc != NO_ERROR) {
+        if (rc == ERR_DB_CORRUPT)
+            printf(M_ERR_DB_CORRUPT);
+        else
+            printf(M_ERR_UPDATE_PART, sdb_strerror(rc), applied, n);
+        return rc == SRCH_NOT_FOUND ? ERR_DB_OP : rc;
+    }
+    printf(M_DB_UPDATED, applied, path);
+    if (cut > 0)
+        printf(M_WARN_NAMES_CUT, cut);
     return NO_ERROR;
 }
 
 void print_student(student_t *s) {
+    long long t = stats_shown ? now_ns(CLOCK_MONOTONIC) : 0;
+
     if (s == NULL || s->id == 0) {
         printf(M_ERR_STD_PRINT);
         return;
@@ -134,87 +266,239 @@ void print_student(student_t *s) {
     float gpa = s->gpa / 100.0;
     printf(STUDENT_PRINT_HDR_STRING, "ID", "FIRST_NAME", "LAST_NAME", "GPA");
     printf(STUDENT_PRINT_FMT_STRING, s->id, s->fname, s->lname, gpa);
+    if (stats_shown)
+        format_ns += now_ns(CLOCK_MONOTONIC) - t;
 }
 
-int print_db(int fd) {
-    student_t student = {0};
-    bool is_empty = true;
-    
-    if (lseek(fd, 0, SEEK_SET) == -1) {
-        printf(M_ERR_DB_READ);
-        return ERR_DB_FILE;
-    }
+//prints the header in front of the first row, state lives in *printed
+static int print_record(const student_t *s, void *arg) {
+    long long t = stats_shown ? now_ns(CLOCK_MONOTONIC) : 0;
+    int *printed = arg;
+
+    if ((*printed)++ == 0)
+        printf(STUDENT_PRINT_HDR_STRING, "ID", "FIRST_NAME", "LAST_NAME", "GPA");
+    printf(STUDENT_PRINT_FMT_STRING, s->id, s->fname, s->lname, s->gpa / 100.0);
+    if (stats_shown)
+        format_ns += now_ns(CLOCK_MONOTONIC) - t;
+    return NO_ERROR;
+}
+
+int print_db(sdb_t *db) {
+    int printed = 0;
+    int rc;
     
-    while (read(fd, &student, STUDENT_RECORD_SIZE) == STUDENT_RECORD_SIZE) {
-        if (memcmp(&student, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE) != 0) {
-            is_empty = false;
-            break;
-        }
+    if ((rc = sdb_scan(db, 0, MAX_STD_ID, print_record, &printed)) != NO_ERROR) {
+        printf(rc == ERR_DB_CORRUPT ? M_ERR_DB_CORRUPT : M_ERR_DB_READ);
+        return rc == ERR_DB_CORRUPT ? rc : ERR_DB_FILE;
     }
     
-    if (is_empty) {
+    if (printed == 0)
         printf(M_DB_EMPTY);
-        return NO_ERROR;
-    }
-    
-    lseek(fd, 0, SEEK_SET);
-    printf(STUDENT_PRINT_HDR_STRING, "ID", "FIRST_NAME", "LAST_NAME", "GPA");
-    
-    while (read(fd, &student, STUDENT_RECORD_SIZE) == STUDENT_RECORD_SIZE) {
-        if (memcmp(&student, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE) != 0) {
-            float gpa = student.gpa / 100.0;
-            printf(STUDENT_PRINT_FMT_STRING, student.id, student.fname, student.lname, gpa);
-        }
-    }
     
     return NO_ERROR;
 }
 
-int compress_db(int fd) {
-    student_t student = {0};
-    int tmp_fd;
-    
-    tmp_fd = open_db(TMP_DB_FILE, true);
-    if (tmp_fd < 0) {
-        printf(M_ERR_DB_OPEN);
+int find_students_by_name(sdb_t *db, char *pattern) {
+    int found = 0;
+
+    switch (sdb_find_name(db, pattern, print_record, &found)) {
+    case NO_ERROR:
+        break;
+    case ERR_DB_OP:
+        printf(M_ERR_NAME_PATTERN, pattern);
+        return ERR_DB_OP;
+    case ERR_DB_CORRUPT:
+        printf(M_ERR_DB_CORRUPT);
+        return ERR_DB_CORRUPT;
+    default:
+        printf(M_ERR_NAME_IDX);
         return ERR_DB_FILE;
     }
-    
-    if (lseek(fd, 0, SEEK_SET) == -1) {
-        close(tmp_fd);
+
+    if (found == 0)
+        printf(M_NAME_NO_MATCH, pattern);
+    return found;
+}
+
+int query_db(sdb_t *db, char *text) {
+    const char *err_at;
+    int printed = 0;
+
+    switch (sdb_query(db, text, print_record, &printed, &err_at)) {
+    case NO_ERROR:
+        break;
+    case ERR_DB_OP:
+        printf(M_ERR_QUERY, err_at);
+        return ERR_DB_OP;
+    case ERR_DB_CORRUPT:
+        printf(M_ERR_DB_CORRUPT);
+        return ERR_DB_CORRUPT;
+    default:
         printf(M_ERR_DB_READ);
         return ERR_DB_FILE;
     }
-    
-    while (read(fd, &student, STUDENT_RECORD_SIZE) == STUDENT_RECORD_SIZE) {
-        if (memcmp(&student, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE) != 0) {
-            off_t offset = student.id * STUDENT_RECORD_SIZE;
-            
-            if (lseek(tmp_fd, offset, SEEK_SET) == -1 ||
-                write(tmp_fd, &student, STUDENT_RECORD_SIZE) != STUDENT_RECORD_SIZE) {
-                close(tmp_fd);
-                printf(M_ERR_DB_WRITE);
-                return ERR_DB_FILE;
-            }
-        }
+
+    if (printed == 0)
+        printf(M_QUERY_NO_MATCH);
+    return printed;
+}
+
+int compress_db(sdb_t *db) {
+    int rc = sdb_compact(db);
+
+    if (rc != NO_ERROR) {
+        printf(rc == ERR_DB_CORRUPT ? M_ERR_DB_CORRUPT : M_ERR_DB_CREATE);
+        return rc == ERR_DB_CORRUPT ? rc : ERR_DB_FILE;
     }
-    
-    close(fd);
-    close(tmp_fd);
-    
-    if (rename(TMP_DB_FILE, DB_FILE) != 0) {
-        printf(M_ERR_DB_CREATE);
+
+    printf(M_DB_COMPRESSED_OK);
+    return NO_ERROR;
+}
+
+int verify_db(sdb_t *db) {
+    sdb_verify_t v;
+    int rc = sdb_verify(db, &v);
+
+    switch (rc) {
+    case NO_ERROR:
+        printf(M_DB_VERIFY_OK, v.pages, v.unchecked);
+        return NO_ERROR;
+    case ERR_DB_CORRUPT:
+        printf(M_DB_VERIFY_BAD, v.bad, v.first_bad_id);
+        return ERR_DB_CORRUPT;
+    default:
+        printf(M_ERR_DB_READ);
         return ERR_DB_FILE;
     }
-    
-    fd = open_db(DB_FILE, false);
-    if (fd < 0) {
-        printf(M_ERR_DB_OPEN);
+}
+
+int export_db(sdb_t *db, char *path) {
+    int n;
+    int rc = sdb_export(db, path, &n);
+
+    if (rc != NO_ERROR) {
+        //a bad page in the database, not in the snapshot
+        if (rc == ERR_DB_CORRUPT)
+            printf(M_ERR_DB_CORRUPT);
+        else
+            printf(M_ERR_SNAPSHOT, path, sdb_strerror(rc));
+        return rc;
+    }
+    printf(M_DB_EXPORTED, n, path);
+    return NO_ERROR;
+}
+
+//A snapshot that fails its checks is reported before the database is
+//touched, see sdb_import()
+int import_db(sdb_t *db, char *path) {
+    int n;
+    int rc = sdb_import(db, path, &n);
+
+    if (rc != NO_ERROR) {
+        printf(M_ERR_SNAPSHOT, path, sdb_strerror(rc));
+        return rc;
+    }
+    printf(M_DB_IMPORTED, n, path);
+    return NO_ERROR;
+}
+
+//names can hold anything that was on the command line, so escape them
+static void print_json_string(const char *s, size_t max) {
+    putchar('"');
+    for (size_t i = 0; i < max && s[i] != '\0'; i++) {
+        unsigned char c = s[i];
+        if (c == '"' || c == '\\')
+            printf("\\%c", c);
+        else if (c < 0x20)
+            printf("\\u%04x", c);
+        else
+            putchar(c);
+    }
+    putchar('"');
+}
+
+//one JSON object per line, gpa is the stored int like everywhere in the db
+static int print_change(long long seq, int op, const student_t *s, void *arg) {
+    long long t = stats_shown ? now_ns(CLOCK_MONOTONIC) : 0;
+
+    (void)arg;
+
+    switch (op) {
+    case SDB_CHANGE_ADD:
+    case SDB_CHANGE_UPDATE:
+        printf("{\"seq\":%lld,\"op\":\"%s\",\"id\":%d,\"fname\":", seq,
+               op == SDB_CHANGE_ADD ? "add" : "update", s->id);
+        print_json_string(s->fname, sizeof(s->fname));
+        printf(",\"lname\":");
+        print_json_string(s->lname, sizeof(s->lname));
+        printf(",\"gpa\":%d}\n", s->gpa);
+        break;
+    case SDB_CHANGE_DEL:
+        printf("{\"seq\":%lld,\"op\":\"del\",\"id\":%d}\n", seq, s->id);
+        break;
+    case SDB_CHANGE_CLEAR:
+        printf("{\"seq\":%lld,\"op\":\"clear\"}\n", seq);
+        break;
+    }
+    if (stats_shown)
+        format_ns += now_ns(CLOCK_MONOTONIC) - t;
+    return NO_ERROR;
+}
+
+int print_changes(sdb_t *db, long long since) {
+    if (sdb_changes_since(db, since, print_change, NULL) != NO_ERROR) {
+        printf(M_ERR_DB_READ);
         return ERR_DB_FILE;
     }
-    
-    printf(M_DB_COMPRESSED_OK);
-    return fd;
+    return NO_ERROR;
+}
+
+//ERR_DB_OP means the file system cannot preallocate, see sdb_reserve()
+int reserve_db(sdb_t *db, int last_id) {
+    int rc = sdb_reserve(db, last_id);
+
+    switch (rc) {
+    case NO_ERROR:
+        printf(M_DB_RESERVED, last_id);
+        return NO_ERROR;
+    case ERR_DB_OP:
+        printf(M_ERR_DB_RESERVE, "the file system does not support it");
+        return rc;
+    default:
+        printf(M_ERR_DB_RESERVE, sdb_strerror(rc));
+        return rc;
+    }
+}
+
+//The database must not be open while it is converted, see sdb_convert().
+int convert_db(char *path, int format) {
+    int rc = sdb_convert(path, format);
+
+    if (rc != NO_ERROR) {
+        printf(M_ERR_DB_CONVERT, sdb_strerror(rc));
+        return rc;
+    }
+    printf(M_DB_CONVERTED, format);
+    return NO_ERROR;
+}
+
+//The database must not be open while it is split, see sdb_shard().
+int shard_db(char *path, char *scheme, int n_shards, char **dirs, int n_dirs) {
+    int rc;
+
+    if (strcmp(scheme, "hash") == 0)
+        rc = sdb_shard(path, SDB_SHARD_HASH, n_shards, dirs, n_dirs);
+    else if (strcmp(scheme, "range") == 0)
+        rc = sdb_shard(path, SDB_SHARD_RANGE, n_shards, dirs, n_dirs);
+    else
+        rc = ERR_DB_OP;
+
+    if (rc != NO_ERROR) {
+        printf(M_ERR_DB_SHARD, sdb_strerror(rc));
+        return rc;
+    }
+    printf(M_DB_SHARDED, n_shards);
+    return NO_ERROR;
 }
 
 int validate_range(int id, int gpa) {
@@ -227,41 +511,119 @@ int validate_range(int id, int gpa) {
     return NO_ERROR;
 }
 
+//Stats go to stderr so the command's own output is unchanged.  Library
+//times are summed over its threads, other is what is left of the wall
+//time (opening files, locking, the work between calls).
+void print_stats(char *cmd, long long wall_ns, long long cpu_ns) {
+    sdb_stats_t st;
+    long long other;
+
+    if (sdb_stats_get(&st) != NO_ERROR)
+        return;
+    fflush(stdout);
+    other = wall_ns - st.io_ns - st.parse_ns - format_ns;
+    fprintf(stderr, M_STATS_HDR, cmd);
+    fprintf(stderr, M_STATS_IO, st.syscalls, st.reads, st.writes, st.bytes_read, st.bytes_written);
+    fprintf(stderr, M_STATS_RECS, st.visited, st.returned);
+    fprintf(stderr, M_STATS_TIME, wall_ns / 1e6, cpu_ns / 1e6, st.io_ns / 1e6,
+            st.parse_ns / 1e6, format_ns / 1e6, (other > 0 ? other : 0) / 1e6);
+}
+
+//long options are mapped to an opt value for main's switch
+static const struct long_opt{
+    const char *name;
+    char        opt;
+} long_opts[] = {
+    { "--changes-since", OPT_CHANGES_SINCE },
+    { "--export",        OPT_EXPORT },
+    { "--import",        OPT_IMPORT },
+    { "--format",        OPT_FORMAT },
+    { "--reserve",       OPT_RESERVE },
+};
+
+char parse_opt(char *arg) {
+    if (arg[1] != '-')
+        return arg[1];
+    for (size_t i = 0; i < sizeof(long_opts) / sizeof(long_opts[0]); i++) {
+        if (strcmp(arg, long_opts[i].name) == 0)
+            return long_opts[i].opt;
+    }
+    return 0;
+}
+
 void usage(char *exename) {
-    printf("usage: %s -[h|a|c|d|f|p|z] options.  Where:\n", exename);
+    printf("usage: %s [--stats] -[h|a|c|d|f|n|p|q|s|u|U|v|x|z] options.  Where:\n", exename);
     printf("\t-h:  prints help\n");
     printf("\t-a id first_name last_name gpa(as 3 digit int):  adds a student\n");
     printf("\t-c:  counts the records in the database\n");
     printf("\t-d id:  deletes a student\n");
     printf("\t-f id:  finds and prints a student in the database\n");
+    printf("\t-n [fname:|lname:]pattern:  finds students by name, pattern is\n");
+    printf("\t    name, prefix*, *suffix or *substring* (case insensitive)\n");
     printf("\t-p:  prints all records in the student database\n");
+    printf("\t-q \"filter\":  prints the students matching a filter, for example\n");
+    printf("\t    \"gpa>=350 && lname==doe || id<10\" (fields id, gpa, fname, lname)\n");
+    printf("\t-s hash|range n [dir ...]:  splits the database into n shard files,\n");
+    printf("\t    spread over the given directories\n");
+    printf("\t-u id field=value ...:  changes fields of a student in place, fields\n");
+    printf("\t    are fname, lname and gpa (as 350 or 3.5)\n");
+    printf("\t-U file:  applies a file of updates, one \"id field=value ...\" per line\n");
+    printf("\t-v:  verifies the checksum of every page of the database\n");
     printf("\t-x:  compress the database file [EXTRA CREDIT]\n");
     printf("\t-z:  zero db file (remove all records)\n");
+    printf("\t--changes-since seq:  prints the adds, updates, deletes and zeroes\n");
+    printf("\t    made after change seq as JSON lines, 0 prints the whole change log\n");
+    printf("\t--export file:  writes every record to a compressed snapshot file\n");
+    printf("\t--import file:  replaces every record with the ones in a snapshot\n");
+    printf("\t--format 1|2:  rewrites the database files in the original format (1)\n");
+    printf("\t    or as 16 byte rows with a name heap (2)\n");
+    printf("\t--reserve id:  allocates disk space for the records up to id ahead of\n");
+    printf("\t    a load, so they end up contiguous on disk\n");
+    printf("\t--stats:  put in front of any command (or set %s=1) to print what\n", STATS_ENV);
+    printf("\t    it cost to stderr: system calls, bytes, records and time\n");
 }
 
 int main(int argc, char *argv[]) {
     char opt;
-    int fd;
+    char *end;
+    sdb_t *db;
     int rc;
     int exit_code;
     int id;
     int gpa;
+    long long since;
+    long long wall_start, cpu_start;
     student_t student = {0};
+    char *env = getenv(STATS_ENV);
+
+    stats_shown = env != NULL && *env != '\0' && strcmp(env, "0") != 0;
+    if (argc >= 2 && strcmp(argv[1], "--stats") == 0) {
+        stats_shown = true;
+        argv[1] = argv[0];
+        argv++;
+        argc--;
+    }
+    if (stats_shown && sdb_stats_enable(1) != NO_ERROR) {
+        fprintf(stderr, M_STATS_OFF);
+        stats_shown = false;
+    }
+    wall_start = now_ns(CLOCK_MONOTONIC);
+    cpu_start = now_ns(CLOCK_PROCESS_CPUTIME_ID);
 
     if ((argc < 2) || (*argv[1] != '-')) {
         usage(argv[0]);
         exit(1);
     }
 
-    opt = (char)*(argv[1] + 1);
+    opt = parse_opt(argv[1]);
 
     if (opt == 'h') {
         usage(argv[0]);
         exit(EXIT_OK);
     }
 
-    fd = open_db(DB_FILE, false);
-    if (fd < 0) {
+    db = open_db(DB_FILE, false);
+    if (db == NULL) {
         exit(EXIT_FAIL_DB);
     }
 
@@ -283,13 +645,39 @@ int main(int argc, char *argv[]) {
             break;
         }
 
-        rc = add_student(fd, id, argv[3], argv[4], gpa);
+        rc = add_student(db, id, argv[3], argv[4], gpa);
         if (rc < 0)
             exit_code = EXIT_FAIL_DB;
         break;
 
+    case 'u':
+        if (argc < 4) {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        rc = update_student(db, atoi(argv[2]), argv + 3, argc - 3);
+        if (rc == ERR_DB_RANGE)
+            exit_code = EXIT_FAIL_ARGS;
+        else if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
+    case 'U':
+        if (argc != 3) {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        rc = update_from_file(db, argv[2]);
+        if (rc == ERR_DB_RANGE)
+            exit_code = EXIT_FAIL_ARGS;
+        else if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
     case 'c':
-        rc = count_db_records(fd);
+        rc = count_db_records(db);
         if (rc < 0)
             exit_code = EXIT_FAIL_DB;
         break;
@@ -301,7 +689,7 @@ int main(int argc, char *argv[]) {
             break;
         }
         id = atoi(argv[2]);
-        rc = del_student(fd, id);
+        rc = del_student(db, id);
         if (rc < 0)
             exit_code = EXIT_FAIL_DB;
         break;
@@ -313,7 +701,7 @@ int main(int argc, char *argv[]) {
             break;
         }
         id = atoi(argv[2]);
-        rc = get_student(fd, id, &student);
+        rc = get_student(db, id, &student);
 
         switch (rc) {
         case NO_ERROR:
@@ -323,6 +711,10 @@ int main(int argc, char *argv[]) {
             printf(M_STD_NOT_FND_MSG, id);
             exit_code = EXIT_FAIL_DB;
             break;
+        case ERR_DB_CORRUPT:
+            printf(M_ERR_DB_CORRUPT);
+            exit_code = EXIT_FAIL_DB;
+            break;
         default:
             printf(M_ERR_DB_READ);
             exit_code = EXIT_FAIL_DB;
@@ -330,22 +722,125 @@ int main(int argc, char *argv[]) {
         }
         break;
 
+    case 'n':
+        if (argc != 3) {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        rc = find_students_by_name(db, argv[2]);
+        if (rc == ERR_DB_OP)
+            exit_code = EXIT_FAIL_ARGS;
+        else if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
     case 'p':
-        rc = print_db(fd);
+        rc = print_db(db);
+        if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
+    case 'q':
+        if (argc != 3) {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        rc = query_db(db, argv[2]);
+        if (rc == ERR_DB_OP)
+            exit_code = EXIT_FAIL_ARGS;
+        else if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
+    case OPT_CHANGES_SINCE:
+        if (argc != 3) {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        since = strtoll(argv[2], &end, 10);
+        if (end == argv[2] || *end != '\0' || since < 0) {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        rc = print_changes(db, since);
+        if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
+    case OPT_EXPORT:
+    case OPT_IMPORT:
+        if (argc != 3) {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        rc = opt == OPT_EXPORT ? export_db(db, argv[2]) : import_db(db, argv[2]);
+        if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
+    case OPT_FORMAT:
+        if (argc != 3) {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        sdb_close(db);
+        db = NULL;
+        rc = convert_db(DB_FILE, atoi(argv[2]));
+        if (rc == ERR_DB_RANGE)
+            exit_code = EXIT_FAIL_ARGS;
+        else if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
+    case OPT_RESERVE:
+        if (argc != 3) {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        rc = reserve_db(db, atoi(argv[2]));
+        if (rc == ERR_DB_RANGE)
+            exit_code = EXIT_FAIL_ARGS;
+        else if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
+    case 's':
+        if (argc < 4) {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        sdb_close(db);
+        db = NULL;
+        rc = shard_db(DB_FILE, argv[2], atoi(argv[3]), argv + 4, argc - 4);
+        if (rc == ERR_DB_OP || rc == ERR_DB_RANGE)
+            exit_code = EXIT_FAIL_ARGS;
+        else if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
+    case 'v':
+        rc = verify_db(db);
         if (rc < 0)
             exit_code = EXIT_FAIL_DB;
         break;
 
     case 'x':
-        fd = compress_db(fd);
-        if (fd < 0)
+        rc = compress_db(db);
+        if (rc < 0)
             exit_code = EXIT_FAIL_DB;
         break;
 
     case 'z':
-        close(fd);
-        fd = open_db(DB_FILE, true);
-        if (fd < 0) {
+        if (sdb_truncate(db) != NO_ERROR) {
+            printf(M_ERR_DB_WRITE);
             exit_code = EXIT_FAIL_DB;
             break;
         }
@@ -358,6 +853,9 @@ int main(int argc, char *argv[]) {
         exit_code = EXIT_FAIL_ARGS;
     }
 
-    close(fd);
+    sdb_close(db);
+    if (stats_shown)
+        print_stats(argv[1], now_ns(CLOCK_MONOTONIC) - wall_start,
+                    now_ns(CLOCK_PROCESS_CPUTIME_ID) - cpu_start);
     exit(exit_code);
 }
@@ -1,28 +1,47 @@
 #ifndef __SDB_H__
+    #define __SDB_H__
 
-#include "db.h" //get student record type
+#include <stdbool.h>
 
-//prototypes for functions go below for this assignment
-int open_db(char *dbFile, bool should_truncate);
-int add_student(int fd, int id, char *fname, char *lname, int gpa);
-int get_student(int fd, int id, student_t *s);
-int del_student(int fd, int id);
-int compress_db(int fd);
+#include "db.h"     //get student record type
+#include "libsdb.h" //the database itself and its error codes
+
+//prototypes for functions go below for this assignment.  These are the
+//command line front end, they print and leave the work to libsdb.
+sdb_t *open_db(char *dbFile, bool should_truncate);
+int add_student(sdb_t *db, int id, char *fname, char *lname, int gpa);
+int get_student(sdb_t *db, int id, student_t *s);
+int del_student(sdb_t *db, int id);
+int update_student(sdb_t *db, int id, char **changes, int n_changes);
+int update_from_file(sdb_t *db, char *path);
+int compress_db(sdb_t *db);
 void print_student(student_t *s);
 int validate_range(int id, int gpa);
-int count_db_records(int fd);
-int print_db(int fd);
+int count_db_records(sdb_t *db);
+int print_db(sdb_t *db);
+int find_students_by_name(sdb_t *db, char *pattern);
+int query_db(sdb_t *db, char *text);
+int convert_db(char *path, int format);
+int reserve_db(sdb_t *db, int last_id);
+int shard_db(char *path, char *scheme, int n_shards, char **dirs, int n_dirs);
+int print_changes(sdb_t *db, long long since);
+int verify_db(sdb_t *db);
+int export_db(sdb_t *db, char *path);
+int import_db(sdb_t *db, char *path);
+void print_stats(char *cmd, long long wall_ns, long long cpu_ns);
+char parse_opt(char *arg);
 void usage(char *);
 
-//error codes to be returned from individual functions
-// NO_ERROR is returned if there are no errors
-// ERR_DB_FILE is returned if there is are any issues with the database file itself
-// ERR_DB_OP is returned if an operation did not work aka add or delete a student
-// SRCH_NOT_FOUND is returned if the student is not found (get_student, and del_student)
-#define NO_ERROR        0
-#define ERR_DB_FILE     -1
-#define ERR_DB_OP       -2
-#define SRCH_NOT_FOUND  -3
+//opt values for the long options, see parse_opt()
+#define OPT_CHANGES_SINCE   1
+#define OPT_EXPORT          2
+#define OPT_IMPORT          3
+#define OPT_FORMAT          4
+#define OPT_RESERVE         5
+
+//set to anything but 0 to get --stats on every command
+#define STATS_ENV           "SDBSC_STATS"
+
 #define NOT_IMPLEMENTED_YET 0
 
 
@@ -53,6 +72,36 @@ void usage(char *);
 #define M_DB_EMPTY        "Database contains no student records.\n"
 #define M_DB_RECORD_CNT   "Database contains %d student record(s).\n"
 #define M_NOT_IMPL        "The requested operation is not implemented yet!\n"
+#define M_ERR_NAME_PATTERN "Invalid name pattern '%s'.\n"
+#define M_ERR_NAME_IDX    "Error reading or building the name index, exiting!\n"
+#define M_NAME_NO_MATCH   "No students matched '%s'.\n"
+#define M_ERR_QUERY       "Invalid query near '%s'.\n"
+#define M_QUERY_NO_MATCH  "No students matched the query.\n"
+#define M_ERR_DB_SHARD    "Cant shard the database, %s.\n"
+#define M_DB_SHARDED      "Database split into %d shard(s).\n"
+#define M_ERR_DB_CORRUPT  "DB file failed its checksum, run -v for details!\n"
+#define M_DB_VERIFY_OK    "Database verified, %ld page(s) checked, %ld without a checksum yet.\n"
+#define M_DB_VERIFY_BAD   "Checksum mismatch in %ld page(s), the first holds ids from %d!\n"
+#define M_DB_EXPORTED     "Exported %d student record(s) to %s.\n"
+#define M_DB_IMPORTED     "Imported %d student record(s) from %s.\n"
+#define M_ERR_DB_CONVERT  "Cant convert the database, %s.\n"
+#define M_DB_CONVERTED    "Database converted to format %d.\n"
+#define M_DB_RESERVED     "Reserved disk space for the ids up to %d.\n"
+#define M_ERR_DB_RESERVE  "Cant reserve disk space, %s.\n"
+#define M_WARN_NAME_CUT   "Name '%s' does not fit, only its first %d characters were kept.\n"
+#define M_WARN_NAMES_CUT  "%d name(s) did not fit and were cut short.\n"
+#define M_STATS_OFF       "Stats were left out of this build, rebuild with make STATS=1.\n"
+#define M_STATS_HDR       "stats for %s:\n"
+#define M_STATS_IO        "  syscalls %lld (%lld reads, %lld writes), %lld bytes read, %lld written\n"
+#define M_STATS_RECS      "  records  %lld visited, %lld returned\n"
+#define M_STATS_TIME      "  time     %.3f ms wall, %.3f ms cpu: %.3f io, %.3f parse, %.3f format, %.3f other\n"
+#define M_STD_UPDATED     "Student %d updated.\n"
+#define M_DB_UPDATED      "Applied %d update(s) from %s.\n"
+#define M_ERR_UPDATE      "Invalid update '%s', use fname=name, lname=name or gpa=value (0 to 500 or 0.0 to 5.0).\n"
+#define M_ERR_UPDATE_LINE "Invalid update on line %d of %s.\n"
+#define M_ERR_UPDATE_FILE "Cant read update file '%s'.\n"
+#define M_ERR_UPDATE_PART "Update stopped, %s, %d of %d update(s) were applied.\n"
+#define M_ERR_SNAPSHOT    "Cant read or write snapshot '%s', %s.\n"
 
 //useful format strings for print students
 //For example to print the header in the required output:
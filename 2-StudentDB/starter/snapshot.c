@@ -0,0 +1,354 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "db.h"
+#include "libsdb.h"
+#include "sdb_internal.h"
+#include "crc32c.h"
+#include "snapshot.h"
+#include "stats.h"
+
+//one distinct name in a block's dictionary
+typedef struct snap_name{
+    uint32_t len;
+    char     text[SNAP_NAME_MAX];
+} snap_name_t;
+
+//export state, the records of the block being filled plus the output file
+typedef struct snap_writer{
+    int          fd;
+    int          n_recs;
+    int          total;
+    student_t    recs[SNAP_BLOCK_RECORDS];
+    int          slots[SNAP_HASH_SIZE];             //dictionary index + 1, 0 is empty
+    snap_name_t  names[2 * SNAP_BLOCK_RECORDS];
+    uint8_t      payload[SNAP_MAX_PAYLOAD];
+} snap_writer_t;
+
+static int write_all(int fd, const void *buff, size_t len) {
+    const char *p = buff;
+
+    while (len > 0) {
+        ssize_t n = sdb_write(fd, p, len);
+        if (n <= 0)
+            return ERR_DB_FILE;
+        p += n;
+        len -= n;
+    }
+    return NO_ERROR;
+}
+
+//Returns NO_ERROR, or SRCH_NOT_FOUND when the file ends first
+static int read_all(int fd, void *buff, size_t len) {
+    char *p = buff;
+
+    while (len > 0) {
+        ssize_t n = sdb_read(fd, p, len);
+        if (n < 0)
+            return ERR_DB_FILE;
+        if (n == 0)
+            return SRCH_NOT_FOUND;
+        p += n;
+        len -= n;
+    }
+    return NO_ERROR;
+}
+
+static uint8_t *put_varint(uint8_t *p, uint32_t v) {
+    while (v >= 0x80) {
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+//Returns NULL when the varint runs past end or does not fit 32 bits
+static const uint8_t *get_varint(const uint8_t *p, const uint8_t *end, uint32_t *v) {
+    uint32_t out = 0;
+
+    for (int shift = 0; shift < 7 * SNAP_VARINT_MAX; shift += 7) {
+        if (p == end)
+            return NULL;
+        out |= (uint32_t)(*p & 0x7f) << shift;
+        if ((*p++ & 0x80) == 0) {
+            *v = out;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+//FNV-1a
+static uint32_t name_hash(const char *text, size_t len) {
+    uint32_t h = 2166136261u;
+
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)text[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+//Index of the name in the block's dictionary, added if it is new
+static uint32_t dict_index(snap_writer_t *w, int *n_names, const char *field, size_t max) {
+    size_t len = strnlen(field, max);
+    uint32_t h = name_hash(field, len) & (SNAP_HASH_SIZE - 1);
+
+    while (w->slots[h] != 0) {
+        snap_name_t *n = &w->names[w->slots[h] - 1];
+        if (n->len == len && memcmp(n->text, field, len) == 0)
+            return w->slots[h] - 1;
+        h = (h + 1) & (SNAP_HASH_SIZE - 1);
+    }
+    w->names[*n_names].len = len;
+    memcpy(w->names[*n_names].text, field, len);
+    w->slots[h] = ++*n_names;
+    return *n_names - 1;
+}
+
+static int flush_block(snap_writer_t *w) {
+    snap_block_hdr_t bh;
+    uint32_t fidx[SNAP_BLOCK_RECORDS];
+    uint32_t lidx[SNAP_BLOCK_RECORDS];
+    uint8_t *p = w->payload;
+    int n_names = 0;
+    int prev_id = 0;
+
+    if (w->n_recs == 0)
+        return NO_ERROR;
+
+    memset(w->slots, 0, sizeof(w->slots));
+    for (int i = 0; i < w->n_recs; i++) {
+        fidx[i] = dict_index(w, &n_names, w->recs[i].fname, sizeof(w->recs[i].fname));
+        lidx[i] = dict_index(w, &n_names, w->recs[i].lname, sizeof(w->recs[i].lname));
+    }
+
+    p = put_varint(p, n_names);
+    for (int i = 0; i < n_names; i++) {
+        p = put_varint(p, w->names[i].len);
+        memcpy(p, w->names[i].text, w->names[i].len);
+        p += w->names[i].len;
+    }
+    for (int i = 0; i < w->n_recs; i++) {
+        p = put_varint(p, w->recs[i].id - prev_id);
+        p = put_varint(p, fidx[i]);
+        p = put_varint(p, lidx[i]);
+        p = put_varint(p, w->recs[i].gpa);
+        prev_id = w->recs[i].id;
+    }
+
+    bh.n_records = w->n_recs;
+    bh.payload_len = p - w->payload;
+    bh.crc = crc32c(0, w->payload, bh.payload_len);
+    w->total += w->n_recs;
+    w->n_recs = 0;
+    if (write_all(w->fd, &bh, sizeof(bh)) != NO_ERROR ||
+        write_all(w->fd, w->payload, bh.payload_len) != NO_ERROR)
+        return ERR_DB_FILE;
+    return NO_ERROR;
+}
+
+static int export_record(const student_t *s, void *arg) {
+    snap_writer_t *w = arg;
+
+    w->recs[w->n_recs++] = *s;
+    if (w->n_recs == SNAP_BLOCK_RECORDS)
+        return flush_block(w);
+    return NO_ERROR;
+}
+
+//Write every record of db to a snapshot at path.  The snapshot is written
+//to a temp file next to path and renamed over it at the end, so a failed
+//export leaves an older snapshot alone.
+int sdb_export(sdb_t *db, const char *path, int *n_records) {
+    snap_hdr_t hdr = { SNAP_MAGIC, SNAP_VERSION, SNAP_BLOCK_RECORDS, 0 };
+    snap_block_hdr_t end = { 0, 0, 0 };
+    char *tmp_path = sdb_side_path(path, TMP_FILE_PREFIX, "");
+    snap_writer_t *w = malloc(sizeof(snap_writer_t));
+    int rc;
+
+    *n_records = 0;
+    if (tmp_path == NULL || w == NULL) {
+        free(tmp_path);
+        free(w);
+        return ERR_DB_MEMORY;
+    }
+    w->n_recs = 0;
+    w->total = 0;
+    w->fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+    if (w->fd == -1) {
+        free(tmp_path);
+        free(w);
+        return ERR_DB_FILE;
+    }
+
+    rc = write_all(w->fd, &hdr, sizeof(hdr));
+    if (rc == NO_ERROR)
+        rc = sdb_scan(db, MIN_STD_ID, MAX_STD_ID, export_record, w);
+    if (rc == NO_ERROR)
+        rc = flush_block(w);
+    if (rc == NO_ERROR)
+        rc = write_all(w->fd, &end, sizeof(end));
+    if (close(w->fd) != 0 && rc == NO_ERROR)
+        rc = ERR_DB_FILE;
+    if (rc == NO_ERROR && rename(tmp_path, path) != 0)
+        rc = ERR_DB_FILE;
+    if (rc != NO_ERROR)
+        unlink(tmp_path);
+    else
+        *n_records = w->total;
+
+    free(tmp_path);
+    free(w);
+    return rc;
+}
+
+//Decode one block into recs.  Everything is checked, a record that could
+//not have come out of sdb_export makes the whole block ERR_DB_CORRUPT.
+static int decode_block(const uint8_t *p, const uint8_t *end, int n_recs,
+                        student_t *recs, int *last_id) {
+    snap_name_t *names;
+    uint32_t n_names;
+    int rc = ERR_DB_CORRUPT;
+
+    if ((p = get_varint(p, end, &n_names)) == NULL || n_names > 2 * (uint32_t)n_recs)
+        return ERR_DB_CORRUPT;
+    if ((names = malloc((n_names > 0 ? n_names : 1) * sizeof(snap_name_t))) == NULL)
+        return ERR_DB_MEMORY;
+
+    for (uint32_t i = 0; i < n_names; i++) {
+        if ((p = get_varint(p, end, &names[i].len)) == NULL ||
+            names[i].len > SNAP_NAME_MAX || names[i].len > (size_t)(end - p))
+            goto out;
+        memcpy(names[i].text, p, names[i].len);
+        p += names[i].len;
+    }
+
+    for (int i = 0; i < n_recs; i++) {
+        student_t *s = &recs[i];
+        uint32_t delta, f, l, gpa;
+        int64_t id;
+
+        if ((p = get_varint(p, end, &delta)) == NULL ||
+            (p = get_varint(p, end, &f)) == NULL ||
+            (p = get_varint(p, end, &l)) == NULL ||
+            (p = get_varint(p, end, &gpa)) == NULL)
+            goto out;
+        //the first id of a block is stored whole
+        if (i == 0 ? (int64_t)delta <= *last_id : delta == 0)
+            goto out;
+        if (f >= n_names || l >= n_names || gpa > MAX_STD_GPA ||
+            names[f].len > sizeof(s->fname) || names[l].len > sizeof(s->lname))
+            goto out;
+
+        id = i == 0 ? (int64_t)delta : (int64_t)recs[i - 1].id + delta;
+        if (id < MIN_STD_ID || id > MAX_STD_ID)
+            goto out;
+        memset(s, 0, sizeof(*s));
+        s->id = id;
+        memcpy(s->fname, names[f].text, names[f].len);
+        memcpy(s->lname, names[l].text, names[l].len);
+        s->gpa = gpa;
+    }
+    if (p == end) {
+        *last_id = recs[n_recs - 1].id;
+        rc = NO_ERROR;
+    }
+out:
+    free(names);
+    return rc;
+}
+
+//Read and check the whole snapshot into *recs before anything is changed
+static int read_snapshot(int fd, student_t **recs, int *n_recs) {
+    snap_hdr_t hdr;
+    snap_block_hdr_t bh;
+    uint8_t *payload = malloc(SNAP_MAX_PAYLOAD);
+    student_t *out = malloc(MAX_STD_ID * sizeof(student_t));
+    int last_id = 0;
+    int n = 0;
+    int rc;
+
+    if (payload == NULL || out == NULL) {
+        rc = ERR_DB_MEMORY;
+        goto out;
+    }
+    if ((rc = read_all(fd, &hdr, sizeof(hdr))) != NO_ERROR ||
+        hdr.magic != SNAP_MAGIC || hdr.version != SNAP_VERSION) {
+        rc = ERR_DB_FILE;
+        goto out;
+    }
+    if (hdr.block_records == 0 || hdr.block_records > SNAP_BLOCK_RECORDS) {
+        rc = ERR_DB_CORRUPT;
+        goto out;
+    }
+
+    while (1) {
+        if ((rc = read_all(fd, &bh, sizeof(bh))) != NO_ERROR)
+            break;
+        if (bh.n_records == 0)
+            break;
+        //ids only go up, so no snapshot holds more than MAX_STD_ID records
+        if (bh.n_records > hdr.block_records || bh.payload_len > SNAP_MAX_PAYLOAD ||
+            bh.n_records > (uint32_t)(MAX_STD_ID - n)) {
+            rc = ERR_DB_CORRUPT;
+            break;
+        }
+        if ((rc = read_all(fd, payload, bh.payload_len)) != NO_ERROR)
+            break;
+        if (crc32c(0, payload, bh.payload_len) != bh.crc) {
+            rc = ERR_DB_CORRUPT;
+            break;
+        }
+        rc = decode_block(payload, payload + bh.payload_len, bh.n_records, out + n, &last_id);
+        if (rc != NO_ERROR)
+            break;
+        n += bh.n_records;
+    }
+    //a file cut short lost its end block
+    if (rc == SRCH_NOT_FOUND)
+        rc = ERR_DB_CORRUPT;
+
+out:
+    free(payload);
+    if (rc != NO_ERROR) {
+        free(out);
+        return rc;
+    }
+    *recs = out;
+    *n_recs = n;
+    return NO_ERROR;
+}
+
+//Replace every record of db with the ones in the snapshot at path.  The
+//snapshot is read and checked in full first, so a bad snapshot leaves db
+//untouched.  The records are then loaded with sdb_put_many.
+int sdb_import(sdb_t *db, const char *path, int *n_records) {
+    student_t *recs = NULL;
+    int n = 0;
+    int rc;
+    int fd;
+
+    *n_records = 0;
+    if ((fd = open(path, O_RDONLY)) == -1)
+        return ERR_DB_FILE;
+    rc = read_snapshot(fd, &recs, &n);
+    close(fd);
+    if (rc != NO_ERROR)
+        return rc;
+
+    rc = sdb_truncate(db);
+    if (rc == NO_ERROR)
+        rc = sdb_put_many(db, recs, n);
+    if (rc == NO_ERROR)
+        *n_records = n;
+    free(recs);
+    return rc;
+}
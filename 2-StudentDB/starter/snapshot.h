@@ -0,0 +1,53 @@
+#ifndef __SNAPSHOT_H__
+    #define __SNAPSHOT_H__
+
+#include <stdint.h>
+
+#include "db.h"     //get student record type
+#include "libsdb.h" //get the sdb_t handle
+
+//Snapshot (.sdbz) format, written by sdb_export and read by sdb_import.
+//
+//  header      snap_hdr_t
+//  blocks      snap_block_hdr_t then payload_len bytes of payload
+//  end         a snap_block_hdr_t with n_records == 0
+//
+//A block holds up to SNAP_BLOCK_RECORDS records in id order.  Its payload
+//starts with a dictionary of the distinct names in the block (fname and
+//lname share it), each one a varint length and the bytes without padding.
+//Then every record is four varints:
+//
+//  id - previous id (the first record of a block stores its id)
+//  dictionary index of fname
+//  dictionary index of lname
+//  gpa
+//
+//so a record that shares its names with its neighbours takes 5 or 6 bytes
+//instead of 64.  Varints are LEB128, 7 bits per byte, low bits first.  Each
+//block carries the CRC32C of its payload and stands on its own.
+#define SNAP_MAGIC          0x5a424453      //"SDBZ"
+#define SNAP_VERSION        1
+#define SNAP_BLOCK_RECORDS  4096
+#define SNAP_NAME_MAX       32              //longest name field, lname
+#define SNAP_VARINT_MAX     5               //bytes in a 32 bit varint
+#define SNAP_HASH_SIZE      16384           //dictionary slots, > 2 names per record
+
+//nothing a valid block can hold is bigger than this
+#define SNAP_MAX_PAYLOAD    (SNAP_VARINT_MAX + \
+                             2 * SNAP_BLOCK_RECORDS * (SNAP_VARINT_MAX + SNAP_NAME_MAX) + \
+                             SNAP_BLOCK_RECORDS * 4 * SNAP_VARINT_MAX)
+
+typedef struct snap_hdr{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t block_records;
+    uint32_t reserved;
+} snap_hdr_t;
+
+typedef struct snap_block_hdr{
+    uint32_t n_records;
+    uint32_t payload_len;
+    uint32_t crc;           //CRC32C of the payload
+} snap_block_hdr_t;
+
+#endif
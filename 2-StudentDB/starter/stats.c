@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include "db.h"
+#include "libsdb.h"
+#include "stats.h"
+
+#if SDB_STATS
+
+bool stats_on;
+sdb_stats_t stats_total;
+
+//one read or write system call that moved got bytes, started at t
+static void count_io(long long t, ssize_t got, bool is_write) {
+    STATS_ADD(syscalls, 1);
+    STATS_ADD(io_ns, stats_clock() - t);
+    if (is_write) {
+        STATS_ADD(writes, 1);
+        STATS_ADD(bytes_written, got > 0 ? got : 0);
+    } else {
+        STATS_ADD(reads, 1);
+        STATS_ADD(bytes_read, got > 0 ? got : 0);
+    }
+}
+
+ssize_t sdb_pread(int fd, void *buff, size_t len, off_t off) {
+    STATS_START(t);
+    ssize_t got = pread(fd, buff, len, off);
+
+    if (stats_on)
+        count_io(t, got, false);
+    return got;
+}
+
+ssize_t sdb_pwrite(int fd, const void *buff, size_t len, off_t off) {
+    STATS_START(t);
+    ssize_t got = pwrite(fd, buff, len, off);
+
+    if (stats_on)
+        count_io(t, got, true);
+    return got;
+}
+
+ssize_t sdb_read(int fd, void *buff, size_t len) {
+    STATS_START(t);
+    ssize_t got = read(fd, buff, len);
+
+    if (stats_on)
+        count_io(t, got, false);
+    return got;
+}
+
+ssize_t sdb_write(int fd, const void *buff, size_t len) {
+    STATS_START(t);
+    ssize_t got = write(fd, buff, len);
+
+    if (stats_on)
+        count_io(t, got, true);
+    return got;
+}
+
+int stats_count_returned(const student_t *s, void *arg) {
+    stats_fn_t *f = arg;
+
+    STATS_ADD(returned, 1);
+    return f->fn(s, f->arg);
+}
+
+//Call before starting any threads that use the library, the flag itself
+//is not atomic.  Turning stats on clears the counters.
+int sdb_stats_enable(int on) {
+    if (on)
+        memset(&stats_total, 0, sizeof(stats_total));
+    stats_on = on;
+    return NO_ERROR;
+}
+
+int sdb_stats_get(sdb_stats_t *s) {
+    *s = stats_total;
+    return NO_ERROR;
+}
+
+#else
+
+int sdb_stats_enable(int on) {
+    (void)on;
+    return ERR_DB_OP;
+}
+
+int sdb_stats_get(sdb_stats_t *s) {
+    memset(s, 0, sizeof(*s));
+    return ERR_DB_OP;
+}
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef __STATS_H__
+    #define __STATS_H__
+
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include "db.h"     //get student record type
+#include "libsdb.h" //get sdb_stats_t
+
+//Counters behind sdb_stats_get().  They are process wide, every handle and
+//thread adds to the same sdb_stats_t with relaxed atomics, and only while
+//sdb_stats_enable() has turned them on.
+//
+//The library does its reads and writes through sdb_pread() and friends
+//below, which count the call, the bytes and the time spent in it.  Hot
+//loops count into a local and add it once per block with STATS_ADD.
+//
+//Building with SDB_STATS defined as 0 (make STATS=0) turns every macro
+//here into nothing and the wrappers into the plain calls, so a build
+//without stats has no trace of them.
+#ifndef SDB_STATS
+    #define SDB_STATS 1
+#endif
+
+#if SDB_STATS
+
+extern bool stats_on;
+extern sdb_stats_t stats_total;
+
+static inline long long stats_clock(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+#define STATS_ADD(field, n) \
+    do { if (stats_on) __atomic_fetch_add(&stats_total.field, (n), __ATOMIC_RELAXED); } while (0)
+#define STATS_START(t)          long long t = stats_on ? stats_clock() : 0
+#define STATS_STOP(t, field)    STATS_ADD(field, stats_clock() - (t))
+
+//route a scan callback through a counter of the records that reach it
+typedef struct stats_fn{
+    sdb_scan_fn fn;
+    void       *arg;
+} stats_fn_t;
+
+int stats_count_returned(const student_t *s, void *arg);
+
+#define STATS_COUNT_RETURNED(fn, arg) \
+    stats_fn_t stats_fn_ = { fn, arg }; \
+    if (stats_on) { fn = stats_count_returned; arg = &stats_fn_; }
+
+ssize_t sdb_pread(int fd, void *buff, size_t len, off_t off);
+ssize_t sdb_pwrite(int fd, const void *buff, size_t len, off_t off);
+ssize_t sdb_read(int fd, void *buff, size_t len);
+ssize_t sdb_write(int fd, const void *buff, size_t len);
+
+#else
+
+#define STATS_ADD(field, n)     do { (void)(n); } while (0)
+#define STATS_START(t)          do { } while (0)
+#define STATS_STOP(t, field)    do { } while (0)
+#define STATS_COUNT_RETURNED(fn, arg)   do { } while (0)
+
+#define sdb_pread   pread
+#define sdb_pwrite  pwrite
+#define sdb_read    read
+#define sdb_write   write
+
+#endif
+
+#endif
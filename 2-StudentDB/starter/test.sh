@@ -6,6 +6,8 @@ setup_file() {
     if [ -f "student.db" ]; then
         rm "student.db"
     fi
+    # and its index, shard map and shard files from an earlier run
+    rm -f student.db.*
 }
 
 @test "Check if database is empty to start" {
@@ -192,4 +194,360 @@ setup_file() {
         echo "Failed Output:  $output"
         return 1
     }
-}
\ No newline at end of file
+}
+@test "Find students by last name prefix" {
+    run ./sdbsc -n "lname:DO*"
+    [ "$status" -eq 0 ]
+
+    normalized_output=$(echo -n "$output" | tr -s '[:space:]' ' ')
+    expected_output="ID FIRST_NAME LAST_NAME GPA 1 john doe 3.45 3 jane doe 3.90 63 jim doe 2.85"
+
+    [ "$normalized_output" = "$expected_output" ] || {
+        echo "Failed Output: $normalized_output"
+        echo "Expected Output: $expected_output"
+        return 1
+    }
+}
+
+@test "Find students by name substring" {
+    run ./sdbsc -n "*an*"
+    [ "$status" -eq 0 ]
+
+    normalized_output=$(echo -n "$output" | tr -s '[:space:]' ' ')
+    expected_output="ID FIRST_NAME LAST_NAME GPA 3 jane doe 3.90"
+
+    [ "$normalized_output" = "$expected_output" ] || {
+        echo "Failed Output: $normalized_output"
+        echo "Expected Output: $expected_output"
+        return 1
+    }
+}
+
+@test "Name search skips deleted students" {
+    run ./sdbsc -n "janet"
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "No students matched 'janet'." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+}
+
+@test "Query students with a filter" {
+    run ./sdbsc -q "gpa>=300 && lname==doe"
+    [ "$status" -eq 0 ]
+
+    normalized_output=$(echo -n "$output" | tr -s '[:space:]' ' ')
+    expected_output="ID FIRST_NAME LAST_NAME GPA 1 john doe 3.45 3 jane doe 3.90"
+
+    [ "$normalized_output" = "$expected_output" ] || {
+        echo "Failed Output: $normalized_output"
+        echo "Expected Output: $expected_output"
+        return 1
+    }
+}
+
+@test "Query with or and id range" {
+    run ./sdbsc -q "id>50 || gpa>3.8"
+    [ "$status" -eq 0 ]
+
+    normalized_output=$(echo -n "$output" | tr -s '[:space:]' ' ')
+    expected_output="ID FIRST_NAME LAST_NAME GPA 3 jane doe 3.90 63 jim doe 2.85"
+
+    [ "$normalized_output" = "$expected_output" ] || {
+        echo "Failed Output: $normalized_output"
+        echo "Expected Output: $expected_output"
+        return 1
+    }
+
+    run ./sdbsc -q "id<-2147483648 || id>2147483647"
+    [ "$status" -eq 0 ]
+    [ "$output" = "No students matched the query." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+}
+
+@test "Reject a bad query" {
+    run ./sdbsc -q "gpa>>3"
+    [ "$status" -eq 2 ]
+    [ "${lines[0]}" = "Invalid query near '>3'." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    run ./sdbsc -q "id==4294967297"
+    [ "$status" -eq 2 ]
+    [ "${lines[0]}" = "Invalid query near '4294967297'." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    run ./sdbsc -q "gpa<3.5e300"
+    [ "$status" -eq 2 ]
+    [ "${lines[0]}" = "Invalid query near '3.5e300'." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+}
+
+@test "Verify page checksums" {
+    run ./sdbsc -v
+    [ "$status" -eq 0 ]
+    [ "$output" = "Database verified, 1 page(s) checked, 0 without a checksum yet." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+}
+
+@test "Export and import a snapshot" {
+    run ./sdbsc --export snap.sdbz
+    [ "$status" -eq 0 ]
+    [ "$output" = "Exported 3 student record(s) to snap.sdbz." ]
+
+    run ./sdbsc -z
+    [ "$status" -eq 0 ]
+
+    run ./sdbsc --import snap.sdbz
+    [ "$status" -eq 0 ]
+    [ "$output" = "Imported 3 student record(s) from snap.sdbz." ]
+    rm -f snap.sdbz
+
+    run ./sdbsc -p
+    [ "$status" -eq 0 ]
+
+    normalized_output=$(echo -n "$output" | tr -s '[:space:]' ' ')
+    expected_output="ID FIRST_NAME LAST_NAME GPA 1 john doe 3.45 3 jane doe 3.90 63 jim doe 2.85"
+
+    [ "$normalized_output" = "$expected_output" ] || {
+        echo "Failed Output: $normalized_output"
+        echo "Expected Output: $expected_output"
+        return 1
+    }
+}
+
+@test "Shard the database and keep every record" {
+    run ./sdbsc -s hash 3
+    [ "$status" -eq 0 ]
+    [ "$output" = "Database split into 3 shard(s)." ]
+    [ -f "student.db.shards" ]
+    [ ! -f "student.db" ]
+
+    run ./sdbsc -p
+    [ "$status" -eq 0 ]
+
+    normalized_output=$(echo -n "$output" | tr -s '[:space:]' ' ')
+    expected_output="ID FIRST_NAME LAST_NAME GPA 1 john doe 3.45 3 jane doe 3.90 63 jim doe 2.85"
+
+    [ "$normalized_output" = "$expected_output" ] || {
+        echo "Failed Output: $normalized_output"
+        echo "Expected Output: $expected_output"
+        return 1
+    }
+
+    run ./sdbsc -a 64 janet doe 310
+    [ "$status" -eq 0 ]
+    run ./sdbsc -n "jan*"
+    [ "$status" -eq 0 ]
+
+    normalized_output=$(echo -n "$output" | tr -s '[:space:]' ' ')
+    expected_output="ID FIRST_NAME LAST_NAME GPA 3 jane doe 3.90 64 janet doe 3.10"
+
+    [ "$normalized_output" = "$expected_output" ] || {
+        echo "Failed Output: $normalized_output"
+        echo "Expected Output: $expected_output"
+        return 1
+    }
+}
+
+@test "Convert to the row format and back" {
+    run ./sdbsc --format 2
+    [ "$status" -eq 0 ]
+    [ "$output" = "Database converted to format 2." ]
+    [ -f "student.db.0.heap" ]
+
+    run ./sdbsc -a 65 jasmine ramirez-delacruz 395
+    [ "$status" -eq 0 ]
+
+    # the row format keeps the student_t name limits
+    run ./sdbsc -a 66 bartholomew-maximilian-xavier doe 250
+    [ "$status" -eq 0 ]
+    [ "${lines[1]}" = "Name 'bartholomew-maximilian-xavier' does not fit, only its first 23 characters were kept." ]
+    run ./sdbsc -f 66
+    [ "${lines[1]}" = "66     bartholomew-maximilian-  doe                              2.50" ]
+    run ./sdbsc -d 66
+    [ "$status" -eq 0 ]
+    run ./sdbsc -q "gpa>=3.0"
+    [ "$status" -eq 0 ]
+
+    normalized_output=$(echo -n "$output" | tr -s '[:space:]' ' ')
+    expected_output="ID FIRST_NAME LAST_NAME GPA 1 john doe 3.45 3 jane doe 3.90 64 janet doe 3.10 65 jasmine ramirez-delacruz 3.95"
+
+    [ "$normalized_output" = "$expected_output" ] || {
+        echo "Failed Output: $normalized_output"
+        echo "Expected Output: $expected_output"
+        return 1
+    }
+
+    run ./sdbsc --format 1
+    [ "$status" -eq 0 ]
+    [ ! -f "student.db.0.heap" ]
+    run ./sdbsc -f 65
+    [ "$status" -eq 0 ]
+    [ "${lines[1]}" = "65     jasmine                  ramirez-delacruz                 3.95" ]
+}
+
+@test "Stats report what a command did" {
+    run ./sdbsc --stats -f 3
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "ID     FIRST_NAME               LAST_NAME                        GPA" ]
+    [ "${lines[2]}" = "stats for -f:" ]
+    [ "${lines[4]}" = "  records  1 visited, 1 returned" ]
+
+    SDBSC_STATS=1 run ./sdbsc -c
+    [ "$status" -eq 0 ]
+    [ "${lines[1]}" = "stats for -c:" ]
+}
+
+@test "Update fields in place" {
+    run ./sdbsc -u 65 gpa=3.2 lname=ramirez
+    [ "$status" -eq 0 ]
+    [ "$output" = "Student 65 updated." ]
+
+    printf '# regrade\n65 gpa=350\n63 fname=jimmy\n' > updates.txt
+    run ./sdbsc -U updates.txt
+    rm -f updates.txt
+    [ "$status" -eq 0 ]
+    [ "$output" = "Applied 2 update(s) from updates.txt." ]
+
+    run ./sdbsc -q "id>=63 && id<=65"
+    [ "$status" -eq 0 ]
+    normalized_output=$(echo -n "$output" | tr -s '[:space:]' ' ')
+    expected_output="ID FIRST_NAME LAST_NAME GPA 63 jimmy doe 2.85 64 janet doe 3.10 65 jasmine ramirez 3.50"
+
+    [ "$normalized_output" = "$expected_output" ] || {
+        echo "Failed Output: $normalized_output"
+        echo "Expected Output: $expected_output"
+        return 1
+    }
+
+    run ./sdbsc -u 2 gpa=300
+    [ "$status" -eq 1 ]
+    [ "$output" = "Student 2 was not found in database." ]
+    run ./sdbsc -u 65 age=20
+    [ "$status" -eq 2 ]
+    run ./sdbsc -u 65 gpa=1e300
+    [ "$status" -eq 2 ]
+}
+
+@test "Reserve space without changing the database" {
+    size=$(stat -c %s student.db.0)
+    run ./sdbsc --reserve 100000
+    [ "$status" -eq 0 ]
+    [ "$output" = "Reserved disk space for the ids up to 100000." ]
+    [ "$(stat -c %s student.db.0)" -eq "$size" ]
+
+    run ./sdbsc --reserve 100001
+    [ "$status" -eq 2 ]
+    run ./sdbsc -c
+    [ "$status" -eq 0 ]
+    [ "$output" = "Database contains 5 student record(s)." ]
+}
+
+@test "Change log streams only the changes after a seq" {
+    run ./sdbsc -d 64
+    [ "$status" -eq 0 ]
+
+    run ./sdbsc --changes-since 0
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = '{"seq":1,"op":"add","id":1,"fname":"john","lname":"doe","gpa":345}' ]
+    last=${#lines[@]}
+
+    run ./sdbsc --changes-since $((last - 1))
+    [ "$status" -eq 0 ]
+    [ "$output" = "{\"seq\":$last,\"op\":\"del\",\"id\":64}" ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+}
+
+@test "Name search and indexed query report a corrupt page" {
+    dir=$(mktemp -d)
+    cp sdbsc "$dir"
+    cd "$dir"
+    ./sdbsc -a 1 john doe 345
+    ./sdbsc -a 3 jane doe 390
+    # a byte of john's name padding, his page no longer matches its sum
+    printf 'X' | dd of=student.db bs=1 seek=74 conv=notrunc 2>/dev/null
+
+    run ./sdbsc -n john
+    name_status=$status
+    name_output=$output
+    run ./sdbsc -q "id==1"
+    cd - > /dev/null
+    rm -rf "$dir"
+
+    [ "$name_status" -eq 1 ]
+    [ "$name_output" = "DB file failed its checksum, run -v for details!" ] || {
+        echo "Failed Output:  $name_output"
+        return 1
+    }
+    [ "$status" -eq 1 ]
+    [ "$output" = "DB file failed its checksum, run -v for details!" ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+}
+
+@test "A bulk load the change log refuses is undone" {
+    dir=$(mktemp -d)
+    cp sdbsc "$dir"
+    cd "$dir"
+    for id in $(seq 1 12); do ./sdbsc -a $id s$id doe 300; done
+    ./sdbsc --export snap.sdbz
+    # the log is past 880 bytes, a 1K file size limit lets the clear of
+    # the import through and fails the append of its records
+    run bash -c "trap '' XFSZ; ulimit -f 1; ./sdbsc --import snap.sdbz"
+    import_status=$status
+    run ./sdbsc -c
+    count_output=$output
+    run ./sdbsc --changes-since 12
+    cd - > /dev/null
+    rm -rf "$dir"
+
+    [ "$import_status" -eq 1 ]
+    [ "$count_output" = "Database contains no student records." ] || {
+        echo "Failed Output:  $count_output"
+        return 1
+    }
+    [ "$output" = '{"seq":13,"op":"clear"}' ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+}
+
+@test "An update the change log refuses is undone" {
+    dir=$(mktemp -d)
+    cp sdbsc "$dir"
+    cd "$dir"
+    ./sdbsc -a 1 john doe 345
+    ./sdbsc -a 2 jane doe 390
+    for id in $(seq 20 34); do ./sdbsc -a $id s$id doe 300; done
+    # the log is past 1K, the records of ids 1 and 2 are not
+    run bash -c "trap '' XFSZ; ulimit -f 1; ./sdbsc -u 1 gpa=100"
+    update_status=$status
+    run ./sdbsc -f 1
+    find_output=$output
+    run ./sdbsc --changes-since 17
+    cd - > /dev/null
+    rm -rf "$dir"
+
+    [ "$update_status" -eq 1 ]
+    [[ "$find_output" == *"3.45"* ]] || {
+        echo "Failed Output:  $find_output"
+        return 1
+    }
+    [ -z "$output" ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+}
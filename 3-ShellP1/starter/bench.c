@@ -0,0 +1,314 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "dshlib.h"
+
+// Parser throughput, built and run by make bench.  A corpus of command
+// lines goes through build_cmd_list() in a tight loop, and through the
+// strdup() and strtok() parser it replaced, kept below as the reference.
+// Each run reports lines/s, MB/s and malloc() calls per line.
+//
+// Before build_cmd_list() is timed its parse of every line is checked
+// against the reference: the same return code and, when OK, the same exe
+// and args for every command.  A mismatch is reported and makes the exit
+// code 1.
+//
+// The corpus is built in, or one line per line of the -f file, e.g. a
+// shell history.
+//
+// usage: bench [-f corpus]
+#define BENCH_MIN_TIME  0.2     // seconds per result
+
+static const char *corpus[] = {
+    "ls -la",
+    "ls -l /usr/bin | grep python | wc -l",
+    "echo hello, world | tr a-z A-Z",
+    "cat /etc/passwd | cut -d: -f1 | sort | uniq -c | sort -rn | head -5",
+    "grep -rn TODO src/ include/ | grep -v test",
+    "find . -name *.c -newer makefile | xargs wc -l",
+    "gcc -Wall -Wextra -O2 -g -o dsh dsh_cli.c dshlib.c",
+    "git log --oneline --graph --decorate --all | head -40",
+    "cmd1 | cmd2 | cmd3 | cmd4 | cmd5 | cmd6 | cmd7 | cmd8",
+    "cmd1 | cmd2 | cmd3 | cmd4 | cmd5 | cmd6 | cmd7 | cmd8 | cmd9",
+    "cd ..",
+    "   echo   leading and trailing   ",
+    "\tcat\tfile.txt\t|\twc\t",
+    "  |  | ",
+    "ls || wc",
+    "",
+    "dragon",
+    "a_very_long_executable_name_that_is_more_than_sixty_four_characters_long",
+    "tar -czf backup.tar.gz --exclude=.git --exclude=*.o project/",
+    "du -sh /var/log/* /tmp | sort -h | tail -3",
+};
+#define N_CORPUS    (int)(sizeof(corpus) / sizeof(corpus[0]))
+
+// malloc() and friends called from the parsers, counted through the
+// linker's --wrap.  strdup() is wrapped too, its own malloc() is inside
+// the C library where --wrap does not reach.
+static unsigned long allocs;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+char *__real_strdup(const char *s);
+
+void *__wrap_malloc(size_t size) {
+    allocs++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+    allocs++;
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    allocs++;
+    return __real_realloc(ptr, size);
+}
+
+char *__wrap_strdup(const char *s) {
+    allocs++;
+    return __real_strdup(s);
+}
+
+// The parse of the reference, exe and args copied out like the
+// command_list_t it filled in
+typedef struct ref_list{
+    int num;
+    struct {
+        char exe[EXE_MAX];
+        char args[ARG_MAX];
+    } commands[CMD_MAX];
+} ref_list_t;
+
+static char *ref_trim(char *str) {
+    char *end;
+
+    while (isspace((unsigned char)*str)) str++;
+    if (*str == 0)
+        return str;
+    end = str + strlen(str) - 1;
+    while (end > str && isspace((unsigned char)*end)) end--;
+    *(end + 1) = 0;
+    return str;
+}
+
+// build_cmd_list() as it was before it parsed into spans
+static int ref_build_cmd_list(char *cmd_line, ref_list_t *clist) {
+    char *cmd_copy = strdup(cmd_line);
+    char *trimmed_cmd = ref_trim(cmd_copy);
+
+    if (strlen(trimmed_cmd) == 0) {
+        free(cmd_copy);
+        return WARN_NO_CMDS;
+    }
+
+    char *pipe_token = strtok(trimmed_cmd, PIPE_STRING);
+    clist->num = 0;
+
+    while (pipe_token != NULL && clist->num < CMD_MAX) {
+        char *curr_cmd = ref_trim(pipe_token);
+
+        if (strlen(curr_cmd) == 0) {
+            pipe_token = strtok(NULL, PIPE_STRING);
+            continue;
+        }
+
+        char *space_pos = strchr(curr_cmd, SPACE_CHAR);
+
+        if (space_pos != NULL) {
+            int exe_len = space_pos - curr_cmd;
+            if (exe_len >= EXE_MAX) {
+                free(cmd_copy);
+                return ERR_CMD_OR_ARGS_TOO_BIG;
+            }
+            strncpy(clist->commands[clist->num].exe, curr_cmd, exe_len);
+            clist->commands[clist->num].exe[exe_len] = '\0';
+
+            char *args = ref_trim(space_pos + 1);
+            if (strlen(args) >= ARG_MAX) {
+                free(cmd_copy);
+                return ERR_CMD_OR_ARGS_TOO_BIG;
+            }
+            strcpy(clist->commands[clist->num].args, args);
+        } else {
+            if (strlen(curr_cmd) >= EXE_MAX) {
+                free(cmd_copy);
+                return ERR_CMD_OR_ARGS_TOO_BIG;
+            }
+            strcpy(clist->commands[clist->num].exe, curr_cmd);
+            clist->commands[clist->num].args[0] = '\0';
+        }
+
+        clist->num++;
+        pipe_token = strtok(NULL, PIPE_STRING);
+    }
+
+    if (pipe_token != NULL) {
+        free(cmd_copy);
+        return ERR_TOO_MANY_COMMANDS;
+    }
+
+    free(cmd_copy);
+    return OK;
+}
+
+static double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// FNV-1a over the return code, the number of commands and every exe and
+// args, what the check compares
+static uint64_t fold(uint64_t h, const void *data, size_t len) {
+    const unsigned char *p = data;
+
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ p[i]) * 0x100000001B3ULL;
+    }
+    return h;
+}
+
+static uint64_t fold_str(uint64_t h, const char *s, size_t len) {
+    h = fold(h, s, len);
+    return fold(h, "", 1);
+}
+
+static command_list_t clist;
+static ref_list_t ref_clist;
+
+// One line through one parser, its hash when want_hash
+static uint64_t parse(bool ref, char *line, bool want_hash) {
+    uint64_t h = 0xCBF29CE484222325ULL;
+    int rc;
+
+    if (ref) {
+        rc = ref_build_cmd_list(line, &ref_clist);
+        h = fold(h, &rc, sizeof(rc));
+        if (!want_hash || rc != OK) return h;
+        h = fold(h, &ref_clist.num, sizeof(ref_clist.num));
+        for (int i = 0; i < ref_clist.num; i++) {
+            h = fold_str(h, ref_clist.commands[i].exe, strlen(ref_clist.commands[i].exe));
+            h = fold_str(h, ref_clist.commands[i].args, strlen(ref_clist.commands[i].args));
+        }
+    } else {
+        rc = build_cmd_list(line, &clist);
+        h = fold(h, &rc, sizeof(rc));
+        if (!want_hash || rc != OK) return h;
+        h = fold(h, &clist.num, sizeof(clist.num));
+        for (int i = 0; i < clist.num; i++) {
+            h = fold_str(h, line + clist.commands[i].exe.off, clist.commands[i].exe.len);
+            h = fold_str(h, line + clist.commands[i].args.off, clist.commands[i].args.len);
+        }
+    }
+    return h;
+}
+
+// The lines of path, or NULL
+static char **read_corpus(const char *path, int *n) {
+    FILE *f = fopen(path, "r");
+    char **lines = NULL;
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t len;
+    int cap = 0;
+
+    *n = 0;
+    if (!f) return NULL;
+    while ((len = getline(&line, &size, f)) != -1) {
+        if (len > 0 && line[len - 1] == '\n') line[len - 1] = '\0';
+        if (*n == cap) {
+            cap = cap ? 2 * cap : 64;
+            lines = realloc(lines, cap * sizeof(char *));
+        }
+        lines[(*n)++] = strdup(line);
+    }
+    free(line);
+    fclose(f);
+    return lines;
+}
+
+int main(int argc, char *argv[]) {
+    static const char *funcs[] = { "strtok (old)", "build_cmd_list" };
+    const char *path = NULL;
+    char **lines;
+    uint64_t *ref;
+    size_t bytes = 0;
+    int n_lines;
+    int bad = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:")) != -1) {
+        if (opt != 'f') {
+            fprintf(stderr, "usage: %s [-f corpus]\n", argv[0]);
+            return 1;
+        }
+        path = optarg;
+    }
+
+    if (path) {
+        lines = read_corpus(path, &n_lines);
+        if (!lines || n_lines == 0) {
+            fprintf(stderr, "no lines in %s\n", path);
+            return 1;
+        }
+    } else {
+        n_lines = N_CORPUS;
+        lines = malloc(n_lines * sizeof(char *));
+        for (int i = 0; i < N_CORPUS; i++) {
+            lines[i] = strdup(corpus[i]);
+        }
+    }
+    for (int i = 0; i < n_lines; i++) {
+        bytes += strlen(lines[i]);
+    }
+    ref = malloc(n_lines * sizeof(uint64_t));
+
+    printf("%-15s %12s %8s %12s  %s\n", "function", "lines/s", "MB/s", "allocs/line",
+           "check");
+    for (int f = 0; f < 2; f++) {
+        bool first = f == 0;
+        bool ok = true;
+        unsigned long n = 0;
+        double start, t;
+
+        for (int i = 0; i < n_lines; i++) {
+            uint64_t h = parse(first, lines[i], true);
+
+            if (first) ref[i] = h;
+            else if (h != ref[i]) ok = false;
+        }
+
+        allocs = 0;
+        start = now();
+        do {
+            for (int i = 0; i < n_lines; i++) {
+                parse(first, lines[i], false);
+            }
+            n += n_lines;
+        } while ((t = now() - start) < BENCH_MIN_TIME);
+
+        if (!ok) bad++;
+        printf("%-15s %12.0f %8.1f %12.3f  %s\n", funcs[f], n / t,
+               (double)n / n_lines * bytes / t / 1e6, (double)allocs / n,
+               first ? "ref" : ok ? "ok" : "MISMATCH");
+    }
+
+    for (int i = 0; i < n_lines; i++) {
+        free(lines[i]);
+    }
+    free(lines);
+    free(ref);
+    if (bad > 0) printf("%d results did not match the reference\n", bad);
+    return bad > 0;
+}
@@ -43,10 +43,13 @@ int main() {
         } else if (rc == OK) {
             printf(CMD_OK_HEADER, clist.num);
             // Print each command
+            // The commands are spans of cmd_buff
             for (int i = 0; i < clist.num; i++) {
-                printf("<%d> %s", i + 1, clist.commands[i].exe);
-                if (strlen(clist.commands[i].args) > 0) {
-                    printf(" [%s]", clist.commands[i].args);
+                command_t *cmd = &clist.commands[i];
+
+                printf("<%d> %.*s", i + 1, (int)cmd->exe.len, cmd_buff + cmd->exe.off);
+                if (cmd->args.len > 0) {
+                    printf(" [%.*s]", (int)cmd->args.len, cmd_buff + cmd->args.off);
                 }
                 printf("\n");
             }
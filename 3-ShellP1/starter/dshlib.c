@@ -4,89 +4,71 @@
 #include <ctype.h>
 #include "dshlib.h"
 
-// Helper function to trim whitespace from both ends of a string
-static char* trim(char* str) {
-    char* end;
-    
-    // Trim leading space
-    while(isspace((unsigned char)*str)) str++;
-    
-    if(*str == 0) // All spaces?
-        return str;
-    
-    // Trim trailing space
-    end = str + strlen(str) - 1;
-    while(end > str && isspace((unsigned char)*end)) end--;
-    
-    // Write new null terminator
-    *(end + 1) = 0;
-    
-    return str;
-}
-
+// One pass over the line, no copy and no allocation.  Each command is the
+// text between pipes with the whitespace at both ends dropped; the exe
+// runs up to the first space and the args are the rest, less the
+// whitespace in front of them.  Commands that are only whitespace are
+// skipped.  The spans in clist point into cmd_line, which is left as is.
 int build_cmd_list(char *cmd_line, command_list_t *clist) {
-    char *cmd_copy = strdup(cmd_line);
-    char *trimmed_cmd = trim(cmd_copy);
-    
-    // Check for empty command
-    if (strlen(trimmed_cmd) == 0) {
-        free(cmd_copy);
+    const char *p = cmd_line;
+
+    clist->num = 0;
+    while (isspace((unsigned char)*p)) p++;
+    if (*p == '\0') {
         return WARN_NO_CMDS;
     }
-    
-    // Split by pipe character
-    char *pipe_token = strtok(trimmed_cmd, PIPE_STRING);
-    clist->num = 0;
-    
-    while (pipe_token != NULL && clist->num < CMD_MAX) {
-        char *curr_cmd = trim(pipe_token);
-        
-        // Skip empty commands between pipes
-        if (strlen(curr_cmd) == 0) {
-            pipe_token = strtok(NULL, PIPE_STRING);
+
+    while (*p != '\0') {
+        const char *seg = p;
+        const char *start = NULL; // first non space
+        const char *end = NULL;   // just past the last non space
+        const char *space = NULL; // first space after start
+        size_t len;
+        int more;
+
+        for (; *p != '\0' && *p != PIPE_CHAR; p++) {
+            if (isspace((unsigned char)*p)) {
+                if (*p == SPACE_CHAR && start != NULL && space == NULL) space = p;
+                continue;
+            }
+            if (start == NULL) start = p;
+            end = p + 1;
+        }
+        len = p - seg;
+        more = *p == PIPE_CHAR;
+        if (more) p++;
+
+        if (start == NULL) {
+            // Whitespace between two pipes is still one command too many
+            // once the list is full, whitespace ending the line is not
+            if (clist->num == CMD_MAX && len > 0 && more) {
+                return ERR_TOO_MANY_COMMANDS;
+            }
             continue;
         }
-        
-        // Get the executable (first token before space)
-        char *space_pos = strchr(curr_cmd, SPACE_CHAR);
-        
-        if (space_pos != NULL) {
+        if (clist->num == CMD_MAX) {
+            return ERR_TOO_MANY_COMMANDS;
+        }
+
+        command_t *cmd = &clist->commands[clist->num];
+        const char *args = end;
+
+        if (space != NULL && space < end) {
             // Have both executable and arguments
-            int exe_len = space_pos - curr_cmd;
-            if (exe_len >= EXE_MAX) {
-                free(cmd_copy);
-                return ERR_CMD_OR_ARGS_TOO_BIG;
-            }
-            strncpy(clist->commands[clist->num].exe, curr_cmd, exe_len);
-            clist->commands[clist->num].exe[exe_len] = '\0';
-            
-            // Copy arguments (trimmed)
-            char *args = trim(space_pos + 1);
-            if (strlen(args) >= ARG_MAX) {
-                free(cmd_copy);
-                return ERR_CMD_OR_ARGS_TOO_BIG;
-            }
-            strcpy(clist->commands[clist->num].args, args);
+            args = space + 1;
+            while (isspace((unsigned char)*args)) args++;
         } else {
-            // Only executable, no arguments
-            if (strlen(curr_cmd) >= EXE_MAX) {
-                free(cmd_copy);
-                return ERR_CMD_OR_ARGS_TOO_BIG;
-            }
-            strcpy(clist->commands[clist->num].exe, curr_cmd);
-            clist->commands[clist->num].args[0] = '\0';
+            space = end;
+        }
+        if (space - start >= EXE_MAX || end - args >= ARG_MAX) {
+            return ERR_CMD_OR_ARGS_TOO_BIG;
         }
-        
+        cmd->exe.off = start - cmd_line;
+        cmd->exe.len = space - start;
+        cmd->args.off = args - cmd_line;
+        cmd->args.len = end - args;
         clist->num++;
-        pipe_token = strtok(NULL, PIPE_STRING);
     }
-    
-    // Check if we have more commands (exceeded CMD_MAX)
-    if (pipe_token != NULL) {
-        free(cmd_copy);
-        return ERR_TOO_MANY_COMMANDS;
-    }
-    
-    free(cmd_copy);
+
     return OK;
 }
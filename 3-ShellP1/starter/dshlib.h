@@ -1,17 +1,28 @@
 #ifndef __DSHLIB_H__
 #define __DSHLIB_H__
 
-// Constants for command structure sizes
+#include <stddef.h>
+
+// Limits on the parsed commands, longer ones are ERR_CMD_OR_ARGS_TOO_BIG
 #define EXE_MAX 64
 #define ARG_MAX 256
 #define CMD_MAX 8
 // Longest command that can be read from the shell
 #define SH_CMD_MAX EXE_MAX + ARG_MAX
 
+// A piece of the command line: offset from the start of the line passed
+// to build_cmd_list() and length.  The line is not copied or changed, so
+// it has to outlive the command_list_t parsed from it.
+typedef struct span
+{
+    size_t off;
+    size_t len;
+} span_t;
+
 typedef struct command
 {
-    char exe[EXE_MAX];
-    char args[ARG_MAX];
+    span_t exe;
+    span_t args; // len 0 when there are none
 } command_t;
 
 typedef struct command_list
@@ -189,3 +189,56 @@ pwd
 EOF
     [ "$status" -eq 0 ]
 }
+
+# Parser limits
+@test "Parser: a command with 100 args" {
+    args=$(seq -s ' ' 1 100)
+    run ./dsh <<EOF
+echo $args
+EOF
+    [ "$status" -eq 0 ]
+    echo "$output" | grep -Fxq "$args"
+}
+
+@test "Parser: a line longer than 4K" {
+    word=$(printf 'y%.0s' $(seq 1 5000))
+    run ./dsh <<EOF
+echo $word
+EOF
+    [ "$status" -eq 0 ]
+    echo "$output" | grep -Fxq "$word"
+}
+
+# Quoting
+@test "Quotes: spaces inside quotes are kept" {
+    run ./dsh <<EOF
+echo "a   b"
+EOF
+    [ "$status" -eq 0 ]
+    echo "$output" | grep -Fxq "a   b"
+}
+
+@test "Quotes: a quoted part joins the arg around it" {
+    run ./dsh <<EOF
+echo a"b c"d "" e
+EOF
+    [ "$status" -eq 0 ]
+    echo "$output" | grep -Fxq "ab cd  e"
+}
+
+@test "Quotes: tabs separate args outside quotes" {
+    run bash -c "printf '\techo\ttab\t\"x\ty\"\n' | ./dsh"
+    [ "$status" -eq 0 ]
+    echo "$output" | grep -Fxq "$(printf 'tab x\ty')"
+}
+
+@test "Quotes: a quoted arg across a 64 byte block, at every scan level" {
+    arg="$(printf 'q%.0s' $(seq 1 60))   |  $(printf 'r%.0s' $(seq 1 20))"
+    for level in scalar sse2 avx2; do
+        run env DSH_SCAN=$level ./dsh <<EOF
+echo "$arg"
+EOF
+        [ "$status" -eq 0 ]
+        echo "$output" | grep -Fxq "$arg"
+    done
+}
@@ -7,105 +7,171 @@
 #include <fcntl.h>
 #include <sys/wait.h>
 #include "dshlib.h"
+#include "scan.h"
 
-// Helper function to check if character is within quotes
-static bool is_within_quotes(const char *str, int pos) {
-    bool within_quotes = false;
-    for (int i = 0; i < pos; i++) {
-        if (str[i] == '"') within_quotes = !within_quotes;
+struct arena_block{
+    arena_block_t *next;
+    size_t         used;
+    size_t         size;
+    char           data[];
+};
+
+void *arena_alloc(arena_t *arena, size_t size) {
+    arena_block_t *b = arena->cur;
+
+    size = (size + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+    if (size == 0) size = ARENA_ALIGN;
+
+    // Move on to the next block, or add one, until something fits.  A
+    // block that was used before the last reset is empty again.
+    while (b == NULL || b->size - b->used < size) {
+        if (b != NULL && b->next != NULL) {
+            b = b->next;
+            b->used = 0;
+            continue;
+        }
+
+        size_t block_size = size > ARENA_BLOCK ? size : ARENA_BLOCK;
+        arena_block_t *nb = malloc(sizeof(arena_block_t) + block_size);
+
+        if (!nb) return NULL;
+        nb->next = NULL;
+        nb->used = 0;
+        nb->size = block_size;
+        if (b == NULL) arena->first = nb;
+        else b->next = nb;
+        b = nb;
     }
-    return within_quotes;
+
+    arena->cur = b;
+    arena->last = b->data + b->used;
+    b->used += size;
+    return arena->last;
 }
 
-// Helper function to trim whitespace
-static char* trim(char* str) {
-    while (isspace((unsigned char)*str)) str++;
-    if (*str == 0) return str;
-    char* end = str + strlen(str) - 1;
-    while (end > str && isspace((unsigned char)*end)) end--;
-    *(end + 1) = 0;
-    return str;
+// Like realloc(), in place when ptr is the latest allocation and its block
+// has the room
+void *arena_grow(arena_t *arena, void *ptr, size_t old_size, size_t size) {
+    if (ptr != NULL && ptr == arena->last) {
+        arena_block_t *b = arena->cur;
+        size_t start = (char *)ptr - b->data;
+        size_t rounded = (size + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+
+        if (b->size - start >= rounded) {
+            b->used = start + rounded;
+            return ptr;
+        }
+    }
+
+    void *p = arena_alloc(arena, size);
+    if (p && ptr) memcpy(p, ptr, old_size);
+    return p;
 }
 
-// Initialize cmd_buff structure
-int alloc_cmd_buff(cmd_buff_t *cmd_buff) {
-    cmd_buff->_cmd_buffer = (char *)malloc(SH_CMD_MAX);
-    if (!cmd_buff->_cmd_buffer) return ERR_MEMORY;
-    cmd_buff->argc = 0;
-    memset(cmd_buff->argv, 0, sizeof(char *) * CMD_ARGV_MAX);
-    return OK;
+void arena_reset(arena_t *arena) {
+    arena->cur = arena->first;
+    if (arena->cur) arena->cur->used = 0;
+    arena->last = NULL;
 }
 
-// Free cmd_buff structure
-int free_cmd_buff(cmd_buff_t *cmd_buff) {
-    if (cmd_buff->_cmd_buffer) {
-        free(cmd_buff->_cmd_buffer);
-        cmd_buff->_cmd_buffer = NULL;
+void arena_free(arena_t *arena) {
+    arena_block_t *b = arena->first;
+
+    while (b) {
+        arena_block_t *next = b->next;
+        free(b);
+        b = next;
     }
-    return OK;
+    arena->first = arena->cur = NULL;
+    arena->last = NULL;
+}
+
+// Initialize cmd_buff structure, everything it holds comes from arena
+int alloc_cmd_buff(cmd_buff_t *cmd_buff, arena_t *arena) {
+    cmd_buff->arena = arena;
+    return clear_cmd_buff(cmd_buff);
+}
+
+// Free cmd_buff structure, the arena goes with arena_free()
+int free_cmd_buff(cmd_buff_t *cmd_buff) {
+    return clear_cmd_buff(cmd_buff);
 }
 
 // Clear cmd_buff for reuse
 int clear_cmd_buff(cmd_buff_t *cmd_buff) {
     cmd_buff->argc = 0;
-    memset(cmd_buff->argv, 0, sizeof(char *) * CMD_ARGV_MAX);
+    cmd_buff->argv = NULL;
+    cmd_buff->_cmd_buffer = NULL;
     return OK;
 }
 
-// Parse command line into cmd_buff structure
-int build_cmd_buff(char *cmd_line, cmd_buff_t *cmd_buff) {
-    clear_cmd_buff(cmd_buff);
-    strncpy(cmd_buff->_cmd_buffer, cmd_line, SH_CMD_MAX - 1);
-    cmd_buff->_cmd_buffer[SH_CMD_MAX - 1] = '\0';
+// Stage 1 over the whole line, the masks come out of the arena
+static int scan_cmd_line(const char *line, size_t len, scan_t *sc, arena_t *arena) {
+    size_t words = SCAN_WORDS(len) ? SCAN_WORDS(len) : 1;
+    uint64_t *masks = arena_alloc(arena, 3 * words * sizeof(uint64_t));
 
-    char *curr = cmd_buff->_cmd_buffer;
-    bool in_quotes = false;
-    bool in_token = false;
-    char *token_start = NULL;
+    if (!masks) return ERR_MEMORY;
+    sc->quote = masks;
+    sc->sep = masks + words;
+    sc->pipe = masks + 2 * words;
+    scan_line(line, len, sc);
+    return OK;
+}
 
-    // Skip leading spaces
-    while (*curr && isspace(*curr)) curr++;
-    if (!*curr) return WARN_NO_CMDS;
+// Stage 2: the args of bytes from to to of the scanned line into cmd_buff.
+// Each arg runs from one clear bit of sep to the next set one, and is
+// copied into the arena a piece at a time between its quotes, so a quoted
+// arg keeps its spaces and joins whatever it touches: a"b c" is the one
+// arg ab c.  The copy is never longer than the line, each space or quote
+// dropped makes room for a '\0'.
+static int parse_scanned(const char *line, size_t from, size_t to, const scan_t *sc,
+                         cmd_buff_t *cmd_buff) {
+    char *out = arena_alloc(cmd_buff->arena, to - from + 1);
+    int cap = CMD_ARGV_INIT;
+    char **argv = arena_alloc(cmd_buff->arena, cap * sizeof(char *));
+    size_t o = 0;
+    size_t start;
 
-    token_start = curr;
-    cmd_buff->argc = 0;
+    if (!out || !argv) return ERR_MEMORY;
 
-    while (*curr) {
-        if (*curr == '"') {
-            if (!in_token) {
-                token_start = curr + 1;
-                in_token = true;
-            } else if (in_quotes) {
-                *curr = '\0';
-                in_token = false;
-            }
-            in_quotes = !in_quotes;
-        } else if (isspace(*curr) && !in_quotes) {
-            if (in_token) {
-                *curr = '\0';
-                cmd_buff->argv[cmd_buff->argc++] = token_start;
-                in_token = false;
-            }
-        } else if (!in_token) {
-            token_start = curr;
-            in_token = true;
+    while ((start = scan_next(sc->sep, from, to, false)) < to) {
+        size_t end = scan_next(sc->sep, start, to, true);
+        char *token = out + o;
+
+        for (size_t i = start; i < end;) {
+            size_t quote = scan_next(sc->quote, i, end, true);
+
+            memcpy(out + o, line + i, quote - i);
+            o += quote - i;
+            i = quote + 1;
         }
+        out[o++] = '\0';
 
-        if (cmd_buff->argc >= CMD_ARGV_MAX - 1) {
-            return ERR_TOO_MANY_COMMANDS;
+        // Keep room for the NULL after the last one
+        if (cmd_buff->argc + 1 == cap) {
+            argv = arena_grow(cmd_buff->arena, argv, cap * sizeof(char *),
+                              2 * cap * sizeof(char *));
+            if (!argv) return ERR_MEMORY;
+            cap *= 2;
         }
-        curr++;
+        argv[cmd_buff->argc++] = token;
+        from = end;
     }
 
-    // Handle the last token if it exists
-    if (in_token) {
-        cmd_buff->argv[cmd_buff->argc++] = token_start;
-    }
+    argv[cmd_buff->argc] = NULL;
+    cmd_buff->argv = argv;
+    cmd_buff->_cmd_buffer = out;
+    return cmd_buff->argc > 0 ? OK : WARN_NO_CMDS;
+}
 
-    // Null terminate the argv array
-    cmd_buff->argv[cmd_buff->argc] = NULL;
+// Parse command line into cmd_buff structure
+int build_cmd_buff(char *cmd_line, cmd_buff_t *cmd_buff) {
+    size_t len = strlen(cmd_line);
+    scan_t sc;
 
-    return OK;
+    clear_cmd_buff(cmd_buff);
+    if (scan_cmd_line(cmd_line, len, &sc, cmd_buff->arena) != OK) return ERR_MEMORY;
+    return parse_scanned(cmd_line, 0, len, &sc, cmd_buff);
 }
 
 // Match built-in commands
@@ -167,19 +233,18 @@ int exec_cmd(cmd_buff_t *cmd) {
 // Main command loop
 int exec_local_cmd_loop() {
     cmd_buff_t cmd;
-    char input_buffer[SH_CMD_MAX];
+    arena_t arena = {0};
+    char *input_buffer = NULL;  // grows to the longest line read
+    size_t input_size = 0;
     int rc;
 
     // Initialize cmd_buff structure
-    if (alloc_cmd_buff(&cmd) != OK) {
-        printf("Failed to allocate command buffer\n");
-        return ERR_MEMORY;
-    }
+    alloc_cmd_buff(&cmd, &arena);
 
     while (1) {
         printf("%s", SH_PROMPT);
         
-        if (fgets(input_buffer, ARG_MAX, stdin) == NULL) {
+        if (getline(&input_buffer, &input_size, stdin) == -1) {
             printf("\n");
             break;
         }
@@ -187,7 +252,8 @@ int exec_local_cmd_loop() {
         // Remove trailing newline
         input_buffer[strcspn(input_buffer, "\n")] = '\0';
 
-        // Build command buffer
+        // Build command buffer, the last line's args go all at once
+        arena_reset(&arena);
         rc = build_cmd_buff(input_buffer, &cmd);
         
         if (rc == WARN_NO_CMDS) {
@@ -195,8 +261,8 @@ int exec_local_cmd_loop() {
             continue;
         }
         
-        if (rc == ERR_TOO_MANY_COMMANDS) {
-            printf(CMD_ERR_PIPE_LIMIT, CMD_MAX);
+        if (rc == ERR_MEMORY) {
+            printf("Failed to allocate command buffer\n");
             continue;
         }
 
@@ -205,6 +271,8 @@ int exec_local_cmd_loop() {
         
         if (cmd_type == BI_CMD_EXIT) {
             free_cmd_buff(&cmd);
+            arena_free(&arena);
+            free(input_buffer);
             return OK_EXIT;
         }
         
@@ -220,5 +288,7 @@ int exec_local_cmd_loop() {
     }
 
     free_cmd_buff(&cmd);
+    arena_free(&arena);
+    free(input_buffer);
     return OK;
 }
@@ -2,19 +2,44 @@
     #define __DSHLIB_H__
 
 
+#include <stddef.h>
+
 //Constants for command structure sizes
 #define EXE_MAX 64
 #define ARG_MAX 256
-#define CMD_MAX 8
-#define CMD_ARGV_MAX (CMD_MAX + 1)
 // Longest command that can be read from the shell
 #define SH_CMD_MAX EXE_MAX + ARG_MAX
 
+//Per command line arena.  The copy of the line and the argv parsed from it
+//come out of blocks of ARENA_BLOCK bytes, so a command costs no malloc()
+//once the first lines have grown the arena, and arena_reset() drops the
+//whole line at once.  Reset keeps the blocks for the next line.
+#define ARENA_BLOCK     4096
+#define ARENA_ALIGN     sizeof(void *)
+
+typedef struct arena_block arena_block_t;
+
+typedef struct arena{
+    arena_block_t *first;
+    arena_block_t *cur;     //the block being filled, the ones after are free
+    void          *last;    //the latest allocation, arena_grow() extends it
+} arena_t;
+
+//NULL when out of memory
+void *arena_alloc(arena_t *arena, size_t size);
+void *arena_grow(arena_t *arena, void *ptr, size_t old_size, size_t size);
+void arena_reset(arena_t *arena);
+void arena_free(arena_t *arena);
+
+//argv starts with room for this many and doubles as it fills
+#define CMD_ARGV_INIT 8
+
 typedef struct cmd_buff
 {
     int  argc;
-    char *argv[CMD_ARGV_MAX];
-    char *_cmd_buffer;
+    char **argv;            //NULL terminated, in the arena
+    char *_cmd_buffer;      //the args, '\0' terminated, in the arena
+    arena_t *arena;
 } cmd_buff_t;
 
 /* WIP - Move to next assignment 
@@ -47,7 +72,7 @@ typedef struct command{
 #define OK_EXIT                 -7
 
 //prototypes
-int alloc_cmd_buff(cmd_buff_t *cmd_buff);
+int alloc_cmd_buff(cmd_buff_t *cmd_buff, arena_t *arena);
 int free_cmd_buff(cmd_buff_t *cmd_buff);
 int clear_cmd_buff(cmd_buff_t *cmd_buff);
 int build_cmd_buff(char *cmd_line, cmd_buff_t *cmd_buff);
@@ -74,6 +99,5 @@ int exec_cmd(cmd_buff_t *cmd);
 //output constants
 #define CMD_OK_HEADER       "PARSED COMMAND LINE - TOTAL COMMANDS %d\n"
 #define CMD_WARN_NO_CMD     "warning: no commands provided\n"
-#define CMD_ERR_PIPE_LIMIT  "error: piping limited to %d commands\n"
 
 #endif
\ No newline at end of file
@@ -0,0 +1,211 @@
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #define SCAN_X86 1
+    #include <immintrin.h>
+#else
+    #define SCAN_X86 0
+#endif
+
+#include "dshlib.h"
+#include "scan.h"
+
+// -1 until the first line works out what the CPU supports
+static int level = -1;
+
+static const char *level_names[] = { "scalar", "sse2", "avx2" };
+
+// The raw masks of one level: every quote, space and pipe of the line,
+// quoted or not
+typedef void (*scan_raw_fn)(const char *line, size_t len, scan_t *sc);
+
+// isspace() in the C locale: ' ' and '\t' to '\r'
+static void raw_scalar(const char *line, size_t len, scan_t *sc) {
+    for (size_t w = 0; w < SCAN_WORDS(len); w++) {
+        const unsigned char *p = (const unsigned char *)line + w * 64;
+        size_t n = len - w * 64 < 64 ? len - w * 64 : 64;
+        uint64_t q = 0, s = 0, pp = 0;
+
+        for (size_t i = 0; i < n; i++) {
+            q |= (uint64_t)(p[i] == '"') << i;
+            s |= (uint64_t)(p[i] == SPACE_CHAR || (unsigned)(p[i] - '\t') <= '\r' - '\t') << i;
+            pp |= (uint64_t)(p[i] == PIPE_CHAR) << i;
+        }
+        sc->quote[w] = q;
+        sc->sep[w] = s;
+        sc->pipe[w] = pp;
+    }
+}
+
+#if SCAN_X86
+
+__attribute__((target("sse2")))
+static void block_sse2(const char *p, scan_t *sc, size_t w) {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i space = _mm_set1_epi8(SPACE_CHAR);
+    const __m128i pipe = _mm_set1_epi8(PIPE_CHAR);
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i ctl = _mm_set1_epi8('\r' - '\t');
+    uint64_t q = 0, s = 0, pp = 0;
+
+    for (int i = 0; i < 4; i++) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + 16 * i));
+        __m128i t = _mm_sub_epi8(v, tab);
+        __m128i ws = _mm_or_si128(_mm_cmpeq_epi8(v, space),
+                                  _mm_cmpeq_epi8(_mm_min_epu8(t, ctl), t));
+
+        q |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, quote)) << (16 * i);
+        s |= (uint64_t)(uint16_t)_mm_movemask_epi8(ws) << (16 * i);
+        pp |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, pipe)) << (16 * i);
+    }
+    sc->quote[w] = q;
+    sc->sep[w] = s;
+    sc->pipe[w] = pp;
+}
+
+__attribute__((target("avx2")))
+static void block_avx2(const char *p, scan_t *sc, size_t w) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i space = _mm256_set1_epi8(SPACE_CHAR);
+    const __m256i pipe = _mm256_set1_epi8(PIPE_CHAR);
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i ctl = _mm256_set1_epi8('\r' - '\t');
+    uint64_t q = 0, s = 0, pp = 0;
+
+    for (int i = 0; i < 2; i++) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + 32 * i));
+        __m256i t = _mm256_sub_epi8(v, tab);
+        __m256i ws = _mm256_or_si256(_mm256_cmpeq_epi8(v, space),
+                                     _mm256_cmpeq_epi8(_mm256_min_epu8(t, ctl), t));
+
+        q |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, quote)) << (32 * i);
+        s |= (uint64_t)(uint32_t)_mm256_movemask_epi8(ws) << (32 * i);
+        pp |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, pipe)) << (32 * i);
+    }
+    sc->quote[w] = q;
+    sc->sep[w] = s;
+    sc->pipe[w] = pp;
+}
+
+// The last part word is copied out and padded with '\0', which is in none
+// of the masks, so the loads never read past the line
+__attribute__((target("sse2")))
+static void raw_sse2(const char *line, size_t len, scan_t *sc) {
+    char tail[64] = {0};
+    size_t w = 0;
+
+    for (; (w + 1) * 64 <= len; w++)
+        block_sse2(line + w * 64, sc, w);
+    if (w * 64 < len) {
+        memcpy(tail, line + w * 64, len - w * 64);
+        block_sse2(tail, sc, w);
+    }
+}
+
+__attribute__((target("avx2")))
+static void raw_avx2(const char *line, size_t len, scan_t *sc) {
+    char tail[64] = {0};
+    size_t w = 0;
+
+    for (; (w + 1) * 64 <= len; w++)
+        block_avx2(line + w * 64, sc, w);
+    if (w * 64 < len) {
+        memcpy(tail, line + w * 64, len - w * 64);
+        block_avx2(tail, sc, w);
+    }
+    _mm256_zeroupper();
+}
+
+static int cpu_level(void) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return SCAN_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return SCAN_SSE2;
+    return SCAN_SCALAR;
+}
+
+#else
+
+// other CPUs only have the scalar masks
+#define raw_sse2 raw_scalar
+#define raw_avx2 raw_scalar
+
+static int cpu_level(void) {
+    return SCAN_SCALAR;
+}
+
+#endif
+
+static const scan_raw_fn raws[] = { raw_scalar, raw_sse2, raw_avx2 };
+
+// Bit i is the XOR of bits 0 to i: set from an opening quote up to, not
+// including, its closing one
+static inline uint64_t prefix_xor(uint64_t x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+void scan_line(const char *line, size_t len, scan_t *sc) {
+    uint64_t carry = 0;     // all ones when the last word ended in quotes
+
+    raws[scan_level()](line, len, sc);
+    for (size_t w = 0; w < SCAN_WORDS(len); w++) {
+        uint64_t in_quotes = prefix_xor(sc->quote[w]) ^ carry;
+
+        sc->sep[w] &= ~in_quotes;
+        sc->pipe[w] &= ~in_quotes;
+        carry = (uint64_t)((int64_t)in_quotes >> 63);
+    }
+}
+
+size_t scan_next(const uint64_t *mask, size_t pos, size_t end, bool set) {
+    uint64_t flip = set ? 0 : ~(uint64_t)0;
+
+    while (pos < end) {
+        uint64_t w = (mask[pos / 64] ^ flip) >> (pos % 64);
+
+        if (w) {
+            pos += __builtin_ctzll(w);
+            return pos < end ? pos : end;
+        }
+        pos = (pos / 64 + 1) * 64;
+    }
+    return end;
+}
+
+int scan_level(void) {
+    int l = __atomic_load_n(&level, __ATOMIC_RELAXED);
+
+    if (l < 0) {
+        const char *env = getenv(SCAN_ENV);
+
+        l = cpu_level();
+        for (int i = SCAN_SCALAR; env && i < l; i++) {
+            if (strcasecmp(env, level_names[i]) == 0)
+                l = i;
+        }
+        __atomic_store_n(&level, l, __ATOMIC_RELAXED);
+    }
+    return l;
+}
+
+int scan_set_level(int want) {
+    int l = cpu_level();
+
+    if (want >= SCAN_SCALAR && want < l)
+        l = want;
+    __atomic_store_n(&level, l, __ATOMIC_RELAXED);
+    return l;
+}
+
+const char *scan_level_name(int l) {
+    return l >= SCAN_SCALAR && l <= SCAN_AVX2 ? level_names[l] : "unknown";
+}
@@ -0,0 +1,371 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "dshlib.h"
+#include "scan.h"
+#include "cache.h"
+
+// Parser throughput, built and run by make bench.  A corpus of command
+// lines goes through build_cmd_list() and build_cmd_buff() in a tight
+// loop, at every scan level the CPU has and with the parse cache off and
+// on, and through the byte at a time parser the scan replaced, kept below
+// as the reference.  Each run reports lines/s, MB/s and malloc() calls per
+// line; the arena and the cache should make that 0 once they are warm.
+//
+// Before a run is timed its parse of every line is checked against the
+// reference.  With the cache on every line is parsed once before the
+// check, so the check sees the parses the cache serves.  A mismatch is
+// reported and makes the exit code 1.
+//
+// The corpus is built in, or one line per line of the -f file, e.g. a
+// shell history.
+//
+// usage: bench [-f corpus]
+#define BENCH_MIN_TIME  0.2     // seconds per result
+#define BENCH_XARGS     300     // args of the generated xargs style line
+#define BENCH_REF       -1      // the level of the reference runs
+
+static const char *corpus[] = {
+    "ls -la",
+    "ls -l /usr/bin | grep python | wc -l",
+    "echo \"hello,      world\" | tr a-z A-Z",
+    "cat /etc/passwd | cut -d: -f1 | sort | uniq -c | sort -rn | head -5",
+    "grep -rn \"TODO\" src/ include/ | grep -v test > todo.txt",
+    "find . -name \"*.c\" -newer makefile | xargs wc -l",
+    "gcc -Wall -Wextra -O2 -g -o dsh dsh_cli.c dshlib.c scan.c cache.c",
+    "git log --oneline --graph --decorate --all | head -40",
+    "ps aux | grep \"[d]sh\" | awk \"{print $2}\"",
+    "sort < input.txt >> sorted.txt",
+    "echo \"a|b|c\" | tr \"|\" \"\\n\"",
+    "cd ..",
+    "curl -s -H \"Accept: application/json\" https://example.com/api/v1/items | jq .",
+    "tar -czf backup.tar.gz --exclude=\".git\" --exclude=\"*.o\" project/",
+    "   echo   \"  leading and trailing  \"   ",
+    "dragon",
+    "cat < in.txt | tr a-z A-Z | rev | sort | uniq | wc -c > out.txt",
+    "echo t | cat | cat | cat | cat | cat | cat | cat | cat | cat | cat | cat",
+    "du -sh \"My Documents\" \"Program Files\" /var/log/*",
+    "awk -F, \"{ sum += $3 } END { print sum }\" data.csv",
+    "  |  | ",
+    "",
+    "echo a\"b c\"d \"\" e",
+    "make -j8 CFLAGS=\"-O3 -march=native\" all 2> build.log",
+};
+#define N_CORPUS    (int)(sizeof(corpus) / sizeof(corpus[0]))
+
+// malloc() and friends called from the parser, counted through the
+// linker's --wrap
+static unsigned long allocs;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+    allocs++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+    allocs++;
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    allocs++;
+    return __real_realloc(ptr, size);
+}
+
+typedef struct run{
+    bool list;              // build_cmd_list(), else build_cmd_buff()
+    int  level;             // a scan level or BENCH_REF
+    bool cache;
+} run_t;
+
+static double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// FNV-1a over the return code and every arg, what the check compares
+static uint64_t fold(uint64_t h, const void *data, size_t len) {
+    const unsigned char *p = data;
+
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ p[i]) * 0x100000001B3ULL;
+    }
+    return h;
+}
+
+static uint64_t fold_cmd(uint64_t h, const cmd_buff_t *cmd) {
+    h = fold(h, &cmd->argc, sizeof(cmd->argc));
+    for (int i = 0; i < cmd->argc; i++) {
+        h = fold(h, cmd->argv[i], strlen(cmd->argv[i]) + 1);
+    }
+    return h;
+}
+
+// The parser before the scan and the arena: each arg copied a byte at a
+// time without its quotes into a malloc()ed buffer, argv realloc()ed as it
+// fills.  Pipes are only split on outside quotes.
+static int ref_parse_cmd(const char *line, size_t len, cmd_buff_t *cmd) {
+    char *out = malloc(len + 1);
+    int cap = CMD_ARGV_INIT;
+    char **argv = malloc(cap * sizeof(char *));
+    char *token_start = NULL;
+    bool in_quotes = false;
+    size_t o = 0;
+
+    cmd->argc = 0;
+    cmd->argv = argv;
+    cmd->_cmd_buffer = out;
+    if (!out || !argv) return ERR_MEMORY;
+
+    for (size_t i = 0; i <= len; i++) {
+        char c = i < len ? line[i] : '\0';
+
+        if (c == '"') {
+            in_quotes = !in_quotes;
+            if (!token_start) token_start = out + o;
+            continue;
+        }
+        if (c != '\0' && (in_quotes || !isspace((unsigned char)c))) {
+            if (!token_start) token_start = out + o;
+            out[o++] = c;
+            continue;
+        }
+        if (!token_start) continue;
+
+        out[o++] = '\0';
+        if (cmd->argc + 1 == cap) {
+            char **more = realloc(argv, 2 * cap * sizeof(char *));
+
+            if (!more) return ERR_MEMORY;
+            argv = cmd->argv = more;
+            cap *= 2;
+        }
+        argv[cmd->argc++] = token_start;
+        token_start = NULL;
+    }
+
+    argv[cmd->argc] = NULL;
+    return cmd->argc > 0 ? OK : WARN_NO_CMDS;
+}
+
+static void ref_free_cmd(cmd_buff_t *cmd) {
+    free(cmd->argv);
+    free(cmd->_cmd_buffer);
+}
+
+static uint64_t ref_parse(bool list, const char *line, bool want_hash) {
+    uint64_t h = 0xCBF29CE484222325ULL;
+    cmd_buff_t *commands = NULL;
+    const char *p = line;
+    int num = 0;
+    int rc = OK;
+
+    if (!list) {
+        cmd_buff_t one;
+
+        rc = ref_parse_cmd(line, strlen(line), &one);
+        h = fold(h, &rc, sizeof(rc));
+        if (want_hash && rc == OK) h = fold_cmd(h, &one);
+        ref_free_cmd(&one);
+        return h;
+    }
+
+    while (*p && rc == OK) {
+        const char *seg = p;
+        bool in_quotes = false;
+        cmd_buff_t *more;
+
+        for (; *p && (*p != PIPE_CHAR || in_quotes); p++) {
+            if (*p == '"') in_quotes = !in_quotes;
+        }
+        more = realloc(commands, (num + 1) * sizeof(cmd_buff_t));
+        if (!more) {
+            rc = ERR_MEMORY;
+            break;
+        }
+        commands = more;
+        rc = ref_parse_cmd(seg, p - seg, &commands[num]);
+        if (rc == OK) {
+            num++;
+        } else {
+            ref_free_cmd(&commands[num]);
+            if (rc == WARN_NO_CMDS) rc = OK;
+        }
+        if (*p) p++;
+    }
+    if (rc == OK && num == 0) rc = WARN_NO_CMDS;
+
+    h = fold(h, &rc, sizeof(rc));
+    for (int i = 0; i < num; i++) {
+        if (want_hash && rc == OK) h = fold_cmd(h, &commands[i]);
+        ref_free_cmd(&commands[i]);
+    }
+    free(commands);
+    return h;
+}
+
+static command_list_t clist;
+static cmd_buff_t cmd;
+static arena_t arena;
+
+// One line through one function, its hash when want_hash
+static uint64_t parse(const run_t *run, char *line, bool want_hash) {
+    uint64_t h = 0xCBF29CE484222325ULL;
+    int rc;
+
+    if (run->level == BENCH_REF) {
+        return ref_parse(run->list, line, want_hash);
+    } else if (run->list) {
+        rc = build_cmd_list(line, &clist);
+        h = fold(h, &rc, sizeof(rc));
+        for (int i = 0; want_hash && rc == OK && i < clist.num; i++) {
+            h = fold_cmd(h, &clist.commands[i]);
+        }
+        free_cmd_list(&clist);
+    } else {
+        arena_reset(&arena);
+        rc = build_cmd_buff(line, &cmd);
+        h = fold(h, &rc, sizeof(rc));
+        if (want_hash && rc == OK) h = fold_cmd(h, &cmd);
+    }
+    return h;
+}
+
+// The lines of path, or NULL
+static char **read_corpus(const char *path, int *n) {
+    FILE *f = fopen(path, "r");
+    char **lines = NULL;
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t len;
+    int cap = 0;
+
+    *n = 0;
+    if (!f) return NULL;
+    while ((len = getline(&line, &size, f)) != -1) {
+        if (len > 0 && line[len - 1] == '\n') line[len - 1] = '\0';
+        if (*n == cap) {
+            cap = cap ? 2 * cap : 64;
+            lines = realloc(lines, cap * sizeof(char *));
+        }
+        lines[(*n)++] = strdup(line);
+    }
+    free(line);
+    fclose(f);
+    return lines;
+}
+
+int main(int argc, char *argv[]) {
+    static const char *funcs[] = { "build_cmd_list", "build_cmd_buff" };
+    int top = scan_set_level(SCAN_AVX2);
+    const char *path = NULL;
+    char **lines;
+    uint64_t *ref;
+    size_t bytes = 0;
+    int n_lines;
+    int bad = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:")) != -1) {
+        if (opt != 'f') {
+            fprintf(stderr, "usage: %s [-f corpus]\n", argv[0]);
+            return 1;
+        }
+        path = optarg;
+    }
+
+    if (path) {
+        lines = read_corpus(path, &n_lines);
+        if (!lines || n_lines == 0) {
+            fprintf(stderr, "no lines in %s\n", path);
+            return 1;
+        }
+    } else {
+        // The corpus and one long xargs style line
+        size_t size = BENCH_XARGS * 32;
+        size_t len;
+
+        n_lines = N_CORPUS + 1;
+        lines = malloc(n_lines * sizeof(char *));
+        for (int i = 0; i < N_CORPUS; i++) {
+            lines[i] = strdup(corpus[i]);
+        }
+        lines[N_CORPUS] = malloc(size);
+        len = sprintf(lines[N_CORPUS], "rm -f");
+        for (int i = 0; i < BENCH_XARGS; i++) {
+            len += sprintf(lines[N_CORPUS] + len, i % 10 ? " build/obj/file_%d.o" :
+                           " \"build/obj/file %d.o\"", i);
+        }
+    }
+    for (int i = 0; i < n_lines; i++) {
+        bytes += strlen(lines[i]);
+    }
+    ref = malloc(n_lines * sizeof(uint64_t));
+    alloc_cmd_buff(&cmd, &arena);
+
+    printf("%-15s %-8s %-6s %12s %8s %12s  %s\n", "function", "level", "cache", "lines/s",
+           "MB/s", "allocs/line", "check");
+    for (int f = 0; f < 2; f++) {
+        // the cache is only in build_cmd_list(), the reference runs once
+        for (int c = 0; c <= (f == 0); c++) {
+            for (int l = c ? SCAN_SCALAR : BENCH_REF; l <= top; l++) {
+                run_t run = { f == 0, l, c };
+                bool first = l == BENCH_REF;
+                bool ok = true;
+                unsigned long n = 0;
+                double start, t;
+
+                if (!first) scan_set_level(l);
+                cache_enable(c);
+                // a warm cache, so the check compares its hits
+                for (int i = 0; c && i < n_lines; i++) {
+                    parse(&run, lines[i], false);
+                }
+                for (int i = 0; i < n_lines; i++) {
+                    uint64_t h = parse(&run, lines[i], true);
+
+                    if (first) ref[i] = h;
+                    else if (h != ref[i]) ok = false;
+                }
+
+                allocs = 0;
+                start = now();
+                do {
+                    for (int i = 0; i < n_lines; i++) {
+                        parse(&run, lines[i], false);
+                    }
+                    n += n_lines;
+                } while ((t = now() - start) < BENCH_MIN_TIME);
+
+                if (!ok) bad++;
+                printf("%-15s %-8s %-6s %12.0f %8.1f %12.3f  %s\n", funcs[f],
+                       first ? "bytewise" : scan_level_name(l), first ? "-" : c ? "on" : "off", n / t,
+                       (double)n / n_lines * bytes / t / 1e6, (double)allocs / n,
+                       first ? "ref" : ok ? "ok" : "MISMATCH");
+                cache_free();
+            }
+        }
+    }
+
+    close_cmd_list(&clist);
+    arena_free(&arena);
+    for (int i = 0; i < n_lines; i++) {
+        free(lines[i]);
+    }
+    free(lines);
+    free(ref);
+    if (bad > 0) printf("%d results did not match the reference\n", bad);
+    return bad > 0;
+}
@@ -0,0 +1,184 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dshlib.h"
+#include "cache.h"
+
+typedef struct cache_entry{
+    uint64_t      hash;
+    unsigned long used;         // lookup count when last found, 0 when empty
+    size_t        line_len;
+    size_t        text_len;
+    int           num;
+    int           n_args;
+    char         *blob;         // argc[num], then off[n_args], the line, the text
+} cache_entry_t;
+
+static cache_entry_t slots[CACHE_SLOTS];
+static unsigned long tick;
+static cache_stats_t stats;
+static bool enabled = true;
+
+// 8 bytes at a time through a multiply and a shift, then a final mix
+static uint64_t hash_line(const char *line, size_t len) {
+    uint64_t h = len * 0x9E3779B97F4A7C15ULL;
+    uint64_t w;
+
+    for (; len >= 8; line += 8, len -= 8) {
+        memcpy(&w, line, 8);
+        h = (h ^ w) * 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 32;
+    }
+    if (len > 0) {
+        w = 0;
+        memcpy(&w, line, len);
+        h = (h ^ w) * 0xC4CEB9FE1A85EC53ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static int *entry_argc(const cache_entry_t *e) {
+    return (int *)e->blob;
+}
+
+static uint32_t *entry_off(const cache_entry_t *e) {
+    return (uint32_t *)(entry_argc(e) + e->num);
+}
+
+static char *entry_line(const cache_entry_t *e) {
+    return (char *)(entry_off(e) + e->n_args);
+}
+
+static char *entry_text(const cache_entry_t *e) {
+    return entry_line(e) + e->line_len;
+}
+
+// The commands of e in the list's arena: one copy of the text and argv
+// pointed back into it
+static int rebuild(const cache_entry_t *e, command_list_t *clist) {
+    const int *argc = entry_argc(e);
+    const uint32_t *off = entry_off(e);
+    cmd_buff_t *commands = arena_alloc(&clist->arena, e->num * sizeof(cmd_buff_t));
+    char **argv = arena_alloc(&clist->arena, (e->n_args + e->num) * sizeof(char *));
+    char *text = arena_alloc(&clist->arena, e->text_len);
+    int a = 0;
+
+    if (!commands || !argv || !text) return ERR_MEMORY;
+    memcpy(text, entry_text(e), e->text_len);
+
+    for (int i = 0; i < e->num; i++) {
+        cmd_buff_t *cmd = &commands[i];
+
+        alloc_cmd_buff(cmd, &clist->arena);
+        cmd->argc = argc[i];
+        cmd->argv = argv;
+        cmd->_cmd_buffer = text + off[a];
+        for (int j = 0; j < argc[i]; j++) {
+            argv[j] = text + off[a++];
+        }
+        argv[argc[i]] = NULL;
+        argv += argc[i] + 1;
+    }
+
+    clist->num = e->num;
+    clist->commands = commands;
+    return OK;
+}
+
+int cache_lookup(const char *line, size_t len, command_list_t *clist) {
+    bool cacheable = enabled && len <= CACHE_LINE_MAX;
+    uint64_t hash = cacheable ? hash_line(line, len) : 0;
+
+    tick++;
+    for (int i = 0; i < CACHE_SLOTS && cacheable; i++) {
+        cache_entry_t *e = &slots[i];
+
+        if (e->used && e->hash == hash && e->line_len == len &&
+            memcmp(entry_line(e), line, len) == 0) {
+            e->used = tick;
+            stats.hits++;
+            return rebuild(e, clist);
+        }
+    }
+    stats.misses++;
+    return WARN_NO_CMDS;
+}
+
+// The args of a command are one after the other in its _cmd_buffer, each
+// with its '\0', so its text runs from argv[0] to the end of the last one
+void cache_store(const char *line, size_t len, const command_list_t *clist) {
+    cache_entry_t *e = &slots[0];
+    size_t text_len = 0;
+    int n_args = 0;
+
+    if (!enabled || len > CACHE_LINE_MAX) return;
+
+    for (int i = 0; i < clist->num; i++) {
+        const cmd_buff_t *cmd = &clist->commands[i];
+        const char *last = cmd->argv[cmd->argc - 1];
+
+        n_args += cmd->argc;
+        text_len += last + strlen(last) + 1 - cmd->argv[0];
+    }
+
+    char *blob = malloc(clist->num * sizeof(int) + n_args * sizeof(uint32_t) + len + text_len);
+    if (!blob) return;
+
+    // An empty slot, or the one least recently found
+    for (int i = 0; i < CACHE_SLOTS && e->used; i++) {
+        if (!slots[i].used || slots[i].used < e->used) e = &slots[i];
+    }
+    if (e->used) {
+        free(e->blob);
+    } else {
+        stats.lines++;
+    }
+
+    e->hash = hash_line(line, len);
+    e->used = tick;
+    e->line_len = len;
+    e->text_len = text_len;
+    e->num = clist->num;
+    e->n_args = n_args;
+    e->blob = blob;
+    memcpy(entry_line(e), line, len);
+
+    int *argc = entry_argc(e);
+    uint32_t *off = entry_off(e);
+    char *text = entry_text(e);
+    size_t base = 0;
+    int a = 0;
+
+    for (int i = 0; i < clist->num; i++) {
+        const cmd_buff_t *cmd = &clist->commands[i];
+        const char *last = cmd->argv[cmd->argc - 1];
+        size_t cmd_len = last + strlen(last) + 1 - cmd->argv[0];
+
+        argc[i] = cmd->argc;
+        for (int j = 0; j < cmd->argc; j++) {
+            off[a++] = base + (cmd->argv[j] - cmd->argv[0]);
+        }
+        memcpy(text + base, cmd->argv[0], cmd_len);
+        base += cmd_len;
+    }
+}
+
+void cache_get_stats(cache_stats_t *out) {
+    *out = stats;
+}
+
+void cache_enable(bool on) {
+    enabled = on;
+}
+
+void cache_free(void) {
+    for (int i = 0; i < CACHE_SLOTS; i++) {
+        free(slots[i].blob);
+    }
+    memset(slots, 0, sizeof(slots));
+    stats.lines = 0;
+}
@@ -7,677 +7,240 @@
 #include <fcntl.h>
 #include <sys/wait.h>
 #include "dshlib.h"
-
-// Helper function to check if character is within quotes
-static bool is_within_quotes(const char *str, int pos) {
-    bool within_quotes = false;
-    for (int i = 0; i < pos; i++) {
-        if (str[i] == '"') within_quotes = !within_quotes;
-    }
-    return within_quotes;
-}
-
-// Helper function to trim whitespace
-static char* trim(char* str) {
-    while (isspace((unsigned char)*str)) str++;
-    if (*str == 0) return str;
-    char* end = str + strlen(str) - 1;
-    while (end > str && isspace((unsigned char)*end)) end--;
-    *(end + 1) = 0;
-    return str;
-}
-
-// Initialize cmd_buff structure
-int alloc_cmd_buff(cmd_buff_t *cmd_buff) {
-    cmd_buff->_cmd_buffer = (char *)malloc(SH_CMD_MAX);
-    if (!cmd_buff->_cmd_buffer) return ERR_MEMORY;
-    cmd_buff->argc = 0;
-    memset(cmd_buff->argv, 0, sizeof(char *) * CMD_ARGV_MAX);
-    return OK;
-}
-
-// Free cmd_buff structure
-int free_cmd_buff(cmd_buff_t *cmd_buff) {
-    if (cmd_buff->_cmd_buffer) {
-        free(cmd_buff->_cmd_buffer);
-        cmd_buff->_cmd_buffer = NULL;
-    }
-    return OK;
-}
-
-// Clear cmd_buff for reuse
-int clear_cmd_buff(cmd_buff_t *cmd_buff) {
-    cmd_buff->argc = 0;
-    memset(cmd_buff->argv, 0, sizeof(char *) * CMD_ARGV_MAX);
-    return OK;
-}
-
-// Parse command line into cmd_buff structure
-int build_cmd_buff(char *cmd_line, cmd_buff_t *cmd_buff) {
-    clear_cmd_buff(cmd_buff);
-    strncpy(cmd_buff->_cmd_buffer, cmd_line, SH_CMD_MAX - 1);
-    cmd_buff->_cmd_buffer[SH_CMD_MAX - 1] = '\0';
-
-    char *curr = cmd_buff->_cmd_buffer;
-    bool in_quotes = false;
-    bool in_token = false;
-    char *token_start = NULL;
-
-    // Skip leading spaces
-    while (*curr && isspace(*curr)) curr++;
-    if (!*curr) return WARN_NO_CMDS;
-
-    token_start = curr;
-    cmd_buff->argc = 0;
-
-    while (*curr) {
-        if (*curr == '"') {
-            if (!in_token) {
-                token_start = curr + 1;
-                in_token = true;
-            } else if (in_quotes) {
-                *curr = '\0';
-                in_token = false;
-            }
-            in_quotes = !in_quotes;
-        } else if (isspace(*curr) && !in_quotes) {
-            if (in_token) {
-                *curr = '\0';
-                cmd_buff->argv[cmd_buff->argc++] = token_start;
-                in_token = false;
-            }
-        } else if (!in_token) {
-            token_start = curr;
-            in_token = true;
-        }
-
-        if (cmd_buff->argc >= CMD_ARGV_MAX - 1) {
-            return ERR_TOO_MANY_COMMANDS;
+#include "scan.h"
+#include "cache.h"
+
+struct arena_block{
+    arena_block_t *next;
+    size_t         used;
+    size_t         size;
+    char           data[];
+};
+
+void *arena_alloc(arena_t *arena, size_t size) {
+    arena_block_t *b = arena->cur;
+
+    size = (size + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+    if (size == 0) size = ARENA_ALIGN;
+
+    // Move on to the next block, or add one, until something fits.  A
+    // block that was used before the last reset is empty again.
+    while (b == NULL || b->size - b->used < size) {
+        if (b != NULL && b->next != NULL) {
+            b = b->next;
+            b->used = 0;
+            continue;
         }
-        curr++;
-    }
-
-    // Handle the last token if it exists
-    if (in_token) {
-        cmd_buff->argv[cmd_buff->argc++] = token_start;
-    }
 
-    // Null terminate the argv array
-    cmd_buff->argv[cmd_buff->argc] = NULL;
-
-    return OK;
-}
-
-// Split command line by pipes and build command list
-int build_cmd_list(char *cmd_line, command_list_t *clist) {
-    char *save_ptr;
-    char *token;
-    int count = 0;
-    char *cmd_line_copy = strdup(cmd_line);
-    
-    if (!cmd_line_copy) return ERR_MEMORY;
-    
-    // Tokenize the command by pipe symbols
-    token = strtok_r(cmd_line_copy, PIPE_STRING, &save_ptr);
-    while (token != NULL && count < CMD_MAX) {
-        // Allocate memory for the command buffer
-        if (alloc_cmd_buff(&(clist->commands[count])) != OK) {
-            free(cmd_line_copy);
-            return ERR_MEMORY;
-        }
-        
-        // Build command buffer for this segment
-        int rc = build_cmd_buff(token, &(clist->commands[count]));
-        if (rc != OK && rc != WARN_NO_CMDS) {
-            free(cmd_line_copy);
-            return rc;
-        }
-        
-        // Only count non-empty commands
-        if (rc != WARN_NO_CMDS) {
-            count++;
-        }
-        
-        token = strtok_r(NULL, PIPE_STRING, &save_ptr);
-    }
-    
-    free(cmd_line_copy);
-    
-    if (token != NULL) {
-        // More tokens remain but we've hit CMD_MAX
-        return ERR_TOO_MANY_COMMANDS;
-    }
-    
-    if (count == 0) {
-        return WARN_NO_CMDS;
-    }
-    
-    clist->num = count;
-    return OK;
-}
+        size_t block_size = size > ARENA_BLOCK ? size : ARENA_BLOCK;
+        arena_block_t *nb = malloc(sizeof(arena_block_t) + block_size);
 
-// Free command list resources
-int free_cmd_list(command_list_t *cmd_lst) {
-    for (int i = 0; i < cmd_lst->num; i++) {
-        free_cmd_buff(&(cmd_lst->commands[i]));
+        if (!nb) return NULL;
+        nb->next = NULL;
+        nb->used = 0;
+        nb->size = block_size;
+        if (b == NULL) arena->first = nb;
+        else b->next = nb;
+        b = nb;
     }
-    return OK;
-}
 
-// Match built-in commands
-Built_In_Cmds match_command(const char *input) {
-    if (!input) return BI_NOT_BI;
-    if (strcmp(input, EXIT_CMD) == 0) return BI_CMD_EXIT;
-    if (strcmp(input, "cd") == 0) return BI_CMD_CD;
-    if (strcmp(input, "dragon") == 0) return BI_CMD_DRAGON;
-    return BI_NOT_BI;
+    arena->cur = b;
+    arena->last = b->data + b->used;
+    b->used += size;
+    return arena->last;
 }
 
-// Execute built-in commands
-Built_In_Cmds exec_built_in_cmd(cmd_buff_t *cmd) {
-    Built_In_Cmds type = match_command(cmd->argv[0]);
-    
-    switch (type) {
-        case BI_CMD_EXIT:
-            return BI_CMD_EXIT;
-            
-        case BI_CMD_CD:
-            if (cmd->argc > 1) {
-                if (chdir(cmd->argv[1]) != 0) {
-                    perror("cd");
-                    return BI_RC;
-                }
-            }
-            return BI_EXECUTED;
-            
-        case BI_CMD_DRAGON:
-            printf("[DRAGON for extra credit would print here]\n");
-            return BI_EXECUTED;
-            
-        default:
-            return BI_NOT_BI;
-    }
-}
-
-// Execute a single command (used for non-piped commands)
-int exec_cmd(cmd_buff_t *cmd) {
-    pid_t pid = fork();
-    int status;
-
-    if (pid < 0) {
-        perror("fork");
-        return ERR_EXEC_CMD;
-    }
-    
-    if (pid == 0) { // Child process
-        // Handle any redirection in the command
-        handle_redirection(cmd);
-        
-        execvp(cmd->argv[0], cmd->argv);
-        // If execvp returns, there was an error
-        perror(cmd->argv[0]);
-        exit(1);
-    } else { // Parent process
-        waitpid(pid, &status, 0);
-        return WEXITSTATUS(status);
-    }
-}
+// Like realloc(), in place when ptr is the latest allocation and its block
+// has the room
+void *arena_grow(arena_t *arena, void *ptr, size_t old_size, size_t size) {
+    if (ptr != NULL && ptr == arena->last) {
+        arena_block_t *b = arena->cur;
+        size_t start = (char *)ptr - b->data;
+        size_t rounded = (size + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
 
-// Check for redirection symbols in command arguments
-// Returns: index of redirection symbol in argv array, or -1 if none found
-// Sets redirection_type to '<', '>', or '>>' (2 for append mode)
-int check_for_redirection(cmd_buff_t *cmd, int *redirection_type) {
-    for (int i = 0; i < cmd->argc; i++) {
-        if (cmd->argv[i] && strcmp(cmd->argv[i], "<") == 0) {
-            *redirection_type = '<';
-            return i;
-        } else if (cmd->argv[i] && strcmp(cmd->argv[i], ">") == 0) {
-            *redirection_type = '>';
-            return i;
-        } else if (cmd->argv[i] && strcmp(cmd->argv[i], ">>") == 0) {
-            *redirection_type = 2; // Using 2 to represent ">>"
-            return i;
+        if (b->size - start >= rounded) {
+            b->used = start + rounded;
+            return ptr;
         }
     }
-    return -1;
-}
 
-// Handle redirection for a command
-// Returns: 0 on success, -1 on failure
-int handle_redirection(cmd_buff_t *cmd) {
-    int redirection_type = 0;
-    int index = check_for_redirection(cmd, &redirection_type);
-    
-    if (index == -1) {
-        // No redirection found
-        return 0;
-    }
-    
-    // Need a filename after the redirection symbol
-    if (index + 1 >= cmd->argc) {
-        fprintf(stderr, "Error: Missing filename for redirection\n");
-        return -1;
-    }
-    
-    char *filename = cmd->argv[index + 1];
-    
-    // Set up redirection
-    int fd;
-    if (redirection_type == '<') {
-        // Input redirection
-        fd = open(filename, O_RDONLY);
-        if (fd == -1) {
-            perror("open");
-            return -1;
-        }
-        if (dup2(fd, STDIN_FILENO) == -1) {
-            perror("dup2");
-            close(fd);
-            return -1;
-        }
-    } else if (redirection_type == '>') {
-        // Output redirection (truncate)
-        fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-        if (fd == -1) {
-            perror("open");
-            return -1;
-        }
-        if (dup2(fd, STDOUT_FILENO) == -1) {
-            perror("dup2");
-            close(fd);
-            return -1;
-        }
-    } else if (redirection_type == 2) { // ">>"
-        // Output redirection (append)
-        fd = open(filename, O_WRONLY | O_CREAT | O_APPEND, 0644);
-        if (fd == -1) {
-            perror("open");
-            return -1;
-        }
-        if (dup2(fd, STDOUT_FILENO) == -1) {
-            perror("dup2");
-            close(fd);
-            return -1;
-        }
-    }
-    
-    close(fd);
-    
-    // Remove redirection symbol and filename from argv
-    for (int i = index; i < cmd->argc - 2; i++) {
-        cmd->argv[i] = cmd->argv[i + 2];
-    }
-    cmd->argv[cmd->argc - 2] = NULL;
-    cmd->argv[cmd->argc - 1] = NULL;
-    cmd->argc -= 2;
-    
-    return 0;
+    void *p = arena_alloc(arena, size);
+    if (p && ptr) memcpy(p, ptr, old_size);
+    return p;
 }
 
-// Execute a pipeline of commands
-int execute_pipeline(command_list_t *clist) {
-    if (clist->num == 0) {
-        return WARN_NO_CMDS;
-    }
-    
-    // If only one command, execute it directly
-    if (clist->num == 1) {
-        // Check if it's a built-in command first
-        Built_In_Cmds cmd_type = exec_built_in_cmd(&(clist->commands[0]));
-        
-        if (cmd_type == BI_CMD_EXIT) {
-            return OK_EXIT;
-        }
-        
-        if (cmd_type == BI_EXECUTED || cmd_type == BI_RC) {
-            return OK;
-        }
-        
-        // Execute the external command
-        return exec_cmd(&(clist->commands[0]));
-    }
-    
-    // For multiple commands, need to set up pipes
-    int pipes[CMD_MAX - 1][2]; // Array of pipe file descriptors
-    pid_t pids[CMD_MAX];       // Array to store child process IDs
-    
-    // Create pipes
-    for (int i = 0; i < clist->num - 1; i++) {
-        if (pipe(pipes[i]) == -1) {
-            perror("pipe");
-            return ERR_EXEC_CMD;
-        }
-    }
-    
-    // Execute commands
-    for (int i = 0; i < clist->num; i++) {
-        pids[i] = fork();
-        
-        if (pids[i] < 0) {
-            perror("fork");
-            
-            // Close all pipes on error
-            for (int j = 0; j < clist->num - 1; j++) {
-                close(pipes[j][0]);
-                close(pipes[j][1]);
-            }
-            
-            return ERR_EXEC_CMD;
-        }
-        
-        if (pids[i] == 0) { // Child process
-            // Set up pipes for this command
-            if (i == 0) {
-                // First command: only redirects its output to the pipe
-                close(pipes[0][0]); // Close read end of first pipe
-                dup2(pipes[0][1], STDOUT_FILENO);
-                
-                // Close all other pipes
-                for (int j = 1; j < clist->num - 1; j++) {
-                    close(pipes[j][0]);
-                    close(pipes[j][1]);
-                }
-            } 
-            else if (i == clist->num - 1) {
-                // Last command: only reads from previous pipe
-                close(pipes[i-1][1]); // Close write end of previous pipe
-                dup2(pipes[i-1][0], STDIN_FILENO);
-                
-                // Close all other pipes
-                for (int j = 0; j < clist->num - 2; j++) {
-                    close(pipes[j][0]);
-                    close(pipes[j][1]);
-                }
-            } 
-            else {
-                // Middle commands: read from previous pipe, write to current pipe
-                close(pipes[i-1][1]); // Close write end of previous pipe
-                close(pipes[i][0]);   // Close read end of current pipe
-                
-                dup2(pipes[i-1][0], STDIN_FILENO);
-                dup2(pipes[i][1], STDOUT_FILENO);
-                
-                // Close all other pipes
-                for (int j = 0; j < clist->num - 1; j++) {
-                    if (j != i && j != i-1) {
-                        close(pipes[j][0]);
-                        close(pipes[j][1]);
-                    }
-                }
-            }
-            
-            // Close remaining pipe ends after dup2
-            if (i == 0) {
-                close(pipes[0][1]);
-            } 
-            else if (i == clist->num - 1) {
-                close(pipes[i-1][0]);
-            } 
-            else {
-                close(pipes[i-1][0]);
-                close(pipes[i][1]);
-            }
-            
-            // Handle any redirection in the command
-            handle_redirection(&(clist->commands[i]));
-            
-            // Execute the command
-            execvp(clist->commands[i].argv[0], clist->commands[i].argv);
-            
-            // If execvp returns, there was an error
-            perror(clist->commands[i].argv[0]);
-            exit(1);
-        }
-    }
-    
-    // Parent process: close all pipe file descriptors
-    for (int i = 0; i < clist->num - 1; i++) {
-        close(pipes[i][0]);
-        close(pipes[i][1]);
-    }
-    
-    // Wait for all child processes
-    int status;
-    int last_status = 0;
-    
-    for (int i = 0; i < clist->num; i++) {
-        waitpid(pids[i], &status, 0);
-        if (i == clist->num - 1) {
-            // Save exit status of last command
-            last_status = WEXITSTATUS(status);
-        }
-    }
-    
-    return last_status;
+void arena_reset(arena_t *arena) {
+    arena->cur = arena->first;
+    if (arena->cur) arena->cur->used = 0;
+    arena->last = NULL;
 }
 
-// Main command loop
-int exec_local_cmd_loop() {
-    char cmd_buff[SH_CMD_MAX];
-    command_list_t clist;
-    int rc;
+void arena_free(arena_t *arena) {
+    arena_block_t *b = arena->first;
 
-    while (1) {
-        printf("%s", SH_PROMPT);
-        
-        if (fgets(cmd_buff, ARG_MAX, stdin) == NULL) {
-            printf("\n");
-            break;
-        }
-
-        // Remove trailing newline
-        cmd_buff[strcspn(cmd_buff, "\n")] = '\0';
-
-        // Check for empty command
-        if (strlen(cmd_buff) == 0) {
-            printf(CMD_WARN_NO_CMD);
-            continue;
-        }
-
-        // Check for exit command
-        if (strcmp(cmd_buff, EXIT_CMD) == 0) {
-            printf("exiting...\n");
-            return OK;
-        }
-
-        // Initialize command list
-        memset(&clist, 0, sizeof(command_list_t));
-
-        // Parse the command line
-        rc = build_cmd_list(cmd_buff, &clist);
-
-        // Handle parsing errors
-        if (rc == WARN_NO_CMDS) {
-            printf(CMD_WARN_NO_CMD);
-            continue;
-        } else if (rc == ERR_TOO_MANY_COMMANDS) {
-            printf(CMD_ERR_PIPE_LIMIT, CMD_MAX);
-            continue;
-        } else if (rc != OK) {
-            printf("Error parsing command line\n");
-            continue;
-        }
-
-        // Execute the pipeline
-        rc = execute_pipeline(&clist);
-        
-        // Handle execution results
-        if (rc == OK_EXIT) {
-            free_cmd_list(&clist);
-            printf("exiting...\n");
-            return OK;
-        }
-
-        // Free command list resources
-        free_cmd_list(&clist);
+    while (b) {
+        arena_block_t *next = b->next;
+        free(b);
+        b = next;
     }
-
-    return OK;
+    arena->first = arena->cur = NULL;
+    arena->last = NULL;
 }
 
-#include <stdlib.h>
-#include <stdio.h>
-#include <string.h>
-#include <ctype.h>
-#include <stdbool.h>
-#include <unistd.h>
-#include <fcntl.h>
-#include <sys/wait.h>
-#include "dshlib.h"
-
-// Helper function to check if character is within quotes
-static bool is_within_quotes(const char *str, int pos) {
-    bool within_quotes = false;
-    for (int i = 0; i < pos; i++) {
-        if (str[i] == '"') within_quotes = !within_quotes;
-    }
-    return within_quotes;
+// Initialize cmd_buff structure, everything it holds comes from arena
+int alloc_cmd_buff(cmd_buff_t *cmd_buff, arena_t *arena) {
+    cmd_buff->arena = arena;
+    return clear_cmd_buff(cmd_buff);
 }
 
-// Helper function to trim whitespace
-static char* trim(char* str) {
-    while (isspace((unsigned char)*str)) str++;
-    if (*str == 0) return str;
-    char* end = str + strlen(str) - 1;
-    while (end > str && isspace((unsigned char)*end)) end--;
-    *(end + 1) = 0;
-    return str;
+// Free cmd_buff structure, the arena goes with arena_free()
+int free_cmd_buff(cmd_buff_t *cmd_buff) {
+    return clear_cmd_buff(cmd_buff);
 }
 
-// Initialize cmd_buff structure
-int alloc_cmd_buff(cmd_buff_t *cmd_buff) {
-    cmd_buff->_cmd_buffer = (char *)malloc(SH_CMD_MAX);
-    if (!cmd_buff->_cmd_buffer) return ERR_MEMORY;
+// Clear cmd_buff for reuse
+int clear_cmd_buff(cmd_buff_t *cmd_buff) {
     cmd_buff->argc = 0;
-    memset(cmd_buff->argv, 0, sizeof(char *) * CMD_ARGV_MAX);
+    cmd_buff->argv = NULL;
+    cmd_buff->_cmd_buffer = NULL;
     return OK;
 }
 
-// Free cmd_buff structure
-int free_cmd_buff(cmd_buff_t *cmd_buff) {
-    if (cmd_buff->_cmd_buffer) {
-        free(cmd_buff->_cmd_buffer);
-        cmd_buff->_cmd_buffer = NULL;
-    }
+// Stage 1 over the whole line, the masks come out of the arena
+static int scan_cmd_line(const char *line, size_t len, scan_t *sc, arena_t *arena) {
+    size_t words = SCAN_WORDS(len) ? SCAN_WORDS(len) : 1;
+    uint64_t *masks = arena_alloc(arena, 3 * words * sizeof(uint64_t));
+
+    if (!masks) return ERR_MEMORY;
+    sc->quote = masks;
+    sc->sep = masks + words;
+    sc->pipe = masks + 2 * words;
+    scan_line(line, len, sc);
     return OK;
 }
 
-// Clear cmd_buff for reuse
-int clear_cmd_buff(cmd_buff_t *cmd_buff) {
-    cmd_buff->argc = 0;
-    memset(cmd_buff->argv, 0, sizeof(char *) * CMD_ARGV_MAX);
-    return OK;
+// Stage 2: the args of bytes from to to of the scanned line into cmd_buff.
+// Each arg runs from one clear bit of sep to the next set one, and is
+// copied into the arena a piece at a time between its quotes, so a quoted
+// arg keeps its spaces and joins whatever it touches: a"b c" is the one
+// arg ab c.  The copy is never longer than the line, each space or quote
+// dropped makes room for a '\0'.
+static int parse_scanned(const char *line, size_t from, size_t to, const scan_t *sc,
+                         cmd_buff_t *cmd_buff) {
+    char *out = arena_alloc(cmd_buff->arena, to - from + 1);
+    int cap = CMD_ARGV_INIT;
+    char **argv = arena_alloc(cmd_buff->arena, cap * sizeof(char *));
+    size_t o = 0;
+    size_t start;
+
+    if (!out || !argv) return ERR_MEMORY;
+
+    while ((start = scan_next(sc->sep, from, to, false)) < to) {
+        size_t end = scan_next(sc->sep, start, to, true);
+        char *token = out + o;
+
+        for (size_t i = start; i < end;) {
+            size_t quote = scan_next(sc->quote, i, end, true);
+
+            memcpy(out + o, line + i, quote - i);
+            o += quote - i;
+            i = quote + 1;
+        }
+        out[o++] = '\0';
+
+        // Keep room for the NULL after the last one
+        if (cmd_buff->argc + 1 == cap) {
+            argv = arena_grow(cmd_buff->arena, argv, cap * sizeof(char *),
+                              2 * cap * sizeof(char *));
+            if (!argv) return ERR_MEMORY;
+            cap *= 2;
+        }
+        argv[cmd_buff->argc++] = token;
+        from = end;
+    }
+
+    argv[cmd_buff->argc] = NULL;
+    cmd_buff->argv = argv;
+    cmd_buff->_cmd_buffer = out;
+    return cmd_buff->argc > 0 ? OK : WARN_NO_CMDS;
 }
 
-// Parse command line into cmd_buff structure
+// Parse command line into cmd_buff structure, a pipe is part of an arg
 int build_cmd_buff(char *cmd_line, cmd_buff_t *cmd_buff) {
-    clear_cmd_buff(cmd_buff);
-    strncpy(cmd_buff->_cmd_buffer, cmd_line, SH_CMD_MAX - 1);
-    cmd_buff->_cmd_buffer[SH_CMD_MAX - 1] = '\0';
-
-    char *curr = cmd_buff->_cmd_buffer;
-    bool in_quotes = false;
-    bool in_token = false;
-    char *token_start = NULL;
+    size_t len = strlen(cmd_line);
+    scan_t sc;
 
-    // Skip leading spaces
-    while (*curr && isspace(*curr)) curr++;
-    if (!*curr) return WARN_NO_CMDS;
+    clear_cmd_buff(cmd_buff);
+    if (scan_cmd_line(cmd_line, len, &sc, cmd_buff->arena) != OK) return ERR_MEMORY;
+    return parse_scanned(cmd_line, 0, len, &sc, cmd_buff);
+}
 
-    token_start = curr;
-    cmd_buff->argc = 0;
+// Split command line by pipes and build command list.  A pipe inside
+// quotes is part of an arg.  The commands and everything they hold come
+// out of the list's arena, emptied here so the last line's list goes all
+// at once.  A line in the parse cache is not parsed again.
+int build_cmd_list(char *cmd_line, command_list_t *clist) {
+    size_t len = strlen(cmd_line);
+    size_t pos = 0;
+    int cap = 0;
+    scan_t sc;
 
-    while (*curr) {
-        if (*curr == '"') {
-            if (!in_token) {
-                token_start = curr + 1;
-                in_token = true;
-            } else if (in_quotes) {
-                *curr = '\0';
-                in_token = false;
-            }
-            in_quotes = !in_quotes;
-        } else if (isspace(*curr) && !in_quotes) {
-            if (in_token) {
-                *curr = '\0';
-                cmd_buff->argv[cmd_buff->argc++] = token_start;
-                in_token = false;
-            }
-        } else if (!in_token) {
-            token_start = curr;
-            in_token = true;
-        }
+    arena_reset(&clist->arena);
+    clist->num = 0;
+    clist->commands = NULL;
 
-        if (cmd_buff->argc >= CMD_ARGV_MAX - 1) {
-            return ERR_TOO_MANY_COMMANDS;
-        }
-        curr++;
-    }
+    int rc = cache_lookup(cmd_line, len, clist);
+    if (rc != WARN_NO_CMDS) return rc;
 
-    // Handle the last token if it exists
-    if (in_token) {
-        cmd_buff->argv[cmd_buff->argc++] = token_start;
-    }
+    if (scan_cmd_line(cmd_line, len, &sc, &clist->arena) != OK) return ERR_MEMORY;
 
-    // Null terminate the argv array
-    cmd_buff->argv[cmd_buff->argc] = NULL;
+    while (pos < len) {
+        size_t pipe = scan_next(sc.pipe, pos, len, true);
 
-    return OK;
-}
+        if (clist->num == cap) {
+            int new_cap = cap ? 2 * cap : CMD_LIST_INIT;
+            cmd_buff_t *commands = arena_grow(&clist->arena, clist->commands,
+                                              cap * sizeof(cmd_buff_t),
+                                              new_cap * sizeof(cmd_buff_t));
 
-// Split command line by pipes and build command list
-int build_cmd_list(char *cmd_line, command_list_t *clist) {
-    char *save_ptr;
-    char *token;
-    int count = 0;
-    char *cmd_line_copy = strdup(cmd_line);
-    
-    if (!cmd_line_copy) return ERR_MEMORY;
-    
-    // Tokenize the command by pipe symbols
-    token = strtok_r(cmd_line_copy, PIPE_STRING, &save_ptr);
-    while (token != NULL && count < CMD_MAX) {
-        // Allocate memory for the command buffer
-        if (alloc_cmd_buff(&(clist->commands[count])) != OK) {
-            free(cmd_line_copy);
-            return ERR_MEMORY;
+            if (!commands) return ERR_MEMORY;
+            clist->commands = commands;
+            cap = new_cap;
         }
-        
-        // Build command buffer for this segment
-        int rc = build_cmd_buff(token, &(clist->commands[count]));
-        if (rc != OK && rc != WARN_NO_CMDS) {
-            free(cmd_line_copy);
+
+        // Build command buffer for this segment, empty ones are skipped
+        cmd_buff_t *cmd = &clist->commands[clist->num];
+        alloc_cmd_buff(cmd, &clist->arena);
+        rc = parse_scanned(cmd_line, pos, pipe, &sc, cmd);
+        if (rc == OK) {
+            clist->num++;
+        } else if (rc != WARN_NO_CMDS) {
             return rc;
         }
-        
-        // Only count non-empty commands
-        if (rc != WARN_NO_CMDS) {
-            count++;
-        }
-        
-        token = strtok_r(NULL, PIPE_STRING, &save_ptr);
-    }
-    
-    free(cmd_line_copy);
-    
-    if (token != NULL) {
-        // More tokens remain but we've hit CMD_MAX
-        return ERR_TOO_MANY_COMMANDS;
+
+        pos = pipe + 1;
     }
-    
-    if (count == 0) {
+
+    if (clist->num == 0) {
         return WARN_NO_CMDS;
     }
-    
-    clist->num = count;
+    cache_store(cmd_line, len, clist);
     return OK;
 }
 
-// Free command list resources
+// Free command list resources, the arena keeps its blocks for the next
+// line
 int free_cmd_list(command_list_t *cmd_lst) {
-    for (int i = 0; i < cmd_lst->num; i++) {
-        free_cmd_buff(&(cmd_lst->commands[i]));
-    }
+    cmd_lst->num = 0;
+    cmd_lst->commands = NULL;
+    arena_reset(&cmd_lst->arena);
+    return OK;
+}
+
+// Give the arena's blocks back once there are no more lines
+int close_cmd_list(command_list_t *cmd_lst) {
+    free_cmd_list(cmd_lst);
+    arena_free(&cmd_lst->arena);
     return OK;
 }
 
@@ -687,6 +250,7 @@ Built_In_Cmds match_command(const char *input) {
     if (strcmp(input, EXIT_CMD) == 0) return BI_CMD_EXIT;
     if (strcmp(input, "cd") == 0) return BI_CMD_CD;
     if (strcmp(input, "dragon") == 0) return BI_CMD_DRAGON;
+    if (strcmp(input, "cache-stats") == 0) return BI_CMD_CACHE_STATS;
     return BI_NOT_BI;
 }
 
@@ -710,6 +274,14 @@ Built_In_Cmds exec_built_in_cmd(cmd_buff_t *cmd) {
         case BI_CMD_DRAGON:
             printf("[DRAGON for extra credit would print here]\n");
             return BI_EXECUTED;
+
+        case BI_CMD_CACHE_STATS: {
+            cache_stats_t stats;
+
+            cache_get_stats(&stats);
+            printf(CACHE_STATS_FMT, stats.hits, stats.misses, stats.lines, CACHE_SLOTS);
+            return BI_EXECUTED;
+        }
             
         default:
             return BI_NOT_BI;
@@ -779,7 +351,7 @@ int handle_redirection(cmd_buff_t *cmd) {
     char *filename = cmd->argv[index + 1];
     
     // Set up redirection
-    int fd;
+    int fd = -1;
     if (redirection_type == '<') {
         // Input redirection
         fd = open(filename, O_RDONLY);
@@ -855,8 +427,8 @@ int execute_pipeline(command_list_t *clist) {
     }
     
     // For multiple commands, need to set up pipes
-    int pipes[CMD_MAX - 1][2]; // Array of pipe file descriptors
-    pid_t pids[CMD_MAX];       // Array to store child process IDs
+    int pipes[clist->num - 1][2]; // Array of pipe file descriptors
+    pid_t pids[clist->num];       // Array to store child process IDs
     
     // Create pipes
     for (int i = 0; i < clist->num - 1; i++) {
@@ -970,14 +542,15 @@ int execute_pipeline(command_list_t *clist) {
 
 // Main command loop
 int exec_local_cmd_loop() {
-    char cmd_buff[SH_CMD_MAX];
-    command_list_t clist;
+    char *cmd_buff = NULL;  // grows to the longest line read
+    size_t cmd_size = 0;
+    command_list_t clist = {0};
     int rc;
 
     while (1) {
         printf("%s", SH_PROMPT);
         
-        if (fgets(cmd_buff, ARG_MAX, stdin) == NULL) {
+        if (getline(&cmd_buff, &cmd_size, stdin) == -1) {
             printf("\n");
             break;
         }
@@ -994,12 +567,9 @@ int exec_local_cmd_loop() {
         // Check for exit command
         if (strcmp(cmd_buff, EXIT_CMD) == 0) {
             printf("exiting...\n");
-            return OK;
+            break;
         }
 
-        // Initialize command list
-        memset(&clist, 0, sizeof(command_list_t));
-
         // Parse the command line
         rc = build_cmd_list(cmd_buff, &clist);
 
@@ -1007,9 +577,6 @@ int exec_local_cmd_loop() {
         if (rc == WARN_NO_CMDS) {
             printf(CMD_WARN_NO_CMD);
             continue;
-        } else if (rc == ERR_TOO_MANY_COMMANDS) {
-            printf(CMD_ERR_PIPE_LIMIT, CMD_MAX);
-            continue;
         } else if (rc != OK) {
             printf("Error parsing command line\n");
             continue;
@@ -1020,15 +587,16 @@ int exec_local_cmd_loop() {
         
         // Handle execution results
         if (rc == OK_EXIT) {
-            free_cmd_list(&clist);
             printf("exiting...\n");
-            return OK;
+            break;
         }
 
         // Free command list resources
         free_cmd_list(&clist);
     }
 
+    close_cmd_list(&clist);
+    cache_free();
+    free(cmd_buff);
     return OK;
 }
-
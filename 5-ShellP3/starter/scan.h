@@ -0,0 +1,49 @@
+#ifndef __SCAN_H__
+    #define __SCAN_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//Stage 1 of the parser, after simdjson: the line is read 64 bytes at a
+//time into bitmasks, one bit per byte, of where its quotes, spaces and
+//pipes are.  Which bytes are inside quotes is the prefix XOR of the quote
+//mask, each quote flips it, and the state carries from one 64 byte word
+//to the next.  Spaces and pipes inside quotes are then cleared, so stage 2
+//(parse_scanned() in dshlib.c) cuts args at the bits of sep and commands
+//at the bits of pipe without looking at quotes again.
+//
+//Redirections need no mask of their own, < > and >> are whole args that
+//handle_redirection() finds in argv.
+#define SCAN_SCALAR     0
+#define SCAN_SSE2       1
+#define SCAN_AVX2       2
+
+//set to scalar, sse2 or avx2 to use a lower level than the CPU supports
+#define SCAN_ENV        "DSH_SCAN"
+
+//mask words for len bytes
+#define SCAN_WORDS(len) (((len) + 63) / 64)
+
+typedef struct scan{
+    uint64_t *quote;        //every '"'
+    uint64_t *sep;          //whitespace outside quotes
+    uint64_t *pipe;         //'|' outside quotes
+} scan_t;
+
+//Fills the masks of sc, each SCAN_WORDS(len) words from the caller.  Bits
+//past len are 0.
+void scan_line(const char *line, size_t len, scan_t *sc);
+
+//The first bit at or after pos that is set (or clear when set is false),
+//end when there is none before end
+size_t scan_next(const uint64_t *mask, size_t pos, size_t end, bool set);
+
+//The level the CPU supports unless SCAN_ENV asks for a lower one.
+//scan_set_level() also never goes above what the CPU supports, and
+//returns the level it set.
+int scan_level(void);
+int scan_set_level(int level);
+const char *scan_level_name(int level);
+
+#endif
@@ -231,6 +231,108 @@ EOF
     [ "$status" -eq 0 ]
 }
 
+# Parser limits
+@test "Parser: a command with 100 args" {
+    args=$(seq -s ' ' 1 100)
+    run ./dsh <<EOF
+echo $args
+EOF
+    [ "$status" -eq 0 ]
+    echo "$output" | grep -Fxq "$args"
+}
+
+@test "Parser: a line longer than 4K" {
+    word=$(printf 'y%.0s' $(seq 1 5000))
+    run ./dsh <<EOF
+echo $word
+EOF
+    [ "$status" -eq 0 ]
+    echo "$output" | grep -Fxq "$word"
+}
+
+@test "Parser: a pipeline of more than 8 commands" {
+    run ./dsh <<EOF
+echo test | cat | cat | cat | cat | cat | cat | cat | cat | cat | cat | tr a-z A-Z
+EOF
+    [ "$status" -eq 0 ]
+    echo "$output" | grep -Fxq "TEST"
+    [[ ! "$output" =~ "piping limited to" ]]
+}
+
+# Quoting
+@test "Quotes: spaces inside quotes are kept" {
+    run ./dsh <<EOF
+echo "a   b"
+EOF
+    [ "$status" -eq 0 ]
+    echo "$output" | grep -Fxq "a   b"
+}
+
+@test "Quotes: a quoted part joins the arg around it" {
+    run ./dsh <<EOF
+echo a"b c"d "" e
+EOF
+    [ "$status" -eq 0 ]
+    echo "$output" | grep -Fxq "ab cd  e"
+}
+
+@test "Quotes: tabs separate args outside quotes" {
+    run bash -c "printf '\techo\ttab\t\"x\ty\"\n' | ./dsh"
+    [ "$status" -eq 0 ]
+    echo "$output" | grep -Fxq "$(printf 'tab x\ty')"
+}
+
+@test "Quotes: a quoted arg across a 64 byte block, at every scan level" {
+    arg="$(printf 'q%.0s' $(seq 1 60))   |  $(printf 'r%.0s' $(seq 1 20))"
+    for level in scalar sse2 avx2; do
+        run env DSH_SCAN=$level ./dsh <<EOF
+echo "$arg"
+EOF
+        [ "$status" -eq 0 ]
+        echo "$output" | grep -Fxq "$arg"
+    done
+}
+
+@test "Quotes: a pipe inside quotes is not a pipe" {
+    run ./dsh <<EOF
+echo "a | b" | tr a-z A-Z
+EOF
+    [ "$status" -eq 0 ]
+    echo "$output" | grep -Fxq "A | B"
+}
+
+# Parse cache
+@test "Cache: a repeated pipeline gives the same output from the cache" {
+    run ./dsh <<EOF
+echo "a  b" | tr a-z A-Z
+echo "a  b" | tr a-z A-Z
+cache-stats
+EOF
+    [ "$status" -eq 0 ]
+    [ "$(echo "$output" | grep -c 'A  B$')" -eq 2 ]
+    # the cache-stats line itself is the second miss
+    [[ "$output" =~ "parse cache: 1 hits, 2 misses, 2 of 64 lines" ]]
+}
+
+@test "Remote: cache-stats reports the server's parse cache" {
+    ./dsh -s -p 5680 &
+    SERVER_PID=$!
+    sleep 1
+
+    run ./dsh -c -p 5680 <<EOF
+echo "a  b" | tr a-z A-Z
+echo "a  b" | tr a-z A-Z
+cache-stats
+stop-server
+EOF
+
+    kill $SERVER_PID 2>/dev/null || true
+
+    [ "$status" -eq 0 ]
+    [ "$(echo "$output" | grep -c 'A  B$')" -eq 2 ]
+    [[ "$output" =~ "parse cache: 1 hits, 2 misses, 2 of 64 lines" ]]
+}
+
 # Clean up any test files that might be left
 teardown() {
     rm -f testfile testinput.txt testoutput.txt testappend.txt
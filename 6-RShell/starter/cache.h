@@ -0,0 +1,48 @@
+#ifndef __CACHE_H__
+    #define __CACHE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "dshlib.h"
+
+//Parse cache.  Scripts and remote clients send the same lines over and
+//over, so build_cmd_list() keeps the parse of the last CACHE_SLOTS
+//distinct lines and a line seen before skips the parser.  Entries are
+//found by a hash of the raw line, then checked byte for byte, and the
+//least recently used one goes when a new line needs the slot.
+//
+//An entry is relocatable: one malloc()ed block with the argc of each
+//command, the offset of each arg in the args text, the line and the text.
+//A hit copies the text into the list's arena and points argv back into
+//it, so the commands of a hit can be changed like any other.
+//
+//The cache is one per process, which is fine while the server takes one
+//client at a time.
+#define CACHE_SLOTS     64
+#define CACHE_LINE_MAX  4096    //longer lines are parsed every time
+
+typedef struct cache_stats{
+    unsigned long hits;
+    unsigned long misses;
+    int           lines;        //cached now
+} cache_stats_t;
+
+//OK with clist built from the cache, WARN_NO_CMDS when the line is not
+//there, ERR_MEMORY
+int cache_lookup(const char *line, size_t len, command_list_t *clist);
+
+//Keeps the parse in clist of line.  Out of memory only means it is not
+//kept.
+void cache_store(const char *line, size_t len, const command_list_t *clist);
+
+void cache_get_stats(cache_stats_t *stats);
+
+//on by default, off makes every lookup a miss and keeps nothing
+void cache_enable(bool on);
+void cache_free(void);
+
+//output of the cache-stats builtin
+#define CACHE_STATS_FMT "parse cache: %lu hits, %lu misses, %d of %d lines\n"
+
+#endif
@@ -7,164 +7,247 @@
 #include <fcntl.h>
 #include <sys/wait.h>
 #include "dshlib.h"
+#include "scan.h"
+#include "cache.h"
 
 // Forward declarations for functions used before they're defined
 int check_for_redirection(cmd_buff_t *cmd, int *redirection_type);
 int handle_redirection(cmd_buff_t *cmd);
 
-// Helper function to check if character is within quotes
-static bool is_within_quotes(const char *str, int pos) {
-    bool within_quotes = false;
-    for (int i = 0; i < pos; i++) {
-        if (str[i] == '"') within_quotes = !within_quotes;
+struct arena_block{
+    arena_block_t *next;
+    size_t         used;
+    size_t         size;
+    char           data[];
+};
+
+void *arena_alloc(arena_t *arena, size_t size) {
+    arena_block_t *b = arena->cur;
+
+    size = (size + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+    if (size == 0) size = ARENA_ALIGN;
+
+    // Move on to the next block, or add one, until something fits.  A
+    // block that was used before the last reset is empty again.
+    while (b == NULL || b->size - b->used < size) {
+        if (b != NULL && b->next != NULL) {
+            b = b->next;
+            b->used = 0;
+            continue;
+        }
+
+        size_t block_size = size > ARENA_BLOCK ? size : ARENA_BLOCK;
+        arena_block_t *nb = malloc(sizeof(arena_block_t) + block_size);
+
+        if (!nb) return NULL;
+        nb->next = NULL;
+        nb->used = 0;
+        nb->size = block_size;
+        if (b == NULL) arena->first = nb;
+        else b->next = nb;
+        b = nb;
     }
-    return within_quotes;
+
+    arena->cur = b;
+    arena->last = b->data + b->used;
+    b->used += size;
+    return arena->last;
 }
 
-// Helper function to trim whitespace
-static char* trim(char* str) {
-    while (isspace((unsigned char)*str)) str++;
-    if (*str == 0) return str;
-    char* end = str + strlen(str) - 1;
-    while (end > str && isspace((unsigned char)*end)) end--;
-    *(end + 1) = 0;
-    return str;
+// Like realloc(), in place when ptr is the latest allocation and its block
+// has the room
+void *arena_grow(arena_t *arena, void *ptr, size_t old_size, size_t size) {
+    if (ptr != NULL && ptr == arena->last) {
+        arena_block_t *b = arena->cur;
+        size_t start = (char *)ptr - b->data;
+        size_t rounded = (size + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+
+        if (b->size - start >= rounded) {
+            b->used = start + rounded;
+            return ptr;
+        }
+    }
+
+    void *p = arena_alloc(arena, size);
+    if (p && ptr) memcpy(p, ptr, old_size);
+    return p;
 }
 
-// Initialize cmd_buff structure
-int alloc_cmd_buff(cmd_buff_t *cmd_buff) {
-    cmd_buff->_cmd_buffer = (char *)malloc(SH_CMD_MAX);
-    if (!cmd_buff->_cmd_buffer) return ERR_MEMORY;
-    cmd_buff->argc = 0;
-    memset(cmd_buff->argv, 0, sizeof(char *) * CMD_ARGV_MAX);
-    return OK;
+void arena_reset(arena_t *arena) {
+    arena->cur = arena->first;
+    if (arena->cur) arena->cur->used = 0;
+    arena->last = NULL;
 }
 
-// Free cmd_buff structure
-int free_cmd_buff(cmd_buff_t *cmd_buff) {
-    if (cmd_buff->_cmd_buffer) {
-        free(cmd_buff->_cmd_buffer);
-        cmd_buff->_cmd_buffer = NULL;
+void arena_free(arena_t *arena) {
+    arena_block_t *b = arena->first;
+
+    while (b) {
+        arena_block_t *next = b->next;
+        free(b);
+        b = next;
     }
-    return OK;
+    arena->first = arena->cur = NULL;
+    arena->last = NULL;
+}
+
+// Initialize cmd_buff structure, everything it holds comes from arena
+int alloc_cmd_buff(cmd_buff_t *cmd_buff, arena_t *arena) {
+    cmd_buff->arena = arena;
+    return clear_cmd_buff(cmd_buff);
+}
+
+// Free cmd_buff structure, the arena goes with arena_free()
+int free_cmd_buff(cmd_buff_t *cmd_buff) {
+    return clear_cmd_buff(cmd_buff);
 }
 
 // Clear cmd_buff for reuse
 int clear_cmd_buff(cmd_buff_t *cmd_buff) {
     cmd_buff->argc = 0;
-    memset(cmd_buff->argv, 0, sizeof(char *) * CMD_ARGV_MAX);
+    cmd_buff->argv = NULL;
+    cmd_buff->_cmd_buffer = NULL;
+    cmd_buff->input_file = NULL;
+    cmd_buff->output_file = NULL;
+    cmd_buff->append_mode = false;
     return OK;
 }
 
-// Parse command line into cmd_buff structure
-int build_cmd_buff(char *cmd_line, cmd_buff_t *cmd_buff) {
-    clear_cmd_buff(cmd_buff);
-    strncpy(cmd_buff->_cmd_buffer, cmd_line, SH_CMD_MAX - 1);
-    cmd_buff->_cmd_buffer[SH_CMD_MAX - 1] = '\0';
-
-    char *curr = cmd_buff->_cmd_buffer;
-    bool in_quotes = false;
-    bool in_token = false;
-    char *token_start = NULL;
-
-    // Skip leading spaces
-    while (*curr && isspace(*curr)) curr++;
-    if (!*curr) return WARN_NO_CMDS;
+// Stage 1 over the whole line, the masks come out of the arena
+static int scan_cmd_line(const char *line, size_t len, scan_t *sc, arena_t *arena) {
+    size_t words = SCAN_WORDS(len) ? SCAN_WORDS(len) : 1;
+    uint64_t *masks = arena_alloc(arena, 3 * words * sizeof(uint64_t));
 
-    token_start = curr;
-    cmd_buff->argc = 0;
+    if (!masks) return ERR_MEMORY;
+    sc->quote = masks;
+    sc->sep = masks + words;
+    sc->pipe = masks + 2 * words;
+    scan_line(line, len, sc);
+    return OK;
+}
 
-    while (*curr) {
-        if (*curr == '"') {
-            if (!in_token) {
-                token_start = curr + 1;
-                in_token = true;
-            } else if (in_quotes) {
-                *curr = '\0';
-                in_token = false;
-            }
-            in_quotes = !in_quotes;
-        } else if (isspace(*curr) && !in_quotes) {
-            if (in_token) {
-                *curr = '\0';
-                cmd_buff->argv[cmd_buff->argc++] = token_start;
-                in_token = false;
-            }
-        } else if (!in_token) {
-            token_start = curr;
-            in_token = true;
+// Stage 2: the args of bytes from to to of the scanned line into cmd_buff.
+// Each arg runs from one clear bit of sep to the next set one, and is
+// copied into the arena a piece at a time between its quotes, so a quoted
+// arg keeps its spaces and joins whatever it touches: a"b c" is the one
+// arg ab c.  The copy is never longer than the line, each space or quote
+// dropped makes room for a '\0'.
+static int parse_scanned(const char *line, size_t from, size_t to, const scan_t *sc,
+                         cmd_buff_t *cmd_buff) {
+    char *out = arena_alloc(cmd_buff->arena, to - from + 1);
+    int cap = CMD_ARGV_INIT;
+    char **argv = arena_alloc(cmd_buff->arena, cap * sizeof(char *));
+    size_t o = 0;
+    size_t start;
+
+    if (!out || !argv) return ERR_MEMORY;
+
+    while ((start = scan_next(sc->sep, from, to, false)) < to) {
+        size_t end = scan_next(sc->sep, start, to, true);
+        char *token = out + o;
+
+        for (size_t i = start; i < end;) {
+            size_t quote = scan_next(sc->quote, i, end, true);
+
+            memcpy(out + o, line + i, quote - i);
+            o += quote - i;
+            i = quote + 1;
         }
-
-        if (cmd_buff->argc >= CMD_ARGV_MAX - 1) {
-            return ERR_TOO_MANY_COMMANDS;
+        out[o++] = '\0';
+
+        // Keep room for the NULL after the last one
+        if (cmd_buff->argc + 1 == cap) {
+            argv = arena_grow(cmd_buff->arena, argv, cap * sizeof(char *),
+                              2 * cap * sizeof(char *));
+            if (!argv) return ERR_MEMORY;
+            cap *= 2;
         }
-        curr++;
+        argv[cmd_buff->argc++] = token;
+        from = end;
     }
 
-    // Handle the last token if it exists
-    if (in_token) {
-        cmd_buff->argv[cmd_buff->argc++] = token_start;
-    }
+    argv[cmd_buff->argc] = NULL;
+    cmd_buff->argv = argv;
+    cmd_buff->_cmd_buffer = out;
+    return cmd_buff->argc > 0 ? OK : WARN_NO_CMDS;
+}
 
-    // Null terminate the argv array
-    cmd_buff->argv[cmd_buff->argc] = NULL;
+// Parse command line into cmd_buff structure, a pipe is part of an arg
+int build_cmd_buff(char *cmd_line, cmd_buff_t *cmd_buff) {
+    size_t len = strlen(cmd_line);
+    scan_t sc;
 
-    return OK;
+    clear_cmd_buff(cmd_buff);
+    if (scan_cmd_line(cmd_line, len, &sc, cmd_buff->arena) != OK) return ERR_MEMORY;
+    return parse_scanned(cmd_line, 0, len, &sc, cmd_buff);
 }
 
-// Split command line by pipes and build command list
+// Split command line by pipes and build command list.  A pipe inside
+// quotes is part of an arg.  The commands and everything they hold come
+// out of the list's arena, emptied here so the last line's list goes all
+// at once.  A line in the parse cache is not parsed again.
 int build_cmd_list(char *cmd_line, command_list_t *clist) {
-    char *save_ptr;
-    char *token;
-    int count = 0;
-    char *cmd_line_copy = strdup(cmd_line);
-    
-    if (!cmd_line_copy) return ERR_MEMORY;
-    
-    // Tokenize the command by pipe symbols
-    token = strtok_r(cmd_line_copy, PIPE_STRING, &save_ptr);
-    while (token != NULL && count < CMD_MAX) {
-        // Allocate memory for the command buffer
-        if (alloc_cmd_buff(&(clist->commands[count])) != OK) {
-            free(cmd_line_copy);
-            return ERR_MEMORY;
+    size_t len = strlen(cmd_line);
+    size_t pos = 0;
+    int cap = 0;
+    scan_t sc;
+
+    arena_reset(&clist->arena);
+    clist->num = 0;
+    clist->commands = NULL;
+
+    int rc = cache_lookup(cmd_line, len, clist);
+    if (rc != WARN_NO_CMDS) return rc;
+
+    if (scan_cmd_line(cmd_line, len, &sc, &clist->arena) != OK) return ERR_MEMORY;
+
+    while (pos < len) {
+        size_t pipe = scan_next(sc.pipe, pos, len, true);
+
+        if (clist->num == cap) {
+            int new_cap = cap ? 2 * cap : CMD_LIST_INIT;
+            cmd_buff_t *commands = arena_grow(&clist->arena, clist->commands,
+                                              cap * sizeof(cmd_buff_t),
+                                              new_cap * sizeof(cmd_buff_t));
+
+            if (!commands) return ERR_MEMORY;
+            clist->commands = commands;
+            cap = new_cap;
         }
-        
-        // Build command buffer for this segment
-        int rc = build_cmd_buff(token, &(clist->commands[count]));
-        if (rc != OK && rc != WARN_NO_CMDS) {
-            free(cmd_line_copy);
+
+        // Build command buffer for this segment, empty ones are skipped
+        cmd_buff_t *cmd = &clist->commands[clist->num];
+        alloc_cmd_buff(cmd, &clist->arena);
+        rc = parse_scanned(cmd_line, pos, pipe, &sc, cmd);
+        if (rc == OK) {
+            clist->num++;
+        } else if (rc != WARN_NO_CMDS) {
             return rc;
         }
-        
-        // Only count non-empty commands
-        if (rc != WARN_NO_CMDS) {
-            count++;
-        }
-        
-        token = strtok_r(NULL, PIPE_STRING, &save_ptr);
-    }
-    
-    free(cmd_line_copy);
-    
-    if (token != NULL) {
-        // More tokens remain but we've hit CMD_MAX
-        return ERR_TOO_MANY_COMMANDS;
+
+        pos = pipe + 1;
     }
-    
-    if (count == 0) {
+
+    if (clist->num == 0) {
         return WARN_NO_CMDS;
     }
-    
-    clist->num = count;
+    cache_store(cmd_line, len, clist);
     return OK;
 }
 
-// Free command list resources
+// Free command list resources, the arena keeps its blocks for the next
+// line
 int free_cmd_list(command_list_t *cmd_lst) {
-    for (int i = 0; i < cmd_lst->num; i++) {
-        free_cmd_buff(&(cmd_lst->commands[i]));
-    }
+    cmd_lst->num = 0;
+    cmd_lst->commands = NULL;
+    arena_reset(&cmd_lst->arena);
+    return OK;
+}
+
+// Give the arena's blocks back once there are no more lines
+int close_cmd_list(command_list_t *cmd_lst) {
+    free_cmd_list(cmd_lst);
+    arena_free(&cmd_lst->arena);
     return OK;
 }
 
@@ -174,6 +257,7 @@ Built_In_Cmds match_command(const char *input) {
     if (strcmp(input, EXIT_CMD) == 0) return BI_CMD_EXIT;
     if (strcmp(input, "cd") == 0) return BI_CMD_CD;
     if (strcmp(input, "dragon") == 0) return BI_CMD_DRAGON;
+    if (strcmp(input, "cache-stats") == 0) return BI_CMD_CACHE_STATS;
     if (strcmp(input, "stop-server") == 0) return BI_CMD_STOP_SVR;
     if (strcmp(input, "rc") == 0) return BI_CMD_RC;
     return BI_NOT_BI;
@@ -199,6 +283,14 @@ Built_In_Cmds exec_built_in_cmd(cmd_buff_t *cmd) {
         case BI_CMD_DRAGON:
             printf("[DRAGON for extra credit would print here]\n");
             return BI_EXECUTED;
+
+        case BI_CMD_CACHE_STATS: {
+            cache_stats_t stats;
+
+            cache_get_stats(&stats);
+            printf(CACHE_STATS_FMT, stats.hits, stats.misses, stats.lines, CACHE_SLOTS);
+            return BI_EXECUTED;
+        }
             
         case BI_CMD_STOP_SVR:
             return BI_CMD_STOP_SVR;
@@ -350,8 +442,8 @@ int execute_pipeline(command_list_t *clist) {
     }
     
     // For multiple commands, need to set up pipes
-    int pipes[CMD_MAX - 1][2]; // Array of pipe file descriptors
-    pid_t pids[CMD_MAX];       // Array to store child process IDs
+    int pipes[clist->num - 1][2]; // Array of pipe file descriptors
+    pid_t pids[clist->num];       // Array to store child process IDs
     
     // Create pipes
     for (int i = 0; i < clist->num - 1; i++) {
@@ -528,14 +620,15 @@ int execute_pipeline(command_list_t *clist) {
 
 // Main command loop
 int exec_local_cmd_loop() {
-    char cmd_buff[SH_CMD_MAX];
-    command_list_t clist;
+    char *cmd_buff = NULL;  // grows to the longest line read
+    size_t cmd_size = 0;
+    command_list_t clist = {0};
     int rc;
     
     while (1) {
         printf("%s", SH_PROMPT);
         
-        if (fgets(cmd_buff, ARG_MAX, stdin) == NULL) {
+        if (getline(&cmd_buff, &cmd_size, stdin) == -1) {
             printf("\n");
             break;
         }
@@ -552,12 +645,9 @@ int exec_local_cmd_loop() {
         // Check for exit command
         if (strcmp(cmd_buff, EXIT_CMD) == 0) {
             printf("exiting...\n");
-            return OK;
+            break;
         }
 
-        // Initialize command list
-        memset(&clist, 0, sizeof(command_list_t));
-
         // Parse the command line
         rc = build_cmd_list(cmd_buff, &clist);
 
@@ -565,9 +655,6 @@ int exec_local_cmd_loop() {
         if (rc == WARN_NO_CMDS) {
             printf(CMD_WARN_NO_CMD);
             continue;
-        } else if (rc == ERR_TOO_MANY_COMMANDS) {
-            printf(CMD_ERR_PIPE_LIMIT, CMD_MAX);
-            continue;
         } else if (rc != OK) {
             printf("Error parsing command line\n");
             continue;
@@ -578,14 +665,16 @@ int exec_local_cmd_loop() {
         
         // Handle execution results
         if (rc == OK_EXIT) {
-            free_cmd_list(&clist);
             printf("exiting...\n");
-            return OK;
+            break;
         }
 
         // Free command list resources
         free_cmd_list(&clist);
     }
 
+    close_cmd_list(&clist);
+    cache_free();
+    free(cmd_buff);
     return OK;
 }
@@ -2,11 +2,11 @@
     #define __DSHLIB_H__
 
 
+#include <stddef.h>
+
 //Constants for command structure sizes
 #define EXE_MAX 64
 #define ARG_MAX 256
-#define CMD_MAX 8
-#define CMD_ARGV_MAX (CMD_MAX + 1)
 // Longest command that can be read from the shell
 #define SH_CMD_MAX EXE_MAX + ARG_MAX
 
@@ -18,19 +18,47 @@ typedef struct command
 
 #include <stdbool.h>
 
+//Per command line arena.  The commands of a line, their argv and the copy
+//of their args come out of blocks of ARENA_BLOCK bytes, so a command costs
+//no malloc() once the first lines have grown the arena, and arena_reset()
+//drops the whole line at once.  Reset keeps the blocks for the next line.
+#define ARENA_BLOCK     4096
+#define ARENA_ALIGN     sizeof(void *)
+
+typedef struct arena_block arena_block_t;
+
+typedef struct arena{
+    arena_block_t *first;
+    arena_block_t *cur;     //the block being filled, the ones after are free
+    void          *last;    //the latest allocation, arena_grow() extends it
+} arena_t;
+
+//NULL when out of memory
+void *arena_alloc(arena_t *arena, size_t size);
+void *arena_grow(arena_t *arena, void *ptr, size_t old_size, size_t size);
+void arena_reset(arena_t *arena);
+void arena_free(arena_t *arena);
+
+//argv starts with room for this many and doubles as it fills, so does
+//the list of commands
+#define CMD_ARGV_INIT 8
+#define CMD_LIST_INIT 4
+
 typedef struct cmd_buff
 {
     int  argc;
-    char *argv[CMD_ARGV_MAX];
-    char *_cmd_buffer;
+    char **argv;            //NULL terminated, in the arena
+    char *_cmd_buffer;      //the args, '\0' terminated, in the arena
     char *input_file;  // extra credit, stores input redirection file (for `<`)
     char *output_file; // extra credit, stores output redirection file (for `>`)
     bool append_mode; // extra credit, sets append mode fomr output_file
+    arena_t *arena;
 } cmd_buff_t;
 
 typedef struct command_list{
     int num;
-    cmd_buff_t commands[CMD_MAX];
+    cmd_buff_t *commands;   //in the arena
+    arena_t arena;
 }command_list_t;
 
 //Special character #defines
@@ -54,13 +82,14 @@ typedef struct command_list{
 #define OK_EXIT                 -7
 
 //prototypes
-int alloc_cmd_buff(cmd_buff_t *cmd_buff);
+int alloc_cmd_buff(cmd_buff_t *cmd_buff, arena_t *arena);
 int free_cmd_buff(cmd_buff_t *cmd_buff);
 int clear_cmd_buff(cmd_buff_t *cmd_buff);
 int build_cmd_buff(char *cmd_line, cmd_buff_t *cmd_buff);
 int close_cmd_buff(cmd_buff_t *cmd_buff);
 int build_cmd_list(char *cmd_line, command_list_t *clist);
 int free_cmd_list(command_list_t *cmd_lst);
+int close_cmd_list(command_list_t *cmd_lst);
 int check_for_redirection(cmd_buff_t *cmd, int *redirection_type);
 int handle_redirection(cmd_buff_t *cmd);
 
@@ -69,6 +98,7 @@ typedef enum {
     BI_CMD_EXIT,
     BI_CMD_DRAGON,
     BI_CMD_CD,
+    BI_CMD_CACHE_STATS,     //hits and misses of the parse cache
     BI_CMD_RC,              //extra credit command
     BI_CMD_STOP_SVR,        //new command "stop-server"
     BI_NOT_BI,
@@ -86,7 +116,6 @@ int execute_pipeline(command_list_t *clist);
 //output constants
 #define CMD_OK_HEADER       "PARSED COMMAND LINE - TOTAL COMMANDS %d\n"
 #define CMD_WARN_NO_CMD     "warning: no commands provided\n"
-#define CMD_ERR_PIPE_LIMIT  "error: piping limited to %d commands\n"
 #define BI_NOT_IMPLEMENTED "not implemented"
 
 #endif
@@ -15,6 +15,7 @@
 
 #include "dshlib.h"
 #include "rshlib.h"
+#include "cache.h"
 
 /*
  * start_server(ifaces, port, is_threaded)
@@ -50,6 +51,7 @@ int start_server(char *ifaces, int port, int is_threaded){
     rc = process_cli_requests(svr_socket);
 
     stop_server(svr_socket);
+    cache_free();
 
     return rc;
 }
@@ -211,7 +213,7 @@ int send_message_string(int cli_socket, char *buff){
  */
 int exec_client_requests(int cli_socket) {
     int io_size;
-    command_list_t cmd_list;
+    command_list_t cmd_list = {0};
     int rc;
     int cmd_rc;
     int last_rc = 0;
@@ -231,12 +233,14 @@ int exec_client_requests(int cli_socket) {
         // Check for errors or connection closed
         if (io_size < 0) {
             perror("recv");
+            close_cmd_list(&cmd_list);
             free(io_buff);
             return ERR_RDSH_COMMUNICATION;
         }
         
         if (io_size == 0) {
             // Client closed connection
+            close_cmd_list(&cmd_list);
             free(io_buff);
             return OK;
         }
@@ -251,6 +255,7 @@ int exec_client_requests(int cli_socket) {
             printf("Client requested exit\n");
             send_message_string(cli_socket, "Goodbye!\n");
             send_message_eof(cli_socket);
+            close_cmd_list(&cmd_list);
             free(io_buff);
             return OK;
         }
@@ -260,22 +265,18 @@ int exec_client_requests(int cli_socket) {
             printf("Client requested server stop\n");
             send_message_string(cli_socket, "Server stopping...\n");
             send_message_eof(cli_socket);
+            close_cmd_list(&cmd_list);
             free(io_buff);
             return OK_EXIT;
         }
         
         // Parse the command
-        memset(&cmd_list, 0, sizeof(command_list_t));
         rc = build_cmd_list(io_buff, &cmd_list);
         
         // Handle command parsing errors
         if (rc != OK) {
             if (rc == WARN_NO_CMDS) {
                 send_message_string(cli_socket, CMD_WARN_NO_CMD);
-            } else if (rc == ERR_TOO_MANY_COMMANDS) {
-                char error_msg[100];
-                sprintf(error_msg, CMD_ERR_PIPE_LIMIT, CMD_MAX);
-                send_message_string(cli_socket, error_msg);
             } else {
                 // Other error
                 char error_msg[100];
@@ -286,6 +287,20 @@ int exec_client_requests(int cli_socket) {
             continue;
         }
         
+        // The parse cache is the server's, so its stats go to the client
+        if (match_command(cmd_list.commands[0].argv[0]) == BI_CMD_CACHE_STATS) {
+            cache_stats_t stats;
+            char stats_msg[100];
+
+            cache_get_stats(&stats);
+            snprintf(stats_msg, sizeof(stats_msg), CACHE_STATS_FMT, stats.hits,
+                     stats.misses, stats.lines, CACHE_SLOTS);
+            send_message_string(cli_socket, stats_msg);
+            send_message_eof(cli_socket);
+            free_cmd_list(&cmd_list);
+            continue;
+        }
+
         // Check for built-in commands in the first command
         if (cmd_list.num > 0) {
             bi_result = exec_built_in_cmd(&cmd_list.commands[0]);
@@ -294,14 +309,14 @@ int exec_client_requests(int cli_socket) {
                 // Client wants to exit
                 send_message_string(cli_socket, "Goodbye!\n");
                 send_message_eof(cli_socket);
-                free_cmd_list(&cmd_list);
+                close_cmd_list(&cmd_list);
                 free(io_buff);
                 return OK;
             } else if (bi_result == BI_CMD_STOP_SVR) {
                 // Client wants to stop server
                 send_message_string(cli_socket, "Server stopping...\n");
                 send_message_eof(cli_socket);
-                free_cmd_list(&cmd_list);
+                close_cmd_list(&cmd_list);
                 free(io_buff);
                 return OK_EXIT;
             } else if (bi_result == BI_EXECUTED) {
@@ -327,6 +342,7 @@ int exec_client_requests(int cli_socket) {
         free_cmd_list(&cmd_list);
     }
 
+    close_cmd_list(&cmd_list);
     free(io_buff);
     return OK;
 }